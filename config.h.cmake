@@ -11,6 +11,15 @@
 #cmakedefine HAVE_ISATTY
 #cmakedefine HAVE_STRCASECMP
 #cmakedefine HAVE_STRNCASECMP
+#cmakedefine01 HAVE_RECVMMSG
+#cmakedefine01 HAVE_SENDMMSG
+#cmakedefine01 HAVE_ACCEPT4
+#cmakedefine01 HAVE_MMAP
+#cmakedefine HAVE_POSIX_FALLOCATE
+#cmakedefine HAVE_PTSNAME_R
+#cmakedefine HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#cmakedefine HAVE_SPLICE
+#cmakedefine HAVE_SENDFILE
 #cmakedefine01 USE_FILE_STDIO
 #cmakedefine ENABLE_INTERNAL_TRACE
 #cmakedefine01 HAVE_DECL_TIOCSRS485
@@ -159,6 +159,10 @@ int gensio_control(struct gensio *io, int depth, bool get,
 #define GENSIO_CONTROL_LADDR			17
 #define GENSIO_CONTROL_LPORT			18
 #define GENSIO_CONTROL_CLOSE_OUTPUT		19
+#define GENSIO_CONTROL_RTT			20
+#define GENSIO_CONTROL_CWND			21
+#define GENSIO_CONTROL_RETRANSMITS		22
+#define GENSIO_CONTROL_RAW_FD			23
 
 const char *gensio_get_type(struct gensio *io, unsigned int depth);
 struct gensio *gensio_get_child(struct gensio *io, unsigned int depth);
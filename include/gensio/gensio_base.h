@@ -37,6 +37,12 @@ typedef int (*gensio_ll_filter_data_handler)(void *cb_data,
  */
 #define GENSIO_FILTER_CB_START_TIMER	2
 
+/*
+ * Tell gensio base to stop its timer if it is running.  A filter can
+ * use this followed by a start to move the timeout earlier.
+ */
+#define GENSIO_FILTER_CB_STOP_TIMER	3
+
 typedef int (*gensio_filter_cb)(void *cb_data, int func, void *data);
 
 
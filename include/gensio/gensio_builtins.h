@@ -148,6 +148,10 @@ int str_to_file_gensio(const char *str, const char * const args[],
 		       struct gensio_os_funcs *o,
 		       gensio_event cb, void *user_data,
 		       struct gensio **new_gensio);
+int str_to_replay_gensio(const char *str, const char * const args[],
+			 struct gensio_os_funcs *o,
+			 gensio_event cb, void *user_data,
+			 struct gensio **new_gensio);
 int str_to_msgdelim_gensio(const char *str, const char * const args[],
 			   struct gensio_os_funcs *o,
 			   gensio_event cb, void *user_data,
@@ -315,6 +319,11 @@ int echo_gensio_alloc(const char * const argv[], const char * const args[],
 		      gensio_event cb, void *user_data,
 		      struct gensio **new_gensio);
 
+int replay_gensio_alloc(const char * const argv[], const char * const args[],
+			struct gensio_os_funcs *o,
+			gensio_event cb, void *user_data,
+			struct gensio **new_gensio);
+
 /*
  * Filter gensios
  */
@@ -49,6 +49,59 @@ int gensio_os_recvfrom(struct gensio_os_funcs *o,
 		       int fd, void *buf, gensiods buflen, gensiods *rcount,
 		       int flags, struct gensio_addr **addr);
 
+/*
+ * Send or receive multiple packets with one call, where the OS
+ * supports it.  For receive, buf and len (the size of buf) must be
+ * set in each entry, len is set to the received length and addr is
+ * allocated for each received packet, the caller must free addr.
+ * For send, buf, len, and addr must be set in each entry.  The
+ * number of packets actually received or sent is returned in
+ * nr_done, this may be zero if the socket would block.
+ *
+ * On receive, segsize is set if the socket has GRO enabled and the
+ * kernel coalesced multiple packets into the buffer, they are each
+ * segsize long except the last one, which may be shorter.  Otherwise
+ * it is set to zero.  It is ignored on send.
+ */
+struct gensio_os_mmsg {
+    void *buf;
+    gensiods len;
+    struct gensio_addr *addr;
+    gensiods segsize;
+};
+
+int gensio_os_sendmto(struct gensio_os_funcs *o, int fd,
+		      struct gensio_os_mmsg *msgs, unsigned int nr_msgs,
+		      unsigned int *nr_done, int flags);
+
+int gensio_os_recvmfrom(struct gensio_os_funcs *o, int fd,
+			struct gensio_os_mmsg *msgs, unsigned int nr_msgs,
+			unsigned int *nr_done, int flags);
+
+/*
+ * Send the data in sg as multiple UDP packets of segsize bytes (the
+ * last may be shorter) with one call using UDP segmentation offload.
+ * Returns GE_NOTSUP if the OS doesn't support it.  The kernel may
+ * refuse with GE_INVAL if segsize doesn't fit the path MTU, the
+ * caller should send the packets individually then.
+ */
+int gensio_os_sendsegto(struct gensio_os_funcs *o,
+			int fd, const struct gensio_sg *sg, gensiods sglen,
+			gensiods *rcount, int flags,
+			const struct gensio_addr *raddr, gensiods segsize);
+
+/*
+ * Enable or disable receiving coalesced UDP packets (GRO) on the
+ * socket, see segsize in gensio_os_mmsg.  Returns GE_NOTSUP if the
+ * OS doesn't support it.
+ */
+int gensio_os_set_udp_gro(struct gensio_os_funcs *o, int fd, bool val);
+
+/*
+ * Accept a connection on fd.  The new socket is returned already set
+ * non-blocking and close-on-exec.  Returns GE_NODATA if there is no
+ * connection waiting.
+ */
 int gensio_os_accept(struct gensio_os_funcs *o, int fd,
 		     struct gensio_addr **addr, int *newsock);
 
@@ -154,7 +207,116 @@ int gensio_os_open_socket(struct gensio_os_funcs *o,
 			  void *data,
 			  struct opensocks **socks, unsigned int *nr_fds);
 
+/*
+ * Like gensio_os_open_socket(), but open nr_shards sockets for each
+ * address, all bound to the same port with SO_REUSEPORT so the
+ * kernel spreads incoming packets or connections across them.  Only
+ * IP addresses are supported.  The handlers for shard n's sockets
+ * get data[n], and shard n's sockets are returned in socks starting
+ * at n * nr_fds.
+ */
+int gensio_os_open_sharded_socket(struct gensio_os_funcs *o,
+				  struct gensio_addr *addr,
+				  void (*readhndlr)(int, void *),
+				  void (*writehndlr)(int, void *),
+				  void (*fd_handler_cleared)(int, void *),
+				  void **data, unsigned int nr_shards,
+				  struct opensocks **socks,
+				  unsigned int *nr_fds);
+
 /* Returns a NULL if the fd is ok, a non-NULL error string if not */
 const char *gensio_os_check_tcpd_ok(int new_fd);
 
+/*
+ * A worker thread for gensios that must do blocking work (file I/O,
+ * libwrap checks, etc.) without blocking the selector.  The worker
+ * owns the thread, a lock and condition variable for the thread and
+ * the selector side to share, a wake pipe the thread uses to get the
+ * selector to call back, and a stop pipe so a thread blocked waiting
+ * on an fd can be told to exit.
+ *
+ * func runs in the thread.  It should return when
+ * gensio_os_worker_wait() or gensio_os_worker_wait_fd() returns
+ * GE_LOCALCLOSED.  The thread only ever blocks in those two
+ * functions, that's what makes stopping it bounded.  All signals are
+ * blocked in the thread.
+ *
+ * wake is called from the selector some time after the thread calls
+ * gensio_os_worker_wake().  Wakes are coalesced and may be spurious.
+ *
+ * done is called from the selector after func has returned and the
+ * thread has been joined, whether it was stopped or returned on its
+ * own.  The worker is idle then and may be freed or restarted from
+ * done.  done is not called for a gensio_os_worker_stop_wait().
+ *
+ * Except as noted, the functions here must be called from the
+ * selector side, not from the thread.  If threads are not available,
+ * gensio_os_worker_alloc() returns GE_NOTSUP.
+ */
+struct gensio_os_worker;
+
+typedef void (*gensio_os_worker_cb)(struct gensio_os_worker *w,
+				    void *cb_data);
+
+int gensio_os_worker_alloc(struct gensio_os_funcs *o,
+			   gensio_os_worker_cb func,
+			   gensio_os_worker_cb wake,
+			   gensio_os_worker_cb done,
+			   void *cb_data,
+			   struct gensio_os_worker **rw);
+
+/* Stops the thread (like gensio_os_worker_stop_wait()) and frees. */
+void gensio_os_worker_free(struct gensio_os_worker *w);
+
+/* Start the thread.  Returns GE_INUSE if it is already running. */
+int gensio_os_worker_start(struct gensio_os_worker *w);
+
+/*
+ * Tell the thread to stop.  This does not wait, done is called when
+ * the thread is gone.  Does nothing if the thread isn't running.
+ */
+void gensio_os_worker_stop(struct gensio_os_worker *w);
+
+/*
+ * Stop the thread and wait for it to exit.  done is not called.
+ * Must not be called with the worker lock held.
+ */
+void gensio_os_worker_stop_wait(struct gensio_os_worker *w);
+
+/* Is a thread started and not yet reported done? */
+bool gensio_os_worker_running(struct gensio_os_worker *w);
+
+/* The worker lock, may be called from the thread or the selector. */
+void gensio_os_worker_lock(struct gensio_os_worker *w);
+void gensio_os_worker_unlock(struct gensio_os_worker *w);
+
+/*
+ * These must be called with the worker lock held.
+ * gensio_os_worker_stopping() returns true if the thread has been
+ * told to stop.  gensio_os_worker_kick() wakes up the thread if it is
+ * in gensio_os_worker_wait().
+ */
+bool gensio_os_worker_stopping(struct gensio_os_worker *w);
+void gensio_os_worker_kick(struct gensio_os_worker *w);
+
+/*
+ * Called from the thread.
+ *
+ * gensio_os_worker_wait() must be called with the worker lock held
+ * and waits for a kick, the timeout (relative, NULL is forever), or a
+ * stop.  It returns 0, GE_TIMEDOUT, or GE_LOCALCLOSED if stopping.
+ *
+ * gensio_os_worker_wait_fd() waits for fd to be readable (or
+ * writable if write is true) without the worker lock held.  It
+ * returns 0 if the fd is ready (or has an error or hangup, the
+ * following read or write will report it), GE_LOCALCLOSED if
+ * stopping, or an error.
+ *
+ * gensio_os_worker_wake() causes the wake callback to be called from
+ * the selector.  The worker lock may or may not be held.
+ */
+int gensio_os_worker_wait(struct gensio_os_worker *w, gensio_time *timeout);
+int gensio_os_worker_wait_fd(struct gensio_os_worker *w, int fd, bool write);
+void gensio_os_worker_wake(struct gensio_os_worker *w);
+
 #endif /* GENSIO_OSOPS_H */
@@ -65,6 +65,9 @@ struct gensio_nocbwait {
 };
 
 struct gensio_sync_io;
+static void gensio_sync_io_free(struct gensio *io);
+static bool gensio_sync_drain_enable(struct gensio *io, bool enabled);
+static void gensio_sync_drain_discard(struct gensio *io);
 
 struct gensio {
     struct gensio_os_funcs *o;
@@ -134,6 +137,8 @@ gensio_data_free(struct gensio *io)
 	io->classes = c->next;
 	io->o->free(io->o, c);
     }
+    if (io->sync_io)
+	gensio_sync_io_free(io);
     io->o->free_lock(io->lock);
     io->o->free(io->o, io);
 }
@@ -156,19 +161,21 @@ void gensio_set_cb(struct gensio *io, gensio_event cb, void *user_data)
     io->user_data = user_data;
 }
 
-int
-gensio_cb(struct gensio *io, int event, int err,
-	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+static void
+gensio_cb_start(struct gensio *io)
 {
     struct gensio_os_funcs *o = io->o;
-    int rv;
 
-    if (!io->cb)
-	return GE_NOTSUP;
     o->lock(io->lock);
     io->cb_count++;
     o->unlock(io->lock);
-    rv = io->cb(io, io->user_data, event, err, buf, buflen, auxdata);
+}
+
+static void
+gensio_cb_done(struct gensio *io)
+{
+    struct gensio_os_funcs *o = io->o;
+
     o->lock(io->lock);
     assert(io->cb_count > 0);
     io->cb_count--;
@@ -186,6 +193,19 @@ gensio_cb(struct gensio *io, int event, int err,
 	}
     }
     o->unlock(io->lock);
+}
+
+int
+gensio_cb(struct gensio *io, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    int rv;
+
+    if (!io->cb)
+	return GE_NOTSUP;
+    gensio_cb_start(io);
+    rv = io->cb(io, io->user_data, event, err, buf, buflen, auxdata);
+    gensio_cb_done(io);
 
     return rv;
 }
@@ -641,6 +661,8 @@ gensio_get_child(struct gensio *io, unsigned int depth)
 int
 gensio_close(struct gensio *io, gensio_done close_done, void *close_data)
 {
+    if (io->sync_io)
+	gensio_sync_drain_discard(io);
     return io->func(io, GENSIO_FUNC_CLOSE, NULL, close_done, 0, close_data,
 		    NULL);
 }
@@ -696,6 +718,8 @@ gensio_free(struct gensio *io)
 void
 gensio_set_read_callback_enable(struct gensio *io, bool enabled)
 {
+    if (io->sync_io && gensio_sync_drain_enable(io, enabled))
+	return;
     io->func(io, GENSIO_FUNC_SET_READ_CALLBACK, NULL, NULL, enabled, NULL,
 	     NULL);
 }
@@ -1324,6 +1348,9 @@ add_default_gensios(void *cb_data)
 #endif
     REG_GENSIO(o, "echo", str_to_echo_gensio);
     REG_GENSIO(o, "file", str_to_file_gensio);
+#if HAVE_MMAP
+    REG_GENSIO(o, "replay", str_to_replay_gensio);
+#endif
     REG_GENSIO(o, "ipmisol", str_to_ipmisol_gensio);
     REG_FILT_GENSIO(o, "msgdelim", str_to_msgdelim_gensio,
 		    msgdelim_gensio_alloc);
@@ -2488,17 +2515,218 @@ struct gensio_sync_op {
     struct gensio_link link;
 };
 
+/*
+ * Data delivered by the gensio beyond what the pending reads asked
+ * for is kept here so the next gensio_read_s() can return it without
+ * waiting.
+ */
+#define GENSIO_SYNC_RBUF_SIZE		4096
+
+/* Number of idle waiters kept around for reuse. */
+#define GENSIO_SYNC_MAX_WAITERS		4
+
 struct gensio_sync_io {
     gensio_event old_cb;
 
+    /*
+     * Cleared by gensio_clear_sync().  If rbuf is not empty then, the
+     * structure is kept and the data is delivered to the restored
+     * callback from drain_runner when the user enables read.  The
+     * gensio's own read stays disabled until rbuf is empty so the
+     * data stays in order.  drain_runner frees the structure when it
+     * has delivered everything.
+     */
+    bool active;
+    struct gensio_runner *drain_runner;
+    bool drain_enabled; /* The user's read enable while draining. */
+    bool drain_pending; /* drain_runner is scheduled. */
+
     struct gensio_list readops;
     struct gensio_list writeops;
     int err;
 
     struct gensio_lock *lock;
     struct gensio_waiter *close_waiter;
+
+    struct gensio_waiter *waiters[GENSIO_SYNC_MAX_WAITERS];
+    unsigned int num_waiters;
+
+    gensiods rbuf_pos;
+    gensiods rbuf_len;
+    unsigned char rbuf[GENSIO_SYNC_RBUF_SIZE];
 };
 
+static struct gensio_waiter *
+gensio_sync_get_waiter(struct gensio_sync_io *sync_io,
+		       struct gensio_os_funcs *o)
+{
+    if (sync_io->num_waiters > 0)
+	return sync_io->waiters[--sync_io->num_waiters];
+    return o->alloc_waiter(o);
+}
+
+/*
+ * Return a waiter to the cache.  If a wake may still be pending on
+ * the waiter it cannot be reused, so it is freed.
+ */
+static void
+gensio_sync_put_waiter(struct gensio_sync_io *sync_io,
+		       struct gensio_os_funcs *o,
+		       struct gensio_waiter *waiter, bool wake_pending)
+{
+    if (!wake_pending && sync_io->num_waiters < GENSIO_SYNC_MAX_WAITERS)
+	sync_io->waiters[sync_io->num_waiters++] = waiter;
+    else
+	o->free_waiter(waiter);
+}
+
+static void
+gensio_sync_free_waiters(struct gensio_sync_io *sync_io,
+			 struct gensio_os_funcs *o)
+{
+    while (sync_io->num_waiters > 0)
+	o->free_waiter(sync_io->waiters[--sync_io->num_waiters]);
+}
+
+/* Save what we can of buf in rbuf, returns the number of bytes saved. */
+static gensiods
+gensio_sync_save_data(struct gensio_sync_io *sync_io,
+		      const unsigned char *buf, gensiods len)
+{
+    gensiods space;
+
+    if (sync_io->rbuf_pos > 0) {
+	memmove(sync_io->rbuf, sync_io->rbuf + sync_io->rbuf_pos,
+		sync_io->rbuf_len);
+	sync_io->rbuf_pos = 0;
+    }
+    space = sizeof(sync_io->rbuf) - sync_io->rbuf_len;
+    if (len > space)
+	len = space;
+    memcpy(sync_io->rbuf + sync_io->rbuf_len, buf, len);
+    sync_io->rbuf_len += len;
+
+    return len;
+}
+
+static void
+gensio_sync_io_free(struct gensio *io)
+{
+    struct gensio_os_funcs *o = io->o;
+    struct gensio_sync_io *sync_io = io->sync_io;
+
+    gensio_sync_free_waiters(sync_io, o);
+    o->free_runner(sync_io->drain_runner);
+    o->free_waiter(sync_io->close_waiter);
+    o->free_lock(sync_io->lock);
+    o->free(o, sync_io);
+    io->sync_io = NULL;
+}
+
+/*
+ * Deliver data left in rbuf by gensio_clear_sync() to the user's
+ * callback.  A reference is held on the gensio while this is
+ * scheduled.
+ */
+static void
+gensio_sync_drain(struct gensio_runner *runner, void *cb_data)
+{
+    struct gensio *io = cb_data;
+    struct gensio_os_funcs *o = io->o;
+    struct gensio_sync_io *sync_io = io->sync_io;
+    gensiods len;
+    bool done = false;
+
+    o->lock(sync_io->lock);
+    while (!sync_io->active && sync_io->drain_enabled &&
+	   sync_io->rbuf_len > 0 && io->cb) {
+	len = sync_io->rbuf_len;
+	/*
+	 * Count the callback before dropping the lock, so
+	 * gensio_set_sync() either sees it or we see active.
+	 */
+	gensio_cb_start(io);
+	o->unlock(sync_io->lock);
+	io->cb(io, io->user_data, GENSIO_EVENT_READ, 0,
+	       sync_io->rbuf + sync_io->rbuf_pos, &len, NULL);
+	gensio_cb_done(io);
+	o->lock(sync_io->lock);
+	if (len == 0)
+	    /* Nothing taken, wait for the user to enable read again. */
+	    break;
+	if (len > sync_io->rbuf_len)
+	    len = sync_io->rbuf_len;
+	sync_io->rbuf_pos += len;
+	sync_io->rbuf_len -= len;
+    }
+    if (!sync_io->active && sync_io->rbuf_len == 0) {
+	/* All delivered, hand read back to the gensio. */
+	sync_io->rbuf_pos = 0;
+	if (sync_io->drain_enabled)
+	    io->func(io, GENSIO_FUNC_SET_READ_CALLBACK, NULL, NULL, true,
+		     NULL, NULL);
+	done = true;
+    }
+    sync_io->drain_pending = false;
+    o->unlock(sync_io->lock);
+
+    /* Nothing is left from sync mode, this is a normal gensio again. */
+    if (done)
+	gensio_sync_io_free(io);
+
+    gensio_free(io);
+}
+
+/*
+ * Called for a read enable with sync_io set.  Returns true if the
+ * enable was handled here because sync mode was cleared with data
+ * still to deliver.  In sync mode this is called with sync_io->lock
+ * held, so active is checked first without the lock; only the user
+ * changes it.
+ */
+static bool
+gensio_sync_drain_enable(struct gensio *io, bool enabled)
+{
+    struct gensio_os_funcs *o = io->o;
+    struct gensio_sync_io *sync_io = io->sync_io;
+
+    if (sync_io->active)
+	return false;
+
+    o->lock(sync_io->lock);
+    if (sync_io->rbuf_len == 0) {
+	/* Done already, but keep it ordered with the runner. */
+	io->func(io, GENSIO_FUNC_SET_READ_CALLBACK, NULL, NULL, enabled,
+		 NULL, NULL);
+	goto out_unlock;
+    }
+    sync_io->drain_enabled = enabled;
+    if (enabled && !sync_io->drain_pending) {
+	sync_io->drain_pending = true;
+	gensio_ref(io);
+	o->run(sync_io->drain_runner);
+    }
+ out_unlock:
+    o->unlock(sync_io->lock);
+    return true;
+}
+
+/* The gensio is closing, nothing more will be delivered. */
+static void
+gensio_sync_drain_discard(struct gensio *io)
+{
+    struct gensio_os_funcs *o = io->o;
+    struct gensio_sync_io *sync_io = io->sync_io;
+
+    o->lock(sync_io->lock);
+    if (!sync_io->active) {
+	sync_io->rbuf_pos = 0;
+	sync_io->rbuf_len = 0;
+	sync_io->drain_enabled = false;
+    }
+    o->unlock(sync_io->lock);
+}
+
 static void
 gensio_sync_flush_waiters(struct gensio_sync_io *sync_io,
 			  struct gensio_os_funcs *o)
@@ -2547,13 +2775,8 @@ gensio_syncio_event(struct gensio *io, void *user_data,
 	    gensio_sync_flush_waiters(sync_io, o);
 	    goto read_unlock;
 	}
-	if (gensio_list_empty(&sync_io->readops)) {
-	    *buflen = 0;
-	    gensio_set_read_callback_enable(io, false);
-	    goto read_unlock;
-	}
 	done_len = *buflen;
-	while (*buflen && !gensio_list_empty(&sync_io->readops)) {
+	while (done_len && !gensio_list_empty(&sync_io->readops)) {
 	    struct gensio_link *l = gensio_list_first(&sync_io->readops);
 	    struct gensio_sync_op *op = gensio_container_of(l,
 							struct gensio_sync_op,
@@ -2563,14 +2786,17 @@ gensio_syncio_event(struct gensio *io, void *user_data,
 	    if (len > op->len)
 		len = op->len;
 	    memcpy(op->buf, buf, len);
+	    buf += len;
 	    op->len = len;
 	    gensio_list_rm(&sync_io->readops, l);
 	    op->queued = false;
 	    o->wake(op->waiter);
 	    done_len -= len;
 	}
-	*buflen -= done_len;
 	if (done_len > 0)
+	    done_len -= gensio_sync_save_data(sync_io, buf, done_len);
+	*buflen -= done_len;
+	if (gensio_list_empty(&sync_io->readops))
 	    gensio_set_read_callback_enable(io, false);
     read_unlock:
 	o->unlock(sync_io->lock);
@@ -2624,8 +2850,20 @@ int
 gensio_set_sync(struct gensio *io)
 {
     struct gensio_os_funcs *o = io->o;
-    struct gensio_sync_io *sync_io = o->zalloc(o, sizeof(*sync_io));
+    struct gensio_sync_io *sync_io = io->sync_io;
 
+    if (sync_io) {
+	if (sync_io->active)
+	    return GE_INUSE;
+	/*
+	 * Left from a previous gensio_clear_sync(), any data not
+	 * delivered yet goes to gensio_read_s().
+	 */
+	sync_io->err = 0;
+	goto out_set;
+    }
+
+    sync_io = o->zalloc(o, sizeof(*sync_io));
     if (!sync_io)
 	return GE_NOMEM;
 
@@ -2642,9 +2880,24 @@ gensio_set_sync(struct gensio *io)
 	return GE_NOMEM;
     }
 
+    sync_io->drain_runner = o->alloc_runner(o, gensio_sync_drain, io);
+    if (!sync_io->drain_runner) {
+	o->free_waiter(sync_io->close_waiter);
+	o->free_lock(sync_io->lock);
+	o->free(o, sync_io);
+	return GE_NOMEM;
+    }
+
     gensio_list_init(&sync_io->readops);
     gensio_list_init(&sync_io->writeops);
 
+ out_set:
+    /* This stops any delivery of data left from the last sync mode. */
+    o->lock(sync_io->lock);
+    sync_io->active = true;
+    sync_io->drain_enabled = false;
+    o->unlock(sync_io->lock);
+
     gensio_set_read_callback_enable(io, false);
     gensio_set_write_callback_enable(io, false);
     gensio_wait_no_cb(io, sync_io->close_waiter, NULL);
@@ -2661,7 +2914,7 @@ gensio_clear_sync(struct gensio *io)
     struct gensio_os_funcs *o = io->o;
     struct gensio_sync_io *sync_io = io->sync_io;
 
-    if (!sync_io)
+    if (!sync_io || !sync_io->active)
 	return GE_NOTREADY;
 
     gensio_set_read_callback_enable(io, false);
@@ -2669,11 +2922,13 @@ gensio_clear_sync(struct gensio *io)
     gensio_wait_no_cb(io, sync_io->close_waiter, NULL);
 
     io->cb = sync_io->old_cb;
+    o->lock(sync_io->lock);
+    sync_io->active = false;
+    o->unlock(sync_io->lock);
 
-    o->free_waiter(sync_io->close_waiter);
-    o->free_lock(sync_io->lock);
-    o->free(o, sync_io);
-    io->sync_io = NULL;
+    gensio_sync_free_waiters(sync_io, o);
+    if (sync_io->rbuf_len == 0)
+	gensio_sync_io_free(io);
 
     return 0;
 }
@@ -2685,9 +2940,9 @@ i_gensio_read_s(struct gensio *io, gensiods *count, void *data, gensiods datalen
     struct gensio_os_funcs *o = io->o;
     struct gensio_sync_io *sync_io = io->sync_io;
     struct gensio_sync_op op;
-    int rv = 0;
+    int rv = 0, waitrv;
 
-    if (!sync_io)
+    if (!sync_io || !sync_io->active)
 	return GE_NOTREADY;
 
     if (datalen == 0) {
@@ -2696,16 +2951,33 @@ i_gensio_read_s(struct gensio *io, gensiods *count, void *data, gensiods datalen
 	return 0;
     }
 
+    o->lock(sync_io->lock);
+    if (sync_io->rbuf_len > 0) {
+	/* Data is already here, no need to wait. */
+	if (datalen > sync_io->rbuf_len)
+	    datalen = sync_io->rbuf_len;
+	memcpy(data, sync_io->rbuf + sync_io->rbuf_pos, datalen);
+	sync_io->rbuf_pos += datalen;
+	sync_io->rbuf_len -= datalen;
+	if (sync_io->rbuf_len == 0)
+	    sync_io->rbuf_pos = 0;
+	o->unlock(sync_io->lock);
+	if (count)
+	    *count = datalen;
+	return 0;
+    }
+    if (sync_io->err) {
+	rv = sync_io->err;
+	goto out_unlock;
+    }
+
     op.queued = true;
     op.buf = data;
     op.len = datalen;
     op.err = 0;
-    op.waiter = o->alloc_waiter(o);
-    if (!op.waiter)
-	return GE_NOMEM;
-    o->lock(sync_io->lock);
-    if (sync_io->err) {
-	rv = sync_io->err;
+    op.waiter = gensio_sync_get_waiter(sync_io, o);
+    if (!op.waiter) {
+	rv = GE_NOMEM;
 	goto out_unlock;
     }
     gensio_set_read_callback_enable(io, true);
@@ -2714,7 +2986,7 @@ i_gensio_read_s(struct gensio *io, gensiods *count, void *data, gensiods datalen
 
     o->unlock(sync_io->lock);
  retry:
-    rv = o->wait_intr(op.waiter, 1, timeout);
+    rv = waitrv = o->wait_intr(op.waiter, 1, timeout);
     if (!return_on_intr && rv == GE_INTERRUPTED)
 	goto retry;
     if (rv == GE_TIMEDOUT)
@@ -2729,11 +3001,11 @@ i_gensio_read_s(struct gensio *io, gensiods *count, void *data, gensiods datalen
     } else if (count) {
 	*count = op.len;
     }
+    gensio_sync_put_waiter(sync_io, o, op.waiter, waitrv && !op.queued);
     if (gensio_list_empty(&sync_io->readops))
 	gensio_set_read_callback_enable(io, false);
  out_unlock:
     o->unlock(sync_io->lock);
-    o->free_waiter(op.waiter);
 
     return rv;
 }
@@ -2760,10 +3032,10 @@ i_gensio_write_s(struct gensio *io, gensiods *count,
     struct gensio_os_funcs *o = io->o;
     struct gensio_sync_io *sync_io = io->sync_io;
     struct gensio_sync_op op;
-    int rv = 0;
-    gensiods origlen;
+    int rv = 0, waitrv;
+    gensiods origlen, len = 0;
 
-    if (!sync_io)
+    if (!sync_io || !sync_io->active)
 	return GE_NOTREADY;
 
     if (datalen == 0) {
@@ -2773,25 +3045,50 @@ i_gensio_write_s(struct gensio *io, gensiods *count,
     }
 
     origlen = datalen;
-    op.queued = true;
-    op.buf = (void *) data;
-    op.len = datalen;
-    op.err = 0;
-    op.waiter = o->alloc_waiter(o);
-    if (!op.waiter)
-	return GE_NOMEM;
     o->lock(sync_io->lock);
     if (sync_io->err) {
 	rv = sync_io->err;
 	goto out_unlock;
     }
+    /*
+     * With nothing ahead of us, try to write it directly.  Not if a
+     * reader is waiting, though.  The write may have queued a runner
+     * (echo and filters do that), and a runner queued from outside
+     * the selector doesn't wake the threads waiting in it, so the
+     * reader would not see the data until its wait times out.  Going
+     * through the write callback runs the selector in this thread.
+     */
+    if (gensio_list_empty(&sync_io->writeops) &&
+		gensio_list_empty(&sync_io->readops)) {
+	rv = gensio_write(io, &len, data, datalen, NULL);
+	if (rv) {
+	    sync_io->err = rv;
+	    gensio_sync_flush_waiters(sync_io, o);
+	    goto out_unlock;
+	}
+	if (len == datalen) {
+	    if (count)
+		*count = len;
+	    goto out_unlock;
+	}
+    }
+
+    op.queued = true;
+    op.buf = ((unsigned char *) data) + len;
+    op.len = datalen - len;
+    op.err = 0;
+    op.waiter = gensio_sync_get_waiter(sync_io, o);
+    if (!op.waiter) {
+	rv = GE_NOMEM;
+	goto out_unlock;
+    }
     gensio_set_write_callback_enable(io, true);
     memset(&op.link, 0, sizeof(op.link));
     gensio_list_add_tail(&sync_io->writeops, &op.link);
 
     o->unlock(sync_io->lock);
  retry:
-    rv = o->wait_intr(op.waiter, 1, timeout);
+    rv = waitrv = o->wait_intr(op.waiter, 1, timeout);
     if (!return_on_intr && rv == GE_INTERRUPTED)
 	goto retry;
     if (rv == GE_TIMEDOUT)
@@ -2803,11 +3100,11 @@ i_gensio_write_s(struct gensio *io, gensiods *count,
 	rv = op.err;
     else if (count)
 	*count = origlen - op.len;
+    gensio_sync_put_waiter(sync_io, o, op.waiter, waitrv && !op.queued);
     if (gensio_list_empty(&sync_io->writeops))
 	gensio_set_write_callback_enable(io, false);
  out_unlock:
     o->unlock(sync_io->lock);
-    o->free_waiter(op.waiter);
 
     return rv;
 }
@@ -1245,6 +1245,9 @@ gensio_base_func(struct gensio *io, int func, gensiods *count,
 
     case GENSIO_FUNC_CONTROL:
 	rv = GE_NOTSUP;
+	if (ndata->filter && buflen == GENSIO_CONTROL_RAW_FD)
+	    /* The filter changes the data, the fd is not raw. */
+	    return GE_NOTSUP;
 	if (ndata->filter) {
 	    rv = gensio_filter_control(ndata->filter, *((bool *) cbuf), buflen,
 				       buf, count);
@@ -1441,6 +1444,20 @@ basen_start_timer_op(void *cb_data, gensio_time *timeout)
     }
 }
 
+static void
+basen_stop_timer_op(void *cb_data)
+{
+    struct basen_data *ndata = cb_data;
+
+    if (ndata->state == BASEN_OPEN) {
+	/* If the timer was stopped, it's ref goes away. */
+	if (ndata->o->stop_timer(ndata->timer) == 0)
+	    basen_deref(ndata);
+    } else {
+	ndata->timer_start_pending = false;
+    }
+}
+
 static int
 gensio_base_filter_cb(void *cb_data, int op, void *data)
 {
@@ -1453,6 +1470,10 @@ gensio_base_filter_cb(void *cb_data, int op, void *data)
 	basen_start_timer_op(cb_data, data);
 	return 0;
 
+    case GENSIO_FILTER_CB_STOP_TIMER:
+	basen_stop_timer_op(cb_data);
+	return 0;
+
     default:
 	return GE_NOTSUP;
     }
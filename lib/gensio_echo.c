@@ -192,8 +192,8 @@ echon_deferred_op(struct gensio_runner *runner, void *cb_data)
 	    if (count >= ndata->data_pending_len) {
 		ndata->data_pending_len = 0;
 	    } else {
-		memcpy(ndata->read_data, ndata->read_data + count,
-		       ndata->data_pending_len - count);
+		memmove(ndata->read_data, ndata->read_data + count,
+		        ndata->data_pending_len - count);
 		ndata->data_pending_len -= count;
 	    }
 	}
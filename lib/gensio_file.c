@@ -9,6 +9,7 @@
 
 #include "config.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <gensio/gensio.h>
@@ -24,6 +25,40 @@
 #include <fcntl.h>
 #endif
 
+/*
+ * Read-ahead uses a worker thread to do the reads into a ring of
+ * buffers, so the selector thread never blocks on the file.
+ */
+#if !USE_FILE_STDIO && defined(USE_PTHREADS)
+#include <gensio/gensio_osops.h>
+#define FILE_READAHEAD 1
+#define filen_ra_running(ndata) ((ndata)->ra_running)
+#else
+#define FILE_READAHEAD 0
+#define filen_ra_running(ndata) false
+#endif
+
+/*
+ * The mmap option maps a regular input file in windows of this size
+ * and delivers the data straight from the mapping.  This must be a
+ * multiple of the page size.
+ */
+#if !USE_FILE_STDIO && HAVE_MMAP
+#include <sys/mman.h>
+#define FILE_MMAP 1
+#define FILEN_MMAP_WINDOW (4 * 1024 * 1024)
+#define filen_mmap_active(ndata) ((ndata)->mmap_active)
+#else
+#define FILE_MMAP 0
+#define filen_mmap_active(ndata) false
+#endif
+
+/*
+ * Maximum number of read or write ready callbacks done in one run of
+ * the deferred op, so a fast consumer doesn't hog the selector.
+ */
+#define FILEN_MAX_CALLBACKS_PER_OP 16
+
 enum filen_state {
     FILEN_CLOSED,
     FILEN_IN_OPEN,
@@ -44,8 +79,49 @@ struct filen_data {
     gensiods max_read_size;
     unsigned char *read_data;
     gensiods data_pending_len;
+    gensiods data_pos;
     int read_err;
 
+#if FILE_READAHEAD
+    /*
+     * If ra_nbufs is non-zero, the ra_worker thread reads into a ring
+     * of ra_nbufs buffers of max_read_size in ra_data.  ra_len is the
+     * amount of data in each buffer.  The thread fills at ra_tail, the
+     * deferred op delivers from ra_head/ra_pos.  ra_err is set at end
+     * of file or on an error.  The thread wakes the selector to
+     * deliver the data, it never takes the main lock.  The ring is
+     * protected by the worker lock, ra_pos and ra_running by the main
+     * lock.  ra_running is set while the thread holds a reference and
+     * the input file, it is cleared when the worker reports done.
+     */
+    unsigned int ra_nbufs;
+    unsigned char *ra_data;
+    gensiods *ra_len;
+    unsigned int ra_head;
+    unsigned int ra_tail;
+    unsigned int ra_filled;
+    gensiods ra_pos;
+    int ra_err;
+    bool ra_running;
+    struct gensio_os_worker *ra_worker;
+#endif
+
+#if FILE_MMAP
+    /*
+     * If mmap_active is set, the input file is being delivered from
+     * map, which holds map_len bytes of the file at map_off.  map_pos
+     * is the amount of the window already delivered.  map_size is
+     * the size of the file when the window was last moved.
+     */
+    bool use_mmap;
+    bool mmap_active;
+    unsigned char *map;
+    gensiods map_len;
+    gensiods map_pos;
+    off_t map_off;
+    off_t map_size;
+#endif
+
     char *infile;
     char *outfile;
     bool create;
@@ -77,6 +153,7 @@ struct filen_data {
 };
 
 static void filen_start_deferred_op(struct filen_data *ndata);
+static void filen_ref(struct filen_data *ndata);
 
 #if USE_FILE_STDIO
 #define f_ready(f) ((f) != NULL)
@@ -146,6 +223,7 @@ f_open(struct gensio_os_funcs *o,
     return 0;
 }
 #define f_close(f) fclose(f)
+#define f_advise_sequential(f) do { } while (0)
 #else
 #define F_O_RDONLY O_RDONLY
 #define F_O_WRONLY O_WRONLY
@@ -204,6 +282,248 @@ f_open(struct gensio_os_funcs *o,
 }
 
 #define f_close(f) close(f)
+#ifdef POSIX_FADV_SEQUENTIAL
+#define f_advise_sequential(f) posix_fadvise(f, 0, 0, POSIX_FADV_SEQUENTIAL)
+#else
+#define f_advise_sequential(f) do { } while (0)
+#endif
+#endif
+
+static void
+filen_lock(struct filen_data *ndata)
+{
+    ndata->o->lock(ndata->lock);
+}
+
+static void
+filen_unlock(struct filen_data *ndata)
+{
+    ndata->o->unlock(ndata->lock);
+}
+
+#if FILE_READAHEAD
+static void
+filen_ra_thread(struct gensio_os_worker *w, void *cb_data)
+{
+    struct filen_data *ndata = cb_data;
+    unsigned int tail;
+    gensiods count = 0;
+    int err = 0;
+
+    gensio_os_worker_lock(w);
+    for (;;) {
+	while (!err && ndata->ra_filled == ndata->ra_nbufs)
+	    err = gensio_os_worker_wait(w, NULL);
+	if (err)
+	    break;
+	tail = ndata->ra_tail;
+	gensio_os_worker_unlock(w);
+
+	/*
+	 * Only block in the poll, a read after it won't wait long, and
+	 * the poll can be stopped.
+	 */
+	err = gensio_os_worker_wait_fd(w, ndata->inf, false);
+	if (!err)
+	    err = f_read(ndata->o, ndata->inf,
+			 ndata->ra_data + tail * ndata->max_read_size,
+			 ndata->max_read_size, &count);
+
+	gensio_os_worker_lock(w);
+	if (err == GE_LOCALCLOSED)
+	    break;
+	if (err) {
+	    ndata->ra_err = err;
+	} else {
+	    ndata->ra_len[tail] = count;
+	    ndata->ra_tail = (tail + 1) % ndata->ra_nbufs;
+	    ndata->ra_filled++;
+	}
+	/* If the ring was empty the deferred op may be waiting on us. */
+	if (err || ndata->ra_filled == 1)
+	    gensio_os_worker_wake(w);
+    }
+    gensio_os_worker_unlock(w);
+}
+
+/* Must be called with the lock held. */
+static int
+filen_ra_start(struct filen_data *ndata)
+{
+    int rv;
+
+    ndata->ra_head = 0;
+    ndata->ra_tail = 0;
+    ndata->ra_filled = 0;
+    ndata->ra_pos = 0;
+    ndata->ra_err = 0;
+    rv = gensio_os_worker_start(ndata->ra_worker);
+    if (rv)
+	return rv;
+    ndata->ra_running = true;
+    filen_ref(ndata);
+    return 0;
+}
+
+/* Deliver data from the read-ahead ring, called with the lock held. */
+static void
+filen_ra_deliver(struct filen_data *ndata)
+{
+    unsigned int callbacks = 0;
+    unsigned char *buf;
+    gensiods count;
+    int err;
+
+    while (ndata->state == FILEN_OPEN && ndata->read_enabled) {
+	buf = NULL;
+	count = 0;
+	err = 0;
+	gensio_os_worker_lock(ndata->ra_worker);
+	if (ndata->ra_filled) {
+	    buf = ndata->ra_data + ndata->ra_head * ndata->max_read_size;
+	    buf += ndata->ra_pos;
+	    count = ndata->ra_len[ndata->ra_head] - ndata->ra_pos;
+	} else {
+	    err = ndata->ra_err;
+	}
+	gensio_os_worker_unlock(ndata->ra_worker);
+
+	if (!buf && !err)
+	    break; /* The thread will run us again when it has data. */
+
+	if (callbacks++ >= FILEN_MAX_CALLBACKS_PER_OP) {
+	    /* Let other things on the selector run. */
+	    filen_start_deferred_op(ndata);
+	    break;
+	}
+
+	if (err)
+	    ndata->read_enabled = false;
+	filen_unlock(ndata);
+	gensio_cb(ndata->io, GENSIO_EVENT_READ, err, buf, &count, NULL);
+	filen_lock(ndata);
+	if (err || count == 0)
+	    continue;
+
+	ndata->ra_pos += count;
+	gensio_os_worker_lock(ndata->ra_worker);
+	if (ndata->ra_pos >= ndata->ra_len[ndata->ra_head]) {
+	    /* Done with this buffer, give it back to the thread. */
+	    ndata->ra_pos = 0;
+	    ndata->ra_head = (ndata->ra_head + 1) % ndata->ra_nbufs;
+	    ndata->ra_filled--;
+	    gensio_os_worker_kick(ndata->ra_worker);
+	}
+	gensio_os_worker_unlock(ndata->ra_worker);
+    }
+}
+#endif
+
+#if FILE_MMAP
+/* Use the mapping if the input is a regular file. */
+static void
+filen_mmap_start(struct filen_data *ndata)
+{
+    struct stat st;
+
+    ndata->mmap_active = false;
+    if (fstat(ndata->inf, &st) == -1 || !S_ISREG(st.st_mode))
+	return;
+    ndata->map = NULL;
+    ndata->map_len = 0;
+    ndata->map_pos = 0;
+    ndata->map_off = 0;
+    ndata->map_size = st.st_size;
+    ndata->mmap_active = true;
+}
+
+static void
+filen_mmap_stop(struct filen_data *ndata)
+{
+    if (ndata->map) {
+	munmap(ndata->map, ndata->map_len);
+	ndata->map = NULL;
+    }
+    ndata->mmap_active = false;
+}
+
+/*
+ * Move the window to the next part of the file.  The size is checked
+ * again each time so a file that has grown is read to its new end,
+ * and the window is never mapped past the current end of the file.
+ * This can't protect against the file shrinking while a window is
+ * mapped, that is documented as not allowed.
+ */
+static int
+filen_mmap_slide(struct filen_data *ndata)
+{
+    struct stat st;
+    gensiods len;
+    void *map;
+
+    if (ndata->map) {
+	munmap(ndata->map, ndata->map_len);
+	ndata->map = NULL;
+	ndata->map_off += ndata->map_len;
+	ndata->map_len = 0;
+	ndata->map_pos = 0;
+    }
+    if (fstat(ndata->inf, &st) == -1)
+	return gensio_os_err_to_err(ndata->o, errno);
+    ndata->map_size = st.st_size;
+    if (ndata->map_off >= ndata->map_size)
+	return GE_REMCLOSE;
+
+    len = FILEN_MMAP_WINDOW;
+    if (len > ndata->map_size - ndata->map_off)
+	len = ndata->map_size - ndata->map_off;
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, ndata->inf, ndata->map_off);
+    if (map == MAP_FAILED)
+	return gensio_os_err_to_err(ndata->o, errno);
+#ifdef MADV_SEQUENTIAL
+    madvise(map, len, MADV_SEQUENTIAL);
+#endif
+    ndata->map = map;
+    ndata->map_len = len;
+    return 0;
+}
+
+/* Deliver data from the mapping, called with the lock held. */
+static void
+filen_mmap_deliver(struct filen_data *ndata)
+{
+    unsigned int callbacks = 0;
+    gensiods count;
+    int err;
+
+    while (ndata->state == FILEN_OPEN && ndata->read_enabled) {
+	if (callbacks++ >= FILEN_MAX_CALLBACKS_PER_OP) {
+	    /* Let other things on the selector run. */
+	    filen_start_deferred_op(ndata);
+	    break;
+	}
+
+	count = 0;
+	err = 0;
+	if (ndata->map_pos >= ndata->map_len)
+	    err = filen_mmap_slide(ndata);
+	if (err) {
+	    ndata->read_enabled = false;
+	    filen_unlock(ndata);
+	    gensio_cb(ndata->io, GENSIO_EVENT_READ, err, NULL, &count, NULL);
+	    filen_lock(ndata);
+	    continue;
+	}
+
+	count = ndata->map_len - ndata->map_pos;
+	filen_unlock(ndata);
+	gensio_cb(ndata->io, GENSIO_EVENT_READ, 0,
+		  ndata->map + ndata->map_pos, &count, NULL);
+	filen_lock(ndata);
+	if (ndata->map)
+	    ndata->map_pos += count;
+    }
+}
 #endif
 
 static void
@@ -211,6 +531,18 @@ filen_finish_free(struct filen_data *ndata)
 {
     struct gensio_os_funcs *o = ndata->o;
 
+#if FILE_MMAP
+    filen_mmap_stop(ndata);
+#endif
+#if FILE_READAHEAD
+    /* The thread holds a reference, so it is not running here. */
+    if (ndata->ra_worker)
+	gensio_os_worker_free(ndata->ra_worker);
+    if (ndata->ra_data)
+	o->free(o, ndata->ra_data);
+    if (ndata->ra_len)
+	o->free(o, ndata->ra_len);
+#endif
     if (ndata->infile)
 	o->free(ndata->o, ndata->infile);
     if (ndata->outfile)
@@ -226,18 +558,6 @@ filen_finish_free(struct filen_data *ndata)
     o->free(o, ndata);
 }
 
-static void
-filen_lock(struct filen_data *ndata)
-{
-    ndata->o->lock(ndata->lock);
-}
-
-static void
-filen_unlock(struct filen_data *ndata)
-{
-    ndata->o->unlock(ndata->lock);
-}
-
 static void
 filen_ref(struct filen_data *ndata)
 {
@@ -312,6 +632,7 @@ static void
 filen_deferred_op(struct gensio_runner *runner, void *cb_data)
 {
     struct filen_data *ndata = cb_data;
+    unsigned int callbacks = 0;
 
     filen_lock(ndata);
     ndata->deferred_op_pending = false;
@@ -332,10 +653,26 @@ filen_deferred_op(struct gensio_runner *runner, void *cb_data)
 	}
     }
 
+#if FILE_MMAP
+    if (ndata->mmap_active)
+	filen_mmap_deliver(ndata);
+    else
+#endif
+#if FILE_READAHEAD
+    if (ndata->ra_nbufs)
+	filen_ra_deliver(ndata);
+    else
+#endif
     while (ndata->state == FILEN_OPEN &&
 	   (f_ready(ndata->inf) || ndata->read_err) && ndata->read_enabled) {
 	gensiods count;
 
+	if (callbacks++ >= FILEN_MAX_CALLBACKS_PER_OP) {
+	    /* Let other things on the selector run. */
+	    filen_start_deferred_op(ndata);
+	    break;
+	}
+
 	if (ndata->data_pending_len == 0 && !ndata->read_err) {
 	    int rv = f_read(ndata->o, ndata->inf, ndata->read_data,
 			    ndata->max_read_size, &count);
@@ -345,33 +682,42 @@ filen_deferred_op(struct gensio_runner *runner, void *cb_data)
 		ndata->read_err = rv;
 	    } else {
 		ndata->data_pending_len = count;
+		ndata->data_pos = 0;
 	    }
 	}
 	count = ndata->data_pending_len;
 	filen_unlock(ndata);
 	gensio_cb(ndata->io, GENSIO_EVENT_READ, ndata->read_err,
-		  ndata->read_data, &count, NULL);
+		  ndata->read_data + ndata->data_pos, &count, NULL);
 	filen_lock(ndata);
 	if (count > 0) {
 	    if (count >= ndata->data_pending_len) {
 		ndata->data_pending_len = 0;
 	    } else {
-		memcpy(ndata->read_data, ndata->read_data + count,
-		       ndata->data_pending_len - count);
+		ndata->data_pos += count;
 		ndata->data_pending_len -= count;
 	    }
 	}
     }
 
+    callbacks = 0;
     while (ndata->state == FILEN_OPEN && ndata->xmit_enabled) {
+	if (callbacks++ >= FILEN_MAX_CALLBACKS_PER_OP) {
+	    filen_start_deferred_op(ndata);
+	    break;
+	}
 	filen_unlock(ndata);
 	gensio_cb(ndata->io, GENSIO_EVENT_WRITE_READY, 0,
 		  NULL, NULL, NULL);
 	filen_lock(ndata);
     }
 
-    if (ndata->state == FILEN_IN_CLOSE) {
+    if (ndata->state == FILEN_IN_CLOSE && !filen_ra_running(ndata)) {
 	ndata->state = FILEN_CLOSED;
+#if FILE_MMAP
+	/* The mapping stays valid after the close, drop it here. */
+	filen_mmap_stop(ndata);
+#endif
 	if (ndata->close_done) {
 	    filen_unlock(ndata);
 	    ndata->close_done(ndata->io, ndata->close_data);
@@ -393,6 +739,42 @@ filen_start_deferred_op(struct filen_data *ndata)
     }
 }
 
+#if FILE_READAHEAD
+static void
+filen_ra_wake(struct gensio_os_worker *w, void *cb_data)
+{
+    struct filen_data *ndata = cb_data;
+
+    filen_lock(ndata);
+    if (ndata->state == FILEN_OPEN && ndata->read_enabled)
+	filen_start_deferred_op(ndata);
+    filen_unlock(ndata);
+}
+
+/*
+ * The thread is gone.  If a close is waiting on it, the input file
+ * can be closed now and the close finished.
+ */
+static void
+filen_ra_done(struct gensio_os_worker *w, void *cb_data)
+{
+    struct filen_data *ndata = cb_data;
+
+    filen_lock(ndata);
+    ndata->ra_running = false;
+    if (ndata->state != FILEN_OPEN && ndata->state != FILEN_IN_OPEN) {
+	if (f_ready(ndata->inf)) {
+	    f_close(ndata->inf);
+	    f_set_not_ready(ndata->inf);
+	}
+	if (ndata->state == FILEN_IN_CLOSE ||
+		ndata->state == FILEN_IN_OPEN_CLOSE)
+	    filen_start_deferred_op(ndata);
+    }
+    filen_unlock_and_deref(ndata);
+}
+#endif
+
 static void
 filen_set_read_callback_enable(struct gensio *io, bool enabled)
 {
@@ -436,6 +818,13 @@ filen_open(struct gensio *io, gensio_done_err open_done, void *open_data)
 	err = f_open(ndata->o, ndata->infile, F_O_RDONLY, 0, &ndata->inf);
 	if (err)
 	    goto out_unlock;
+	f_advise_sequential(ndata->inf);
+	ndata->read_err = 0;
+	ndata->data_pending_len = 0;
+#if FILE_MMAP
+	if (ndata->use_mmap)
+	    filen_mmap_start(ndata);
+#endif
     }
     if (ndata->outfile) {
 	int flags = F_O_WRONLY;
@@ -445,8 +834,15 @@ filen_open(struct gensio *io, gensio_done_err open_done, void *open_data)
 	err = f_open(ndata->o, ndata->outfile, flags, ndata->mode,
 		     &ndata->outf);
 	if (err)
-	    goto out_unlock;
+	    goto out_close_in;
     }
+#if FILE_READAHEAD
+    if (ndata->ra_nbufs && f_ready(ndata->inf) && !filen_mmap_active(ndata)) {
+	err = filen_ra_start(ndata);
+	if (err)
+	    goto out_close_out;
+    }
+#endif
     ndata->state = FILEN_IN_OPEN;
     ndata->open_done = open_done;
     ndata->open_data = open_data;
@@ -455,6 +851,23 @@ filen_open(struct gensio *io, gensio_done_err open_done, void *open_data)
     filen_unlock(ndata);
 
     return err;
+
+#if FILE_READAHEAD
+ out_close_out:
+    if (f_ready(ndata->outf)) {
+	f_close(ndata->outf);
+	f_set_not_ready(ndata->outf);
+    }
+#endif
+ out_close_in:
+#if FILE_MMAP
+    filen_mmap_stop(ndata);
+#endif
+    if (f_ready(ndata->inf)) {
+	f_close(ndata->inf);
+	f_set_not_ready(ndata->inf);
+    }
+    goto out_unlock;
 }
 
 static int
@@ -468,6 +881,15 @@ filen_close(struct gensio *io, gensio_done close_done, void *close_data)
 	err = GE_NOTREADY;
 	goto out_unlock;
     }
+#if FILE_READAHEAD
+    /*
+     * The thread is using the input file.  Tell it to stop, the done
+     * callback closes the file and finishes the close.
+     */
+    if (ndata->ra_running)
+	gensio_os_worker_stop(ndata->ra_worker);
+    else
+#endif
     if (f_ready(ndata->inf)) {
 	f_close(ndata->inf);
 	f_set_not_ready(ndata->inf);
@@ -506,6 +928,13 @@ filen_free(struct gensio *io)
 
     filen_lock(ndata);
     assert(ndata->refcount > 0);
+#if FILE_READAHEAD
+    /* Freed without a close, the thread's done drops the last ref. */
+    if (ndata->ra_running && ndata->refcount == 2) {
+	ndata->state = FILEN_CLOSED;
+	gensio_os_worker_stop(ndata->ra_worker);
+    }
+#endif
     if (ndata->refcount == 1)
 	ndata->state = FILEN_CLOSED;
     filen_unlock_and_deref(ndata);
@@ -523,6 +952,43 @@ filen_disable(struct gensio *io)
     return 0;
 }
 
+static int
+filen_control(struct gensio *io, bool get, unsigned int option,
+	      char *data, gensiods *datalen)
+{
+#if USE_FILE_STDIO
+    return GE_NOTSUP;
+#else
+    struct filen_data *ndata = gensio_get_gensio_data(io);
+    unsigned long val;
+    int fd;
+
+    if (option != GENSIO_CONTROL_RAW_FD || !get)
+	return GE_NOTSUP;
+
+    val = strtoul(data, NULL, 0);
+    if (val == 0) {
+#if FILE_READAHEAD
+	/* The read-ahead thread is already reading from it. */
+	if (ndata->ra_running)
+	    return GE_NOTSUP;
+#endif
+	/* Data is delivered from the mapping, not the fd position. */
+	if (filen_mmap_active(ndata))
+	    return GE_NOTSUP;
+	fd = ndata->inf;
+    } else if (val == 1) {
+	fd = ndata->outf;
+    } else {
+	return GE_INVAL;
+    }
+    if (fd == -1)
+	return GE_NOTREADY;
+    *datalen = snprintf(data, *datalen, "%d", fd);
+    return 0;
+#endif
+}
+
 static int
 gensio_file_func(struct gensio *io, int func, gensiods *count,
 		  const void *cbuf, gensiods buflen, void *buf,
@@ -563,6 +1029,9 @@ gensio_file_func(struct gensio *io, int func, gensiods *count,
     case GENSIO_FUNC_DISABLE:
 	return filen_disable(io);
 
+    case GENSIO_FUNC_CONTROL:
+	return filen_control(io, *((bool *) cbuf), buflen, buf, count);
+
     default:
 	return GE_NOTSUP;
     }
@@ -570,10 +1039,12 @@ gensio_file_func(struct gensio *io, int func, gensiods *count,
 
 static int
 file_ndata_setup(struct gensio_os_funcs *o, gensiods max_read_size,
+		 unsigned int readahead,
 		 const char *infile, const char *outfile, bool create,
 		 mode_type mode, struct filen_data **new_ndata)
 {
     struct filen_data *ndata;
+    int err = GE_NOMEM;
 
     ndata = o->zalloc(o, sizeof(*ndata));
     if (!ndata)
@@ -599,9 +1070,27 @@ file_ndata_setup(struct gensio_os_funcs *o, gensiods max_read_size,
     f_set_not_ready(ndata->outf);
 
     ndata->max_read_size = max_read_size;
-    ndata->read_data = o->zalloc(o, max_read_size);
-    if (!ndata->read_data)
-	goto out_nomem;
+#if FILE_READAHEAD
+    if (readahead && infile) {
+	ndata->ra_data = o->zalloc(o, max_read_size * readahead);
+	if (!ndata->ra_data)
+	    goto out_nomem;
+	ndata->ra_len = o->zalloc(o, sizeof(gensiods) * readahead);
+	if (!ndata->ra_len)
+	    goto out_nomem;
+	ndata->ra_nbufs = readahead;
+	err = gensio_os_worker_alloc(o, filen_ra_thread, filen_ra_wake,
+				     filen_ra_done, ndata,
+				     &ndata->ra_worker);
+	if (err)
+	    goto out_err;
+    } else
+#endif
+    {
+	ndata->read_data = o->zalloc(o, max_read_size);
+	if (!ndata->read_data)
+	    goto out_nomem;
+    }
 
     ndata->deferred_op_runner = o->alloc_runner(o, filen_deferred_op, ndata);
     if (!ndata->deferred_op_runner)
@@ -616,9 +1105,13 @@ file_ndata_setup(struct gensio_os_funcs *o, gensiods max_read_size,
     return 0;
 
  out_nomem:
+    err = GE_NOMEM;
+#if FILE_READAHEAD
+ out_err:
+#endif
     filen_finish_free(ndata);
 
-    return GE_NOMEM;
+    return err;
 }
 
 int
@@ -666,7 +1159,8 @@ file_gensio_alloc(const char * const argv[], const char * const args[],
     gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
     const char *infile = NULL, *outfile = NULL;
     unsigned int umode = 6, gmode = 6, omode = 6;
-    bool create = false;
+    unsigned int readahead = 0;
+    bool create = false, use_mmap = false;
 
     for (i = 0; args && args[i]; i++) {
 	if (gensio_check_keyds(args[i], "readbuf", &max_read_size) > 0)
@@ -677,6 +1171,12 @@ file_gensio_alloc(const char * const argv[], const char * const args[],
 	    continue;
 	if (gensio_check_keybool(args[i], "create", &create) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "readahead", &readahead) > 0)
+	    continue;
+#if FILE_MMAP
+	if (gensio_check_keybool(args[i], "mmap", &use_mmap) > 0)
+	    continue;
+#endif
 #if !USE_FILE_STDIO
 	if (gensio_check_keymode(args[i], "umode", &umode) > 0)
 	    continue;
@@ -688,10 +1188,14 @@ file_gensio_alloc(const char * const argv[], const char * const args[],
 	return GE_INVAL;
     }
 
-    err = file_ndata_setup(o, max_read_size, infile, outfile, create,
+    err = file_ndata_setup(o, max_read_size, readahead,
+			   infile, outfile, create,
 			   umode << 6 | gmode << 3 | omode, &ndata);
     if (err)
 	return err;
+#if FILE_MMAP
+    ndata->use_mmap = use_mmap;
+#endif
 
     ndata->io = gensio_data_alloc(ndata->o, cb, user_data,
 				  gensio_file_func, NULL, "file", ndata);
@@ -6,6 +6,7 @@
  */
 
 #include "config.h"
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
@@ -33,6 +34,17 @@ enum relpkt_msgs {
      * | pktlen msb     |    pktlen lsb  |
      * +----------------+----------------+
      * A - response bit, 1 if a response, 0 if not.
+     *
+     * Version 1 and later add a 16-bit receive window after the
+     * packet length.  The 8-bit receive window is still filled in
+     * (limited to 127) so a version 0 implementation can talk to us.
+     *
+     * +----------------+----------------+
+     * | recv win msb   |  recv win lsb  |
+     * +----------------+----------------+
+     *
+     * The version used for the connection is the lower of the two
+     * versions.  The response carries the version that was chosen.
      */
     RELPKT_MSG_INIT = 1,
 
@@ -41,9 +53,18 @@ enum relpkt_msgs {
      * is ignore and this is only an ack.
      * 
      * +----------------+----------------+----------------+
-     * |   2   |reserv|A| next expected  |  msg seq       |
+     * |   2   |r|D|K|A| next expected  |  msg seq       |
      * +----------------+----------------+----------------+
      * A - eom bit, if 1 end of message, if 0 not.
+     * K - ack request, version 1 and later only.  The sender cannot
+     *     send any more data until it gets an ack, so the receiver
+     *     should not delay the ack for this packet.
+     * D - duplicate ack, version 1 and later only, and only on an ack
+     *     with no data.  The ack was sent because a data packet
+     *     arrived out of order, so something before it is missing.
+     *
+     * In version 1 and later, next expected and msg seq are 16 bits,
+     * msb first, making the header 5 bytes.
      */
     RELPKT_MSG_DATA = 2,
 
@@ -55,6 +76,14 @@ enum relpkt_msgs {
      * +----------------+----------------+----------------+
      * |   3   |reserved|first seq resend|last seq resend |
      * +----------------+----------------+----------------+
+     *
+     * In version 1 and later this is a 16-bit first sequence number
+     * followed by a bitmap.  Bit n (lsb first in each byte) of the
+     * bitmap set means first seq + n needs to be resent.
+     *
+     * +----------------+----------------+----------------+-----
+     * |   3   |reserved| first seq msb  | first seq lsb  | bitmap...
+     * +----------------+----------------+----------------+-----
      */
     RELPKT_MSG_RESEND = 3,
 
@@ -68,6 +97,57 @@ enum relpkt_msgs {
     RELPKT_MSG_CLOSE = 4
 };
 
+/* The highest protocol version we support. */
+#define RELPKT_VERSION		1
+
+/* The largest data header of any version. */
+#define RELPKT_MAX_HDRLEN	5
+
+/*
+ * With 16-bit sequence numbers the window must be less than half the
+ * sequence space to tell old packets from new ones.
+ */
+#define RELPKT_MAX_PACKETS	32767
+
+/* Version 0 only has 8-bit sequence numbers. */
+#define RELPKT_V0_MAX_PACKETS	127
+
+/*
+ * Default packet size.  The usual transport on a serial port is
+ * msgdelim, which has 128 byte packets, leaving 123 after the v1
+ * header.  A datagram transport can take something that fits in a
+ * network MTU.
+ */
+#define RELPKT_DEFAULT_PKTSIZE		123
+#define RELPKT_DEFAULT_DGRAM_PKTSIZE	1400
+
+/* Default window, version 0 peers limit this to 127. */
+#define RELPKT_DEFAULT_PACKETS	128
+
+/*
+ * Retransmit timing, all in microseconds.  The retransmit timeout is
+ * calculated from the round trip time as described in RFC 6298 and
+ * limited to these values.  Liveness checks and keepalive acks are
+ * done once a second.
+ */
+#define RELPKT_INITIAL_RTO	1000000
+#define RELPKT_MIN_RTO		200000
+#define RELPKT_MAX_RTO		2000000
+#define RELPKT_HOUSEKEEPING	1000000
+
+/* Congestion window in packets when a connection starts. */
+#define RELPKT_INITIAL_CWND	4
+
+/* Number of duplicate acks that trigger a fast retransmit. */
+#define RELPKT_DUPACK_THRESH	3
+
+/*
+ * By default, ack every other packet delivered to the user, or after
+ * 10ms if nothing else comes along to carry the ack.
+ */
+#define RELPKT_DEFAULT_ACK_EVERY	2
+#define RELPKT_DEFAULT_ACK_DELAY	10
+
 enum relpkt_state {
     /*
      * relpkt is not operational.
@@ -246,6 +326,10 @@ struct pkt {
 
     bool ready; /* If true, packet is ready to deliver to the user. */
     bool eom; /* If true, report end of message. */
+    bool nak; /* Receive only, if true, request a resend of the packet. */
+    bool ackreq; /* Receive only, the sender wants an ack right away. */
+    bool resent; /* Transmit only, packet has been retransmitted. */
+    int64_t send_time; /* Transmit only, last time sent, in usecs. */
 
     unsigned char *data;
 };
@@ -268,11 +352,18 @@ struct relpkt_filter {
 
     gensiods max_pktsize;
     unsigned int max_pkt; /* Our set value. */
+    unsigned int recv_pkt; /* Receive window in use, limited by version. */
+
+    unsigned int max_version; /* The highest version we offer. */
+    unsigned int version; /* Protocol version in use. */
+    unsigned int hdrlen; /* Size of a data packet header for version. */
+    unsigned int seq_mask; /* Sequence numbers wrap with this mask. */
 
-    uint8_t next_expected_seq; /* Next seq we expect from the remote. */
-    uint8_t next_deliver_seq; /* Next seq we will deliver to the user. */
-    uint8_t deliver_recvpkt; /* Pos in recvpkts of next_deliver_seq. */
+    unsigned int next_expected_seq; /* Next seq we expect from the remote. */
+    unsigned int next_deliver_seq; /* Next seq we will deliver to the user. */
+    unsigned int deliver_recvpkt; /* Pos in recvpkts of next_deliver_seq. */
     struct pkt *recvpkts;
+    unsigned char *recvbuf;
 
     /*
      * The other end is supposed to send an ack or data at least once
@@ -284,13 +375,14 @@ struct relpkt_filter {
 
     unsigned int max_xmit_pktsize;
     unsigned int max_xmitpkt; /* Set from remote end by init packet. */
-    uint8_t next_acked_seq; /* Seq for next packet that is unacked. */
-    uint8_t next_send_seq; /* Seq for next packet we will send. */
-    uint8_t first_xmitpkt; /* Pos in xmitpkts of where next_ack_seq is. */
+    unsigned int next_acked_seq; /* Seq for next packet that is unacked. */
+    unsigned int next_send_seq; /* Seq for next packet we will send. */
+    unsigned int first_xmitpkt; /* Pos in xmitpkts of where next_ack_seq is. */
     struct pkt *xmitpkts;
+    unsigned char *xmitbuf;
     unsigned int nr_waiting_xmitpkt; /* nr in xmitpkt unsent */
 
-    char init_pkt[5];
+    char init_pkt[7];
     bool send_init_pkt;
     unsigned int init_retry_count;
 
@@ -298,15 +390,49 @@ struct relpkt_filter {
     bool send_close_pkt;
     unsigned int close_retry_count;
 
-    char ack_pkt[3];
+    char ack_pkt[RELPKT_MAX_HDRLEN];
     bool send_ack_pkt;
 
-    char resend_pkt[51];
+    /*
+     * Delayed acks.  Acks are held until ack_every packets have been
+     * delivered or ack_delay usecs pass, unless outgoing data carries
+     * the ack first.
+     */
+    unsigned int ack_every;
+    int64_t ack_delay;
+    unsigned int unacked_delivered;
+    bool ack_armed; /* If true, ack_deadline is valid. */
+    int64_t ack_deadline;
+
+    /*
+     * For version 0 this holds the resend pairs as they are requested.
+     * For version 1 the bitmap is built from the nak flags at send
+     * time, resend_pkt_len is zero until that is done.
+     */
+    char *resend_pkt;
+    gensiods resend_pkt_size;
     bool send_resend_pkt;
-    uint16_t resend_pkt_len;
+    gensiods resend_pkt_len;
 
-    uint8_t last_timeout_ack; /* next_acked_seq on the last timeout. */
-    unsigned int timeout_ack_count; /* nr timeouts last_timeout_ack same. */
+    /*
+     * Round trip time and congestion handling.  Times are monotonic
+     * times in usecs.  srtt is zero until the first sample arrives.
+     */
+    int64_t srtt;
+    int64_t rttvar;
+    int64_t rto;
+    bool rto_armed; /* If true, rto_deadline is valid. */
+    int64_t rto_deadline;
+    int64_t next_housekeeping;
+    int64_t timer_expiry; /* When the timer we started will go off. */
+    bool timer_check_pending; /* Timer needs updating from a safe context. */
+    unsigned int cwnd; /* Packets that may be in flight. */
+    unsigned int ssthresh;
+    unsigned int cwnd_acked; /* Acks toward the next cwnd increase. */
+    unsigned int dupacks;
+    bool in_recovery; /* Don't cut cwnd again until recover_seq acked. */
+    unsigned int recover_seq;
+    unsigned int retransmits;
 };
 
 #define filter_to_relpkt(v) ((struct relpkt_filter *) \
@@ -327,74 +453,286 @@ relpkt_unlock(struct relpkt_filter *rfilter)
     rfilter->o->unlock(rfilter->lock);
 }
 
+static void
+relpkt_set_version(struct relpkt_filter *rfilter, unsigned int version)
+{
+    rfilter->version = version;
+    rfilter->recv_pkt = rfilter->max_pkt;
+    if (version == 0) {
+	rfilter->hdrlen = 3;
+	rfilter->seq_mask = 0xff;
+	/*
+	 * We told the remote end the window was no more than this in
+	 * the init message.  It also has to be limited to tell old
+	 * packets from new ones with 8-bit sequence numbers.
+	 */
+	if (rfilter->recv_pkt > RELPKT_V0_MAX_PACKETS)
+	    rfilter->recv_pkt = RELPKT_V0_MAX_PACKETS;
+    } else {
+	rfilter->hdrlen = 5;
+	rfilter->seq_mask = 0xffff;
+    }
+}
+
+/* Returns (a - b) in sequence space. */
+static unsigned int
+seq_diff(struct relpkt_filter *rfilter, unsigned int a, unsigned int b)
+{
+    return (a - b) & rfilter->seq_mask;
+}
+
+static unsigned int
+seq_add(struct relpkt_filter *rfilter, unsigned int seq, unsigned int n)
+{
+    return (seq + n) & rfilter->seq_mask;
+}
+
 /*
  * Returns true if seq >= first and seq < next, taking into account
  * wrapping.  If first == next, this will always return false.
  */
 static bool
-seq_inside(uint8_t seq, uint8_t first, uint8_t next)
+seq_inside(struct relpkt_filter *rfilter,
+	   unsigned int seq, unsigned int first, unsigned int next)
 {
-    if (first <= next)
-	/* not wrapped */
-	return seq >= first && seq < next;
-    else
-	/* wrapped */
-	return seq >= first || seq < next;
+    return seq_diff(rfilter, seq, first) < seq_diff(rfilter, next, first);
 }
 
-static uint8_t
-recvpkt_pos(struct relpkt_filter *rfilter, uint8_t pos)
+static unsigned int
+seq_size(struct relpkt_filter *rfilter)
 {
-    return (rfilter->deliver_recvpkt + pos) % rfilter->max_pkt;
+    return rfilter->version == 0 ? 1 : 2;
 }
 
-static uint8_t
-xmitpkt_pos(struct relpkt_filter *rfilter, uint8_t pos)
+static unsigned int
+get_seq(struct relpkt_filter *rfilter, const unsigned char *buf)
+{
+    if (rfilter->version == 0)
+	return buf[0];
+    return buf[0] << 8 | buf[1];
+}
+
+static void
+put_seq(struct relpkt_filter *rfilter, unsigned char *buf, unsigned int seq)
+{
+    if (rfilter->version == 0) {
+	buf[0] = seq;
+    } else {
+	buf[0] = seq >> 8;
+	buf[1] = seq & 0xff;
+    }
+}
+
+static unsigned int
+recvpkt_pos(struct relpkt_filter *rfilter, unsigned int pos)
+{
+    return (rfilter->deliver_recvpkt + pos) % rfilter->recv_pkt;
+}
+
+static unsigned int
+xmitpkt_pos(struct relpkt_filter *rfilter, unsigned int pos)
 {
     return (rfilter->first_xmitpkt + pos) % rfilter->max_xmitpkt;
 }
 
+static int64_t
+relpkt_now(struct relpkt_filter *rfilter)
+{
+    gensio_time now;
+
+    rfilter->o->get_monotonic_time(rfilter->o, &now);
+    return now.secs * 1000000 + now.nsecs / 1000;
+}
+
 static void
-resend_packets(struct relpkt_filter *rfilter, uint8_t first, uint8_t last)
+resend_packets(struct relpkt_filter *rfilter,
+	       unsigned int first, unsigned int last)
 {
-    uint8_t seq;
-    unsigned int i, pos;
+    unsigned int i, pos, seq;
 
-    for (seq = first, i = first - rfilter->next_acked_seq; seq != last; i++) {
+    i = seq_diff(rfilter, first, rfilter->next_acked_seq);
+    for (seq = first; seq != last; i++, seq = seq_add(rfilter, seq, 1)) {
 	pos = xmitpkt_pos(rfilter, i);
 	if (rfilter->xmitpkts[pos].sent) {
 	    rfilter->xmitpkts[pos].sent = false;
+	    rfilter->xmitpkts[pos].resent = true;
 	    rfilter->nr_waiting_xmitpkt++;
 	}
-	seq++;
     }
 }
 
+/*
+ * Return the first packet that needs to be sent and is inside the
+ * congestion window, or NULL if there is none.
+ */
 static struct pkt *
 first_xmitpkt_to_send(struct relpkt_filter *rfilter)
 {
-    uint8_t seq = rfilter->next_acked_seq;
-    unsigned int i, pos;
+    unsigned int i, pos, count;
 
-    for (i = 0; seq != rfilter->next_send_seq; i++, seq++) {
+    count = seq_diff(rfilter, rfilter->next_send_seq,
+		     rfilter->next_acked_seq);
+    if (count > rfilter->cwnd)
+	count = rfilter->cwnd;
+    for (i = 0; i < count; i++) {
 	pos = xmitpkt_pos(rfilter, i);
 	if (!rfilter->xmitpkts[pos].sent)
 	    return &(rfilter->xmitpkts[pos]);
     }
-    assert(0);
+    return NULL;
+}
+
+/*
+ * If nothing can be sent after this packet until an ack comes back,
+ * ask the remote end not to delay its ack.
+ */
+static void
+set_ackreq(struct relpkt_filter *rfilter, struct pkt *p)
+{
+    unsigned int seq, limit;
+
+    seq = get_seq(rfilter, p->data + 1 + seq_size(rfilter));
+    limit = seq_diff(rfilter, rfilter->next_send_seq, rfilter->next_acked_seq);
+    if (limit > rfilter->cwnd)
+	limit = rfilter->cwnd;
+    if (p->resent ||
+		seq_diff(rfilter, seq, rfilter->next_acked_seq) + 1 >= limit)
+	p->data[0] |= 2;
+    else
+	p->data[0] &= ~2;
+}
+
+static void
+relpkt_rtt_sample(struct relpkt_filter *rfilter, int64_t rtt)
+{
+    int64_t diff;
+
+    if (rtt < 1)
+	rtt = 1;
+    if (rfilter->srtt == 0) {
+	rfilter->srtt = rtt;
+	rfilter->rttvar = rtt / 2;
+    } else {
+	diff = rfilter->srtt - rtt;
+	if (diff < 0)
+	    diff = -diff;
+	rfilter->rttvar = (3 * rfilter->rttvar + diff) / 4;
+	rfilter->srtt = (7 * rfilter->srtt + rtt) / 8;
+    }
+    rfilter->rto = rfilter->srtt + 4 * rfilter->rttvar;
+    if (rfilter->rto < RELPKT_MIN_RTO)
+	rfilter->rto = RELPKT_MIN_RTO;
+    if (rfilter->rto > RELPKT_MAX_RTO)
+	rfilter->rto = RELPKT_MAX_RTO;
+}
+
+/* A packet was acked, open the congestion window. */
+static void
+relpkt_cwnd_acked(struct relpkt_filter *rfilter)
+{
+    if (rfilter->cwnd >= rfilter->max_xmitpkt)
+	return;
+    if (rfilter->cwnd < rfilter->ssthresh) {
+	/* Slow start */
+	rfilter->cwnd++;
+    } else if (++rfilter->cwnd_acked >= rfilter->cwnd) {
+	/* Congestion avoidance */
+	rfilter->cwnd++;
+	rfilter->cwnd_acked = 0;
+    }
+}
+
+/*
+ * Packets have been lost, cut the congestion window.  For anything
+ * but a timeout, only do this once per window of data.
+ */
+static void
+relpkt_congestion_event(struct relpkt_filter *rfilter, bool timeout)
+{
+    unsigned int in_flight;
+
+    if (rfilter->in_recovery && !timeout)
+	return;
+
+    in_flight = seq_diff(rfilter, rfilter->next_send_seq,
+			 rfilter->next_acked_seq);
+    rfilter->ssthresh = in_flight / 2;
+    if (rfilter->ssthresh < 2)
+	rfilter->ssthresh = 2;
+    if (timeout)
+	rfilter->cwnd = 1;
+    else
+	rfilter->cwnd = rfilter->ssthresh;
+    rfilter->cwnd_acked = 0;
+    rfilter->in_recovery = true;
+    rfilter->recover_seq = rfilter->next_send_seq;
 }
 
 static void
 send_init(struct relpkt_filter *rfilter, bool response)
 {
+    unsigned int v0_max_pkt = rfilter->max_pkt;
+
+    if (v0_max_pkt > RELPKT_V0_MAX_PACKETS)
+	v0_max_pkt = RELPKT_V0_MAX_PACKETS;
     rfilter->init_pkt[0] = (RELPKT_MSG_INIT << 4) | (uint8_t) response;
-    rfilter->init_pkt[1] = 0; /* version */
-    rfilter->init_pkt[2] = rfilter->max_pkt;
+    rfilter->init_pkt[1] = rfilter->version;
+    rfilter->init_pkt[2] = v0_max_pkt;
     rfilter->init_pkt[3] = rfilter->max_pktsize >> 8;
     rfilter->init_pkt[4] = rfilter->max_pktsize & 0xff;
+    rfilter->init_pkt[5] = rfilter->max_pkt >> 8;
+    rfilter->init_pkt[6] = rfilter->max_pkt & 0xff;
     rfilter->send_init_pkt = true;
 }
 
+/*
+ * Handle the contents of an init message from the remote end, lower
+ * our version to the remote end's if necessary and pull out the
+ * remote end's limits.  Returns true on a protocol error.
+ */
+static bool
+handle_init(struct relpkt_filter *rfilter,
+	    unsigned char *buf, gensiods buflen)
+{
+    unsigned int version = rfilter->version;
+
+    if (buf[1] < version)
+	version = buf[1];
+    if (version >= 1) {
+	if (buflen < 7)
+	    return true;
+	rfilter->max_xmitpkt = buf[5] << 8 | buf[6];
+    } else {
+	rfilter->max_xmitpkt = buf[2];
+    }
+    if (rfilter->max_xmitpkt == 0)
+	return true;
+    if (version == 0 && rfilter->max_xmitpkt > RELPKT_V0_MAX_PACKETS)
+	rfilter->max_xmitpkt = RELPKT_V0_MAX_PACKETS;
+    if (rfilter->max_xmitpkt > rfilter->max_pkt)
+	rfilter->max_xmitpkt = rfilter->max_pkt;
+    rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
+    if (rfilter->max_xmit_pktsize == 0)
+	return true;
+    if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
+	rfilter->max_xmit_pktsize = rfilter->max_pktsize;
+    relpkt_set_version(rfilter, version);
+
+    rfilter->srtt = 0;
+    rfilter->rttvar = 0;
+    rfilter->rto = RELPKT_INITIAL_RTO;
+    rfilter->rto_armed = false;
+    rfilter->next_housekeeping = relpkt_now(rfilter) + RELPKT_HOUSEKEEPING;
+    rfilter->cwnd = RELPKT_INITIAL_CWND;
+    if (rfilter->cwnd > rfilter->max_xmitpkt)
+	rfilter->cwnd = rfilter->max_xmitpkt;
+    rfilter->ssthresh = rfilter->max_xmitpkt;
+    rfilter->cwnd_acked = 0;
+    rfilter->dupacks = 0;
+    rfilter->in_recovery = false;
+    return false;
+}
+
 static void
 send_close(struct relpkt_filter *rfilter)
 {
@@ -407,69 +745,262 @@ send_close(struct relpkt_filter *rfilter)
 static void
 send_ack(struct relpkt_filter *rfilter)
 {
+    memset(rfilter->ack_pkt, 0, sizeof(rfilter->ack_pkt));
     rfilter->ack_pkt[0] = RELPKT_MSG_DATA << 4;
     /* seq will be filled in at send time. */
-    rfilter->ack_pkt[2] = 0;
     rfilter->send_ack_pkt = true;
+    rfilter->ack_armed = false;
+}
+
+/*
+ * A data packet arrived after a hole, send an ack marked so the remote
+ * end can count it as a duplicate ack.  Version 0 has no room for the
+ * mark, it relies on the resend request.
+ */
+static void
+send_dupack(struct relpkt_filter *rfilter)
+{
+    send_ack(rfilter);
+    if (rfilter->version >= 1)
+	rfilter->ack_pkt[0] |= 4;
+}
+
+/* Something carrying the current ack went out. */
+static void
+ack_sent(struct relpkt_filter *rfilter)
+{
+    rfilter->send_ack_pkt = false;
+    rfilter->ack_armed = false;
+    rfilter->unacked_delivered = 0;
 }
 
 static void
-request_resend(struct relpkt_filter *rfilter, uint8_t first, uint8_t last)
+request_resend(struct relpkt_filter *rfilter,
+	       unsigned int first, unsigned int last)
 {
+    unsigned int seq;
+
+    if (rfilter->version >= 1) {
+	/* Mark them, the bitmap is built when the message is sent. */
+	last = seq_add(rfilter, last, 1);
+	for (seq = first; seq != last; seq = seq_add(rfilter, seq, 1)) {
+	    unsigned int pos = seq_diff(rfilter, seq, rfilter->next_deliver_seq);
+
+	    rfilter->recvpkts[recvpkt_pos(rfilter, pos)].nak = true;
+	}
+	rfilter->send_resend_pkt = true;
+	return;
+    }
+
     if (!rfilter->send_resend_pkt) {
 	rfilter->resend_pkt_len = 1;
 	rfilter->resend_pkt[0] = RELPKT_MSG_RESEND << 4;
 	rfilter->send_resend_pkt = true;
     }
-    if (rfilter->resend_pkt_len + 1 >= sizeof(rfilter->resend_pkt))
+    if (rfilter->resend_pkt_len + 1 >= rfilter->resend_pkt_size)
 	return; /* No space left, let transmit timeout get it. */
     rfilter->resend_pkt[rfilter->resend_pkt_len++] = first;
     rfilter->resend_pkt[rfilter->resend_pkt_len++] = last;
-    rfilter->timeout_ack_count = 0;
 }
 
-/* Returns true on a protocol error. */
+/*
+ * Build a version 1 resend bitmap from the nak'd receive packets
+ * that have not arrived yet.  Sets resend_pkt_len to zero if there
+ * is nothing to request.
+ */
+static void
+build_resend_bitmap(struct relpkt_filter *rfilter)
+{
+    unsigned int i, pos, first = 0, count;
+    unsigned char *buf = (unsigned char *) rfilter->resend_pkt;
+    struct pkt *p;
+
+    count = seq_diff(rfilter, rfilter->next_expected_seq,
+		     rfilter->next_deliver_seq);
+    rfilter->resend_pkt_len = 0;
+    for (i = 0; i < count; i++) {
+	p = &(rfilter->recvpkts[recvpkt_pos(rfilter, i)]);
+	if (!p->nak || p->ready)
+	    continue;
+	if (!rfilter->resend_pkt_len) {
+	    first = i;
+	    buf[0] = RELPKT_MSG_RESEND << 4;
+	    put_seq(rfilter, buf + 1,
+		    seq_add(rfilter, rfilter->next_deliver_seq, i));
+	    rfilter->resend_pkt_len = 3;
+	}
+	pos = i - first;
+	while (rfilter->resend_pkt_len <= 3 + pos / 8)
+	    buf[rfilter->resend_pkt_len++] = 0;
+	buf[3 + pos / 8] |= 1 << (pos % 8);
+    }
+}
+
+/* The bitmap was sent, clear the nak flags it covered. */
+static void
+resend_bitmap_sent(struct relpkt_filter *rfilter)
+{
+    const unsigned char *buf = (unsigned char *) rfilter->resend_pkt;
+    unsigned int i, first;
+
+    first = seq_diff(rfilter, get_seq(rfilter, buf + 1),
+		     rfilter->next_deliver_seq);
+    for (i = 0; i < (rfilter->resend_pkt_len - 3) * 8; i++) {
+	if (buf[3 + i / 8] & (1 << (i % 8)))
+	    rfilter->recvpkts[recvpkt_pos(rfilter, first + i)].nak = false;
+    }
+    rfilter->resend_pkt_len = 0;
+}
+
+/*
+ * Handle an ack from the remote end.  dupack is true if the message
+ * was an ack with no data that the remote end sent because data
+ * arrived out of order.  Only those count toward a fast retransmit,
+ * the remote end sends the same ack for other reasons (keepalives,
+ * delayed acks, acking duplicate data).  Returns true on a protocol
+ * error.
+ */
 static bool
-handle_ack(struct relpkt_filter *rfilter, uint8_t seq)
+handle_ack(struct relpkt_filter *rfilter, unsigned int seq, bool dupack)
 {
     unsigned int pos;
+    struct pkt *p;
+    int64_t now, rtt = -1;
 
     /*
      * The last received message on the other end is in seq, but we
      * keep the next thing that should be acked, thus the +1.
      */
-    if (!seq_inside(seq, rfilter->next_acked_seq,
-		    rfilter->next_send_seq + 1))
+    if (!seq_inside(rfilter, seq, rfilter->next_acked_seq,
+		    seq_add(rfilter, rfilter->next_send_seq, 1)))
 	return true;
+    rfilter->timeouts_since_ack = 0;
+
+    if (seq == rfilter->next_acked_seq) {
+	/* Only count it if something is outstanding. */
+	if (dupack && seq != rfilter->next_send_seq) {
+	    rfilter->dupacks++;
+	    if (rfilter->dupacks == RELPKT_DUPACK_THRESH) {
+		/* The remote end is missing this one, send it now. */
+		resend_packets(rfilter, seq, seq_add(rfilter, seq, 1));
+		relpkt_congestion_event(rfilter, false);
+	    }
+	}
+	return false;
+    }
+
+    now = relpkt_now(rfilter);
+    rfilter->dupacks = 0;
     while (rfilter->next_acked_seq != seq) {
 	pos = rfilter->first_xmitpkt;
-	if (!rfilter->xmitpkts[pos].sent) {
+	p = &(rfilter->xmitpkts[pos]);
+	if (!p->sent) {
 	    /*
 	     * Packets wasn't sent yet, but we got an ack.  Could
 	     * happen on a retransmit or some other error.  Just act
 	     * like it was transmitted.
 	     */
-	    rfilter->xmitpkts[pos].sent = true;
+	    p->sent = true;
 	    assert(rfilter->nr_waiting_xmitpkt > 0);
 	    rfilter->nr_waiting_xmitpkt--;
+	} else if (!p->resent) {
+	    /* Only use packets sent once for timing, per Karn. */
+	    rtt = now - p->send_time;
 	}
+	relpkt_cwnd_acked(rfilter);
 	rfilter->first_xmitpkt = xmitpkt_pos(rfilter, 1);
-	rfilter->next_acked_seq++;
+	rfilter->next_acked_seq = seq_add(rfilter, rfilter->next_acked_seq, 1);
     }
-    rfilter->timeouts_since_ack = 0;
+    if (rtt >= 0)
+	relpkt_rtt_sample(rfilter, rtt);
+
+    if (rfilter->in_recovery &&
+		!seq_inside(rfilter, seq_diff(rfilter, rfilter->recover_seq, 1),
+			    rfilter->next_acked_seq, rfilter->next_send_seq))
+	rfilter->in_recovery = false;
+
+    /* Progress was made, restart the retransmit timeout. */
+    rfilter->rto_armed = rfilter->next_acked_seq != rfilter->next_send_seq;
+    if (rfilter->rto_armed)
+	rfilter->rto_deadline = now + rfilter->rto;
 
     return false;
 }
 
+/*
+ * Calculate the time until the next thing the timer needs to do, a
+ * retransmit, a delayed ack, or the once a second housekeeping.
+ */
+static void
+relpkt_next_timeout(struct relpkt_filter *rfilter, gensio_time *timeout)
+{
+    int64_t now = relpkt_now(rfilter), expiry = rfilter->next_housekeeping;
+
+    if (rfilter->rto_armed && rfilter->rto_deadline < expiry)
+	expiry = rfilter->rto_deadline;
+    if (rfilter->ack_armed && rfilter->ack_deadline < expiry)
+	expiry = rfilter->ack_deadline;
+    rfilter->timer_expiry = expiry;
+    if (expiry < now)
+	expiry = now;
+    timeout->secs = (expiry - now) / 1000000;
+    timeout->nsecs = ((expiry - now) % 1000000) * 1000;
+}
+
 static void
 relpkt_filter_start_timer(struct relpkt_filter *rfilter)
 {
-    gensio_time timeout = { 1, 0 };
+    gensio_time timeout;
 
+    relpkt_next_timeout(rfilter, &timeout);
     rfilter->filter_cb(rfilter->filter_cb_data,
 		       GENSIO_FILTER_CB_START_TIMER, &timeout);
 }
 
+/*
+ * If a retransmit or delayed ack is now due before the running timer
+ * goes off, restart the timer so it is not late.
+ */
+static void
+relpkt_check_timer(struct relpkt_filter *rfilter)
+{
+    bool restart = false;
+
+    if (rfilter->rto_armed && rfilter->rto_deadline < rfilter->timer_expiry)
+	restart = true;
+    if (rfilter->ack_armed && rfilter->ack_deadline < rfilter->timer_expiry)
+	restart = true;
+    if (!restart)
+	return;
+    rfilter->filter_cb(rfilter->filter_cb_data,
+		       GENSIO_FILTER_CB_STOP_TIMER, NULL);
+    relpkt_filter_start_timer(rfilter);
+}
+
+/*
+ * A packet was delivered to the user, which moves the ack forward.
+ * Ack right away every ack_every packets, otherwise wait a little for
+ * more packets or outgoing data to carry the ack.
+ *
+ * This is called from the lower layer's read, where the timer cannot
+ * be touched, so have the write side restart the timer if the ack
+ * needs to go out before it would go off.
+ */
+static void
+relpkt_delivered(struct relpkt_filter *rfilter, bool ackreq)
+{
+    rfilter->unacked_delivered++;
+    if (ackreq || rfilter->unacked_delivered >= rfilter->ack_every ||
+		rfilter->ack_delay == 0) {
+	send_ack(rfilter);
+    } else if (!rfilter->ack_armed && !rfilter->send_ack_pkt) {
+	rfilter->ack_armed = true;
+	rfilter->ack_deadline = relpkt_now(rfilter) + rfilter->ack_delay;
+	if (rfilter->ack_deadline < rfilter->timer_expiry)
+	    rfilter->timer_check_pending = true;
+    }
+}
+
 static void
 relpkt_set_callbacks(struct relpkt_filter *rfilter,
 		     gensio_filter_cb cb, void *cb_data)
@@ -489,7 +1020,8 @@ relpkt_ul_read_pending(struct relpkt_filter *rfilter)
 static bool
 relpkt_ll_write_pending(struct relpkt_filter *rfilter)
 {
-    return rfilter->nr_waiting_xmitpkt || rfilter->send_init_pkt ||
+    return (rfilter->nr_waiting_xmitpkt && first_xmitpkt_to_send(rfilter)) ||
+	rfilter->timer_check_pending || rfilter->send_init_pkt ||
 	rfilter->send_close_pkt || rfilter->send_resend_pkt ||
 	rfilter->send_ack_pkt;
 }
@@ -591,12 +1123,13 @@ relpkt_try_disconnect(struct relpkt_filter *rfilter, gensio_time *timeout,
 	    /* Nothing left to send, start the close process. */
 	    rfilter->state = RELPKT_WAITING_CLOSE_RSP;
 	    send_close(rfilter);
+	    timeout->secs = 1;
+	    timeout->nsecs = 0;
 	} else {
 	    /* Wait for output to clear. */
 	    rfilter->state = RELPKT_WAITING_CLOSE_CLEAR;
+	    relpkt_next_timeout(rfilter, timeout);
 	}
-	timeout->secs = 1;
-	timeout->nsecs = 0;
 	rv = GE_RETRY;
 	break;
 
@@ -609,8 +1142,7 @@ relpkt_try_disconnect(struct relpkt_filter *rfilter, gensio_time *timeout,
 	    rv = rfilter->err;
 	} else if (was_timeout) {
 	    i_relpkt_filter_timeout(rfilter);
-	    timeout->secs = 1;
-	    timeout->nsecs = 0;
+	    relpkt_next_timeout(rfilter, timeout);
 	    rv = GE_RETRY;
 	} else {
 	    rv = GE_INPROGRESS;
@@ -649,14 +1181,20 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 		const char *const *auxdata)
 {
     struct gensio_sg rsg = { NULL, 0 };
-    struct pkt *p = NULL;
+    struct pkt *p = NULL, *xp = NULL;
     unsigned int nrqueued;
     int err = 0;
     bool *endbool = NULL;
     bool finish_close = false;
 
     relpkt_lock(rfilter);
-    nrqueued = rfilter->next_send_seq - rfilter->next_acked_seq;
+    if (rfilter->timer_check_pending) {
+	rfilter->timer_check_pending = false;
+	relpkt_check_timer(rfilter);
+    }
+
+    nrqueued = seq_diff(rfilter, rfilter->next_send_seq,
+			rfilter->next_acked_seq);
     if (sglen == 0 || nrqueued >= rfilter->max_xmitpkt) {
 	if (rcount)
 	    *rcount = 0;
@@ -676,7 +1214,7 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 		inlen = rfilter->max_xmit_pktsize - p->len;
 		trunc = true;
 	    }
-	    memcpy(p->data + p->len + 3, buf, inlen);
+	    memcpy(p->data + p->len + rfilter->hdrlen, buf, inlen);
 	    writelen += inlen;
 	    p->len += inlen;
 	    if (p->len == rfilter->max_xmit_pktsize)
@@ -689,33 +1227,48 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 	    if (!trunc && gensio_str_in_auxdata(auxdata, "eom"))
 		p->eom = true;
 	    p->data[0] = (RELPKT_MSG_DATA << 4) | (uint8_t) p->eom;
-	    /* Ack (byte 1) will be filled in on transmit. */
-	    p->data[2] = rfilter->next_send_seq;
-	    rfilter->next_send_seq++;
+	    /* Ack will be filled in on transmit. */
+	    put_seq(rfilter, p->data + 1 + seq_size(rfilter),
+		    rfilter->next_send_seq);
+	    rfilter->next_send_seq = seq_add(rfilter, rfilter->next_send_seq, 1);
 	    p->sent = false;
-	    p->len += 3; /* For the header. */
+	    p->resent = false;
+	    p->len += rfilter->hdrlen; /* For the header. */
 	    rfilter->nr_waiting_xmitpkt++;
 	}
     }
 
+    if (rfilter->send_resend_pkt && rfilter->version >= 1) {
+	build_resend_bitmap(rfilter);
+	if (!rfilter->resend_pkt_len)
+	    /* Everything requested has arrived. */
+	    rfilter->send_resend_pkt = false;
+    }
+
+    if (rfilter->nr_waiting_xmitpkt)
+	xp = first_xmitpkt_to_send(rfilter);
+
     if (rfilter->send_init_pkt) {
 	rsg.buf = rfilter->init_pkt;
-	rsg.buflen = 5;
+	rsg.buflen = rfilter->version >= 1 ? 7 : 5;
 	endbool = &rfilter->send_init_pkt;
-    } else if (rfilter->nr_waiting_xmitpkt) {
-	p = first_xmitpkt_to_send(rfilter);
+    } else if (xp) {
+	p = xp;
 	rsg.buf = p->data;
 	rsg.buflen = p->len;
-	p->data[1] = rfilter->next_deliver_seq; /* Add the ack */
-	rfilter->send_ack_pkt = false;
+	/* Add the ack */
+	put_seq(rfilter, p->data + 1, rfilter->next_deliver_seq);
+	if (rfilter->version >= 1)
+	    set_ackreq(rfilter, p);
     } else if (rfilter->send_resend_pkt) {
 	rsg.buf = rfilter->resend_pkt;
 	rsg.buflen = rfilter->resend_pkt_len;
 	endbool = &rfilter->send_resend_pkt;
     } else if (rfilter->send_ack_pkt) {
-	rfilter->ack_pkt[1] = rfilter->next_deliver_seq;
+	put_seq(rfilter, (unsigned char *) rfilter->ack_pkt + 1,
+		rfilter->next_deliver_seq);
 	rsg.buf = rfilter->ack_pkt;
-	rsg.buflen = 3;
+	rsg.buflen = rfilter->hdrlen;
 	endbool = &rfilter->send_ack_pkt;
     } else if (rfilter->send_close_pkt) {
 	rsg.buf = rfilter->close_pkt;
@@ -753,12 +1306,27 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 		err = GE_TOOBIG;
 	    } else if (count != 0) {
 		if (p) {
+		    /* The ack was piggybacked on the data. */
+		    ack_sent(rfilter);
 		    p->sent = true;
 		    assert(rfilter->nr_waiting_xmitpkt);
 		    rfilter->nr_waiting_xmitpkt--;
 		    rfilter->send_since_timeout = true;
+		    if (p->resent)
+			rfilter->retransmits++;
+		    p->send_time = relpkt_now(rfilter);
+		    if (!rfilter->rto_armed) {
+			rfilter->rto_armed = true;
+			rfilter->rto_deadline = p->send_time + rfilter->rto;
+			relpkt_check_timer(rfilter);
+		    }
 		} else {
 		    *endbool = false;
+		    if (endbool == &rfilter->send_ack_pkt)
+			ack_sent(rfilter);
+		    if (endbool == &rfilter->send_resend_pkt &&
+				rfilter->version >= 1)
+			resend_bitmap_sent(rfilter);
 		    if (finish_close) {
 			rfilter->err = GE_REMCLOSE;
 			err = GE_REMCLOSE;
@@ -782,7 +1350,7 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
     int err = 0;
     static const char *eomaux[2] = { "eom", NULL };
     bool response;
-    uint8_t seq, endseq, pos, ppos;
+    unsigned int seq, endseq, pos, ppos;
     unsigned int i;
     struct pkt *p;
 
@@ -822,14 +1390,8 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 
 	case RELPKT_WAITING_INIT:
 	    if (!response) {
-		rfilter->max_xmitpkt = buf[2];
-		if (rfilter->max_xmitpkt == 0)
+		if (handle_init(rfilter, buf, buflen))
 		    goto protocol_err;
-		if (rfilter->max_xmitpkt > rfilter->max_pkt)
-		    rfilter->max_xmitpkt = rfilter->max_pkt;
-		rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
-		if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
-		    rfilter->max_xmit_pktsize = rfilter->max_pktsize;
 		send_init(rfilter, true);
 		rfilter->state = RELPKT_OPEN;
 		relpkt_filter_start_timer(rfilter);
@@ -838,12 +1400,8 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 
 	case RELPKT_WAITING_INIT_RSP:
 	    if (response) {
-		rfilter->max_xmitpkt = buf[2];
-		if (rfilter->max_xmitpkt > rfilter->max_pkt)
-		    rfilter->max_xmitpkt = rfilter->max_pkt;
-		rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
-		if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
-		    rfilter->max_xmit_pktsize = rfilter->max_pktsize;
+		if (handle_init(rfilter, buf, buflen))
+		    goto protocol_err;
 		rfilter->state = RELPKT_OPEN;
 		relpkt_filter_start_timer(rfilter);
 	    }
@@ -874,9 +1432,13 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 
 	case RELPKT_OPEN:
 	case RELPKT_WAITING_CLOSE_CLEAR:
-	    if (buflen > rfilter->max_pktsize + 3)
+	    if (buflen < rfilter->hdrlen)
+		goto protocol_err;
+	    if (buflen > rfilter->max_pktsize + rfilter->hdrlen)
 		goto protocol_err;
-	    if (handle_ack(rfilter, buf[1]))
+	    if (handle_ack(rfilter, get_seq(rfilter, buf + 1),
+			   buflen == rfilter->hdrlen &&
+			   rfilter->version >= 1 && buf[0] & 4))
 		goto protocol_err;
 	    if (rfilter->state != RELPKT_OPEN) {
 		/* Only deliver data in open state */
@@ -888,29 +1450,51 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 		}
 		break;
 	    }
-	    if (buflen == 3) /* Just an ack */
+	    if (buflen == rfilter->hdrlen) /* Just an ack */
+		break;
+	    seq = get_seq(rfilter, buf + 1 + seq_size(rfilter));
+	    pos = seq_diff(rfilter, seq, rfilter->next_deliver_seq);
+	    if (pos >= rfilter->recv_pkt) {
+		/*
+		 * Already delivered, the remote end probably missed
+		 * our ack.  Ack it again, but ignore the data.
+		 */
+		send_ack(rfilter);
 		break;
-	    seq = buf[2];
-	    pos = seq - rfilter->next_deliver_seq;
-	    if (seq - rfilter->next_deliver_seq > rfilter->max_pkt)
-		break; /* Ignore it */
+	    }
 	    ppos = recvpkt_pos(rfilter, pos);
 	    if (seq == rfilter->next_expected_seq) {
-		rfilter->next_expected_seq++;
-	    } else if (!seq_inside(seq, rfilter->next_deliver_seq,
+		rfilter->next_expected_seq = seq_add(rfilter, seq, 1);
+		/*
+		 * In order, the ack is normally sent when it's delivered.
+		 * But if something before it is missing, keep the acks
+		 * coming so the remote end knows about the hole.
+		 */
+		if (seq != rfilter->next_deliver_seq &&
+			!rfilter->recvpkts[rfilter->deliver_recvpkt].ready)
+		    send_dupack(rfilter);
+	    } else if (!seq_inside(rfilter, seq, rfilter->next_deliver_seq,
 				  rfilter->next_expected_seq)) {
-		request_resend(rfilter, rfilter->next_expected_seq, seq - 1);
-		rfilter->next_expected_seq = seq + 1;
+		request_resend(rfilter, rfilter->next_expected_seq,
+			       seq_diff(rfilter, seq, 1));
+		rfilter->next_expected_seq = seq_add(rfilter, seq, 1);
+		/* Let the remote end know immediately something is missing. */
+		send_dupack(rfilter);
+	    } else {
+		/* Filling in a hole, ack right away. */
+		send_ack(rfilter);
 	    }
 	    p = &(rfilter->recvpkts[ppos]);
 	    if (!p->ready) {
-		memcpy(p->data, buf + 3, buflen - 3);
-		p->len = buflen - 3;
+		memcpy(p->data, buf + rfilter->hdrlen,
+		       buflen - rfilter->hdrlen);
+		p->len = buflen - rfilter->hdrlen;
 		p->start = 0;
 		p->ready = true;
+		p->nak = false;
 		p->eom = buf[0] & 1;
+		p->ackreq = rfilter->version >= 1 && buf[0] & 2;
 	    }
-	    send_ack(rfilter);
 	    break;
 
 	default:
@@ -929,6 +1513,29 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	case RELPKT_OPEN:
 	case RELPKT_WAITING_CLOSE_CLEAR:
 	case RELPKT_WAITING_CLOSE_RSP:
+	    /* The remote end lost something, treat it as congestion. */
+	    relpkt_congestion_event(rfilter, false);
+	    if (rfilter->version >= 1) {
+		seq = get_seq(rfilter, buf + 1);
+		buf += 3;
+		buflen -= 3;
+		if (buflen > (rfilter->max_xmitpkt + 7) / 8)
+		    goto protocol_err;
+		for (i = 0; i < buflen * 8; i++) {
+		    if (!(buf[i / 8] & (1 << (i % 8))))
+			continue;
+		    endseq = seq_add(rfilter, seq, i);
+		    /*
+		     * An ack may pass the resend request, just ignore
+		     * anything that has already been acked.
+		     */
+		    if (!seq_inside(rfilter, endseq, rfilter->next_acked_seq,
+				    rfilter->next_send_seq))
+			continue;
+		    resend_packets(rfilter, endseq, seq_add(rfilter, endseq, 1));
+		}
+		break;
+	    }
 	    buf++;
 	    buflen--;
 	    if (buflen % 2 != 0) /* Should be pairs of sequence numbers. */
@@ -936,13 +1543,13 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	    for (i = 0; i < buflen; i += 2) {
 		seq = buf[i];
 		endseq = buf[i + 1];
-		if (!seq_inside(seq, rfilter->next_acked_seq,
+		if (!seq_inside(rfilter, seq, rfilter->next_acked_seq,
 				rfilter->next_send_seq))
 		    goto protocol_err;
-		if (!seq_inside(endseq, rfilter->next_acked_seq,
+		if (!seq_inside(rfilter, endseq, rfilter->next_acked_seq,
 				rfilter->next_send_seq))
 		    goto protocol_err;
-		resend_packets(rfilter, seq, endseq + 1);
+		resend_packets(rfilter, seq, seq_add(rfilter, endseq, 1));
 	    }
 	    break;
 
@@ -994,7 +1601,9 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	    if (count >= p->len - p->start) {
 		p->ready = false;
 		rfilter->deliver_recvpkt = recvpkt_pos(rfilter, 1);
-		rfilter->next_deliver_seq++;
+		rfilter->next_deliver_seq = seq_add(rfilter,
+						    rfilter->next_deliver_seq, 1);
+		relpkt_delivered(rfilter, p->ackreq);
 	    } else {
 		p->start += count;
 	    }
@@ -1022,6 +1631,7 @@ relpkt_filter_cleanup(struct relpkt_filter *rfilter)
 
     rfilter->state = RELPKT_CLOSED;
     rfilter->err = 0;
+    relpkt_set_version(rfilter, rfilter->max_version);
     rfilter->next_expected_seq = 0;
     rfilter->next_deliver_seq = 0;
     rfilter->deliver_recvpkt = 0;
@@ -1035,11 +1645,18 @@ relpkt_filter_cleanup(struct relpkt_filter *rfilter)
     rfilter->send_close_pkt = false;
     rfilter->close_retry_count = 0;
     rfilter->send_resend_pkt = false;
+    rfilter->resend_pkt_len = 0;
     rfilter->send_ack_pkt = false;
+    rfilter->rto_armed = false;
+    rfilter->ack_armed = false;
+    rfilter->unacked_delivered = 0;
+    rfilter->timer_check_pending = false;
+    rfilter->retransmits = 0;
     for (i = 0; i < rfilter->max_pkt; i++) {
 	struct pkt *p = &rfilter->recvpkts[i];
 
 	p->ready = false;
+	p->nak = false;
     }
 }
 
@@ -1047,25 +1664,19 @@ static void
 relpkt_free(struct relpkt_filter *rfilter)
 {
     struct gensio_os_funcs *o = rfilter->o;
-    gensiods i;
 
     if (rfilter->lock)
 	o->free_lock(rfilter->lock);
-    if (rfilter->recvpkts) {
-	for (i = 0; i < rfilter->max_pkt; i++) {
-	    if (rfilter->recvpkts[i].data)
-		o->free(o, rfilter->recvpkts[i].data);
-	}
+    if (rfilter->recvpkts)
 	o->free(o, rfilter->recvpkts);
-    }
-    if (rfilter->xmitpkts) {
-	/* Yes, the below is max_pkt for xmit.  That's the array size. */
-	for (i = 0; i < rfilter->max_pkt; i++) {
-	    if (rfilter->xmitpkts[i].data)
-		o->free(o, rfilter->xmitpkts[i].data);
-	}
+    if (rfilter->recvbuf)
+	o->free(o, rfilter->recvbuf);
+    if (rfilter->xmitpkts)
 	o->free(o, rfilter->xmitpkts);
-    }
+    if (rfilter->xmitbuf)
+	o->free(o, rfilter->xmitbuf);
+    if (rfilter->resend_pkt)
+	o->free(o, rfilter->resend_pkt);
     if (rfilter->filter)
 	gensio_filter_free_data(rfilter->filter);
     rfilter->o->free(rfilter->o, rfilter);
@@ -1074,34 +1685,38 @@ relpkt_free(struct relpkt_filter *rfilter)
 static void
 i_relpkt_filter_timeout(struct relpkt_filter *rfilter)
 {
-    rfilter->timeouts_since_ack++;
-    if (rfilter->timeouts_since_ack > 5) {
-	rfilter->err = GE_TIMEDOUT;
-	goto out;
+    int64_t now = relpkt_now(rfilter);
+
+    if (now >= rfilter->next_housekeeping) {
+	rfilter->next_housekeeping = now + RELPKT_HOUSEKEEPING;
+	rfilter->timeouts_since_ack++;
+	if (rfilter->timeouts_since_ack > 5) {
+	    rfilter->err = GE_TIMEDOUT;
+	    goto out;
+	}
+
+	if (rfilter->send_since_timeout)
+	    rfilter->send_since_timeout = false;
+	else
+	    send_ack(rfilter);
     }
 
-    if (rfilter->send_since_timeout)
-	rfilter->send_since_timeout = false;
-    else
+    if (rfilter->ack_armed && now >= rfilter->ack_deadline)
 	send_ack(rfilter);
 
-    if (rfilter->next_acked_seq != rfilter->next_send_seq) {
-	if (rfilter->next_acked_seq == rfilter->last_timeout_ack) {
-	    rfilter->timeout_ack_count++;
-	    if (rfilter->timeout_ack_count > 1) {
-		/* 
-		 * We haven't received an ack for something we sent.
-		 * The packet must have been dropped.  Resend.
-		 */
-		resend_packets(rfilter, rfilter->next_acked_seq,
-			       rfilter->next_send_seq);
-		rfilter->timeout_ack_count = 0;
-	    }
-	} else {
-	    rfilter->timeout_ack_count = 0;
-	    rfilter->last_timeout_ack = rfilter->next_acked_seq;
-	}
-	
+    if (rfilter->rto_armed && now >= rfilter->rto_deadline) {
+	/*
+	 * We haven't received an ack for something we sent in the
+	 * retransmit time.  The packets must have been dropped.
+	 * Back off and resend.
+	 */
+	resend_packets(rfilter, rfilter->next_acked_seq,
+		       rfilter->next_send_seq);
+	relpkt_congestion_event(rfilter, true);
+	rfilter->rto *= 2;
+	if (rfilter->rto > RELPKT_MAX_RTO)
+	    rfilter->rto = RELPKT_MAX_RTO;
+	rfilter->rto_deadline = now + rfilter->rto;
     }
  out:
     relpkt_filter_start_timer(rfilter);
@@ -1115,6 +1730,37 @@ relpkt_filter_timeout(struct relpkt_filter *rfilter)
     relpkt_unlock(rfilter);
 }
 
+static int
+relpkt_filter_control(struct relpkt_filter *rfilter, bool get, int op,
+		      char *data, gensiods *datalen)
+{
+    int rv = 0;
+
+    if (!get)
+	return GE_NOTSUP;
+
+    relpkt_lock(rfilter);
+    switch (op) {
+    case GENSIO_CONTROL_RTT:
+	*datalen = snprintf(data, *datalen, "%lld", (long long) rfilter->srtt);
+	break;
+
+    case GENSIO_CONTROL_CWND:
+	*datalen = snprintf(data, *datalen, "%u", rfilter->cwnd);
+	break;
+
+    case GENSIO_CONTROL_RETRANSMITS:
+	*datalen = snprintf(data, *datalen, "%u", rfilter->retransmits);
+	break;
+
+    default:
+	rv = GE_NOTSUP;
+    }
+    relpkt_unlock(rfilter);
+
+    return rv;
+}
+
 static int gensio_relpkt_filter_func(struct gensio_filter *filter, int op,
 				     const void *func, void *data,
 				     gensiods *count,
@@ -1171,7 +1817,8 @@ static int gensio_relpkt_filter_func(struct gensio_filter *filter, int op,
 	return 0;
 
     case GENSIO_FILTER_FUNC_CONTROL:
-	return GE_NOTSUP;
+	return relpkt_filter_control(rfilter, *((bool *) cbuf), buflen, data,
+				     count);
 
     default:
 	return GE_NOTSUP;
@@ -1181,7 +1828,8 @@ static int gensio_relpkt_filter_func(struct gensio_filter *filter, int op,
 static struct gensio_filter *
 gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
 			       gensiods max_pktsize, gensiods max_packets,
-			       bool server)
+			       unsigned int ack_every, unsigned int ack_delay,
+			       unsigned int max_version, bool server)
 {
     struct relpkt_filter *rfilter;
     gensiods i;
@@ -1199,24 +1847,45 @@ gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
 
     rfilter->max_pkt = max_packets;
     rfilter->max_pktsize = max_pktsize;
+    rfilter->max_version = max_version;
+    rfilter->ack_every = ack_every;
+    rfilter->ack_delay = (int64_t) ack_delay * 1000;
+    relpkt_set_version(rfilter, rfilter->max_version);
 
+    /*
+     * The packet data is allocated in one block per direction, with
+     * a large window that's a lot of allocations otherwise.
+     */
     rfilter->recvpkts = o->zalloc(o, sizeof(struct pkt) * max_packets);
     if (!rfilter->recvpkts)
 	goto out_nomem;
-    for (i = 0; i < max_packets; i++) {
-	rfilter->recvpkts[i].data = o->zalloc(o, max_pktsize);
-	if (!rfilter->recvpkts[i].data)
-	    goto out_nomem;
-    }
+    rfilter->recvbuf = o->zalloc(o, max_pktsize * max_packets);
+    if (!rfilter->recvbuf)
+	goto out_nomem;
+    for (i = 0; i < max_packets; i++)
+	rfilter->recvpkts[i].data = rfilter->recvbuf + i * max_pktsize;
 
     rfilter->xmitpkts = o->zalloc(o, sizeof(struct pkt) * max_packets);
     if (!rfilter->xmitpkts)
 	goto out_nomem;
-    for (i = 0; i < max_packets; i++) {
-	rfilter->xmitpkts[i].data = o->zalloc(o, max_pktsize + 3);
-	if (!rfilter->xmitpkts[i].data)
-	    goto out_nomem;
-    }
+    rfilter->xmitbuf = o->zalloc(o, ((max_pktsize + RELPKT_MAX_HDRLEN)
+				     * max_packets));
+    if (!rfilter->xmitbuf)
+	goto out_nomem;
+    for (i = 0; i < max_packets; i++)
+	rfilter->xmitpkts[i].data = (rfilter->xmitbuf +
+				     i * (max_pktsize + RELPKT_MAX_HDRLEN));
+
+    /*
+     * Version 0 resends are pairs of sequence numbers, there is a
+     * fixed limit on those.  Version 1 needs a bit per packet.
+     */
+    rfilter->resend_pkt_size = 3 + (max_packets + 7) / 8;
+    if (rfilter->resend_pkt_size < 51)
+	rfilter->resend_pkt_size = 51;
+    rfilter->resend_pkt = o->zalloc(o, rfilter->resend_pkt_size);
+    if (!rfilter->resend_pkt)
+	goto out_nomem;
 
     rfilter->filter = gensio_filter_alloc_data(o, gensio_relpkt_filter_func,
 					       rfilter);
@@ -1233,15 +1902,22 @@ gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
 int
 gensio_relpkt_filter_alloc(struct gensio_os_funcs *o,
 			   const char * const args[],
-			   bool server, struct gensio_filter **rfilter)
+			   bool server, bool datagram,
+			   struct gensio_filter **rfilter)
 {
     struct gensio_filter *filter;
     unsigned int i;
-    gensiods max_pktsize = 123; /* FIXME - magic number. */
-    gensiods max_packets = 16;
+    gensiods max_pktsize = RELPKT_DEFAULT_PKTSIZE;
+    gensiods max_packets = RELPKT_DEFAULT_PACKETS;
+    unsigned int max_version = RELPKT_VERSION;
+    unsigned int ack_every = RELPKT_DEFAULT_ACK_EVERY;
+    unsigned int ack_delay = RELPKT_DEFAULT_ACK_DELAY;
     char *str = NULL;
     int rv;
 
+    if (datagram)
+	max_pktsize = RELPKT_DEFAULT_DGRAM_PKTSIZE;
+
     rv = gensio_get_default(o, "relpkt", "mode", false,
 			    GENSIO_DEFAULT_STR, &str, NULL);
     if (rv) {
@@ -1266,13 +1942,30 @@ gensio_relpkt_filter_alloc(struct gensio_os_funcs *o,
 	    continue;
 	if (gensio_check_keyds(args[i], "max_packets", &max_packets) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "ack_every", &ack_every) > 0)
+	    continue;
+	if (gensio_check_keyuint(args[i], "ack_delay", &ack_delay) > 0)
+	    continue;
+	if (gensio_check_keyuint(args[i], "version", &max_version) > 0)
+	    continue;
 	if (gensio_check_keyboolv(args[i], "mode", "server", "client",
 				  &server) > 0)
 	    continue;
 	return GE_INVAL;
     }
 
+    /* These have to fit in the init message. */
+    if (max_pktsize == 0 || max_pktsize > 65535)
+	return GE_INVAL;
+    if (max_packets == 0 || max_packets > RELPKT_MAX_PACKETS)
+	return GE_INVAL;
+    if (ack_every == 0)
+	return GE_INVAL;
+    if (max_version > RELPKT_VERSION)
+	return GE_INVAL;
+
     filter = gensio_relpkt_filter_raw_alloc(o, max_pktsize, max_packets,
+					    ack_every, ack_delay, max_version,
 					    server);
     if (!filter)
 	return GE_NOMEM;
@@ -12,7 +12,7 @@
 
 int gensio_relpkt_filter_alloc(struct gensio_os_funcs *o,
 			       const char * const args[],
-			       bool default_is_server,
+			       bool default_is_server, bool datagram,
 			       struct gensio_filter **rfilter);
 
 #endif /* GENSIO_FILTER_RELPKT_H */
@@ -205,12 +205,14 @@ telnet_ul_write(struct gensio_filter *filter,
 	    gensiods inlen = sg[i].buflen;
 	    const unsigned char *buf = sg[i].buf;
 
-	    tfilter->write_data_len =
-		process_telnet_xmit(tfilter->write_data,
-				    tfilter->max_write_size,
+	    tfilter->write_data_len +=
+		process_telnet_xmit(tfilter->write_data +
+				    tfilter->write_data_len,
+				    tfilter->max_write_size -
+				    tfilter->write_data_len,
 				    &buf, &inlen);
 	    writelen += sg[i].buflen - inlen;
-	    if (inlen != sg[i].buflen)
+	    if (inlen)
 		break;
 	}
 	if (rcount)
@@ -312,6 +314,37 @@ telnet_ll_write(struct gensio_filter *filter,
 	    }
 	}
 
+	if (inlen > 0 && tfilter->tn_data.telnet_cmd_pos == 0) {
+	    /*
+	     * Deliver the data up to the next IAC straight from the
+	     * lower layer's buffer.  Only data after a command has to
+	     * be copied into read_data.  If the user doesn't take it
+	     * all, the lower layer keeps the rest.
+	     */
+	    unsigned char *p = memchr(buf, TN_IAC, inlen);
+	    gensiods run = p ? (gensiods) (p - buf) : inlen, count = 0;
+
+	    if (run) {
+		telnet_unlock(tfilter);
+		err = handler(cb_data, &count, buf, run, NULL);
+		telnet_lock(tfilter);
+		if (err) {
+		    /* Urgent data skipped before the run was consumed. */
+		    if (rcount)
+			*rcount = buflen - inlen;
+		    goto out_unlock;
+		}
+		if (count > run)
+		    count = run;
+		buf += count;
+		inlen -= count;
+		if (rcount)
+		    *rcount = buflen - inlen;
+		if (count < run || inlen == 0)
+		    goto out_unlock;
+	    }
+	}
+
 	/*
 	 * Process the telnet receive data unlocked.  It can do callbacks to
 	 * the users, and we are guaranteed to be single-threaded in the
@@ -10,8 +10,15 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <ctype.h>
+#if HAVE_MMAP
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include <gensio/gensio_class.h>
+#include <gensio/gensio_osops.h>
 
 #include "gensio_filter_trace.h"
 
@@ -22,6 +29,21 @@ enum trace_dir {
     TRACE_BOTH
 };
 
+#define TRACE_DEFAULT_BUFSIZE	(1024 * 1024)
+#define TRACE_MIN_BUFSIZE	4096
+
+#define TRACE_DEFAULT_SEGSIZE	(16 * 1024 * 1024)
+#define TRACE_MIN_SEGSIZE	4096
+#define TRACE_DEFAULT_SEGMENTS	4
+
+#if HAVE_MMAP
+struct trace_cap_seg {
+    int fd;
+    unsigned char *map; /* NULL if not in use. */
+    gensiods pos;
+};
+#endif
+
 struct trace_filter {
     struct gensio_filter *filter;
 
@@ -36,6 +58,48 @@ struct trace_filter {
     bool tr_stderr;
 
     FILE *tr;
+
+    bool binary;
+    unsigned int dropped;
+
+#if HAVE_MMAP
+    /*
+     * Capture output goes into a rotating set of pre-sized segment
+     * files that are memory mapped, so adding a record is just a
+     * copy.  Segment n is named "<capture>.<n>", cap is the one being
+     * written.  The capture worker prepares the next segment in
+     * cap_spare ahead of time and finishes the old one from
+     * cap_retire after a switch, those two are protected by the
+     * worker lock.
+     */
+    char *capture;
+    gensiods segsize;
+    unsigned int segments;
+    unsigned int cap_seg;
+    uint64_t cap_seq;
+    struct trace_cap_seg cap;
+    struct trace_cap_seg cap_spare;
+    struct trace_cap_seg cap_retire;
+    unsigned int cap_retire_newseg;
+    struct gensio_os_worker *cap_worker;
+    unsigned int cap_dropped;
+#endif
+
+#ifdef USE_PTHREADS
+    /*
+     * In binary mode records go into a ring buffer and a worker
+     * thread writes them to the file.  There is only one producer
+     * (callers hold the filter lock) and one consumer, so head and
+     * tail are just atomics.  Producers only touch the worker lock to
+     * wake the writer when the buffer is getting full.
+     */
+    unsigned char *ring;
+    gensiods ring_size;
+    gensiods head;
+    gensiods tail;
+    bool writer_idle;
+    struct gensio_os_worker *writer;
+#endif
 };
 
 #define filter_to_trace(v) ((struct trace_filter *) \
@@ -77,6 +141,90 @@ trace_check_open_done(struct gensio_filter *filter, struct gensio *io)
     return 0;
 }
 
+#if HAVE_MMAP
+static void trace_cap_find_start(struct trace_filter *tfilter);
+static int trace_cap_open_seg(struct trace_filter *tfilter, const char *name,
+			      struct trace_cap_seg *seg);
+static void trace_cap_use_seg(struct trace_filter *tfilter,
+			      struct trace_cap_seg *seg);
+static void trace_cap_close(struct trace_filter *tfilter);
+#endif
+
+#ifdef USE_PTHREADS
+static void
+trace_ring_write(struct trace_filter *tfilter, gensiods tail, gensiods head)
+{
+    gensiods pos = tail % tfilter->ring_size;
+    gensiods len = head - tail;
+
+    if (pos + len > tfilter->ring_size) {
+	fwrite(tfilter->ring + pos, 1, tfilter->ring_size - pos, tfilter->tr);
+	len -= tfilter->ring_size - pos;
+	pos = 0;
+    }
+    fwrite(tfilter->ring + pos, 1, len, tfilter->tr);
+    fflush(tfilter->tr);
+}
+
+static void
+trace_writer(struct gensio_os_worker *w, void *cb_data)
+{
+    struct trace_filter *tfilter = cb_data;
+    gensio_time timeout;
+    gensiods head, tail;
+
+    gensio_os_worker_lock(w);
+    for (;;) {
+	head = __atomic_load_n(&tfilter->head, __ATOMIC_ACQUIRE);
+	tail = tfilter->tail;
+	if (head == tail) {
+	    /* Everything is written before the thread stops. */
+	    if (gensio_os_worker_stopping(w))
+		break;
+	    /* Wake up periodically so data doesn't sit around too long. */
+	    timeout.secs = 0;
+	    timeout.nsecs = 100000000;
+	    __atomic_store_n(&tfilter->writer_idle, true, __ATOMIC_RELEASE);
+	    gensio_os_worker_wait(w, &timeout);
+	    __atomic_store_n(&tfilter->writer_idle, false, __ATOMIC_RELEASE);
+	    continue;
+	}
+	gensio_os_worker_unlock(w);
+	trace_ring_write(tfilter, tail, head);
+	__atomic_store_n(&tfilter->tail, head, __ATOMIC_RELEASE);
+	gensio_os_worker_lock(w);
+    }
+    gensio_os_worker_unlock(w);
+}
+
+static int
+trace_writer_start(struct trace_filter *tfilter)
+{
+    tfilter->head = 0;
+    tfilter->tail = 0;
+    return gensio_os_worker_start(tfilter->writer);
+}
+#endif
+
+static void
+trace_close_file(struct trace_filter *tfilter)
+{
+#ifdef USE_PTHREADS
+    /* Normally already stopped by trace_try_disconnect(). */
+    if (tfilter->writer)
+	gensio_os_worker_stop_wait(tfilter->writer);
+#endif
+    if (!tfilter->tr_stdout && !tfilter->tr_stderr && tfilter->tr)
+	fclose(tfilter->tr);
+    else if (tfilter->tr)
+	fflush(tfilter->tr);
+    tfilter->tr = NULL;
+#if HAVE_MMAP
+    if (tfilter->capture)
+	trace_cap_close(tfilter);
+#endif
+}
+
 static int
 trace_try_connect(struct gensio_filter *filter, gensio_time *timeout)
 {
@@ -91,6 +239,38 @@ trace_try_connect(struct gensio_filter *filter, gensio_time *timeout)
 	if (!tfilter->tr)
 	    return GE_PERM;
     }
+#ifdef USE_PTHREADS
+    if (tfilter->tr && tfilter->binary) {
+	int err = trace_writer_start(tfilter);
+
+	if (err) {
+	    trace_close_file(tfilter);
+	    return err;
+	}
+    }
+#endif
+#if HAVE_MMAP
+    if (tfilter->capture) {
+	char name[strlen(tfilter->capture) + 12];
+	struct trace_cap_seg seg;
+	int err;
+
+	trace_cap_find_start(tfilter);
+	tfilter->cap_dropped = 0;
+	snprintf(name, sizeof(name), "%s.%u", tfilter->capture,
+		 tfilter->cap_seg);
+	err = trace_cap_open_seg(tfilter, name, &seg);
+	if (!err) {
+	    trace_cap_use_seg(tfilter, &seg);
+	    if (tfilter->cap_worker)
+		err = gensio_os_worker_start(tfilter->cap_worker);
+	}
+	if (err) {
+	    trace_close_file(tfilter);
+	    return err;
+	}
+    }
+#endif
     return 0;
 }
 
@@ -98,22 +278,50 @@ static int
 trace_try_disconnect(struct gensio_filter *filter, gensio_time *timeout)
 {
     struct trace_filter *tfilter = filter_to_trace(filter);
-
-    if (!tfilter->tr_stdout && !tfilter->tr_stderr && tfilter->tr)
-	fclose(tfilter->tr);
-    tfilter->tr = NULL;
+#ifdef USE_PTHREADS
+    bool running = false;
+
+    /*
+     * Let the workers finish up and exit.  The trace file may be a
+     * pipe that is slow to take the data, so don't block for it.
+     */
+    if (tfilter->writer && gensio_os_worker_running(tfilter->writer)) {
+	gensio_os_worker_stop(tfilter->writer);
+	running = true;
+    }
+#if HAVE_MMAP
+    if (tfilter->cap_worker && gensio_os_worker_running(tfilter->cap_worker)) {
+	gensio_os_worker_stop(tfilter->cap_worker);
+	running = true;
+    }
+#endif
+    if (running) {
+	timeout->secs = 0;
+	timeout->nsecs = 10000000;
+	return GE_RETRY;
+    }
+#endif
+    trace_close_file(tfilter);
     return 0;
 }
 
-struct dump_history {
-    unsigned int column;
-    unsigned int pos;
-    unsigned char data[16];
-};
+void
+gensio_trace_print_rec(FILE *f, int64_t secs, int32_t nsecs,
+		       const char *op, int err, gensiods len)
+{
+    if (err)
+	fprintf(f, "%ld:%6.6d %s error: %d %s\n",
+		(long) secs, (nsecs + 500) / 1000, op,
+		err, gensio_err_to_str(err));
+    else
+	fprintf(f, "%ld:%6.6d %s (%lu):\n",
+		(long) secs, (nsecs + 500) / 1000,
+		op, (unsigned long) len);
+}
 
-static void
-dump_buf(FILE *f, const unsigned char *buf, gensiods len,
-	 struct dump_history *h)
+void
+gensio_trace_dump_buf(FILE *f, const unsigned char *buf, gensiods len,
+		      struct gensio_trace_dump_history *h)
 {
     gensiods i, j;
 
@@ -137,8 +345,8 @@ dump_buf(FILE *f, const unsigned char *buf, gensiods len,
     }
 }
 
-static void
-dump_buf_finish(FILE *f, struct dump_history *h)
+void
+gensio_trace_dump_buf_finish(FILE *f, struct gensio_trace_dump_history *h)
 {
     gensiods i;
 
@@ -161,15 +369,13 @@ trace_data(const char *op, struct gensio_os_funcs *o,
 	   FILE *f, bool raw, int err, gensiods written,
 	   const struct gensio_sg *sg, gensiods sglen)
 {
-    struct dump_history h;
+    struct gensio_trace_dump_history h;
     gensio_time time;
 
     o->get_monotonic_time(o, &time);
     if (err) {
 	if (!raw) {
-	    fprintf(f, "%ld:%6.6d %s error: %d %s\n",
-		    time.secs, (time.nsecs + 500) / 1000, op,
-		    err, gensio_err_to_str(err));
+	    gensio_trace_print_rec(f, time.secs, time.nsecs, op, err, 0);
 	    fflush(f);
 	}
     } else if (written > 0) {
@@ -177,9 +383,7 @@ trace_data(const char *op, struct gensio_os_funcs *o,
 
 	memset(&h, 0, sizeof(h));
 	if (!raw)
-	    fprintf(f, "%ld:%6.6d %s (%lu):\n",
-		    time.secs, (time.nsecs + 500) / 1000,
-		    op, (unsigned long) written);
+	    gensio_trace_print_rec(f, time.secs, time.nsecs, op, 0, written);
 	for (i = 0; i < sglen && written > 0; i++, written -= len) {
 	    if (sg[i].buflen > written)
 		len = written;
@@ -188,13 +392,503 @@ trace_data(const char *op, struct gensio_os_funcs *o,
 	    if (raw)
 		fwrite(sg[i].buf, 1, len, f);
 	    else
-		dump_buf(f, sg[i].buf, len, &h);
+		gensio_trace_dump_buf(f, sg[i].buf, len, &h);
 	}
-	dump_buf_finish(f, &h);
+	gensio_trace_dump_buf_finish(f, &h);
 	fflush(f);
     }
 }
 
+static void
+trace_put_le(unsigned char *p, uint64_t v, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++, v >>= 8)
+	p[i] = v & 0xff;
+}
+
+uint64_t
+gensio_trace_get_le(const unsigned char *p, unsigned int len)
+{
+    uint64_t v = 0;
+
+    while (len--)
+	v = (v << 8) | p[len];
+    return v;
+}
+
+static void
+trace_fill_hdr(unsigned char *hdr, unsigned char op, unsigned char flags,
+	       gensiods len, gensio_time *time, int32_t val)
+{
+    memset(hdr, 0, TRACE_REC_HDR_SIZE);
+    hdr[0] = op;
+    hdr[1] = flags;
+    trace_put_le(hdr + 4, len, 4);
+    trace_put_le(hdr + 8, time->secs, 8);
+    trace_put_le(hdr + 16, time->nsecs, 4);
+    trace_put_le(hdr + 20, (uint32_t) val, 4);
+}
+
+#ifdef USE_PTHREADS
+static gensiods
+trace_ring_put(struct trace_filter *tfilter, gensiods head,
+	       const void *data, gensiods len)
+{
+    gensiods pos = head % tfilter->ring_size;
+    gensiods left = tfilter->ring_size - pos;
+
+    if (len > left) {
+	memcpy(tfilter->ring + pos, data, left);
+	memcpy(tfilter->ring, ((const unsigned char *) data) + left,
+	       len - left);
+    } else {
+	memcpy(tfilter->ring + pos, data, len);
+    }
+    return head + len;
+}
+#endif
+
+/*
+ * Add a binary record.  This is called with the filter lock held.
+ * With threads this only copies into the ring buffer, if there is no
+ * room the record is dropped and counted instead of blocking the
+ * data path.
+ */
+static void
+trace_bin_data(struct trace_filter *tfilter, unsigned char op,
+	       unsigned char flags, int err, gensiods written,
+	       const struct gensio_sg *sg, gensiods sglen)
+{
+    unsigned char hdr[TRACE_REC_HDR_SIZE], drophdr[TRACE_REC_HDR_SIZE];
+    gensio_time time;
+    gensiods i, len, needed;
+#ifdef USE_PTHREADS
+    gensiods head, used;
+#endif
+
+    if (!err && written == 0)
+	return;
+    if (err)
+	written = 0;
+
+    tfilter->o->get_monotonic_time(tfilter->o, &time);
+    trace_fill_hdr(hdr, op, flags, written, &time, err);
+    needed = TRACE_REC_HDR_SIZE + written;
+    if (tfilter->dropped) {
+	trace_fill_hdr(drophdr, TRACE_REC_DROPPED, 0, 0, &time,
+		       tfilter->dropped);
+	needed += TRACE_REC_HDR_SIZE;
+    }
+
+#ifdef USE_PTHREADS
+    head = tfilter->head;
+    used = head - __atomic_load_n(&tfilter->tail, __ATOMIC_ACQUIRE);
+    if (needed > tfilter->ring_size - used) {
+	tfilter->dropped++;
+	return;
+    }
+    if (tfilter->dropped)
+	head = trace_ring_put(tfilter, head, drophdr, TRACE_REC_HDR_SIZE);
+    head = trace_ring_put(tfilter, head, hdr, TRACE_REC_HDR_SIZE);
+    for (i = 0; i < sglen && written > 0; i++, written -= len) {
+	len = sg[i].buflen > written ? written : sg[i].buflen;
+	head = trace_ring_put(tfilter, head, sg[i].buf, len);
+    }
+    __atomic_store_n(&tfilter->head, head, __ATOMIC_RELEASE);
+    tfilter->dropped = 0;
+
+    /* Kick the writer if it is asleep and the buffer is a quarter full. */
+    if (used + needed >= tfilter->ring_size / 4 &&
+		__atomic_load_n(&tfilter->writer_idle, __ATOMIC_ACQUIRE)) {
+	gensio_os_worker_lock(tfilter->writer);
+	gensio_os_worker_kick(tfilter->writer);
+	gensio_os_worker_unlock(tfilter->writer);
+    }
+#else
+    /* No thread to hand off to, just let stdio buffer it. */
+    if (tfilter->dropped)
+	fwrite(drophdr, 1, TRACE_REC_HDR_SIZE, tfilter->tr);
+    fwrite(hdr, 1, TRACE_REC_HDR_SIZE, tfilter->tr);
+    for (i = 0; i < sglen && written > 0; i++, written -= len) {
+	len = sg[i].buflen > written ? written : sg[i].buflen;
+	fwrite(sg[i].buf, 1, len, tfilter->tr);
+    }
+    tfilter->dropped = 0;
+#endif
+}
+
+#if HAVE_MMAP
+static void
+trace_cap_segname(struct trace_filter *tfilter, unsigned int seg,
+		  char *name, gensiods len)
+{
+    snprintf(name, len, "%s.%u", tfilter->capture, seg);
+}
+
+/* The next segment is prepared under this name. */
+static void
+trace_cap_sparename(struct trace_filter *tfilter, char *name, gensiods len)
+{
+    snprintf(name, len, "%s.new", tfilter->capture);
+}
+
+/*
+ * Find the segment with the highest sequence number left by a
+ * previous capture so the new capture continues after it instead of
+ * overwriting the newest data.
+ */
+static void
+trace_cap_find_start(struct trace_filter *tfilter)
+{
+    unsigned char hdr[TRACE_CAP_HDR_SIZE];
+    char name[strlen(tfilter->capture) + 12];
+    unsigned int i;
+    uint64_t seq;
+    bool found = false;
+    int fd;
+
+    tfilter->cap_seg = 0;
+    tfilter->cap_seq = 0;
+    for (i = 0; i < tfilter->segments; i++) {
+	trace_cap_segname(tfilter, i, name, sizeof(name));
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	    continue;
+	if (read(fd, hdr, sizeof(hdr)) == sizeof(hdr) &&
+		memcmp(hdr, TRACE_CAP_MAGIC, TRACE_CAP_MAGIC_SIZE) == 0) {
+	    seq = gensio_trace_get_le(hdr + TRACE_CAP_MAGIC_SIZE, 8);
+	    if (!found || seq >= tfilter->cap_seq) {
+		found = true;
+		tfilter->cap_seq = seq;
+		tfilter->cap_seg = i;
+	    }
+	}
+	close(fd);
+    }
+    if (found) {
+	tfilter->cap_seg = (tfilter->cap_seg + 1) % tfilter->segments;
+	tfilter->cap_seq++;
+    }
+}
+
+/*
+ * Create, size and map a segment file.  The header is written except
+ * for the sequence number, which is set when the segment goes into
+ * use.  This does file I/O, with threads it is only done from the
+ * capture worker or when connecting.
+ */
+static int
+trace_cap_open_seg(struct trace_filter *tfilter, const char *name,
+		   struct trace_cap_seg *seg)
+{
+    void *map;
+    int fd, err;
+
+    fd = open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+	return gensio_os_err_to_err(tfilter->o, errno);
+
+    /*
+     * Allocate the whole segment now.  If the disk filled up while
+     * storing into a sparse mapping we would get a SIGBUS.
+     */
+#ifdef HAVE_POSIX_FALLOCATE
+    err = posix_fallocate(fd, 0, tfilter->segsize);
+#else
+    err = ftruncate(fd, tfilter->segsize) ? errno : 0;
+#endif
+    if (err) {
+	err = gensio_os_err_to_err(tfilter->o, err);
+	goto out_err;
+    }
+
+    map = mmap(NULL, tfilter->segsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	       fd, 0);
+    if (map == MAP_FAILED) {
+	err = gensio_os_err_to_err(tfilter->o, errno);
+	goto out_err;
+    }
+
+    seg->fd = fd;
+    seg->map = map;
+    memcpy(seg->map, TRACE_CAP_MAGIC, TRACE_CAP_MAGIC_SIZE);
+    seg->pos = TRACE_CAP_HDR_SIZE;
+    return 0;
+
+ out_err:
+    close(fd);
+    unlink(name);
+    return err;
+}
+
+/* Make seg the segment being written, with sequence number cap_seq. */
+static void
+trace_cap_use_seg(struct trace_filter *tfilter, struct trace_cap_seg *seg)
+{
+    trace_put_le(seg->map + TRACE_CAP_MAGIC_SIZE, tfilter->cap_seq, 8);
+    tfilter->cap = *seg;
+    seg->map = NULL;
+}
+
+/*
+ * Finish a segment: store the used length in the header, which tells
+ * readers the segment is complete, unmap it, and cut it down to what
+ * was used.
+ */
+static void
+trace_cap_finish_seg(struct trace_filter *tfilter, struct trace_cap_seg *seg)
+{
+    trace_put_le(seg->map + TRACE_CAP_USED_OFF, seg->pos, 8);
+    munmap(seg->map, tfilter->segsize);
+    seg->map = NULL;
+    if (ftruncate(seg->fd, seg->pos))
+	; /* Leaving the zero-filled end is harmless. */
+    close(seg->fd);
+    seg->fd = -1;
+}
+
+/*
+ * After a rotation, finish the old segment and move the new one,
+ * which was prepared under the spare name, to its real name.  The
+ * rename replaces the oldest segment.  Anything that has that one
+ * open still sees the complete old file, it is never truncated under
+ * a reader.
+ */
+static void
+trace_cap_retire(struct trace_filter *tfilter, struct trace_cap_seg *old,
+		 unsigned int newseg)
+{
+    char spare[strlen(tfilter->capture) + 12];
+    char name[strlen(tfilter->capture) + 12];
+
+    trace_cap_finish_seg(tfilter, old);
+    trace_cap_sparename(tfilter, spare, sizeof(spare));
+    trace_cap_segname(tfilter, newseg, name, sizeof(name));
+    if (rename(spare, name))
+	gensio_log(tfilter->o, GENSIO_LOG_ERR,
+		   "trace: Unable to rename capture segment %s: %s",
+		   name, strerror(errno));
+}
+
+static int
+trace_cap_open_spare(struct trace_filter *tfilter, struct trace_cap_seg *seg)
+{
+    char name[strlen(tfilter->capture) + 12];
+
+    trace_cap_sparename(tfilter, name, sizeof(name));
+    return trace_cap_open_seg(tfilter, name, seg);
+}
+
+static void
+trace_cap_free_spare(struct trace_filter *tfilter, struct trace_cap_seg *seg)
+{
+    char name[strlen(tfilter->capture) + 12];
+
+    if (!seg->map)
+	return;
+    munmap(seg->map, tfilter->segsize);
+    seg->map = NULL;
+    close(seg->fd);
+    seg->fd = -1;
+    trace_cap_sparename(tfilter, name, sizeof(name));
+    unlink(name);
+}
+
+/*
+ * The capture worker does all the file work for rotation, so the
+ * data path only has to swap in the spare segment: it finishes the
+ * old segment and renames the new one, then prepares the next spare.
+ */
+static void
+trace_cap_worker(struct gensio_os_worker *w, void *cb_data)
+{
+    struct trace_filter *tfilter = cb_data;
+    struct trace_cap_seg seg;
+    gensio_time timeout;
+    unsigned int newseg;
+    bool logged = false;
+    int err;
+
+    gensio_os_worker_lock(w);
+    for (;;) {
+	if (tfilter->cap_retire.map) {
+	    seg = tfilter->cap_retire;
+	    newseg = tfilter->cap_retire_newseg;
+	    gensio_os_worker_unlock(w);
+	    trace_cap_retire(tfilter, &seg, newseg);
+	    gensio_os_worker_lock(w);
+	    tfilter->cap_retire.map = NULL;
+	    continue;
+	}
+	if (gensio_os_worker_stopping(w))
+	    break;
+	if (!tfilter->cap_spare.map) {
+	    gensio_os_worker_unlock(w);
+	    err = trace_cap_open_spare(tfilter, &seg);
+	    if (err && !logged)
+		gensio_log(tfilter->o, GENSIO_LOG_ERR,
+			   "trace: Unable to open capture segment: %s",
+			   gensio_err_to_str(err));
+	    logged = err != 0;
+	    gensio_os_worker_lock(w);
+	    if (!err) {
+		tfilter->cap_spare = seg;
+		continue;
+	    }
+	    /* Try again in a bit, records are dropped until then. */
+	    timeout.secs = 1;
+	    timeout.nsecs = 0;
+	    gensio_os_worker_wait(w, &timeout);
+	    continue;
+	}
+	gensio_os_worker_wait(w, NULL);
+    }
+    gensio_os_worker_unlock(w);
+}
+
+/*
+ * Switch to the next segment, called with the filter lock held.  With
+ * a capture worker this just swaps in the spare segment it prepared,
+ * if it isn't ready the caller drops the record.  Without threads the
+ * file work has to be done here.
+ */
+static void
+trace_cap_rotate(struct trace_filter *tfilter)
+{
+    struct gensio_os_worker *w = tfilter->cap_worker;
+    struct trace_cap_seg seg, old;
+
+    if (!w) {
+	if (trace_cap_open_spare(tfilter, &seg)) {
+	    gensio_log(tfilter->o, GENSIO_LOG_ERR,
+		       "trace: Unable to open capture segment, "
+		       "capture stopped");
+	    trace_cap_finish_seg(tfilter, &tfilter->cap);
+	    return;
+	}
+	old = tfilter->cap;
+	tfilter->cap_seg = (tfilter->cap_seg + 1) % tfilter->segments;
+	tfilter->cap_seq++;
+	trace_cap_use_seg(tfilter, &seg);
+	trace_cap_retire(tfilter, &old, tfilter->cap_seg);
+	return;
+    }
+
+    gensio_os_worker_lock(w);
+    if (tfilter->cap_spare.map && !tfilter->cap_retire.map) {
+	tfilter->cap_retire = tfilter->cap;
+	tfilter->cap_seg = (tfilter->cap_seg + 1) % tfilter->segments;
+	tfilter->cap_seq++;
+	tfilter->cap_retire_newseg = tfilter->cap_seg;
+	trace_cap_use_seg(tfilter, &tfilter->cap_spare);
+    }
+    gensio_os_worker_kick(w);
+    gensio_os_worker_unlock(w);
+}
+
+/* Called with the capture worker stopped. */
+static void
+trace_cap_close(struct trace_filter *tfilter)
+{
+    if (tfilter->cap_worker)
+	gensio_os_worker_stop_wait(tfilter->cap_worker);
+    /* The segment being written may still have the spare name. */
+    if (tfilter->cap_retire.map)
+	trace_cap_retire(tfilter, &tfilter->cap_retire,
+			 tfilter->cap_retire_newseg);
+    trace_cap_free_spare(tfilter, &tfilter->cap_spare);
+    if (tfilter->cap.map)
+	trace_cap_finish_seg(tfilter, &tfilter->cap);
+}
+
+static void
+trace_cap_put(struct trace_filter *tfilter, const void *data, gensiods len)
+{
+    memcpy(tfilter->cap.map + tfilter->cap.pos, data, len);
+    tfilter->cap.pos += len;
+}
+
+/*
+ * Add a record to the capture, called with the filter lock held.  The
+ * op byte of the record is stored last, a zero op marks the end of
+ * the data in a segment so a reader never sees a partial record.
+ */
+static void
+trace_cap_data(struct trace_filter *tfilter, unsigned char op,
+	       unsigned char flags, int err, gensiods written,
+	       const struct gensio_sg *sg, gensiods sglen)
+{
+    unsigned char hdr[TRACE_REC_HDR_SIZE];
+    gensio_time time;
+    gensiods i, len, needed, start;
+
+    if (!err && written == 0)
+	return;
+    if (err)
+	written = 0;
+
+    needed = TRACE_REC_HDR_SIZE + written;
+    if (tfilter->cap_dropped)
+	needed += TRACE_REC_HDR_SIZE;
+    if (needed > tfilter->segsize - TRACE_CAP_HDR_SIZE) {
+	tfilter->cap_dropped++;
+	return;
+    }
+    if (tfilter->cap.map && tfilter->cap.pos + needed > tfilter->segsize)
+	trace_cap_rotate(tfilter);
+    if (!tfilter->cap.map || tfilter->cap.pos + needed > tfilter->segsize) {
+	/* Capture stopped, or the next segment isn't ready yet. */
+	tfilter->cap_dropped++;
+	return;
+    }
+
+    tfilter->o->get_monotonic_time(tfilter->o, &time);
+    if (tfilter->cap_dropped) {
+	trace_fill_hdr(hdr, TRACE_REC_DROPPED, 0, 0, &time,
+		       tfilter->cap_dropped);
+	trace_cap_put(tfilter, hdr, TRACE_REC_HDR_SIZE);
+	tfilter->cap_dropped = 0;
+    }
+    trace_fill_hdr(hdr, op, flags, written, &time, err);
+    start = tfilter->cap.pos;
+    tfilter->cap.pos++; /* The op byte is stored last. */
+    trace_cap_put(tfilter, hdr + 1, TRACE_REC_HDR_SIZE - 1);
+    for (i = 0; i < sglen && written > 0; i++, written -= len) {
+	len = sg[i].buflen > written ? written : sg[i].buflen;
+	trace_cap_put(tfilter, sg[i].buf, len);
+    }
+    __atomic_store_n(tfilter->cap.map + start, op, __ATOMIC_RELEASE);
+}
+#endif
+
+static void
+trace_record(struct trace_filter *tfilter, const char *opstr,
+	     unsigned char op, const char *const *auxdata,
+	     int err, gensiods count, const struct gensio_sg *sg,
+	     gensiods sglen)
+{
+    unsigned char flags = 0;
+
+    if (gensio_str_in_auxdata(auxdata, "oob"))
+	flags |= TRACE_REC_FLAG_OOB;
+
+    trace_lock(tfilter);
+    if (tfilter->tr) {
+	if (tfilter->binary)
+	    trace_bin_data(tfilter, op, flags, err, count, sg, sglen);
+	else
+	    trace_data(opstr, tfilter->o, tfilter->tr, tfilter->raw, err,
+		       count, sg, sglen);
+    }
+#if HAVE_MMAP
+    if (tfilter->capture)
+	trace_cap_data(tfilter, op, flags, err, count, sg, sglen);
+#endif
+    trace_unlock(tfilter);
+}
+
 static int
 trace_ul_write(struct gensio_filter *filter,
 	       gensio_ul_filter_data_handler handler, void *cb_data,
@@ -208,10 +902,8 @@ trace_ul_write(struct gensio_filter *filter,
 
     err = handler(cb_data, &count, sg, sglen, auxdata);
     if (tfilter->dir == TRACE_WRITE || tfilter->dir == TRACE_BOTH) {
-	trace_lock(tfilter);
-	trace_data("Write", tfilter->o, tfilter->tr, tfilter->raw, err,
-		   count, sg, sglen);
-	trace_unlock(tfilter);
+	trace_record(tfilter, "Write", TRACE_REC_WRITE, auxdata, err, count,
+		     sg, sglen);
     }
     if (!err && rcount)
 	*rcount = count;
@@ -234,10 +926,8 @@ trace_ll_write(struct gensio_filter *filter,
     if (tfilter->dir == TRACE_READ || tfilter->dir == TRACE_BOTH) {
 	struct gensio_sg sg = {buf, buflen};
 
-	trace_lock(tfilter);
-	trace_data("Read", tfilter->o, tfilter->tr, tfilter->raw, err,
-		   count, &sg, 1);
-	trace_unlock(tfilter);
+	trace_record(tfilter, "Read", TRACE_REC_READ, auxdata, err, count,
+		     &sg, 1);
     }
     if (!err && rcount)
 	*rcount = count;
@@ -259,12 +949,25 @@ trace_filter_cleanup(struct gensio_filter *filter)
 static void
 tfilter_free(struct trace_filter *tfilter)
 {
+    trace_close_file(tfilter);
+#ifdef USE_PTHREADS
+    if (tfilter->writer)
+	gensio_os_worker_free(tfilter->writer);
+    if (tfilter->ring)
+	tfilter->o->free(tfilter->o, tfilter->ring);
+#endif
     if (tfilter->lock)
 	tfilter->o->free_lock(tfilter->lock);
     if (tfilter->filter)
 	gensio_filter_free_data(tfilter->filter);
     if (tfilter->filename)
 	tfilter->o->free(tfilter->o, tfilter->filename);
+#if HAVE_MMAP
+    if (tfilter->cap_worker)
+	gensio_os_worker_free(tfilter->cap_worker);
+    if (tfilter->capture)
+	tfilter->o->free(tfilter->o, tfilter->capture);
+#endif
     tfilter->o->free(tfilter->o, tfilter);
 }
 
@@ -332,17 +1035,36 @@ static int gensio_trace_filter_func(struct gensio_filter *filter, int op,
 static struct gensio_filter *
 gensio_trace_filter_raw_alloc(struct gensio_os_funcs *o, enum trace_dir dir,
 			      bool raw, const char *filename, bool tr_stdout,
-			      bool tr_stderr)
+			      bool tr_stderr, bool binary, gensiods bufsize,
+			      const char *capture, gensiods segsize,
+			      unsigned int segments)
 {
     struct trace_filter *tfilter;
 
-    if (!filename && !tr_stdout && !tr_stderr)
+    if (!filename && !tr_stdout && !tr_stderr && !capture)
 	dir = TRACE_NONE;
 
     tfilter = o->zalloc(o, sizeof(*tfilter));
     if (!tfilter)
 	return NULL;
 
+#if HAVE_MMAP
+    tfilter->segsize = segsize;
+    tfilter->segments = segments;
+    if (capture && dir != TRACE_NONE) {
+	int err;
+
+	tfilter->capture = gensio_strdup(o, capture);
+	if (!tfilter->capture)
+	    goto out_nomem;
+	/* Without threads rotation is just done inline. */
+	err = gensio_os_worker_alloc(o, trace_cap_worker, NULL, NULL,
+				     tfilter, &tfilter->cap_worker);
+	if (err && err != GE_NOTSUP)
+	    goto out_nomem;
+    }
+#endif
+
     tfilter->o = o;
     tfilter->dir = dir;
     tfilter->raw = raw;
@@ -353,6 +1075,19 @@ gensio_trace_filter_raw_alloc(struct gensio_os_funcs *o, enum trace_dir dir,
     }
     tfilter->tr_stdout = tr_stdout;
     tfilter->tr_stderr = tr_stderr;
+    tfilter->binary = binary;
+
+#ifdef USE_PTHREADS
+    if (binary && (filename || tr_stdout || tr_stderr) && dir != TRACE_NONE) {
+	tfilter->ring = o->zalloc(o, bufsize);
+	if (!tfilter->ring)
+	    goto out_nomem;
+	tfilter->ring_size = bufsize;
+	if (gensio_os_worker_alloc(o, trace_writer, NULL, NULL, tfilter,
+				   &tfilter->writer))
+	    goto out_nomem;
+    }
+#endif
 
     tfilter->lock = o->alloc_lock(o);
     if (!tfilter->lock)
@@ -385,8 +1120,11 @@ gensio_trace_filter_alloc(struct gensio_os_funcs *o,
 {
     struct gensio_filter *filter;
     int dir = TRACE_NONE;
-    bool raw = false, tr_stdout = false, tr_stderr = false;
-    const char *filename = NULL;
+    bool raw = false, tr_stdout = false, tr_stderr = false, binary = false;
+    const char *filename = NULL, *capture = NULL;
+    gensiods bufsize = TRACE_DEFAULT_BUFSIZE;
+    gensiods segsize = TRACE_DEFAULT_SEGSIZE;
+    unsigned int segments = TRACE_DEFAULT_SEGMENTS;
     unsigned int i;
 
     for (i = 0; args && args[i]; i++) {
@@ -400,11 +1138,34 @@ gensio_trace_filter_alloc(struct gensio_os_funcs *o,
 	    continue;
 	if (gensio_check_keybool(args[i], "stderr", &tr_stderr) > 0)
 	    continue;
+	if (gensio_check_keybool(args[i], "binary", &binary) > 0)
+	    continue;
+	if (gensio_check_keyds(args[i], "bufsize", &bufsize) > 0) {
+	    if (bufsize < TRACE_MIN_BUFSIZE)
+		return GE_INVAL;
+	    continue;
+	}
+#if HAVE_MMAP
+	if (gensio_check_keyvalue(args[i], "capture", &capture) > 0)
+	    continue;
+	if (gensio_check_keyds(args[i], "segsize", &segsize) > 0) {
+	    if (segsize < TRACE_MIN_SEGSIZE)
+		return GE_INVAL;
+	    continue;
+	}
+	if (gensio_check_keyuint(args[i], "segments", &segments) > 0) {
+	    if (segments < 1)
+		return GE_INVAL;
+	    continue;
+	}
+#endif
 	return GE_INVAL;
     }
 
     filter = gensio_trace_filter_raw_alloc(o, dir, raw, filename,
-					   tr_stdout, tr_stderr);
+					   tr_stdout, tr_stderr,
+					   binary, bufsize,
+					   capture, segsize, segments);
     if (!filter)
 	return GE_NOMEM;
 
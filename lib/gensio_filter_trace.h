@@ -8,8 +8,70 @@
 #ifndef GENSIO_FILTER_TRACE_H
 #define GENSIO_FILTER_TRACE_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include <gensio/gensio_base.h>
 
+/*
+ * Binary trace records, used by the binary and capture output of the
+ * trace filter and read by the replay gensio.  Each record is a 24
+ * byte header followed by the data, all values are little endian:
+ *   0: op (TRACE_REC_xxx), 0 marks the end of a capture segment
+ *   1: flags (TRACE_REC_FLAG_xxx)
+ *   2-3: zero
+ *   4-7: data length
+ *   8-15: seconds
+ *   16-19: nanoseconds
+ *   20-23: gensio error, or for a drop record the number of records
+ *          that were dropped.
+ */
+#define TRACE_REC_READ		1
+#define TRACE_REC_WRITE		2
+#define TRACE_REC_DROPPED	3
+#define TRACE_REC_HDR_SIZE	24
+
+#define TRACE_REC_FLAG_OOB	(1 << 0)
+
+/*
+ * Capture segment files start with this header, all little endian:
+ *   0-7: magic
+ *   8-15: sequence number, used to put rotated segments back in order
+ *   16-23: length of the segment, including this header
+ * Records follow the header.  The length is zero while the segment
+ * is being written and is set when the segment is finished.  Readers
+ * must not use a segment with a zero length, it may be truncated at
+ * any time.  A finished segment is never modified, when it is reused
+ * a new file is renamed over it.
+ */
+#define TRACE_CAP_MAGIC		"GNSCAP1"
+#define TRACE_CAP_MAGIC_SIZE	8
+#define TRACE_CAP_USED_OFF	16
+#define TRACE_CAP_HDR_SIZE	24
+
+/*
+ * Text output, shared by the trace filter and gtracedump.  A record
+ * is printed with gensio_trace_print_rec(), then if there was no
+ * error its data is printed as a hex dump by calling
+ * gensio_trace_dump_buf() one or more times and then
+ * gensio_trace_dump_buf_finish().  The history must be zeroed before
+ * each record.
+ */
+struct gensio_trace_dump_history {
+    unsigned int column;
+    unsigned int pos;
+    unsigned char data[16];
+};
+
+void gensio_trace_print_rec(FILE *f, int64_t secs, int32_t nsecs,
+			    const char *op, int err, gensiods len);
+void gensio_trace_dump_buf(FILE *f, const unsigned char *buf, gensiods len,
+			   struct gensio_trace_dump_history *h);
+void gensio_trace_dump_buf_finish(FILE *f,
+				  struct gensio_trace_dump_history *h);
+
+/* Get a little endian value from a record or capture header. */
+uint64_t gensio_trace_get_le(const unsigned char *p, unsigned int len);
+
 int gensio_trace_filter_alloc(struct gensio_os_funcs *o,
 			      const char * const args[],
 			      struct gensio_filter **rfilter);
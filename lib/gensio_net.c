@@ -25,6 +25,13 @@ int unlink(const char *pathname);
 #include <gensio/argvutils.h>
 #include <gensio/gensio_osops.h>
 #include <gensio/gensio_builtins.h>
+#include "utils.h"
+
+#ifdef HAVE_TCPD_H
+#ifdef USE_PTHREADS
+#define NETNA_TCPD_ASYNC
+#endif
+#endif
 
 struct net_data {
     struct gensio_os_funcs *o;
@@ -196,6 +203,15 @@ net_control(void *handler_data, int fd, bool get, unsigned int option,
 	*datalen = snprintf(data, *datalen, "%d", i);
 	return 0;
 
+    case GENSIO_CONTROL_RAW_FD:
+	if (!get)
+	    return GE_NOTSUP;
+	if (fd == -1)
+	    return GE_NOTREADY;
+	/* The same socket is used for both directions. */
+	*datalen = snprintf(data, *datalen, "%d", fd);
+	return 0;
+
     default:
 	return GE_NOTSUP;
     }
@@ -415,6 +431,48 @@ str_to_unix_gensio(const char *str, const char * const args[],
 
 struct netna_data;
 
+/*
+ * Maximum number of connections accepted each time the listening
+ * socket is ready, so a burst of connections doesn't take a trip
+ * through the selector for each one.
+ */
+#define GENSIO_DEFAULT_ACCEPT_BATCH	16
+
+/* Maximum number of SO_REUSEPORT listening sockets per address. */
+#define GENSIO_MAX_REUSEPORT		64
+
+/* Default time tcpd decisions stay in the cache, in seconds. */
+#define GENSIO_DEFAULT_TCPD_CACHE_TTL	10
+
+#ifdef HAVE_TCPD_H
+/*
+ * tcpd (libwrap) reads and parses the hosts files on every check.
+ * The accepter can keep the decisions for a while.  hosts_access()
+ * decides on the client address, the server address and the daemon
+ * name, so those (without the ports) are the key.  The cache is
+ * direct mapped, a new entry just replaces whatever is in its slot.
+ */
+struct netna_tcpd_ent {
+    struct gensio_addr *addr;
+    struct gensio_addr *laddr;
+    char *daemon;
+    bool allowed;
+    int64_t expire; /* Monotonic time in seconds. */
+};
+#endif
+
+#ifdef NETNA_TCPD_ASYNC
+/* A connection waiting for, or finished with, a tcpd check. */
+struct netna_tcpd_req {
+    struct netna_tcpd_req *next;
+    int fd;
+    struct gensio_addr *raddr;
+    struct gensio_addr *laddr; /* NULL if not caching. */
+    bool checked;
+    bool allowed;
+};
+#endif
+
 struct netna_data {
     struct gensio_accepter *acc;
 
@@ -426,6 +484,7 @@ struct netna_data {
 
     gensiods max_read_size;
     bool nodelay;
+    unsigned int accept_batch;
 
     gensio_acc_done shutdown_done;
     gensio_acc_done cb_en_done;
@@ -437,10 +496,40 @@ struct netna_data {
     unsigned int   nr_acceptfds;
     unsigned int   nr_accept_close_waiting;
 
+    /*
+     * Number of listening sockets for each address.  If more than
+     * one, acceptfds holds reuseport copies of the per-address
+     * sockets, one after the other.
+     */
+    unsigned int reuseport;
+
     bool istcp;
 
     /* Remove the socket file if it exists. */
     bool delsock;
+
+#ifdef HAVE_TCPD_H
+    /* Protected by lock. */
+    struct netna_tcpd_ent *tcpd_cache;
+    unsigned int tcpd_cache_size;
+    unsigned int tcpd_cache_ttl;
+#endif
+
+#ifdef NETNA_TCPD_ASYNC
+    /*
+     * If tcpd_async is set, tcpd checks are done in tcpd_worker.
+     * New connections go on tcpd_pending, the thread moves them to
+     * tcpd_done when checked and wakes the selector to finish them.
+     * At shutdown the thread hands back anything left unchecked and
+     * exits, the shutdown is not done until the worker reports the
+     * thread is gone.  The lists are protected by the worker lock.
+     */
+    bool tcpd_async;
+    struct gensio_os_worker *tcpd_worker;
+    struct netna_tcpd_req *tcpd_pending;
+    struct netna_tcpd_req *tcpd_pending_tail;
+    struct netna_tcpd_req *tcpd_done;
+#endif
 };
 
 static const struct gensio_fd_ll_ops net_server_fd_ll_ops = {
@@ -453,13 +542,10 @@ static const struct gensio_fd_ll_ops net_server_fd_ll_ops = {
 };
 
 static void
-netna_fd_cleared(int fd, void *cbdata)
+netna_close_wait_done(struct netna_data *nadata)
 {
-    struct netna_data *nadata = cbdata;
     unsigned int num_left;
 
-    gensio_os_close(nadata->o, fd);
-
     nadata->o->lock(nadata->lock);
     assert(nadata->nr_accept_close_waiting > 0);
     num_left = --nadata->nr_accept_close_waiting;
@@ -474,6 +560,15 @@ netna_fd_cleared(int fd, void *cbdata)
 	nadata->shutdown_done(nadata->acc, NULL);
 }
 
+static void
+netna_fd_cleared(int fd, void *cbdata)
+{
+    struct netna_data *nadata = cbdata;
+
+    gensio_os_close(nadata->o, fd);
+    netna_close_wait_done(nadata);
+}
+
 static void
 netna_set_fd_enables(struct netna_data *nadata, bool enable)
 {
@@ -491,42 +586,23 @@ netna_finish_server_open(struct gensio *net, int err, void *cb_data)
     base_gensio_server_open_done(nadata->acc, net, err);
 }
 
-static void
-netna_readhandler(int fd, void *cbdata)
+/*
+ * Set up a gensio for a newly accepted socket.  Returns GE_NOTREADY
+ * if the accepter is not accepting connections any more.
+ */
+static int
+netna_new_connection(struct netna_data *nadata, int new_fd,
+		     struct gensio_addr *raddr)
 {
-    struct netna_data *nadata = cbdata;
-    int new_fd = -1;
-    struct gensio_addr *raddr;
     struct net_data *tdata = NULL;
     struct gensio *io = NULL;
-    int protocol = nadata->istcp ? GENSIO_NET_PROTOCOL_TCP
-				 : GENSIO_NET_PROTOCOL_UNIX;
     int err;
 
-    err = gensio_os_accept(nadata->o, fd, &raddr, &new_fd);
-    if (err) {
-	if (err != GE_NODATA)
-	    /* FIXME - maybe shut down the socket I/O? */
-	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-			   "Error accepting net gensio: %s",
-			   gensio_err_to_str(err));
-	return;
-    }
-
     err = base_gensio_accepter_new_child_start(nadata->acc);
     if (err) {
 	gensio_addr_free(raddr);
 	gensio_os_close(nadata->o, new_fd);
-	return;
-    }
-
-    if (nadata->istcp) {
-	if (gensio_os_check_tcpd_ok(new_fd)) {
-	    gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
-			   "Error accepting net gensio: tcpd check failed");
-	    err = GE_INVAL;
-	    goto out_err;
-	}
+	return err;
     }
 
     tdata = nadata->o->zalloc(nadata->o, sizeof(*tdata));
@@ -539,13 +615,19 @@ netna_readhandler(int fd, void *cbdata)
 
     tdata->o = nadata->o;
     tdata->ai = raddr;
-    
-    err = gensio_os_socket_setup(tdata->o, new_fd, protocol, tdata->istcp,
-				 tdata->nodelay, tdata->lai);
-    if (err) {
-	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-		       "Error setting up net port: %s", gensio_err_to_str(err));
-	goto out_err;
+    raddr = NULL;
+
+    /* gensio_os_accept() already made it non-blocking. */
+    if (nadata->nodelay) {
+	err = gensio_os_set_nodelay(tdata->o, new_fd, GENSIO_NET_PROTOCOL_TCP,
+				    1);
+	if (err) {
+	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			   "Error setting up net port: %s",
+			   gensio_err_to_str(err));
+	    goto out_err;
+	}
+	tdata->nodelay = true;
     }
 
     tdata->ll = fd_gensio_ll_alloc(nadata->o, new_fd, &net_server_fd_ll_ops,
@@ -571,7 +653,7 @@ netna_readhandler(int fd, void *cbdata)
     if (err)
 	goto out_err;
     base_gensio_accepter_new_child_end(nadata->acc, io, 0);
-    return;
+    return 0;
 
  out_err:
     base_gensio_accepter_new_child_end(nadata->acc, NULL, err);
@@ -583,9 +665,308 @@ netna_readhandler(int fd, void *cbdata)
 	else {
 	    /* gensio_ll_free() frees it otherwise. */
 	    net_free(tdata);
-	    if (new_fd != -1)
-		gensio_os_close(nadata->o, new_fd);
+	    gensio_os_close(nadata->o, new_fd);
 	}
+    } else {
+	gensio_addr_free(raddr);
+	gensio_os_close(nadata->o, new_fd);
+    }
+    return err;
+}
+
+#ifdef HAVE_TCPD_H
+static unsigned int
+netna_tcpd_hash(struct gensio_addr *raddr, struct gensio_addr *laddr,
+		const char *daemon)
+{
+    unsigned int h = gensio_addr_hash(raddr, false);
+
+    h = h * 31 + gensio_addr_hash(laddr, false);
+    for (; *daemon; daemon++)
+	h = h * 31 + (unsigned char) *daemon;
+    return h;
+}
+
+static struct netna_tcpd_ent *
+netna_tcpd_cache_ent(struct netna_data *nadata, struct gensio_addr *raddr,
+		     struct gensio_addr *laddr, const char *daemon)
+{
+    unsigned int idx = netna_tcpd_hash(raddr, laddr, daemon);
+
+    return &nadata->tcpd_cache[idx % nadata->tcpd_cache_size];
+}
+
+static void
+netna_tcpd_ent_clear(struct netna_data *nadata, struct netna_tcpd_ent *e)
+{
+    if (e->addr)
+	gensio_addr_free(e->addr);
+    if (e->laddr)
+	gensio_addr_free(e->laddr);
+    if (e->daemon)
+	nadata->o->free(nadata->o, e->daemon);
+    e->addr = NULL;
+    e->laddr = NULL;
+    e->daemon = NULL;
+}
+
+/*
+ * Returns true if a decision was found for the remote address, local
+ * address and daemon name and sets allowed.
+ */
+static bool
+netna_tcpd_cache_lookup(struct netna_data *nadata, struct gensio_addr *raddr,
+			struct gensio_addr *laddr, bool *allowed)
+{
+    const char *daemon = gensio_os_get_progname();
+    struct netna_tcpd_ent *e;
+    gensio_time now;
+    bool found = false;
+
+    if (!nadata->tcpd_cache_size || !laddr)
+	return false;
+
+    nadata->o->get_monotonic_time(nadata->o, &now);
+    nadata->o->lock(nadata->lock);
+    e = netna_tcpd_cache_ent(nadata, raddr, laddr, daemon);
+    if (e->addr && now.secs < e->expire &&
+		gensio_addr_equal(e->addr, raddr, false, false) &&
+		gensio_addr_equal(e->laddr, laddr, false, false) &&
+		strcmp(e->daemon, daemon) == 0) {
+	*allowed = e->allowed;
+	found = true;
+    }
+    nadata->o->unlock(nadata->lock);
+
+    return found;
+}
+
+static void
+netna_tcpd_cache_add(struct netna_data *nadata, struct gensio_addr *raddr,
+		     struct gensio_addr *laddr, bool allowed)
+{
+    const char *daemon = gensio_os_get_progname();
+    struct netna_tcpd_ent *e, old, new;
+    gensio_time now;
+
+    if (!nadata->tcpd_cache_size || !laddr)
+	return;
+
+    new.addr = gensio_addr_dup(raddr);
+    new.laddr = gensio_addr_dup(laddr);
+    new.daemon = gensio_strdup(nadata->o, daemon);
+    new.allowed = allowed;
+    if (!new.addr || !new.laddr || !new.daemon) {
+	/* Just don't cache it. */
+	netna_tcpd_ent_clear(nadata, &new);
+	return;
+    }
+
+    nadata->o->get_monotonic_time(nadata->o, &now);
+    new.expire = now.secs + nadata->tcpd_cache_ttl;
+    nadata->o->lock(nadata->lock);
+    e = netna_tcpd_cache_ent(nadata, raddr, laddr, daemon);
+    old = *e;
+    *e = new;
+    nadata->o->unlock(nadata->lock);
+
+    netna_tcpd_ent_clear(nadata, &old);
+}
+
+static void
+netna_tcpd_cache_free(struct netna_data *nadata)
+{
+    unsigned int i;
+
+    for (i = 0; i < nadata->tcpd_cache_size; i++)
+	netna_tcpd_ent_clear(nadata, &nadata->tcpd_cache[i]);
+    nadata->o->free(nadata->o, nadata->tcpd_cache);
+}
+#endif
+
+#ifdef NETNA_TCPD_ASYNC
+static void
+netna_tcpd_thread(struct gensio_os_worker *w, void *cb_data)
+{
+    struct netna_data *nadata = cb_data;
+    struct netna_tcpd_req *req;
+
+    gensio_os_worker_lock(w);
+    for (;;) {
+	if (!nadata->tcpd_pending) {
+	    if (gensio_os_worker_wait(w, NULL) == GE_LOCALCLOSED)
+		break;
+	    continue;
+	}
+
+	req = nadata->tcpd_pending;
+	nadata->tcpd_pending = req->next;
+	gensio_os_worker_unlock(w);
+
+	req->allowed = !gensio_os_check_tcpd_ok(req->fd);
+	req->checked = true;
+
+	gensio_os_worker_lock(w);
+	req->next = nadata->tcpd_done;
+	nadata->tcpd_done = req;
+	gensio_os_worker_wake(w);
+    }
+
+    /* Shutting down, hand back anything not checked. */
+    while (nadata->tcpd_pending) {
+	req = nadata->tcpd_pending;
+	nadata->tcpd_pending = req->next;
+	req->next = nadata->tcpd_done;
+	nadata->tcpd_done = req;
+    }
+    gensio_os_worker_unlock(w);
+}
+
+/* Finish the connections the thread is done with. */
+static void
+netna_tcpd_finish(struct gensio_os_worker *w, void *cb_data)
+{
+    struct netna_data *nadata = cb_data;
+    struct netna_tcpd_req *req, *list, *next, *rev = NULL;
+
+    gensio_os_worker_lock(w);
+    list = nadata->tcpd_done;
+    nadata->tcpd_done = NULL;
+    gensio_os_worker_unlock(w);
+
+    /* They were pushed on the front, handle them in order. */
+    for (req = list; req; req = next) {
+	next = req->next;
+	req->next = rev;
+	rev = req;
+    }
+
+    for (req = rev; req; req = next) {
+	next = req->next;
+	if (req->checked)
+	    netna_tcpd_cache_add(nadata, req->raddr, req->laddr,
+				 req->allowed);
+	if (req->allowed) {
+	    netna_new_connection(nadata, req->fd, req->raddr);
+	} else {
+	    if (req->checked)
+		gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
+			       "Error accepting net gensio: "
+			       "tcpd check failed");
+	    gensio_addr_free(req->raddr);
+	    gensio_os_close(nadata->o, req->fd);
+	}
+	if (req->laddr)
+	    gensio_addr_free(req->laddr);
+	nadata->o->free(nadata->o, req);
+    }
+}
+
+/* The thread is gone, finish the shutdown. */
+static void
+netna_tcpd_done(struct gensio_os_worker *w, void *cb_data)
+{
+    struct netna_data *nadata = cb_data;
+
+    netna_tcpd_finish(w, nadata);
+    /* This may free nadata, don't touch it after this. */
+    netna_close_wait_done(nadata);
+}
+
+static int
+netna_tcpd_queue(struct netna_data *nadata, int new_fd,
+		 struct gensio_addr *raddr, struct gensio_addr *laddr)
+{
+    struct gensio_os_worker *w = nadata->tcpd_worker;
+    struct netna_tcpd_req *req;
+
+    req = nadata->o->zalloc(nadata->o, sizeof(*req));
+    if (!req)
+	return GE_NOMEM;
+    req->fd = new_fd;
+    req->raddr = raddr;
+    req->laddr = laddr;
+
+    gensio_os_worker_lock(w);
+    if (nadata->tcpd_pending)
+	nadata->tcpd_pending_tail->next = req;
+    else
+	nadata->tcpd_pending = req;
+    nadata->tcpd_pending_tail = req;
+    gensio_os_worker_kick(w);
+    gensio_os_worker_unlock(w);
+
+    return 0;
+}
+#endif
+
+/*
+ * Do the tcpd check for a new connection.  Returns 0 if the
+ * connection can be set up now.  Otherwise the check was queued to
+ * be finished later, or it failed, in which case new_fd has been
+ * closed and raddr freed.
+ */
+static int
+netna_tcpd_check(struct netna_data *nadata, int new_fd,
+		 struct gensio_addr *raddr)
+{
+#ifdef HAVE_TCPD_H
+    struct gensio_addr *laddr = NULL;
+    bool allowed;
+
+    if (nadata->tcpd_cache_size &&
+		gensio_os_getsockname(nadata->o, new_fd, &laddr))
+	laddr = NULL; /* Just don't use the cache. */
+
+    if (!netna_tcpd_cache_lookup(nadata, raddr, laddr, &allowed)) {
+#ifdef NETNA_TCPD_ASYNC
+	if (nadata->tcpd_async) {
+	    if (!netna_tcpd_queue(nadata, new_fd, raddr, laddr))
+		return GE_INPROGRESS;
+	    /* Couldn't queue it, just do it here. */
+	}
+#endif
+	allowed = !gensio_os_check_tcpd_ok(new_fd);
+	netna_tcpd_cache_add(nadata, raddr, laddr, allowed);
+    }
+    if (laddr)
+	gensio_addr_free(laddr);
+    if (!allowed) {
+	gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
+		       "Error accepting net gensio: tcpd check failed");
+	gensio_addr_free(raddr);
+	gensio_os_close(nadata->o, new_fd);
+	return GE_INVAL;
+    }
+#endif
+    return 0;
+}
+
+static void
+netna_readhandler(int fd, void *cbdata)
+{
+    struct netna_data *nadata = cbdata;
+    struct gensio_addr *raddr;
+    unsigned int i;
+    int new_fd, err;
+
+    for (i = 0; i < nadata->accept_batch; i++) {
+	err = gensio_os_accept(nadata->o, fd, &raddr, &new_fd);
+	if (err) {
+	    if (err != GE_NODATA)
+		/* FIXME - maybe shut down the socket I/O? */
+		gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			       "Error accepting net gensio: %s",
+			       gensio_err_to_str(err));
+	    return;
+	}
+
+	if (nadata->istcp && netna_tcpd_check(nadata, new_fd, raddr))
+	    continue;
+
+	err = netna_new_connection(nadata, new_fd, raddr);
+	if (err == GE_NOTREADY)
+	    return;
     }
 }
 
@@ -611,11 +992,40 @@ netna_startup(struct gensio_accepter *accepter, struct netna_data *nadata)
     if (!nadata->istcp && nadata->delsock)
 	netna_rm_unix_socket(nadata->ai);
 
-    rv = gensio_os_open_socket(nadata->o, nadata->ai, netna_readhandler,
-			       NULL, netna_fd_cleared, nadata,
-			       &nadata->acceptfds, &nadata->nr_acceptfds);
+#ifdef NETNA_TCPD_ASYNC
+    if (nadata->tcpd_async &&
+		!gensio_os_worker_running(nadata->tcpd_worker)) {
+	rv = gensio_os_worker_start(nadata->tcpd_worker);
+	if (rv)
+	    return rv;
+    }
+#endif
+
+    if (nadata->reuseport > 1) {
+	void *data[GENSIO_MAX_REUSEPORT];
+	unsigned int i, nr_fds;
+
+	for (i = 0; i < nadata->reuseport; i++)
+	    data[i] = nadata;
+	rv = gensio_os_open_sharded_socket(nadata->o, nadata->ai,
+					   netna_readhandler, NULL,
+					   netna_fd_cleared, data,
+					   nadata->reuseport,
+					   &nadata->acceptfds, &nr_fds);
+	if (!rv)
+	    nadata->nr_acceptfds = nr_fds * nadata->reuseport;
+    } else {
+	rv = gensio_os_open_socket(nadata->o, nadata->ai, netna_readhandler,
+				   NULL, netna_fd_cleared, nadata,
+				   &nadata->acceptfds, &nadata->nr_acceptfds);
+    }
     if (!rv)
 	netna_set_fd_enables(nadata, true);
+#ifdef NETNA_TCPD_ASYNC
+    else if (nadata->tcpd_async)
+	/* The thread hasn't seen any connections, just stop it. */
+	gensio_os_worker_stop_wait(nadata->tcpd_worker);
+#endif
     return rv;
 }
 
@@ -628,6 +1038,14 @@ netna_shutdown(struct gensio_accepter *accepter,
 
     nadata->shutdown_done = shutdown_done;
     nadata->nr_accept_close_waiting = nadata->nr_acceptfds;
+#ifdef NETNA_TCPD_ASYNC
+    if (nadata->tcpd_async &&
+		gensio_os_worker_running(nadata->tcpd_worker)) {
+	/* netna_tcpd_done() finishes this one when the thread is gone. */
+	nadata->nr_accept_close_waiting++;
+	gensio_os_worker_stop(nadata->tcpd_worker);
+    }
+#endif
     for (i = 0; i < nadata->nr_acceptfds; i++)
 	nadata->o->clear_fd_handlers(nadata->o, nadata->acceptfds[i].fd);
 
@@ -667,6 +1085,14 @@ netna_set_accept_callback_enable(struct gensio_accepter *accepter,
 static void
 netna_free(struct gensio_accepter *accepter, struct netna_data *nadata)
 {
+#ifdef NETNA_TCPD_ASYNC
+    if (nadata->tcpd_worker)
+	gensio_os_worker_free(nadata->tcpd_worker);
+#endif
+#ifdef HAVE_TCPD_H
+    if (nadata->tcpd_cache)
+	netna_tcpd_cache_free(nadata);
+#endif
     if (nadata->lock)
 	nadata->o->free_lock(nadata->lock);
     if (nadata->cb_en_done_runner)
@@ -761,7 +1187,7 @@ netna_control_laddr(struct netna_data *nadata, bool get,
 	return GE_NOTREADY;
 
     i = strtoul(data, NULL, 0);
-    if (i >= nadata->nr_acceptfds)
+    if (i >= nadata->nr_acceptfds / nadata->reuseport)
 	return GE_NOTFOUND;
 
     rv = gensio_os_getsockname(nadata->o, nadata->acceptfds[i].fd, &addr);
@@ -793,7 +1219,7 @@ netna_control_lport(struct netna_data *nadata, bool get,
 	return GE_NOTREADY;
 
     i = strtoul(data, NULL, 0);
-    if (i >= nadata->nr_acceptfds)
+    if (i >= nadata->nr_acceptfds / nadata->reuseport)
 	return GE_NOTFOUND;
 
     *datalen = snprintf(data, *datalen, "%d", nadata->acceptfds[i].port);
@@ -877,6 +1303,11 @@ net_gensio_accepter_alloc(struct gensio_addr *iai,
     bool nodelay = false;
     bool istcp = strcmp(type, "tcp") == 0;
     bool delsock = false;
+    unsigned int accept_batch = GENSIO_DEFAULT_ACCEPT_BATCH;
+    unsigned int reuseport = 1;
+    unsigned int tcpd_cache_size = 0;
+    unsigned int tcpd_cache_ttl = GENSIO_DEFAULT_TCPD_CACHE_TTL;
+    bool tcpd_async = false;
     unsigned int i;
     int err, ival;
 
@@ -894,9 +1325,33 @@ net_gensio_accepter_alloc(struct gensio_addr *iai,
 	if (!istcp &&
 		gensio_check_keybool(args[i], "delsock", &delsock) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "acceptbatch", &accept_batch) > 0)
+	    continue;
+	if (istcp &&
+		gensio_check_keyuint(args[i], "reuseport", &reuseport) > 0)
+	    continue;
+	if (istcp &&
+		gensio_check_keyuint(args[i], "tcpdcache",
+				     &tcpd_cache_size) > 0)
+	    continue;
+	if (istcp &&
+		gensio_check_keyuint(args[i], "tcpdttl", &tcpd_cache_ttl) > 0)
+	    continue;
+	if (istcp &&
+		gensio_check_keybool(args[i], "tcpdasync", &tcpd_async) > 0)
+	    continue;
 	return GE_INVAL;
     }
 
+#if defined(HAVE_TCPD_H) && !defined(NETNA_TCPD_ASYNC)
+    if (tcpd_async)
+	return GE_NOTSUP;
+#endif
+
+    if (accept_batch == 0 ||
+		reuseport == 0 || reuseport > GENSIO_MAX_REUSEPORT)
+	return GE_INVAL;
+
     nadata = o->zalloc(o, sizeof(*nadata));
     if (!nadata)
 	return GE_NOMEM;
@@ -918,6 +1373,28 @@ net_gensio_accepter_alloc(struct gensio_addr *iai,
     nadata->istcp = istcp;
     nadata->delsock = delsock;
 
+#ifdef HAVE_TCPD_H
+    if (tcpd_cache_size) {
+	nadata->tcpd_cache = o->zalloc(o, (sizeof(*nadata->tcpd_cache) *
+					   tcpd_cache_size));
+	if (!nadata->tcpd_cache)
+	    goto out_err;
+	nadata->tcpd_cache_size = tcpd_cache_size;
+	nadata->tcpd_cache_ttl = tcpd_cache_ttl;
+    }
+#endif
+
+#ifdef NETNA_TCPD_ASYNC
+    if (tcpd_async) {
+	err = gensio_os_worker_alloc(o, netna_tcpd_thread, netna_tcpd_finish,
+				     netna_tcpd_done, nadata,
+				     &nadata->tcpd_worker);
+	if (err)
+	    goto out_err;
+	nadata->tcpd_async = true;
+    }
+#endif
+
     err = base_gensio_accepter_alloc(NULL, netna_base_acc_op, nadata,
 				    o, type, cb, user_data, accepter);
     if (err)
@@ -927,6 +1404,8 @@ net_gensio_accepter_alloc(struct gensio_addr *iai,
     gensio_acc_set_is_reliable(nadata->acc, true);
     nadata->max_read_size = max_read_size;
     nadata->nodelay = nodelay;
+    nadata->accept_batch = accept_batch;
+    nadata->reuseport = reuseport;
 
     return 0;
 
@@ -6,7 +6,7 @@
  */
 
 #include "config.h"
-#define _DEFAULT_SOURCE /* Get getgrouplist(), setgroups() */
+#define _GNU_SOURCE /* Get getgrouplist(), setgroups(), recvmmsg() */
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
@@ -22,6 +22,7 @@
 
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #if HAVE_LIBSCTP
 #include <netinet/sctp.h>
 #endif
@@ -32,6 +33,12 @@
 #ifdef HAVE_TCPD_H
 #include <tcpd.h>
 #endif /* HAVE_TCPD_H */
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#endif
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -42,6 +49,8 @@
 #include <gensio/gensio_class.h>
 #include <gensio/argvutils.h>
 
+#include "utils.h"
+
 /* MacOS doesn't have IPV6_ADD_MEMBERSHIP, but has an equivalent. */
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -88,7 +97,7 @@ struct gensio_listen_scan_info {
  */
 static int gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 			       int family, int socktype, int protocol,
-			       int flags,
+			       int flags, bool reuseport,
 			       struct sockaddr *addr, socklen_t addrlen,
 			       void (*readhndlr)(int, void *),
 			       void (*writehndlr)(int, void *), void *data,
@@ -107,6 +116,12 @@ bool gensio_set_progname(const char *iprogname)
     return true;
 }
 
+const char *
+gensio_os_get_progname(void)
+{
+    return progname;
+}
+
 static int
 check_ipv6_only(int family, int protocol, int flags, int fd)
 {
@@ -234,6 +249,44 @@ gensio_os_sendto(struct gensio_os_funcs *o,
     ERRHANDLE();
 }
 
+int
+gensio_os_sendsegto(struct gensio_os_funcs *o,
+		    int fd, const struct gensio_sg *sg, gensiods sglen,
+		    gensiods *rcount,
+		    int flags, const struct gensio_addr *raddr,
+		    gensiods segsize)
+{
+#ifdef UDP_SEGMENT
+    ssize_t rv;
+    struct msghdr hdr;
+    union {
+	char buf[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr align;
+    } ctrl;
+    struct cmsghdr *cmsg;
+    uint16_t val = segsize;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_name = (void *) raddr->curr->ai_addr;
+    hdr.msg_namelen = raddr->curr->ai_addrlen;
+    hdr.msg_iov = (struct iovec *) sg;
+    hdr.msg_iovlen = sglen;
+    memset(&ctrl, 0, sizeof(ctrl));
+    hdr.msg_control = ctrl.buf;
+    hdr.msg_controllen = sizeof(ctrl.buf);
+    cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(val));
+    memcpy(CMSG_DATA(cmsg), &val, sizeof(val));
+ retry:
+    rv = sendmsg(fd, &hdr, flags);
+    ERRHANDLE();
+#else
+    return GE_NOTSUP;
+#endif
+}
+
 struct gensio_addr *
 gensio_addr_make(struct gensio_os_funcs *o, socklen_t size)
 {
@@ -304,6 +357,208 @@ gensio_os_recvfrom(struct gensio_os_funcs *o,
     ERRHANDLE();
 }
 
+/* Maximum number of packets handled in one sendmmsg/recvmmsg call. */
+#define GENSIO_OS_MAX_MMSG 64
+
+int
+gensio_os_sendmto(struct gensio_os_funcs *o, int fd,
+		  struct gensio_os_mmsg *msgs, unsigned int nr_msgs,
+		  unsigned int *nr_done, int flags)
+{
+#if HAVE_SENDMMSG
+    struct mmsghdr hdrs[GENSIO_OS_MAX_MMSG];
+    struct iovec iovs[GENSIO_OS_MAX_MMSG];
+    unsigned int i;
+    int rv;
+
+    if (nr_msgs > GENSIO_OS_MAX_MMSG)
+	nr_msgs = GENSIO_OS_MAX_MMSG;
+
+    memset(hdrs, 0, sizeof(*hdrs) * nr_msgs);
+    for (i = 0; i < nr_msgs; i++) {
+	iovs[i].iov_base = msgs[i].buf;
+	iovs[i].iov_len = msgs[i].len;
+	hdrs[i].msg_hdr.msg_name = msgs[i].addr->curr->ai_addr;
+	hdrs[i].msg_hdr.msg_namelen = msgs[i].addr->curr->ai_addrlen;
+	hdrs[i].msg_hdr.msg_iov = &iovs[i];
+	hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+ retry:
+    rv = sendmmsg(fd, hdrs, nr_msgs, flags);
+    if (rv < 0) {
+	if (errno == EINTR)
+	    goto retry;
+	if (errno == EWOULDBLOCK || errno == EAGAIN)
+	    rv = 0;
+	else
+	    return gensio_os_err_to_err(o, errno);
+    }
+    *nr_done = rv;
+    return 0;
+#else
+    unsigned int i;
+    struct msghdr hdr;
+    struct iovec iov;
+    ssize_t rv;
+    int err;
+
+    /*
+     * Use sendmsg() directly, a zero length datagram is a valid
+     * message, gensio_os_sendto() would report it as a closed
+     * connection.
+     */
+    for (i = 0; i < nr_msgs; i++) {
+	iov.iov_base = msgs[i].buf;
+	iov.iov_len = msgs[i].len;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_name = msgs[i].addr->curr->ai_addr;
+	hdr.msg_namelen = msgs[i].addr->curr->ai_addrlen;
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+    retry:
+	rv = sendmsg(fd, &hdr, flags);
+	if (rv < 0) {
+	    err = errno;
+	    if (err == EINTR)
+		goto retry;
+	    if (err == EWOULDBLOCK || err == EAGAIN)
+		break;
+	    if (i > 0)
+		break; /* Report what was sent, the error will come again. */
+	    return gensio_os_err_to_err(o, err);
+	}
+    }
+    *nr_done = i;
+    return 0;
+#endif
+}
+
+int
+gensio_os_recvmfrom(struct gensio_os_funcs *o, int fd,
+		    struct gensio_os_mmsg *msgs, unsigned int nr_msgs,
+		    unsigned int *nr_done, int flags)
+{
+#if HAVE_RECVMMSG
+    struct mmsghdr hdrs[GENSIO_OS_MAX_MMSG];
+    struct iovec iovs[GENSIO_OS_MAX_MMSG];
+    struct sockaddr_storage addrs[GENSIO_OS_MAX_MMSG];
+#ifdef UDP_GRO
+    union {
+	char buf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+    } ctrls[GENSIO_OS_MAX_MMSG];
+    struct cmsghdr *cmsg;
+    int segsize;
+#endif
+    struct gensio_addr *addr;
+    unsigned int i;
+    int rv;
+
+    if (nr_msgs > GENSIO_OS_MAX_MMSG)
+	nr_msgs = GENSIO_OS_MAX_MMSG;
+
+    memset(hdrs, 0, sizeof(*hdrs) * nr_msgs);
+    for (i = 0; i < nr_msgs; i++) {
+	iovs[i].iov_base = msgs[i].buf;
+	iovs[i].iov_len = msgs[i].len;
+	hdrs[i].msg_hdr.msg_name = &addrs[i];
+	hdrs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+	hdrs[i].msg_hdr.msg_iov = &iovs[i];
+	hdrs[i].msg_hdr.msg_iovlen = 1;
+#ifdef UDP_GRO
+	hdrs[i].msg_hdr.msg_control = ctrls[i].buf;
+	hdrs[i].msg_hdr.msg_controllen = sizeof(ctrls[i].buf);
+#endif
+    }
+
+ retry:
+    rv = recvmmsg(fd, hdrs, nr_msgs, flags, NULL);
+    if (rv < 0) {
+	if (errno == EINTR)
+	    goto retry;
+	if (errno == EWOULDBLOCK || errno == EAGAIN)
+	    rv = 0;
+	else
+	    return gensio_os_err_to_err(o, errno);
+    }
+
+    for (i = 0; i < (unsigned int) rv; i++) {
+	addr = gensio_addr_make(o, hdrs[i].msg_hdr.msg_namelen);
+	if (!addr) {
+	    while (i > 0) {
+		i--;
+		gensio_addr_free(msgs[i].addr);
+		msgs[i].addr = NULL;
+	    }
+	    return GE_NOMEM;
+	}
+	memcpy(addr->curr->ai_addr, &addrs[i], hdrs[i].msg_hdr.msg_namelen);
+	addr->curr->ai_family = addrs[i].ss_family;
+	msgs[i].addr = addr;
+	msgs[i].len = hdrs[i].msg_len;
+	msgs[i].segsize = 0;
+#ifdef UDP_GRO
+	for (cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cmsg;
+	     cmsg = CMSG_NXTHDR(&hdrs[i].msg_hdr, cmsg)) {
+	    if (cmsg->cmsg_level == IPPROTO_UDP &&
+			cmsg->cmsg_type == UDP_GRO) {
+		memcpy(&segsize, CMSG_DATA(cmsg), sizeof(segsize));
+		if (segsize > 0 && (gensiods) segsize < msgs[i].len)
+		    msgs[i].segsize = segsize;
+	    }
+	}
+#endif
+    }
+    *nr_done = rv;
+    return 0;
+#else
+    struct gensio_addr *addr;
+    unsigned int i;
+    ssize_t rv;
+    int err;
+
+    /*
+     * Use recvfrom() directly, a zero length datagram is a valid
+     * message and only errno can tell it from no data.
+     */
+    for (i = 0; i < nr_msgs; i++) {
+	addr = gensio_addr_make(o, sizeof(struct sockaddr_storage));
+	if (!addr) {
+	    err = GE_NOMEM;
+	    goto out_err;
+	}
+    retry:
+	rv = recvfrom(fd, msgs[i].buf, msgs[i].len, flags,
+		      addr->curr->ai_addr, &addr->curr->ai_addrlen);
+	if (rv < 0) {
+	    err = errno;
+	    if (err == EINTR)
+		goto retry;
+	    gensio_addr_free(addr);
+	    if (err == EWOULDBLOCK || err == EAGAIN)
+		break;
+	    err = gensio_os_err_to_err(o, err);
+	    goto out_err;
+	}
+	addr->curr->ai_family = addr->curr->ai_addr->sa_family;
+	msgs[i].addr = addr;
+	msgs[i].len = rv;
+	msgs[i].segsize = 0;
+    }
+    *nr_done = i;
+    return 0;
+
+ out_err:
+    if (i > 0) {
+	/* Report what was received, the error will come again. */
+	*nr_done = i;
+	return 0;
+    }
+    return err;
+#endif
+}
+
 int
 gensio_os_accept(struct gensio_os_funcs *o, int fd,
 		 struct gensio_addr **raddr, int *newsock)
@@ -325,7 +580,22 @@ gensio_os_accept(struct gensio_os_funcs *o, int fd,
 	len = sizeof(sadata);
     }
 
+#if HAVE_ACCEPT4
+    rv = accept4(fd, sa, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     rv = accept(fd, sa, &len);
+    if (rv >= 0) {
+	if (fcntl(rv, F_SETFL, O_NONBLOCK) == -1 ||
+		fcntl(rv, F_SETFD, FD_CLOEXEC) == -1) {
+	    int err = errno;
+
+	    close(rv);
+	    if (addr)
+		gensio_addr_free(addr);
+	    return gensio_os_err_to_err(o, err);
+	}
+    }
+#endif
 
     if (rv >= 0) {
 	if (addr) {
@@ -337,7 +607,7 @@ gensio_os_accept(struct gensio_os_funcs *o, int fd,
     } else if (addr) {
 	gensio_addr_free(addr);
     }
-    if (errno == EAGAIN && errno == EWOULDBLOCK)
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
 	return GE_NODATA;
     return gensio_os_err_to_err(o, errno);
 }
@@ -451,7 +721,7 @@ gensio_os_sctp_open_socket(struct gensio_os_funcs *o,
 
 	rv = gensio_setup_listen_socket(o, true, ai->ai_family,
 					SOCK_STREAM, IPPROTO_SCTP, ai->ai_flags,
-					ai->ai_addr, ai->ai_addrlen,
+					false, ai->ai_addr, ai->ai_addrlen,
 					readhndlr, NULL, data,
 					fd_handler_cleared,
 					setup_socket,
@@ -816,9 +1086,16 @@ gensio_os_socket_setup(struct gensio_os_funcs *o, int fd,
 	    return gensio_os_err_to_err(o, errno);
     }
 
-    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
-		   (void *)&val, sizeof(val)) == -1)
+    /*
+     * Linux will give unbound UDP sockets with SO_REUSEADDR set the
+     * same ephemeral port when it binds them on the first send, so
+     * only set it on UDP if binding to a specific address.
+     */
+    if (protocol != GENSIO_NET_PROTOCOL_UDP || bindaddr) {
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+		       (void *)&val, sizeof(val)) == -1)
 	    return gensio_os_err_to_err(o, errno);
+    }
 
     if (nodelay) {
 	if (protocol == GENSIO_NET_PROTOCOL_TCP)
@@ -974,6 +1251,20 @@ gensio_os_mcast_del(struct gensio_os_funcs *o, int fd,
     return 0;
 }
 
+int
+gensio_os_set_udp_gro(struct gensio_os_funcs *o, int fd, bool ival)
+{
+#ifdef UDP_GRO
+    int val = ival;
+
+    if (setsockopt(fd, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)) == -1)
+	return gensio_os_err_to_err(o, errno);
+    return 0;
+#else
+    return GE_NOTSUP;
+#endif
+}
+
 int
 gensio_os_set_mcast_loop(struct gensio_os_funcs *o, int fd,
 			 struct gensio_addr *addr, bool ival)
@@ -1164,22 +1455,22 @@ unsigned int gensio_dyn_scan_next(unsigned int port)
 	return port + 1;
 }
 
-int
-gensio_os_open_socket(struct gensio_os_funcs *o,
-		      struct gensio_addr *ai,
-		      void (*readhndlr)(int, void *),
-		      void (*writehndlr)(int, void *),
-		      void (*fd_handler_cleared)(int, void *),
-		      void *data,
-		      struct opensocks **rfds, unsigned int *nr_fds)
+static int
+i_gensio_os_open_socket(struct gensio_os_funcs *o,
+			struct gensio_addr *ai,
+			void (*readhndlr)(int, void *),
+			void (*writehndlr)(int, void *),
+			void (*fd_handler_cleared)(int, void *),
+			void **data, unsigned int nr_shards,
+			struct opensocks **rfds, unsigned int *nr_fds)
 {
     struct addrinfo *rp;
     int family = AF_INET6; /* Try IPV6 first, then IPV4. */
-    struct opensocks *fds;
-    unsigned int curr_fd = 0, i;
+    struct opensocks *fds, *sfds;
+    unsigned int curr_fd = 0, i, j;
     unsigned int max_fds = 0;
     int rv = 0;
-    struct gensio_listen_scan_info scaninfo;
+    struct gensio_listen_scan_info scaninfo, sscaninfo;
 
     for (rp = ai->a; rp != NULL; rp = rp->ai_next)
 	max_fds++;
@@ -1187,7 +1478,12 @@ gensio_os_open_socket(struct gensio_os_funcs *o,
     if (max_fds == 0)
 	return GE_INVAL;
 
-    fds = o->zalloc(o, sizeof(*fds) * max_fds);
+    /*
+     * Shard 0's sockets come first, the other shards' sockets are
+     * put in the same position in the following blocks of max_fds.
+     * They get packed together at the end.
+     */
+    fds = o->zalloc(o, sizeof(*fds) * max_fds * nr_shards);
     if (!fds)
 	return GE_NOMEM;
 
@@ -1198,17 +1494,48 @@ gensio_os_open_socket(struct gensio_os_funcs *o,
 	if (family != rp->ai_family)
 	    continue;
 
+	if (nr_shards > 1 && family != AF_INET && family != AF_INET6) {
+	    rv = GE_NOTSUP;
+	    goto out_close;
+	}
+
 	rv = gensio_setup_listen_socket(o, rp->ai_socktype == SOCK_STREAM,
 					rp->ai_family, rp->ai_socktype,
 					rp->ai_protocol, rp->ai_flags,
+					nr_shards > 1,
 					rp->ai_addr, rp->ai_addrlen,
-					readhndlr, writehndlr, data,
+					readhndlr, writehndlr, data[0],
 					fd_handler_cleared, NULL,
 					&fds[curr_fd].fd, &fds[curr_fd].port,
 					&scaninfo);
 	if (rv)
 	    goto out_close;
 	fds[curr_fd].family = rp->ai_family;
+
+	/* The other shards bind to the port shard 0 got. */
+	for (j = 1; j < nr_shards; j++) {
+	    sfds = &fds[j * max_fds + curr_fd];
+	    memset(&sscaninfo, 0, sizeof(sscaninfo));
+	    sscaninfo.reqport = fds[curr_fd].port;
+	    rv = gensio_setup_listen_socket(o, rp->ai_socktype == SOCK_STREAM,
+					    rp->ai_family, rp->ai_socktype,
+					    rp->ai_protocol, rp->ai_flags, true,
+					    rp->ai_addr, rp->ai_addrlen,
+					    readhndlr, writehndlr, data[j],
+					    fd_handler_cleared, NULL,
+					    &sfds->fd, &sfds->port, &sscaninfo);
+	    if (rv) {
+		for (; j > 1; j--) {
+		    sfds = &fds[(j - 1) * max_fds + curr_fd];
+		    o->clear_fd_handlers_norpt(o, sfds->fd);
+		    close(sfds->fd);
+		}
+		o->clear_fd_handlers_norpt(o, fds[curr_fd].fd);
+		close(fds[curr_fd].fd);
+		goto out_close;
+	    }
+	    sfds->family = rp->ai_family;
+	}
 	curr_fd++;
     }
     if (family == AF_INET6) {
@@ -1230,6 +1557,9 @@ gensio_os_open_socket(struct gensio_os_funcs *o,
 	return GE_NOTFOUND;
     }
 
+    for (j = 1; j < nr_shards; j++)
+	memmove(&fds[j * curr_fd], &fds[j * max_fds], sizeof(*fds) * curr_fd);
+
     *nr_fds = curr_fd;
     *rfds = fds;
 
@@ -1237,8 +1567,11 @@ gensio_os_open_socket(struct gensio_os_funcs *o,
 
  out_close:
     for (i = 0; i < curr_fd; i++) {
-	o->clear_fd_handlers_norpt(o, fds[i].fd);
-	close(fds[i].fd);
+	for (j = 0; j < nr_shards; j++) {
+	    sfds = &fds[j * max_fds + i];
+	    o->clear_fd_handlers_norpt(o, sfds->fd);
+	    close(sfds->fd);
+	}
     }
 
     if (rv == GE_ADDRINUSE && scaninfo.start != 0 &&
@@ -1254,6 +1587,36 @@ gensio_os_open_socket(struct gensio_os_funcs *o,
     return rv;
 }
 
+int
+gensio_os_open_socket(struct gensio_os_funcs *o,
+		      struct gensio_addr *ai,
+		      void (*readhndlr)(int, void *),
+		      void (*writehndlr)(int, void *),
+		      void (*fd_handler_cleared)(int, void *),
+		      void *data,
+		      struct opensocks **rfds, unsigned int *nr_fds)
+{
+    return i_gensio_os_open_socket(o, ai, readhndlr, writehndlr,
+				   fd_handler_cleared, &data, 1,
+				   rfds, nr_fds);
+}
+
+int
+gensio_os_open_sharded_socket(struct gensio_os_funcs *o,
+			      struct gensio_addr *ai,
+			      void (*readhndlr)(int, void *),
+			      void (*writehndlr)(int, void *),
+			      void (*fd_handler_cleared)(int, void *),
+			      void **data, unsigned int nr_shards,
+			      struct opensocks **rfds, unsigned int *nr_fds)
+{
+    if (nr_shards == 0)
+	return GE_INVAL;
+    return i_gensio_os_open_socket(o, ai, readhndlr, writehndlr,
+				   fd_handler_cleared, data, nr_shards,
+				   rfds, nr_fds);
+}
+
 int
 gensio_os_socket_get_port(struct gensio_os_funcs *o, int fd, unsigned int *port)
 {
@@ -1275,6 +1638,7 @@ gensio_os_socket_get_port(struct gensio_os_funcs *o, int fd, unsigned int *port)
 static int
 gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 			   int family, int socktype, int protocol, int flags,
+			   bool reuseport,
 			   struct sockaddr *addr, socklen_t addrlen,
 			   void (*readhndlr)(int, void *),
 			   void (*writehndlr)(int, void *), void *data,
@@ -1315,6 +1679,17 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 		   (void *)&optval, sizeof(optval)) == -1)
 	goto out_err;
 
+    if (reuseport) {
+#ifdef SO_REUSEPORT
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+		       (void *)&optval, sizeof(optval)) == -1)
+	    goto out_err;
+#else
+	rv = GE_NOTSUP;
+	goto out;
+#endif
+    }
+
     if (check_ipv6_only(family, protocol, flags, fd) == -1)
 	goto out_err;
 
@@ -1376,7 +1751,12 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
 	    goto out;
     }
 
-    if (do_listen && listen(fd, 5) != 0)
+    /*
+     * Let the kernel queue as many connections as it allows, the
+     * accepter takes them in batches and a short queue would drop
+     * connections that come in a burst.
+     */
+    if (do_listen && listen(fd, SOMAXCONN) != 0)
 	goto out_err;
 
     rv = o->set_fd_handlers(o, fd, data,
@@ -1394,22 +1774,398 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o, bool do_listen,
     goto out;
 }
 
+#if defined(HAVE_TCPD_H) && defined(USE_PTHREADS)
+/*
+ * libwrap keeps global state and uses non-reentrant resolver calls,
+ * and accepters may run checks from their own threads, so only let
+ * one check run at a time in the process.
+ */
+static pthread_mutex_t tcpd_lock = PTHREAD_MUTEX_INITIALIZER;
+#define TCPD_LOCK() pthread_mutex_lock(&tcpd_lock)
+#define TCPD_UNLOCK() pthread_mutex_unlock(&tcpd_lock)
+#else
+#define TCPD_LOCK() do { } while (0)
+#define TCPD_UNLOCK() do { } while (0)
+#endif
+
 const char *
 gensio_os_check_tcpd_ok(int new_fd)
 {
 #ifdef HAVE_TCPD_H
     struct request_info req;
+    int allowed;
 
+    TCPD_LOCK();
     request_init(&req, RQ_DAEMON, progname, RQ_FILE, new_fd, NULL);
     fromhost(&req);
+    allowed = hosts_access(&req);
+    TCPD_UNLOCK();
 
-    if (!hosts_access(&req))
+    if (!allowed)
 	return "Access denied\r\n";
 #endif
 
     return NULL;
 }
 
+#ifdef USE_PTHREADS
+struct gensio_os_worker {
+    struct gensio_os_funcs *o;
+    gensio_os_worker_cb func;
+    gensio_os_worker_cb wake;
+    gensio_os_worker_cb done;
+    void *cb_data;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /*
+     * The thread writes wake_pipe to get the selector to call wake
+     * and, when func returns, to finish the thread.  Writing
+     * stop_pipe makes gensio_os_worker_wait_fd() return, it stays
+     * readable until the next start.
+     */
+    int wake_pipe[2];
+    int stop_pipe[2];
+
+    /* Only touched from the selector side. */
+    bool running;
+
+    /* Protected by lock. */
+    bool stopping;
+    bool exited;
+};
+
+static void
+gensio_os_worker_write_pipe(int fd)
+{
+    char c = 0;
+    ssize_t rv;
+
+    /* The pipe is non-blocking, if it's full a wakeup is pending. */
+    rv = write(fd, &c, 1);
+    (void) rv;
+}
+
+static void *
+gensio_os_worker_thread(void *cb_data)
+{
+    struct gensio_os_worker *w = cb_data;
+
+    w->func(w, w->cb_data);
+
+    pthread_mutex_lock(&w->lock);
+    w->exited = true;
+    pthread_mutex_unlock(&w->lock);
+    gensio_os_worker_write_pipe(w->wake_pipe[1]);
+
+    return NULL;
+}
+
+static void
+gensio_os_worker_wake_handler(int fd, void *cb_data)
+{
+    struct gensio_os_worker *w = cb_data;
+    char buf[16];
+    bool exited;
+
+    /*
+     * Drain before the callbacks, anything the thread does after
+     * this will cause another wakeup.
+     */
+    while (read(fd, buf, sizeof(buf)) > 0)
+	;
+
+    if (w->wake)
+	w->wake(w, w->cb_data);
+
+    pthread_mutex_lock(&w->lock);
+    exited = w->running && w->exited;
+    if (exited) {
+	w->running = false;
+	w->exited = false;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (exited) {
+	pthread_join(w->thread, NULL);
+	/* This may free the worker, don't touch it after this. */
+	if (w->done)
+	    w->done(w, w->cb_data);
+    }
+}
+
+static int
+gensio_os_worker_pipe(struct gensio_os_funcs *o, int fds[2])
+{
+    int err;
+
+    if (pipe(fds))
+	return gensio_os_err_to_err(o, errno);
+    err = gensio_os_set_non_blocking(o, fds[0]);
+    if (!err)
+	err = gensio_os_set_non_blocking(o, fds[1]);
+    if (err) {
+	close(fds[0]);
+	close(fds[1]);
+	fds[0] = -1;
+	fds[1] = -1;
+    }
+    return err;
+}
+
+int
+gensio_os_worker_alloc(struct gensio_os_funcs *o,
+		       gensio_os_worker_cb func,
+		       gensio_os_worker_cb wake,
+		       gensio_os_worker_cb done,
+		       void *cb_data,
+		       struct gensio_os_worker **rw)
+{
+    struct gensio_os_worker *w;
+    int err;
+
+    w = o->zalloc(o, sizeof(*w));
+    if (!w)
+	return GE_NOMEM;
+    w->o = o;
+    w->func = func;
+    w->wake = wake;
+    w->done = done;
+    w->cb_data = cb_data;
+    w->stop_pipe[0] = -1;
+    w->stop_pipe[1] = -1;
+
+    err = gensio_os_worker_pipe(o, w->wake_pipe);
+    if (err)
+	goto out_free;
+    err = gensio_os_worker_pipe(o, w->stop_pipe);
+    if (err)
+	goto out_close;
+    err = o->set_fd_handlers(o, w->wake_pipe[0], w,
+			     gensio_os_worker_wake_handler,
+			     NULL, NULL, NULL);
+    if (err)
+	goto out_close;
+    if (pthread_mutex_init(&w->lock, NULL)) {
+	err = GE_NOMEM;
+	goto out_clear;
+    }
+    if (pthread_cond_init(&w->cond, NULL)) {
+	pthread_mutex_destroy(&w->lock);
+	err = GE_NOMEM;
+	goto out_clear;
+    }
+    o->set_read_handler(o, w->wake_pipe[0], true);
+
+    *rw = w;
+    return 0;
+
+ out_clear:
+    o->clear_fd_handlers_norpt(o, w->wake_pipe[0]);
+ out_close:
+    close(w->wake_pipe[0]);
+    close(w->wake_pipe[1]);
+    if (w->stop_pipe[0] != -1) {
+	close(w->stop_pipe[0]);
+	close(w->stop_pipe[1]);
+    }
+ out_free:
+    o->free(o, w);
+    return err;
+}
+
+void
+gensio_os_worker_free(struct gensio_os_worker *w)
+{
+    struct gensio_os_funcs *o = w->o;
+
+    gensio_os_worker_stop_wait(w);
+    o->clear_fd_handlers_norpt(o, w->wake_pipe[0]);
+    close(w->wake_pipe[0]);
+    close(w->wake_pipe[1]);
+    close(w->stop_pipe[0]);
+    close(w->stop_pipe[1]);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    o->free(o, w);
+}
+
+int
+gensio_os_worker_start(struct gensio_os_worker *w)
+{
+    sigset_t set, oldset;
+    char buf[16];
+    int rv;
+
+    if (w->running)
+	return GE_INUSE;
+
+    while (read(w->stop_pipe[0], buf, sizeof(buf)) > 0)
+	;
+    w->stopping = false;
+    w->exited = false;
+
+    /* Signals are for the application's threads, not this one. */
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+    rv = pthread_create(&w->thread, NULL, gensio_os_worker_thread, w);
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+    if (rv)
+	return gensio_os_err_to_err(w->o, rv);
+    w->running = true;
+    return 0;
+}
+
+void
+gensio_os_worker_stop(struct gensio_os_worker *w)
+{
+    if (!w->running)
+	return;
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    gensio_os_worker_write_pipe(w->stop_pipe[1]);
+}
+
+void
+gensio_os_worker_stop_wait(struct gensio_os_worker *w)
+{
+    if (!w->running)
+	return;
+    gensio_os_worker_stop(w);
+    pthread_join(w->thread, NULL);
+    w->running = false;
+    w->exited = false;
+}
+
+bool
+gensio_os_worker_running(struct gensio_os_worker *w)
+{
+    return w->running;
+}
+
+void
+gensio_os_worker_lock(struct gensio_os_worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+}
+
+void
+gensio_os_worker_unlock(struct gensio_os_worker *w)
+{
+    pthread_mutex_unlock(&w->lock);
+}
+
+bool
+gensio_os_worker_stopping(struct gensio_os_worker *w)
+{
+    return w->stopping;
+}
+
+void
+gensio_os_worker_kick(struct gensio_os_worker *w)
+{
+    pthread_cond_signal(&w->cond);
+}
+
+int
+gensio_os_worker_wait(struct gensio_os_worker *w, gensio_time *timeout)
+{
+    struct timespec ts;
+    int rv = 0;
+
+    if (w->stopping)
+	return GE_LOCALCLOSED;
+    if (timeout) {
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout->secs;
+	ts.tv_nsec += timeout->nsecs;
+	while (ts.tv_nsec >= 1000000000) {
+	    ts.tv_sec++;
+	    ts.tv_nsec -= 1000000000;
+	}
+	rv = pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+    } else {
+	pthread_cond_wait(&w->cond, &w->lock);
+    }
+    if (w->stopping)
+	return GE_LOCALCLOSED;
+    if (rv == ETIMEDOUT)
+	return GE_TIMEDOUT;
+    return 0;
+}
+
+int
+gensio_os_worker_wait_fd(struct gensio_os_worker *w, int fd, bool write)
+{
+    struct pollfd fds[2];
+    int rv;
+
+    fds[0].fd = fd;
+    fds[0].events = write ? POLLOUT : POLLIN;
+    fds[1].fd = w->stop_pipe[0];
+    fds[1].events = POLLIN;
+    for (;;) {
+	fds[0].revents = 0;
+	fds[1].revents = 0;
+	rv = poll(fds, 2, -1);
+	if (rv == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return gensio_os_err_to_err(w->o, errno);
+	}
+	if (fds[1].revents)
+	    return GE_LOCALCLOSED;
+	if (fds[0].revents)
+	    return 0;
+    }
+}
+
+void
+gensio_os_worker_wake(struct gensio_os_worker *w)
+{
+    gensio_os_worker_write_pipe(w->wake_pipe[1]);
+}
+#else
+int
+gensio_os_worker_alloc(struct gensio_os_funcs *o,
+		       gensio_os_worker_cb func,
+		       gensio_os_worker_cb wake,
+		       gensio_os_worker_cb done,
+		       void *cb_data,
+		       struct gensio_os_worker **rw)
+{
+    return GE_NOTSUP;
+}
+
+void gensio_os_worker_free(struct gensio_os_worker *w) { }
+int gensio_os_worker_start(struct gensio_os_worker *w) { return GE_NOTSUP; }
+void gensio_os_worker_stop(struct gensio_os_worker *w) { }
+void gensio_os_worker_stop_wait(struct gensio_os_worker *w) { }
+bool gensio_os_worker_running(struct gensio_os_worker *w) { return false; }
+void gensio_os_worker_lock(struct gensio_os_worker *w) { }
+void gensio_os_worker_unlock(struct gensio_os_worker *w) { }
+bool gensio_os_worker_stopping(struct gensio_os_worker *w) { return true; }
+void gensio_os_worker_kick(struct gensio_os_worker *w) { }
+
+int
+gensio_os_worker_wait(struct gensio_os_worker *w, gensio_time *timeout)
+{
+    return GE_LOCALCLOSED;
+}
+
+int
+gensio_os_worker_wait_fd(struct gensio_os_worker *w, int fd, bool write)
+{
+    return GE_LOCALCLOSED;
+}
+
+void gensio_os_worker_wake(struct gensio_os_worker *w) { }
+#endif /* USE_PTHREADS */
+
 int
 gensio_i_os_err_to_err(struct gensio_os_funcs *o,
 		       int oserr, const char *caller, const char *file,
@@ -1533,6 +2289,63 @@ gensio_addr_equal(const struct gensio_addr *a1,
     return true;
 }
 
+/* FNV-1a, simple and good enough for a few bytes of address. */
+static unsigned int
+hash_bytes(unsigned int hash, const void *data, size_t len)
+{
+    const unsigned char *d = data;
+
+    while (len--) {
+	hash ^= *d++;
+	hash *= 16777619;
+    }
+    return hash;
+}
+
+unsigned int
+gensio_addr_hash(const struct gensio_addr *addr, bool compare_ports)
+{
+    const struct sockaddr *sa = addr->curr->ai_addr;
+    unsigned int hash = 2166136261U;
+
+    hash = hash_bytes(hash, &sa->sa_family, sizeof(sa->sa_family));
+    switch (sa->sa_family) {
+    case AF_INET:
+	{
+	    const struct sockaddr_in *s = (const struct sockaddr_in *) sa;
+
+	    if (compare_ports)
+		hash = hash_bytes(hash, &s->sin_port, sizeof(s->sin_port));
+	    hash = hash_bytes(hash, &s->sin_addr.s_addr,
+			      sizeof(s->sin_addr.s_addr));
+	}
+	break;
+
+    case AF_INET6:
+	{
+	    const struct sockaddr_in6 *s = (const struct sockaddr_in6 *) sa;
+
+	    if (compare_ports)
+		hash = hash_bytes(hash, &s->sin6_port, sizeof(s->sin6_port));
+	    hash = hash_bytes(hash, s->sin6_addr.s6_addr,
+			      sizeof(s->sin6_addr.s6_addr));
+	}
+	break;
+
+#if HAVE_UNIX
+    case AF_UNIX:
+	{
+	    const struct sockaddr_un *s = (const struct sockaddr_un *) sa;
+
+	    hash = hash_bytes(hash, s->sun_path, strlen(s->sun_path));
+	}
+	break;
+#endif
+    }
+
+    return hash;
+}
+
 static int
 gensio_sockaddr_to_str(const struct sockaddr *addr,
 		       char *buf, gensiods *pos, gensiods buflen)
@@ -8,7 +8,7 @@
 /* This code handles running a child process using a pty. */
 
 #include "config.h"
-#define _XOPEN_SOURCE 600 /* Get posix_openpt() and friends. */
+#define _GNU_SOURCE /* Get posix_openpt(), ptsname_r() and friends. */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -20,6 +20,9 @@
 #include <pwd.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#include <spawn.h>
+#endif
 
 #include <gensio/gensio.h>
 #include <gensio/gensio_class.h>
@@ -54,6 +57,74 @@ static int pty_check_open(void *handler_data, int fd)
  */
 extern char **environ;
 
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP) && \
+	defined(HAVE_PTSNAME_R) && defined(POSIX_SPAWN_SETSID)
+/*
+ * Start the program with posix_spawn(), which does not have to copy
+ * our page tables like fork() does.  The child starts a new session
+ * and opens the slave without O_NOCTTY, so the slave becomes its
+ * controlling terminal.  posix_spawn() can't change the user, so this
+ * is only used if gensio_os_setupnewprog() has nothing to do.
+ *
+ * Returns -1 if posix_spawn() can't be used, otherwise 0 or an errno.
+ */
+static int
+pty_spawn_child(int ptym, char *const argv[], const char **env, pid_t *rpid)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    char slave[64];
+    const char *pgm = argv[0];
+    char * const *penv = environ;
+    int err;
+
+    if (geteuid() != getuid())
+	return -1;
+
+    if (grantpt(ptym) < 0)
+	return errno;
+    err = ptsname_r(ptym, slave, sizeof(slave));
+    if (err)
+	return err;
+
+    if (*pgm == '-')
+	pgm++;
+    if (env)
+	penv = (char * const *) env;
+
+    err = posix_spawnattr_init(&attr);
+    if (err)
+	return err;
+    err = posix_spawn_file_actions_init(&fa);
+    if (err)
+	goto out_attr;
+
+    err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    if (!err)
+	err = posix_spawn_file_actions_addopen(&fa, 0, slave, O_RDWR, 0);
+    if (!err)
+	err = posix_spawn_file_actions_adddup2(&fa, 0, 1);
+    if (!err)
+	err = posix_spawn_file_actions_adddup2(&fa, 0, 2);
+    /* Close everything else, including the master. */
+    if (!err)
+	err = posix_spawn_file_actions_addclosefrom_np(&fa, 3);
+    if (!err)
+	err = posix_spawnp(rpid, pgm, &fa, &attr, argv, penv);
+
+    posix_spawn_file_actions_destroy(&fa);
+ out_attr:
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+#else
+static int
+pty_spawn_child(int ptym, char *const argv[], const char **env, pid_t *rpid)
+{
+    return -1;
+}
+#endif
+
 static int
 gensio_setup_child_on_pty(struct gensio_os_funcs *o,
 			  char *const argv[], const char **env,
@@ -79,7 +150,13 @@ gensio_setup_child_on_pty(struct gensio_os_funcs *o,
 	return gensio_os_err_to_err(o, err);
     }
 
-    pid = fork();
+    err = pty_spawn_child(ptym, argv, env, &pid);
+    if (err > 0) {
+	close(ptym);
+	return gensio_os_err_to_err(o, err);
+    }
+    if (err < 0)
+	pid = fork();
     if (pid < 0) {
 	err = errno;
 	close(ptym);
@@ -7,6 +7,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gensio/gensio_class.h>
 #include <gensio/gensio_ll_gensio.h>
 #include <gensio/gensio_acc_gensio.h>
@@ -14,6 +16,38 @@
 
 #include "gensio_filter_relpkt.h"
 
+/*
+ * relpkt can use larger packets on a datagram transport than on
+ * msgdelim, look at the bottom of the stack to choose the default.
+ */
+static bool
+relpkt_type_is_datagram(const char *type)
+{
+    return type && strcmp(type, "udp") == 0;
+}
+
+static bool
+relpkt_child_is_datagram(struct gensio *child)
+{
+    const char *type, *last = NULL;
+    unsigned int i;
+
+    for (i = 0; (type = gensio_get_type(child, i)); i++)
+	last = type;
+    return relpkt_type_is_datagram(last);
+}
+
+static bool
+relpkt_acc_child_is_datagram(struct gensio_accepter *child)
+{
+    const char *type, *last = NULL;
+    unsigned int i;
+
+    for (i = 0; (type = gensio_acc_get_type(child, i)); i++)
+	last = type;
+    return relpkt_type_is_datagram(last);
+}
+
 int
 relpkt_gensio_alloc(struct gensio *child, const char *const args[],
 		    struct gensio_os_funcs *o,
@@ -25,7 +59,8 @@ relpkt_gensio_alloc(struct gensio *child, const char *const args[],
     struct gensio_ll *ll;
     struct gensio *io;
 
-    err = gensio_relpkt_filter_alloc(o, args, false, &filter);
+    err = gensio_relpkt_filter_alloc(o, args, false,
+				     relpkt_child_is_datagram(child), &filter);
     if (err)
 	return err;
 
@@ -76,6 +111,7 @@ struct relpktna_data {
     struct gensio_accepter *acc;
     const char **args;
     struct gensio_os_funcs *o;
+    bool datagram;
 };
 
 static void
@@ -103,7 +139,8 @@ relpktna_new_child(void *acc_data, void **finish_data,
 {
     struct relpktna_data *nadata = acc_data;
 
-    return gensio_relpkt_filter_alloc(nadata->o, nadata->args, true, filter);
+    return gensio_relpkt_filter_alloc(nadata->o, nadata->args, true,
+				      nadata->datagram, filter);
 }
 
 static int
@@ -161,6 +198,7 @@ relpkt_gensio_accepter_alloc(struct gensio_accepter *child,
     }
 
     nadata->o = o;
+    nadata->datagram = relpkt_acc_child_is_datagram(child);
 
     err = gensio_gensio_accepter_alloc(child, o, "relpkt", cb, user_data,
 				       gensio_gensio_acc_relpkt_cb, nadata,
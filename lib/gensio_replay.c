@@ -0,0 +1,830 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * This code is for a gensio that plays back data captured by the
+ * trace gensio, either the capture segments or binary trace output.
+ * The captured data is delivered as read data, at the speed it was
+ * recorded or as fast as the user will take it.  Written data is
+ * thrown away.
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_class.h>
+#include <gensio/gensio_builtins.h>
+#include <gensio/argvutils.h>
+
+#include "gensio_filter_trace.h"
+
+enum replayn_state {
+    REPLAYN_CLOSED,
+    REPLAYN_IN_OPEN,
+    REPLAYN_OPEN,
+    REPLAYN_IN_OPEN_CLOSE,
+    REPLAYN_IN_CLOSE,
+};
+
+#define REPLAY_DIR_READ		(1 << TRACE_REC_READ)
+#define REPLAY_DIR_WRITE	(1 << TRACE_REC_WRITE)
+
+/* How much of a file to read at a time. */
+#define REPLAY_READ_SIZE	(256 * 1024)
+
+/*
+ * A segment to play.  The file is kept open while playing, so a
+ * capture segment that is replaced by a new capture still reads
+ * back the same.  len is the size of the data to use, taken when the
+ * file was opened, the file is read with pread(), never mapped, so
+ * a file that shrinks just looks truncated.
+ */
+struct replay_seg {
+    int fd;
+    gensiods len;
+    gensiods start;
+    uint64_t seq;
+};
+
+struct replayn_data {
+    struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+
+    unsigned int refcount;
+    enum replayn_state state;
+
+    struct gensio *io;
+
+    char *filename;
+    unsigned int dirmask;
+    bool realtime;
+
+    struct replay_seg *segs;
+    unsigned int nsegs;
+
+    /*
+     * Data read from the current segment, buf_len bytes from offset
+     * buf_pos.
+     */
+    unsigned char *buf;
+    gensiods buf_size;
+    gensiods buf_pos;
+    gensiods buf_len;
+
+    /* Current record and how much of its data has been delivered. */
+    unsigned int cur_seg;
+    gensiods pos;
+    gensiods data_off;
+
+    /* Time base for replaying at the recorded speed. */
+    bool time_base_set;
+    int64_t rec_base;
+    int64_t time_base;
+
+    int read_err;
+
+    bool read_enabled;
+    bool xmit_enabled;
+
+    gensio_done_err open_done;
+    void *open_data;
+
+    gensio_done close_done;
+    void *close_data;
+
+    bool deferred_op_pending;
+    struct gensio_runner *deferred_op_runner;
+
+    bool timer_running;
+    struct gensio_timer *timer;
+};
+
+static const char *const replay_oob_auxdata[] = { "oob", NULL };
+
+static void replayn_start_deferred_op(struct replayn_data *ndata);
+
+static void
+replayn_close_segs(struct replayn_data *ndata)
+{
+    unsigned int i;
+
+    for (i = 0; i < ndata->nsegs; i++)
+	close(ndata->segs[i].fd);
+    if (ndata->segs)
+	ndata->o->free(ndata->o, ndata->segs);
+    ndata->segs = NULL;
+    ndata->nsegs = 0;
+    ndata->buf_len = 0;
+}
+
+static void
+replayn_finish_free(struct replayn_data *ndata)
+{
+    struct gensio_os_funcs *o = ndata->o;
+
+    replayn_close_segs(ndata);
+    if (ndata->buf)
+	o->free(o, ndata->buf);
+    if (ndata->filename)
+	o->free(o, ndata->filename);
+    if (ndata->io)
+	gensio_data_free(ndata->io);
+    if (ndata->timer)
+	o->free_timer(ndata->timer);
+    if (ndata->deferred_op_runner)
+	o->free_runner(ndata->deferred_op_runner);
+    if (ndata->lock)
+	o->free_lock(ndata->lock);
+    o->free(o, ndata);
+}
+
+static void
+replayn_lock(struct replayn_data *ndata)
+{
+    ndata->o->lock(ndata->lock);
+}
+
+static void
+replayn_unlock(struct replayn_data *ndata)
+{
+    ndata->o->unlock(ndata->lock);
+}
+
+static void
+replayn_ref(struct replayn_data *ndata)
+{
+    assert(ndata->refcount > 0);
+    ndata->refcount++;
+}
+
+/* Only for dropping a ref that is known not to be the last one. */
+static void
+replayn_deref(struct replayn_data *ndata)
+{
+    assert(ndata->refcount > 1);
+    ndata->refcount--;
+}
+
+static void
+replayn_unlock_and_deref(struct replayn_data *ndata)
+{
+    assert(ndata->refcount > 0);
+    if (ndata->refcount == 1) {
+	replayn_unlock(ndata);
+	replayn_finish_free(ndata);
+    } else {
+	ndata->refcount--;
+	replayn_unlock(ndata);
+    }
+}
+
+static void
+replayn_stop_timer(struct replayn_data *ndata)
+{
+    if (ndata->timer_running && ndata->o->stop_timer(ndata->timer) == 0) {
+	ndata->timer_running = false;
+	replayn_deref(ndata);
+    }
+}
+
+/*
+ * Open one file to play and read its header.  Returns GE_NOTFOUND if
+ * it doesn't exist or is empty, GE_NOTREADY if it is a capture
+ * segment that is still being written.
+ */
+static int
+replayn_open_file(struct replayn_data *ndata, const char *name,
+		  struct replay_seg *seg)
+{
+    unsigned char hdr[TRACE_CAP_HDR_SIZE];
+    struct stat st;
+    uint64_t used;
+    int fd;
+
+    fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+	return GE_NOTFOUND;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+	close(fd);
+	return GE_NOTFOUND;
+    }
+
+    seg->fd = fd;
+    seg->len = st.st_size;
+    if (pread(fd, hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+	    memcmp(hdr, TRACE_CAP_MAGIC, TRACE_CAP_MAGIC_SIZE) == 0) {
+	used = gensio_trace_get_le(hdr + TRACE_CAP_USED_OFF, 8);
+	if (used < TRACE_CAP_HDR_SIZE || used > seg->len) {
+	    /* Not finished, it may be truncated at any time. */
+	    close(fd);
+	    return GE_NOTREADY;
+	}
+	seg->len = used;
+	seg->start = TRACE_CAP_HDR_SIZE;
+	seg->seq = gensio_trace_get_le(hdr + TRACE_CAP_MAGIC_SIZE, 8);
+    } else {
+	/* Plain binary trace output. */
+	seg->start = 0;
+	seg->seq = 0;
+    }
+    return 0;
+}
+
+static int
+replay_seg_cmp(const void *a, const void *b)
+{
+    const struct replay_seg *sa = a, *sb = b;
+
+    if (sa->seq < sb->seq)
+	return -1;
+    if (sa->seq > sb->seq)
+	return 1;
+    return 0;
+}
+
+/*
+ * If the file name exists, play just that file.  Otherwise play the
+ * finished capture segments "<file>.0", "<file>.1", ... in sequence
+ * order, skipping the one still being written.
+ */
+static int
+replayn_scan(struct replayn_data *ndata)
+{
+    struct gensio_os_funcs *o = ndata->o;
+    char name[strlen(ndata->filename) + 12];
+    struct replay_seg seg, *segs;
+    unsigned int i;
+    int err;
+
+    err = replayn_open_file(ndata, ndata->filename, &seg);
+    if (err != GE_NOTFOUND) {
+	if (err)
+	    return err;
+	ndata->segs = o->zalloc(o, sizeof(seg));
+	if (!ndata->segs) {
+	    close(seg.fd);
+	    return GE_NOMEM;
+	}
+	ndata->segs[0] = seg;
+	ndata->nsegs = 1;
+    } else {
+	for (i = 0; ; i++) {
+	    snprintf(name, sizeof(name), "%s.%u", ndata->filename, i);
+	    if (access(name, F_OK) != 0)
+		break;
+	    if (replayn_open_file(ndata, name, &seg))
+		continue;
+	    segs = o->zalloc(o, sizeof(seg) * (ndata->nsegs + 1));
+	    if (!segs) {
+		close(seg.fd);
+		replayn_close_segs(ndata);
+		return GE_NOMEM;
+	    }
+	    if (ndata->segs) {
+		memcpy(segs, ndata->segs, sizeof(seg) * ndata->nsegs);
+		o->free(o, ndata->segs);
+	    }
+	    ndata->segs = segs;
+	    ndata->segs[ndata->nsegs++] = seg;
+	}
+	if (ndata->nsegs == 0)
+	    return GE_NOTFOUND;
+	qsort(ndata->segs, ndata->nsegs, sizeof(seg), replay_seg_cmp);
+    }
+
+    ndata->cur_seg = 0;
+    ndata->pos = ndata->segs[0].start;
+    ndata->data_off = 0;
+    ndata->buf_len = 0;
+    ndata->time_base_set = false;
+    ndata->read_err = 0;
+    return 0;
+}
+
+/*
+ * Return len bytes at pos in the current segment, reading them in if
+ * necessary.  Returns NULL and sets err to 0 if they aren't all in
+ * the segment.
+ */
+static unsigned char *
+replayn_get(struct replayn_data *ndata, gensiods pos, gensiods len, int *err)
+{
+    struct gensio_os_funcs *o = ndata->o;
+    struct replay_seg *seg = &ndata->segs[ndata->cur_seg];
+    gensiods size, got = 0;
+    ssize_t rv;
+
+    *err = 0;
+    if (pos > seg->len || len > seg->len - pos)
+	return NULL;
+    if (pos >= ndata->buf_pos && pos - ndata->buf_pos <= ndata->buf_len &&
+		len <= ndata->buf_len - (pos - ndata->buf_pos))
+	return ndata->buf + (pos - ndata->buf_pos);
+
+    size = len > REPLAY_READ_SIZE ? len : REPLAY_READ_SIZE;
+    if (size > seg->len - pos)
+	size = seg->len - pos;
+    if (size > ndata->buf_size) {
+	ndata->buf_len = 0;
+	if (ndata->buf)
+	    o->free(o, ndata->buf);
+	ndata->buf_size = 0;
+	ndata->buf = o->zalloc(o, size);
+	if (!ndata->buf) {
+	    *err = GE_NOMEM;
+	    return NULL;
+	}
+	ndata->buf_size = size;
+    }
+
+    while (got < size) {
+	rv = pread(seg->fd, ndata->buf + got, size - got, pos + got);
+	if (rv == -1 && errno == EINTR)
+	    continue;
+	if (rv <= 0)
+	    break;
+	got += rv;
+    }
+    ndata->buf_pos = pos;
+    ndata->buf_len = got;
+    if (got < len)
+	return NULL; /* The file got shorter. */
+    return ndata->buf;
+}
+
+/*
+ * Find the next record to deliver, skipping records in the other
+ * direction, errors, and drop records.  Returns NULL at the end, or
+ * on an error, which is returned in err.
+ */
+static unsigned char *
+replayn_cur_rec(struct replayn_data *ndata, gensiods *rlen, int *err)
+{
+    unsigned char *rec;
+    gensiods len;
+
+    while (ndata->cur_seg < ndata->nsegs) {
+	rec = replayn_get(ndata, ndata->pos, TRACE_REC_HDR_SIZE, err);
+	if (!rec || rec[0] == 0)
+	    goto next_seg;
+	len = gensio_trace_get_le(rec + 4, 4);
+	rec = replayn_get(ndata, ndata->pos, TRACE_REC_HDR_SIZE + len, err);
+	if (!rec)
+	    goto next_seg; /* Truncated record. */
+	if (rec[0] < 32 && (ndata->dirmask & (1 << rec[0])) && len > 0 &&
+		gensio_trace_get_le(rec + 20, 4) == 0) {
+	    *rlen = len;
+	    return rec;
+	}
+	ndata->pos += TRACE_REC_HDR_SIZE + len;
+	continue;
+
+    next_seg:
+	if (*err)
+	    return NULL;
+	ndata->cur_seg++;
+	ndata->buf_len = 0;
+	if (ndata->cur_seg < ndata->nsegs)
+	    ndata->pos = ndata->segs[ndata->cur_seg].start;
+    }
+    return NULL;
+}
+
+/*
+ * For replaying at the recorded speed, returns true and starts the
+ * timer if the record isn't due yet.
+ */
+static bool
+replayn_wait_for_rec(struct replayn_data *ndata, unsigned char *rec)
+{
+    gensio_time now;
+    int64_t recns, nowns, duens;
+
+    recns = (gensio_trace_get_le(rec + 8, 8) * 1000000000LL +
+	     gensio_trace_get_le(rec + 16, 4));
+    ndata->o->get_monotonic_time(ndata->o, &now);
+    nowns = now.secs * 1000000000LL + now.nsecs;
+    if (!ndata->time_base_set) {
+	ndata->time_base_set = true;
+	ndata->rec_base = recns;
+	ndata->time_base = nowns;
+	return false;
+    }
+    duens = ndata->time_base + (recns - ndata->rec_base);
+    if (duens <= nowns)
+	return false;
+
+    now.secs = duens / 1000000000LL;
+    now.nsecs = duens % 1000000000LL;
+    if (ndata->o->start_timer_abs(ndata->timer, &now) != 0)
+	return false;
+    ndata->timer_running = true;
+    replayn_ref(ndata);
+    return true;
+}
+
+static int
+replayn_write(struct gensio *io, gensiods *count,
+	      const struct gensio_sg *sg, gensiods sglen)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+    gensiods total_write = 0, i;
+    int err = 0;
+
+    replayn_lock(ndata);
+    if (ndata->state != REPLAYN_OPEN) {
+	err = GE_NOTREADY;
+    } else {
+	/* Just drop the data. */
+	for (i = 0; i < sglen; i++)
+	    total_write += sg[i].buflen;
+    }
+    replayn_unlock(ndata);
+    if (count)
+	*count = total_write;
+    return err;
+}
+
+static int
+replayn_raddr_to_str(struct gensio *io, gensiods *pos,
+		     char *buf, gensiods buflen)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    gensio_pos_snprintf(buf, buflen, pos, "replay(file=%s)", ndata->filename);
+
+    return 0;
+}
+
+static int
+replayn_remote_id(struct gensio *io, int *id)
+{
+    return GE_NOTSUP;
+}
+
+static void
+replayn_deferred_op(struct gensio_runner *runner, void *cb_data)
+{
+    struct replayn_data *ndata = cb_data;
+
+    replayn_lock(ndata);
+    ndata->deferred_op_pending = false;
+
+    if (ndata->state == REPLAYN_IN_OPEN ||
+		ndata->state == REPLAYN_IN_OPEN_CLOSE) {
+	int err = 0;
+
+	if (ndata->state == REPLAYN_IN_OPEN_CLOSE) {
+	    ndata->state = REPLAYN_IN_CLOSE;
+	    err = GE_LOCALCLOSED;
+	} else {
+	    ndata->state = REPLAYN_OPEN;
+	}
+	if (ndata->open_done) {
+	    replayn_unlock(ndata);
+	    ndata->open_done(ndata->io, err, ndata->open_data);
+	    replayn_lock(ndata);
+	}
+    }
+
+    while (ndata->state == REPLAYN_OPEN && ndata->read_enabled &&
+	   !ndata->timer_running) {
+	unsigned char *rec = NULL;
+	const char *const *auxdata = NULL;
+	gensiods len = 0, count = 0;
+	int err;
+
+	if (!ndata->read_err) {
+	    rec = replayn_cur_rec(ndata, &len, &err);
+	    if (!rec) {
+		ndata->read_enabled = false;
+		ndata->read_err = err ? err : GE_REMCLOSE;
+	    } else if (ndata->realtime && ndata->data_off == 0 &&
+		       replayn_wait_for_rec(ndata, rec)) {
+		break;
+	    } else {
+		count = len - ndata->data_off;
+		if (rec[1] & TRACE_REC_FLAG_OOB)
+		    auxdata = replay_oob_auxdata;
+	    }
+	}
+	replayn_unlock(ndata);
+	gensio_cb(ndata->io, GENSIO_EVENT_READ, ndata->read_err,
+		  rec ? rec + TRACE_REC_HDR_SIZE + ndata->data_off : NULL,
+		  &count, auxdata);
+	replayn_lock(ndata);
+	if (rec) {
+	    ndata->data_off += count;
+	    if (ndata->data_off >= len) {
+		ndata->pos += TRACE_REC_HDR_SIZE + len;
+		ndata->data_off = 0;
+	    }
+	}
+    }
+
+    while (ndata->state == REPLAYN_OPEN && ndata->xmit_enabled) {
+	replayn_unlock(ndata);
+	gensio_cb(ndata->io, GENSIO_EVENT_WRITE_READY, 0,
+		  NULL, NULL, NULL);
+	replayn_lock(ndata);
+    }
+
+    if (ndata->state == REPLAYN_IN_CLOSE) {
+	ndata->state = REPLAYN_CLOSED;
+	if (ndata->close_done) {
+	    replayn_unlock(ndata);
+	    ndata->close_done(ndata->io, ndata->close_data);
+	    replayn_lock(ndata);
+	}
+    }
+
+    replayn_unlock_and_deref(ndata);
+}
+
+static void
+replayn_start_deferred_op(struct replayn_data *ndata)
+{
+    if (!ndata->deferred_op_pending) {
+	/* Call the read from the selector to avoid lock nesting issues. */
+	ndata->deferred_op_pending = true;
+	ndata->o->run(ndata->deferred_op_runner);
+	replayn_ref(ndata);
+    }
+}
+
+static void
+replayn_timeout(struct gensio_timer *t, void *cb_data)
+{
+    struct replayn_data *ndata = cb_data;
+
+    replayn_lock(ndata);
+    ndata->timer_running = false;
+    if (ndata->state == REPLAYN_OPEN)
+	replayn_start_deferred_op(ndata);
+    replayn_unlock_and_deref(ndata);
+}
+
+static void
+replayn_set_read_callback_enable(struct gensio *io, bool enabled)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    replayn_lock(ndata);
+    if (ndata->read_enabled != enabled) {
+	ndata->read_enabled = enabled;
+	if (enabled && ndata->state == REPLAYN_OPEN && !ndata->timer_running)
+	    replayn_start_deferred_op(ndata);
+    }
+    replayn_unlock(ndata);
+}
+
+static void
+replayn_set_write_callback_enable(struct gensio *io, bool enabled)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    replayn_lock(ndata);
+    if (ndata->xmit_enabled != enabled) {
+	ndata->xmit_enabled = enabled;
+	if (enabled && ndata->state == REPLAYN_OPEN)
+	    replayn_start_deferred_op(ndata);
+    }
+    replayn_unlock(ndata);
+}
+
+static int
+replayn_open(struct gensio *io, gensio_done_err open_done, void *open_data)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+    int err = 0;
+
+    replayn_lock(ndata);
+    if (ndata->state != REPLAYN_CLOSED) {
+	err = GE_NOTREADY;
+	goto out_unlock;
+    }
+    replayn_close_segs(ndata);
+    err = replayn_scan(ndata);
+    if (err)
+	goto out_unlock;
+    ndata->state = REPLAYN_IN_OPEN;
+    ndata->open_done = open_done;
+    ndata->open_data = open_data;
+    replayn_start_deferred_op(ndata);
+ out_unlock:
+    replayn_unlock(ndata);
+
+    return err;
+}
+
+static int
+replayn_close(struct gensio *io, gensio_done close_done, void *close_data)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+    int err = 0;
+
+    replayn_lock(ndata);
+    if (ndata->state != REPLAYN_OPEN && ndata->state != REPLAYN_IN_OPEN) {
+	err = GE_NOTREADY;
+	goto out_unlock;
+    }
+    replayn_stop_timer(ndata);
+    if (ndata->state == REPLAYN_IN_OPEN)
+	ndata->state = REPLAYN_IN_OPEN_CLOSE;
+    else
+	ndata->state = REPLAYN_IN_CLOSE;
+    ndata->close_done = close_done;
+    ndata->close_data = close_data;
+    replayn_start_deferred_op(ndata);
+ out_unlock:
+    replayn_unlock(ndata);
+
+    return err;
+}
+
+static void
+replayn_func_ref(struct gensio *io)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    replayn_lock(ndata);
+    replayn_ref(ndata);
+    replayn_unlock(ndata);
+}
+
+static void
+replayn_free(struct gensio *io)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    replayn_lock(ndata);
+    assert(ndata->refcount > 0);
+    replayn_stop_timer(ndata);
+    if (ndata->refcount == 1)
+	ndata->state = REPLAYN_CLOSED;
+    replayn_unlock_and_deref(ndata);
+}
+
+static int
+replayn_disable(struct gensio *io)
+{
+    struct replayn_data *ndata = gensio_get_gensio_data(io);
+
+    replayn_lock(ndata);
+    ndata->state = REPLAYN_CLOSED;
+    replayn_unlock(ndata);
+
+    return 0;
+}
+
+static int
+gensio_replay_func(struct gensio *io, int func, gensiods *count,
+		   const void *cbuf, gensiods buflen, void *buf,
+		   const char *const *auxdata)
+{
+    switch (func) {
+    case GENSIO_FUNC_WRITE_SG:
+	return replayn_write(io, count, cbuf, buflen);
+
+    case GENSIO_FUNC_RADDR_TO_STR:
+	return replayn_raddr_to_str(io, count, buf, buflen);
+
+    case GENSIO_FUNC_OPEN:
+	return replayn_open(io, cbuf, buf);
+
+    case GENSIO_FUNC_CLOSE:
+	return replayn_close(io, cbuf, buf);
+
+    case GENSIO_FUNC_FREE:
+	replayn_free(io);
+	return 0;
+
+    case GENSIO_FUNC_REF:
+	replayn_func_ref(io);
+	return 0;
+
+    case GENSIO_FUNC_SET_READ_CALLBACK:
+	replayn_set_read_callback_enable(io, buflen);
+	return 0;
+
+    case GENSIO_FUNC_SET_WRITE_CALLBACK:
+	replayn_set_write_callback_enable(io, buflen);
+	return 0;
+
+    case GENSIO_FUNC_REMOTE_ID:
+	return replayn_remote_id(io, buf);
+
+    case GENSIO_FUNC_DISABLE:
+	return replayn_disable(io);
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static struct gensio_enum_val replay_dir_enum[] = {
+    { "read", REPLAY_DIR_READ },
+    { "write", REPLAY_DIR_WRITE },
+    { "both", REPLAY_DIR_READ | REPLAY_DIR_WRITE },
+    { NULL }
+};
+
+static struct gensio_enum_val replay_speed_enum[] = {
+    { "max", false },
+    { "recorded", true },
+    { NULL }
+};
+
+int
+replay_gensio_alloc(const char * const argv[], const char * const args[],
+		    struct gensio_os_funcs *o,
+		    gensio_event cb, void *user_data,
+		    struct gensio **new_gensio)
+{
+    struct replayn_data *ndata = NULL;
+    const char *filename = NULL;
+    int dirmask = REPLAY_DIR_READ, realtime = false;
+    int i;
+
+    for (i = 0; args && args[i]; i++) {
+	if (gensio_check_keyvalue(args[i], "file", &filename) > 0)
+	    continue;
+	if (gensio_check_keyenum(args[i], "dir", replay_dir_enum,
+				 &dirmask) > 0)
+	    continue;
+	if (gensio_check_keyenum(args[i], "speed", replay_speed_enum,
+				 &realtime) > 0)
+	    continue;
+	return GE_INVAL;
+    }
+    if (!filename)
+	return GE_INVAL;
+
+    ndata = o->zalloc(o, sizeof(*ndata));
+    if (!ndata)
+	return GE_NOMEM;
+    ndata->o = o;
+    ndata->refcount = 1;
+    ndata->dirmask = dirmask;
+    ndata->realtime = realtime;
+
+    ndata->filename = gensio_strdup(o, filename);
+    if (!ndata->filename)
+	goto out_nomem;
+
+    ndata->deferred_op_runner = o->alloc_runner(o, replayn_deferred_op, ndata);
+    if (!ndata->deferred_op_runner)
+	goto out_nomem;
+
+    ndata->timer = o->alloc_timer(o, replayn_timeout, ndata);
+    if (!ndata->timer)
+	goto out_nomem;
+
+    ndata->lock = o->alloc_lock(o);
+    if (!ndata->lock)
+	goto out_nomem;
+
+    ndata->io = gensio_data_alloc(ndata->o, cb, user_data,
+				  gensio_replay_func, NULL, "replay", ndata);
+    if (!ndata->io)
+	goto out_nomem;
+    gensio_set_is_client(ndata->io, true);
+    gensio_set_is_reliable(ndata->io, true);
+
+    *new_gensio = ndata->io;
+
+    return 0;
+
+ out_nomem:
+    replayn_finish_free(ndata);
+    return GE_NOMEM;
+}
+
+int
+str_to_replay_gensio(const char *str, const char * const args[],
+		     struct gensio_os_funcs *o,
+		     gensio_event cb, void *user_data,
+		     struct gensio **new_gensio)
+{
+    int err;
+    const char **argv;
+
+    err = gensio_str_to_argv(o, str, NULL, &argv, NULL);
+    if (!err) {
+	err = replay_gensio_alloc(argv, args, o, cb, user_data, new_gensio);
+	gensio_argv_free(o, argv);
+    }
+    return err;
+}
+
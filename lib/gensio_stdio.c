@@ -8,6 +8,7 @@
 /* This code handles stdio stream I/O. */
 
 #include "config.h"
+#define _GNU_SOURCE /* Get posix_spawn_file_actions_addclosefrom_np(). */
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -17,6 +18,12 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#include <spawn.h>
+#endif
 
 #include <gensio/gensio.h>
 #include <gensio/gensio_class.h>
@@ -24,6 +31,25 @@
 
 #include "utils.h"
 
+/*
+ * A pidfd becomes readable when the process exits, so we can wait
+ * for it in the selector instead of polling waitpid().
+ */
+#ifdef SYS_pidfd_open
+static int
+stdio_pidfd_open(pid_t pid)
+{
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+#else
+static int
+stdio_pidfd_open(pid_t pid)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
 static int gensio_stdio_func(struct gensio *io, int func, gensiods *count,
 			     const void *cbuf, gensiods buflen, void *buf,
 			     const char *const *auxdata);
@@ -96,6 +122,13 @@ struct stdiona_data {
 
     struct gensio_timer *waitpid_timer;
 
+    /*
+     * If not -1, a pidfd for opid.  Used to wait for the process to
+     * exit, otherwise waitpid_timer is used to poll for it.
+     */
+    int pidfd;
+    bool pidfd_handler_set;
+
     int old_flags_ostdin;
     int old_flags_ostdout;
     bool old_flags_ostdin_set;
@@ -157,6 +190,8 @@ stdiona_finish_free(struct stdiona_data *nadata)
 	nadata->o->free(nadata->o, nadata->io.read_data);
     if (nadata->waitpid_timer)
 	nadata->o->free_timer(nadata->waitpid_timer);
+    if (nadata->pidfd != -1)
+	close(nadata->pidfd);
     if (nadata->err.read_data)
 	nadata->o->free(nadata->o, nadata->err.read_data);
     if (nadata->lock)
@@ -278,6 +313,9 @@ stdion_finish_read(struct stdion_channel *schan, int err)
     stdiona_unlock(nadata);
 }
 
+static void stdiona_pidfd_ready(int fd, void *cb_data);
+static void stdiona_pidfd_cleared(int fd, void *cb_data);
+
 static void
 check_waitpid(struct stdion_channel *schan)
 {
@@ -297,15 +335,38 @@ check_waitpid(struct stdion_channel *schan)
 	if (rv == 0) {
 	    gensio_time timeout = { 0, 10000000 };
 
-	    /* The sub-process has not died, wait a bit and try again. */
+	    nadata->closing_chan = schan;
+	    if (nadata->pidfd_handler_set && nadata->pidfd != -1)
+		/* Already waiting for the pidfd. */
+		return;
+
+	    /* The sub-process has not died, wait for it. */
 	    stdiona_ref(nadata);
+	    if (nadata->pidfd != -1 &&
+		    !nadata->o->set_fd_handlers(nadata->o, nadata->pidfd,
+						nadata, stdiona_pidfd_ready,
+						NULL, NULL,
+						stdiona_pidfd_cleared)) {
+		nadata->pidfd_handler_set = true;
+		nadata->o->set_read_handler(nadata->o, nadata->pidfd, true);
+		return;
+	    }
+
+	    /* No pidfd, wait a bit and try again. */
 	    nadata->o->start_timer(nadata->waitpid_timer, &timeout);
-	    nadata->closing_chan = schan;
 	    return;
 	}
 
 	nadata->exit_code_set = true;
 	nadata->opid = -1;
+	if (nadata->pidfd != -1) {
+	    if (nadata->pidfd_handler_set)
+		/* The cleared handler will close it. */
+		nadata->o->clear_fd_handlers(nadata->o, nadata->pidfd);
+	    else
+		close(nadata->pidfd);
+	    nadata->pidfd = -1;
+	}
     }
 
     if (schan->close_done) {
@@ -337,6 +398,32 @@ check_waitpid_timeout(struct gensio_timer *t, void *cb_data)
     stdiona_deref_and_unlock(nadata);
 }
 
+static void
+stdiona_pidfd_ready(int fd, void *cb_data)
+{
+    struct stdiona_data *nadata = cb_data;
+
+    stdiona_lock(nadata);
+    nadata->o->set_read_handler(nadata->o, fd, false);
+    /* The cleared handler closes it. */
+    nadata->pidfd = -1;
+    /* The process has exited, this will reap it. */
+    check_waitpid(&nadata->io);
+    nadata->o->clear_fd_handlers(nadata->o, fd);
+    stdiona_unlock(nadata);
+}
+
+static void
+stdiona_pidfd_cleared(int fd, void *cb_data)
+{
+    struct stdiona_data *nadata = cb_data;
+
+    stdiona_lock(nadata);
+    nadata->pidfd_handler_set = false;
+    close(fd);
+    stdiona_deref_and_unlock(nadata);
+}
+
 static void
 stdion_start_close(struct stdion_channel *schan)
 {
@@ -547,6 +634,54 @@ stdion_write_except_ready(int fd, void *cbdata)
 
 extern char **environ;
 
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+/*
+ * Start the program with posix_spawn(), which does not have to copy
+ * our page tables like fork() does.  It can't change the user, so
+ * this is only used if gensio_os_setupnewprog() has nothing to do.
+ *
+ * Returns -1 if posix_spawn() can't be used, otherwise 0 or an errno.
+ */
+static int
+stdio_spawn_child(struct stdiona_data *nadata, int infd, int outfd,
+		  int errfd)
+{
+    posix_spawn_file_actions_t fa;
+    char * const *env = environ;
+    int err;
+
+    if (geteuid() != getuid())
+	return -1;
+
+    err = posix_spawn_file_actions_init(&fa);
+    if (err)
+	return err;
+    err = posix_spawn_file_actions_adddup2(&fa, infd, 0);
+    if (!err)
+	err = posix_spawn_file_actions_adddup2(&fa, outfd, 1);
+    if (!err && errfd != -1)
+	err = posix_spawn_file_actions_adddup2(&fa, errfd, 2);
+    /* Close everything but stdio. */
+    if (!err)
+	err = posix_spawn_file_actions_addclosefrom_np(&fa, 3);
+    if (nadata->env)
+	env = (char * const *) nadata->env;
+    if (!err)
+	err = posix_spawnp(&nadata->opid, nadata->argv[0], &fa, NULL,
+			   (char * const *) nadata->argv, env);
+    posix_spawn_file_actions_destroy(&fa);
+
+    return err;
+}
+#else
+static int
+stdio_spawn_child(struct stdiona_data *nadata, int infd, int outfd,
+		  int errfd)
+{
+    return -1;
+}
+#endif
+
 static int
 setup_child_proc(struct stdiona_data *nadata)
 {
@@ -599,7 +734,12 @@ setup_child_proc(struct stdiona_data *nadata)
 	}
     }
 
-    nadata->opid = fork();
+    err = stdio_spawn_child(nadata, stdinpipe[0], stdoutpipe[1],
+			    nadata->noredir_stderr ? -1 : stderrpipe[1]);
+    if (err > 0)
+	goto out_err;
+    if (err < 0)
+	nadata->opid = fork();
     if (nadata->opid < 0) {
 	err = errno;
 	goto out_err;
@@ -635,6 +775,13 @@ setup_child_proc(struct stdiona_data *nadata)
     close(stdoutpipe[1]);
     if (stdoutpipe[1] != stderrpipe[1])
 	close(stderrpipe[1]);
+
+    /*
+     * If this fails, or the pidfd from the last run is still being
+     * cleaned up, we just fall back to polling with waitpid().
+     */
+    if (!nadata->pidfd_handler_set)
+	nadata->pidfd = stdio_pidfd_open(nadata->opid);
     return 0;
 
  out_err:
@@ -960,7 +1107,8 @@ stdion_control(struct gensio *io, bool get, unsigned int option,
     struct stdion_channel *schan = gensio_get_gensio_data(io);
     struct stdiona_data *nadata = schan->nadata;
     const char **env, **argv;
-    int err, status;
+    int err, status, fd;
+    unsigned long val;
 
     switch (option) {
     case GENSIO_CONTROL_ENVIRONMENT:
@@ -1011,6 +1159,22 @@ stdion_control(struct gensio *io, bool get, unsigned int option,
 	}
 	stdiona_unlock(nadata);
 	return err;
+
+    case GENSIO_CONTROL_RAW_FD:
+	if (!get)
+	    return GE_NOTSUP;
+	/* We read from outfd and write to infd. */
+	val = strtoul(data, NULL, 0);
+	if (val == 0)
+	    fd = schan->outfd;
+	else if (val == 1)
+	    fd = schan->infd;
+	else
+	    return GE_INVAL;
+	if (fd == -1)
+	    return GE_NOTREADY;
+	*datalen = snprintf(data, *datalen, "%d", fd);
+	return 0;
     }
 
     return GE_NOTSUP;
@@ -1094,6 +1258,7 @@ stdio_nadata_setup(struct gensio_os_funcs *o, gensiods max_read_size,
     nadata->io.infd = -1;
     nadata->io.outfd = -1;
     nadata->opid = -1;
+    nadata->pidfd = -1;
 
     nadata->waitpid_timer = o->alloc_timer(o, check_waitpid_timeout,
 					   &nadata->io);
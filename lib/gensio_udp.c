@@ -18,6 +18,7 @@
 #include <gensio/argvutils.h>
 #include <gensio/gensio_osops.h>
 #include <gensio/gensio_builtins.h>
+#include "utils.h"
 
 #ifdef ENABLE_INTERNAL_TRACE
 #define LOCK_TRACING
@@ -30,6 +31,25 @@
  */
 #define GENSIO_DEFAULT_UDP_BUF_SIZE	65536
 
+/*
+ * Number of packets read from the socket at once by default.  Each
+ * one needs a readbuf sized buffer, so batching is off unless asked
+ * for.  Writes are sent immediately by default, a larger writebatch
+ * queues them and sends them together.
+ */
+#define GENSIO_DEFAULT_UDP_READ_BATCH	1
+#define GENSIO_DEFAULT_UDP_WRITE_BATCH	1
+#define GENSIO_MAX_UDP_BATCH		64
+
+/* Maximum number of SO_REUSEPORT shards for an accepter. */
+#define GENSIO_MAX_UDP_SHARDS		64
+
+/*
+ * Largest amount of data sent in one GSO send, the IP length field
+ * limits it to this.
+ */
+#define GENSIO_MAX_UDP_GSO_SIZE		65507
+
 struct udpna_data;
 
 enum udpn_state {
@@ -72,11 +92,31 @@ struct udpn_data {
     struct gensio_addr *raddr;		/* Points to remote, for convenience. */
 
     struct gensio_link link;
+
+    unsigned int hash; /* Hash of raddr. */
+    struct gensio_link hash_link;
 };
 
 #define gensio_link_to_ndata(l) \
     gensio_container_of(l, struct udpn_data, link);
 
+#define gensio_hash_link_to_ndata(l) \
+    gensio_container_of(l, struct udpn_data, hash_link);
+
+/*
+ * A hash table of udpns by remote address, to quickly find the owner
+ * of an incoming packet.  Each list of udpns has one.  The table
+ * grows as udpns are added, if it can't be allocated the list is
+ * searched instead.
+ */
+struct udpn_hash {
+    struct gensio_list *buckets;
+    unsigned int size; /* A power of 2, 0 if not allocated. */
+    unsigned int count;
+};
+
+#define UDPN_HASH_MIN_SIZE	16
+
 struct udpna_data;
 
 struct udpna_waiters {
@@ -88,9 +128,18 @@ struct udpna_waiters {
     struct udpna_waiters *next;
 };
 
+/* Tracks an operation done on all shards, done is called when all finish. */
+struct udpna_shard_done {
+    struct udpna_data *nadata;
+    unsigned int pending;
+    gensio_acc_done done;
+    void *done_data;
+};
+
 struct udpna_data {
     struct gensio_accepter *acc;
     struct gensio_list udpns;
+    struct udpn_hash udpn_hash;
     unsigned int udpn_count;
     unsigned int refcount;
 
@@ -100,13 +149,45 @@ struct udpna_data {
 
     gensiods max_read_size;
 
+    /*
+     * Packets are read in batches of up to read_batch packets into
+     * read_bufs.  rpkts[rpkt_pos] is the next one to be handled,
+     * there are rpkt_count of them left, all read from rpkt_fd.
+     * read_data points to the one currently being delivered.  If
+     * GRO is on, a packet may hold multiple coalesced ones,
+     * rpkt_off is where the next one in rpkts[rpkt_pos] starts.
+     */
+    unsigned int read_batch;
+    unsigned char *read_bufs;
+    struct gensio_os_mmsg *rpkts;
+    unsigned int rpkt_pos;
+    unsigned int rpkt_count;
+    gensiods rpkt_off;
+    int rpkt_fd;
+    bool in_handle_rpkts;
+    bool gro;
+
     unsigned char *read_data;
 
+    /*
+     * If write_batch is more than one, written packets are copied
+     * here and sent together from the deferred op, or when the queue
+     * fills up.  wpkt_fds holds the fd each packet goes out on.
+     */
+    unsigned int write_batch;
+    unsigned char *write_bufs;
+    struct gensio_os_mmsg *wpkts;
+    int *wpkt_fds;
+    unsigned int wpkt_count;
+    bool wpkt_write_wait; /* Waiting for the socket to take more. */
+    bool gso; /* Send runs of packets to the same place with GSO. */
+
     gensiods data_pending_len;
     gensiods data_pos;
     struct udpn_data *pending_data_owner;
 
     struct gensio_list closed_udpns;
+    struct udpn_hash closed_udpn_hash;
 
     /*
      * Used to run read callbacks from the selector to avoid running
@@ -120,6 +201,20 @@ struct udpna_data {
 
     bool is_dummy; /* Am I a dummy udpna? */
 
+    /*
+     * With the shards option, an accepter has nr_shards sets of
+     * sockets bound to the same addresses with SO_REUSEPORT, and the
+     * kernel spreads the remote ends across them.  Each shard is a
+     * full udpna_data with its own lock, buffers, and connections, so
+     * different shards can be handled in parallel by different
+     * threads.  The first shard belongs to the accepter and holds the
+     * others in shards.  The others point back to it in parent and
+     * hold a reference to it.
+     */
+    unsigned int nr_shards;
+    struct udpna_data **shards;
+    struct udpna_data *parent;
+
     bool enabled;
     bool closed;
     bool in_shutdown;
@@ -191,6 +286,7 @@ i_udpna_locktrace_add(struct udpna_data *nadata, bool locked, unsigned int line)
 #endif
 
 static void udpna_ref(struct udpna_data *nadata);
+static void udpna_deref_and_unlock(struct udpna_data *nadata);
 
 static void udpna_start_deferred_op(struct udpna_data *nadata)
 {
@@ -201,17 +297,87 @@ static void udpna_start_deferred_op(struct udpna_data *nadata)
     }
 }
 
+static struct udpn_hash *
+udpn_list_hash(struct udpna_data *nadata, struct gensio_list *list)
+{
+    if (list == &nadata->udpns)
+	return &nadata->udpn_hash;
+    return &nadata->closed_udpn_hash;
+}
+
+static void
+udpn_hash_free(struct gensio_os_funcs *o, struct udpn_hash *h)
+{
+    if (h->buckets)
+	o->free(o, h->buckets);
+    h->buckets = NULL;
+    h->size = 0;
+}
+
+/*
+ * Make the table bigger when it gets too full, rebuilding it from
+ * the list.  If that fails, just keep using the old one, it still
+ * works, just slower.  Returns false if the table could not be
+ * allocated, and nothing was changed.
+ */
+static bool
+udpn_hash_grow(struct gensio_os_funcs *o, struct udpn_hash *h,
+	       struct gensio_list *list)
+{
+    struct gensio_list *nb;
+    struct gensio_link *l;
+    unsigned int i, nsize;
+
+    nsize = h->size ? h->size * 2 : UDPN_HASH_MIN_SIZE;
+    nb = o->zalloc(o, sizeof(*nb) * nsize);
+    if (!nb)
+	return false;
+    for (i = 0; i < nsize; i++)
+	gensio_list_init(&nb[i]);
+
+    gensio_list_for_each(list, l) {
+	struct udpn_data *ndata = gensio_link_to_ndata(l);
+
+	if (ndata->hash_link.list)
+	    gensio_list_rm(ndata->hash_link.list, &ndata->hash_link);
+	gensio_list_add_tail(&nb[ndata->hash & (nsize - 1)],
+			     &ndata->hash_link);
+    }
+    udpn_hash_free(o, h);
+    h->buckets = nb;
+    h->size = nsize;
+    return true;
+}
+
 static void
 udpn_remove_from_list(struct gensio_list *list, struct udpn_data *ndata)
 {
+    struct udpn_hash *h = udpn_list_hash(ndata->nadata, list);
+
     gensio_list_rm(list, &ndata->link);
+    if (ndata->hash_link.list)
+	gensio_list_rm(ndata->hash_link.list, &ndata->hash_link);
+    h->count--;
 }
 
 static struct udpn_data *
-udpn_find(struct gensio_list *list, struct gensio_addr *addr)
+udpn_find(struct udpna_data *nadata, struct gensio_list *list,
+	  struct gensio_addr *addr)
 {
+    struct udpn_hash *h = udpn_list_hash(nadata, list);
     struct gensio_link *l;
 
+    if (h->size) {
+	list = &h->buckets[gensio_addr_hash(addr, true) & (h->size - 1)];
+	gensio_list_for_each(list, l) {
+	    struct udpn_data *ndata = gensio_hash_link_to_ndata(l);
+
+	    if (gensio_addr_equal(ndata->raddr, addr, true, false))
+		return ndata;
+	}
+	return NULL;
+    }
+
     gensio_list_for_each(list, l) {
 	struct udpn_data *ndata = gensio_link_to_ndata(l);
 
@@ -224,7 +390,16 @@ udpn_find(struct gensio_list *list, struct gensio_addr *addr)
 
 static void udpn_add_to_list(struct gensio_list *list, struct udpn_data *ndata)
 {
+    struct gensio_os_funcs *o = ndata->o;
+    struct udpn_hash *h = udpn_list_hash(ndata->nadata, list);
+
     gensio_list_add_tail(list, &ndata->link);
+    h->count++;
+    if (h->count > h->size * 2 && udpn_hash_grow(o, h, list))
+	return; /* This added the new one, too. */
+    if (h->size)
+	gensio_list_add_tail(&h->buckets[ndata->hash & (h->size - 1)],
+			     &ndata->hash_link);
 }
 
 static void
@@ -305,11 +480,150 @@ udpna_fd_write_enable(struct udpna_data *nadata)
     nadata->write_enable_count++;
 }
 
+/* Drop the first count packets from the write queue. */
+static void
+udpna_wpkts_remove(struct udpna_data *nadata, unsigned int count)
+{
+    struct gensio_os_mmsg tmsg;
+    unsigned int i;
+    int tfd;
+
+    for (i = 0; i < count; i++) {
+	gensio_addr_free(nadata->wpkts[i].addr);
+	nadata->wpkts[i].addr = NULL;
+    }
+
+    /* Move the rest to the front, keeping the buffers with the slots. */
+    for (i = count; i < nadata->wpkt_count; i++) {
+	tmsg = nadata->wpkts[i - count];
+	nadata->wpkts[i - count] = nadata->wpkts[i];
+	nadata->wpkts[i] = tmsg;
+	tfd = nadata->wpkt_fds[i - count];
+	nadata->wpkt_fds[i - count] = nadata->wpkt_fds[i];
+	nadata->wpkt_fds[i] = tfd;
+    }
+    nadata->wpkt_count -= count;
+}
+
+/*
+ * Return how many packets at the front of the write queue can go out
+ * in one GSO send.  They must go out the same fd to the same address
+ * and all be the same size, except the last may be shorter.
+ */
+static unsigned int
+udpna_gso_run(struct udpna_data *nadata)
+{
+    struct gensio_os_mmsg *first = &nadata->wpkts[0], *msg;
+    gensiods total = first->len;
+    unsigned int n;
+
+    for (n = 1; n < nadata->wpkt_count; n++) {
+	msg = &nadata->wpkts[n];
+	if (nadata->wpkt_fds[n] != nadata->wpkt_fds[0] ||
+		msg->len == 0 || msg->len > first->len ||
+		total + msg->len > GENSIO_MAX_UDP_GSO_SIZE ||
+		!gensio_addr_equal(msg->addr, first->addr, true, false))
+	    break;
+	total += msg->len;
+	if (msg->len < first->len)
+	    return n + 1;
+    }
+    return n;
+}
+
+static int
+udpna_send_gso(struct udpna_data *nadata, unsigned int n, unsigned int *sent)
+{
+    struct gensio_sg sg[GENSIO_MAX_UDP_BATCH];
+    gensiods count;
+    unsigned int i;
+    int err;
+
+    for (i = 0; i < n; i++) {
+	sg[i].buf = nadata->wpkts[i].buf;
+	sg[i].buflen = nadata->wpkts[i].len;
+    }
+    err = gensio_os_sendsegto(nadata->o, nadata->wpkt_fds[0], sg, n, &count,
+			      0, nadata->wpkts[0].addr, nadata->wpkts[0].len);
+    if (!err)
+	*sent = count ? n : 0;
+    return err;
+}
+
+/*
+ * Send whatever is in the write queue.  If the socket won't take it
+ * all, wait for it to become writable, unless this is the final
+ * flush before freeing, then the rest is just dropped.
+ */
+static void
+udpna_flush_writes(struct udpna_data *nadata, bool final)
+{
+    unsigned int n = 1, sent;
+    int err;
+
+    while (nadata->wpkt_count) {
+	if (nadata->gso)
+	    n = udpna_gso_run(nadata);
+	if (n > 1) {
+	    err = udpna_send_gso(nadata, n, &sent);
+	    if (err) {
+		/*
+		 * The OS or the path can't do it (the segments must
+		 * fit the MTU), send packets one at a time from now on.
+		 */
+		gensio_log(nadata->o, GENSIO_LOG_INFO,
+			   "udp: Disabling GSO: %s", gensio_err_to_str(err));
+		nadata->gso = false;
+		n = 1;
+		continue;
+	    }
+	} else {
+	    /* Send a run of packets going out the same fd. */
+	    for (n = 1; n < nadata->wpkt_count; n++) {
+		if (nadata->wpkt_fds[n] != nadata->wpkt_fds[0])
+		    break;
+	    }
+	    err = gensio_os_sendmto(nadata->o, nadata->wpkt_fds[0],
+				    nadata->wpkts, n, &sent, 0);
+	    if (err) {
+		/*
+		 * Nobody to report this to, the write already
+		 * succeeded.  Drop the packet, like the network would.
+		 */
+		gensio_log(nadata->o, GENSIO_LOG_WARNING,
+			   "udp: Error sending queued packet: %s",
+			   gensio_err_to_str(err));
+		sent = 1;
+	    }
+	}
+	if (sent == 0) {
+	    if (final)
+		break;
+	    if (!nadata->wpkt_write_wait) {
+		nadata->wpkt_write_wait = true;
+		udpna_fd_write_enable(nadata);
+	    }
+	    return;
+	}
+	udpna_wpkts_remove(nadata, sent);
+    }
+
+    if (final) {
+	udpna_wpkts_remove(nadata, nadata->wpkt_count);
+    } else if (nadata->wpkt_write_wait) {
+	nadata->wpkt_write_wait = false;
+	udpna_fd_write_disable(nadata);
+    }
+}
+
 static void
 udpna_do_free(struct udpna_data *nadata)
 {
     unsigned int i;
 
+    if (nadata->wpkt_count)
+	udpna_flush_writes(nadata, true);
+
     for (i = 0; i < nadata->nr_fds; i++) {
 	if (nadata->fds[i].fd != -1)
 	    gensio_os_close(nadata->o, nadata->fds[i].fd);
@@ -323,10 +637,35 @@ udpna_do_free(struct udpna_data *nadata)
 	nadata->o->free(nadata->o, nadata->fds);
     if (nadata->curr_recvaddr)
 	gensio_addr_free(nadata->curr_recvaddr);
-    if (nadata->read_data)
-	nadata->o->free(nadata->o, nadata->read_data);
+    if (nadata->rpkts) {
+	for (i = 0; i < nadata->read_batch; i++) {
+	    if (nadata->rpkts[i].addr)
+		gensio_addr_free(nadata->rpkts[i].addr);
+	}
+	nadata->o->free(nadata->o, nadata->rpkts);
+    }
+    if (nadata->read_bufs)
+	nadata->o->free(nadata->o, nadata->read_bufs);
+    if (nadata->wpkts)
+	nadata->o->free(nadata->o, nadata->wpkts);
+    if (nadata->wpkt_fds)
+	nadata->o->free(nadata->o, nadata->wpkt_fds);
+    udpn_hash_free(nadata->o, &nadata->udpn_hash);
+    udpn_hash_free(nadata->o, &nadata->closed_udpn_hash);
+    if (nadata->write_bufs)
+	nadata->o->free(nadata->o, nadata->write_bufs);
     if (nadata->lock)
 	nadata->o->free_lock(nadata->lock);
+    if (nadata->shards)
+	nadata->o->free(nadata->o, nadata->shards);
+    if (nadata->parent) {
+	struct udpna_data *parent = nadata->parent;
+
+	nadata->o->free(nadata->o, nadata);
+	udpna_lock(parent);
+	udpna_deref_and_unlock(parent);
+	return;
+    }
     if (nadata->acc)
 	gensio_acc_data_free(nadata->acc);
     nadata->o->free(nadata->o, nadata);
@@ -409,6 +748,68 @@ udpn_finish_free(struct udpn_data *ndata)
     udpna_check_finish_free(nadata);
 }
 
+/*
+ * Add a packet to the write queue, it will be sent from the deferred
+ * op, or now if the queue is full.  If the queue can't be emptied,
+ * nothing is written, just like a full socket.  addr is consumed if
+ * addr_owned is set.
+ */
+static int
+udpn_queue_write(struct udpn_data *ndata, gensiods *count,
+		 const struct gensio_sg *sg, gensiods sglen,
+		 struct gensio_addr *addr, bool addr_owned)
+{
+    struct udpna_data *nadata = ndata->nadata;
+    struct gensio_os_mmsg *msg;
+    gensiods i, len = 0;
+
+    for (i = 0; i < sglen; i++)
+	len += sg[i].buflen;
+    if (len > GENSIO_DEFAULT_UDP_BUF_SIZE) {
+	if (addr_owned)
+	    gensio_addr_free(addr);
+	return GE_TOOBIG;
+    }
+
+    if (!addr_owned) {
+	addr = gensio_addr_dup(addr);
+	if (!addr)
+	    return GE_NOMEM;
+    }
+
+    udpna_lock(nadata);
+    if (nadata->wpkt_count == nadata->write_batch &&
+		!nadata->wpkt_write_wait)
+	udpna_flush_writes(nadata, false);
+    if (nadata->wpkt_count == nadata->write_batch) {
+	udpna_unlock(nadata);
+	gensio_addr_free(addr);
+	if (count)
+	    *count = 0;
+	return 0;
+    }
+
+    msg = &nadata->wpkts[nadata->wpkt_count];
+    msg->len = 0;
+    for (i = 0; i < sglen; i++) {
+	memcpy((unsigned char *) msg->buf + msg->len, sg[i].buf, sg[i].buflen);
+	msg->len += sg[i].buflen;
+    }
+    msg->addr = addr;
+    nadata->wpkt_fds[nadata->wpkt_count] = ndata->myfd;
+    nadata->wpkt_count++;
+
+    if (nadata->wpkt_count == nadata->write_batch)
+	udpna_flush_writes(nadata, false);
+    else
+	udpna_start_deferred_op(nadata);
+    udpna_unlock(nadata);
+
+    if (count)
+	*count = len;
+    return 0;
+}
+
 static int
 udpn_write(struct gensio *io, gensiods *count,
 	   const struct gensio_sg *sg, gensiods sglen,
@@ -437,6 +838,9 @@ udpn_write(struct gensio *io, gensiods *count,
     if (!addr)
 	addr = ndata->raddr;
 
+    if (ndata->nadata->write_batch > 1)
+	return udpn_queue_write(ndata, count, sg, sglen, addr, free_addr);
+
     err = gensio_os_sendto(ndata->o, ndata->myfd, sg, sglen, count, 0, addr);
     if (free_addr)
 	gensio_addr_free(addr);
@@ -489,6 +893,9 @@ udpn_finish_close(struct udpna_data *nadata, struct udpn_data *ndata)
 	}
 	nadata->pending_data_owner = NULL;
 	nadata->data_pending_len = 0;
+	if (nadata->rpkt_count)
+	    /* Let the rest of the read batch get handled. */
+	    udpna_start_deferred_op(nadata);
     }
 
     if (ndata->freed)
@@ -521,7 +928,8 @@ udpn_finish_read(struct udpn_data *ndata)
 	if (err)
 	    strncpy(raddrdata, gensio_err_to_str(err), sizeof(raddrdata));
     }
-    gensio_cb(io, GENSIO_EVENT_READ, 0, nadata->read_data, &count, auxdata);
+    gensio_cb(io, GENSIO_EVENT_READ, 0, nadata->read_data + nadata->data_pos,
+	      &count, auxdata);
     udpna_lock(nadata);
 
     if (ndata->state == UDPN_IN_CLOSE) {
@@ -548,17 +956,39 @@ udpn_finish_read(struct udpn_data *ndata)
     udpna_check_read_state(nadata);
 }
 
+static void
+udpna_run_waiters(struct udpna_data *nadata, struct udpna_waiters *waiters)
+{
+    struct udpna_waiters *next;
+
+    while (waiters) {
+	next = waiters->next;
+	waiters->done(nadata->acc, waiters->done_data);
+	nadata->o->free(nadata->o, waiters);
+	waiters = next;
+    }
+}
+
+static struct udpna_waiters *udpna_handle_rpkts(struct udpna_data *nadata);
+
 static void
 udpna_deferred_op(struct gensio_runner *runner, void *cbdata)
 {
     struct udpna_data *nadata = cbdata;
+    struct udpna_waiters *waiters = NULL;
 
     udpna_lock(nadata);
     nadata->deferred_op_pending = false;
+    if (nadata->wpkt_count && !nadata->wpkt_write_wait)
+	udpna_flush_writes(nadata, false);
+
     while (nadata->pending_data_owner &&
 			nadata->pending_data_owner->read_enabled)
 	udpn_finish_read(nadata->pending_data_owner);
 
+    if (!nadata->data_pending_len && nadata->rpkt_count)
+	waiters = udpna_handle_rpkts(nadata);
+
     if (nadata->in_shutdown && !nadata->in_new_connection) {
 	struct gensio_accepter *accepter = nadata->acc;
 
@@ -574,6 +1004,8 @@ udpna_deferred_op(struct gensio_runner *runner, void *cbdata)
     if (!nadata->freed || !nadata->closed)
 	udpna_check_read_state(nadata);
     udpna_deref_and_unlock(nadata);
+
+    udpna_run_waiters(nadata, waiters);
 }
 
 static void
@@ -646,6 +1078,9 @@ udpn_start_close(struct udpn_data *ndata,
     if (nadata->pending_data_owner == ndata) {
 	nadata->pending_data_owner = NULL;
 	nadata->data_pending_len = 0;
+	if (nadata->rpkt_count)
+	    /* Let the rest of the read batch get handled. */
+	    udpna_start_deferred_op(nadata);
     }
     ndata->close_done = close_done;
     ndata->close_data = close_data;
@@ -840,6 +1275,12 @@ udpna_writehandler(int fd, void *cbdata)
 	goto out_unlock;
 
     udpna_disable_write(nadata);
+    if (nadata->wpkt_count) {
+	udpna_flush_writes(nadata, false);
+	if (nadata->wpkt_count)
+	    /* No room for users to write yet. */
+	    goto out_enable;
+    }
     gensio_list_for_each(&nadata->udpns, l) {
 	struct udpn_data *ndata = gensio_link_to_ndata(l);
 
@@ -852,6 +1293,7 @@ udpna_writehandler(int fd, void *cbdata)
 	    break;
 	}
     }
+ out_enable:
     if (nadata->write_enable_count > 0)
 	udpna_enable_write(nadata);
  out_unlock:
@@ -1037,6 +1479,7 @@ udp_alloc_gensio(struct udpna_data *nadata, int fd,
     }
 
     ndata->raddr = gensio_addr_dup(addr);
+    ndata->hash = gensio_addr_hash(addr, true);
     if (!ndata->raddr) {
 	ndata->o->free_runner(ndata->deferred_op_runner);
 	nadata->o->free(nadata->o, ndata);
@@ -1062,23 +1505,178 @@ udp_alloc_gensio(struct udpna_data *nadata, int fd,
     return ndata;
 }
 
+/*
+ * Handle the packets from the last read batch in order.  Each one is
+ * given to its owner, creating a new connection if necessary, before
+ * going on to the next.  If the owner can't take it now, the rest
+ * wait until it does.  Returns any accept disable waiters that are
+ * now done, the caller must run them after unlocking.
+ */
+static struct udpna_waiters *
+udpna_handle_rpkts(struct udpna_data *nadata)
+{
+    struct udpn_data *ndata;
+    struct udpna_waiters *waiters = NULL, *w;
+    struct gensio_os_mmsg *pkt;
+    struct gensio_addr *addr;
+    gensiods len;
+    bool addr_owned;
+
+    if (nadata->in_handle_rpkts)
+	return NULL;
+    nadata->in_handle_rpkts = true;
+
+    udpna_fd_read_disable(nadata);
+    while (!nadata->data_pending_len && nadata->rpkt_count) {
+	pkt = &nadata->rpkts[nadata->rpkt_pos];
+	nadata->read_data = (unsigned char *) pkt->buf + nadata->rpkt_off;
+	len = pkt->len - nadata->rpkt_off;
+	if (pkt->segsize && len > pkt->segsize) {
+	    /*
+	     * GRO coalesced packets, hand them out one at a time.  The
+	     * packet keeps the address until the last one.
+	     */
+	    len = pkt->segsize;
+	    nadata->rpkt_off += len;
+	    addr = pkt->addr;
+	    addr_owned = false;
+	} else {
+	    nadata->rpkt_pos++;
+	    nadata->rpkt_count--;
+	    nadata->rpkt_off = 0;
+	    addr = pkt->addr;
+	    pkt->addr = NULL;
+	    addr_owned = true;
+	}
+	if (len == 0)
+	    goto next;
+
+	nadata->data_pending_len = len;
+	nadata->data_pos = 0;
+
+	if (nadata->nocon) {
+	    if (gensio_list_empty(&nadata->udpns)) {
+		ndata = NULL;
+	    } else {
+		ndata = gensio_link_to_ndata(gensio_list_first(&nadata->udpns));
+		if (!addr_owned)
+		    addr = gensio_addr_dup(addr);
+		nadata->curr_recvaddr = addr;
+		addr = NULL;
+	    }
+	} else {
+	    ndata = udpn_find(nadata, &nadata->udpns, addr);
+	}
+	if (ndata)
+	    /* Data belongs to an existing connection. */
+	    goto got_ndata;
+
+	if (nadata->closed || !nadata->enabled) {
+	    nadata->data_pending_len = 0;
+	    goto next;
+	}
+
+	/* New connection. */
+	ndata = NULL;
+	if (!addr_owned) {
+	    addr = gensio_addr_dup(addr);
+	    addr_owned = true;
+	}
+	if (addr)
+	    ndata = udp_alloc_gensio(nadata, nadata->rpkt_fd, addr, NULL, NULL,
+				     &nadata->udpns);
+	if (!ndata) {
+	    nadata->data_pending_len = 0;
+	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			   "Out of memory allocating for udp port");
+	    goto next;
+	}
+
+	addr = NULL;
+	ndata->state = UDPN_OPEN;
+	nadata->read_disable_count++;
+
+	nadata->pending_data_owner = ndata;
+	nadata->in_new_connection = true;
+	ndata->in_read = true;
+	udpna_unlock(nadata);
+
+	gensio_acc_cb(nadata->acc, GENSIO_ACC_EVENT_NEW_CONNECTION, ndata->io);
+
+	udpna_lock(nadata);
+	ndata->in_read = false;
+	nadata->in_new_connection = false;
+	if (nadata->acc_disable_waiters) {
+	    for (w = nadata->acc_disable_waiters; w->next; w = w->next)
+		;
+	    w->next = waiters;
+	    waiters = nadata->acc_disable_waiters;
+	    nadata->acc_disable_waiters = NULL;
+	}
+
+	if (ndata->state == UDPN_OPEN) {
+	got_ndata:
+	    /*
+	     * With batching the owner may have turned off reads while
+	     * handling an earlier packet from the batch, record who
+	     * the data is for so enabling reads delivers it.
+	     */
+	    nadata->pending_data_owner = ndata;
+	    if (ndata->read_enabled && !ndata->in_read) {
+		ndata->in_read = true;
+		udpn_finish_read(ndata);
+	    }
+	} else {
+	    nadata->data_pending_len = 0;
+	}
+
+	if (ndata->state == UDPN_IN_CLOSE) {
+	    udpn_finish_close(nadata, ndata);
+	    goto next;
+	}
+
+	if (nadata->in_shutdown) {
+	    struct gensio_accepter *accepter = nadata->acc;
+
+	    ndata->in_read = true;
+	    udpna_unlock(nadata);
+	    if (nadata->shutdown_done)
+		nadata->shutdown_done(accepter, nadata->shutdown_data);
+	    udpna_lock(nadata);
+	    ndata->in_read = false;
+	    nadata->in_shutdown = false;
+	}
+	udpna_check_finish_free(nadata);
+    next:
+	if (addr && addr_owned)
+	    gensio_addr_free(addr);
+    }
+    udpna_fd_read_enable(nadata);
+
+    nadata->in_handle_rpkts = false;
+    return waiters;
+}
+
 static void
 udpna_readhandler(int fd, void *cbdata)
 {
     struct udpna_data *nadata = cbdata;
-    struct udpn_data *ndata;
-    struct udpna_waiters *waiters = NULL, *next;
-    struct gensio_addr *addr = NULL;
-    gensiods datalen;
+    struct udpna_waiters *waiters = NULL;
+    unsigned int i;
     int err;
 
     udpna_lock_and_ref(nadata);
     if (nadata->data_pending_len)
 	goto out_unlock;
 
-    err = gensio_os_recvfrom(nadata->o,
-			     fd, nadata->read_data, nadata->max_read_size,
-			     &datalen, 0, &addr);
+    if (nadata->rpkt_count)
+	/* Still have packets from the last read, handle those first. */
+	goto handle_pkts;
+
+    for (i = 0; i < nadata->read_batch; i++)
+	nadata->rpkts[i].len = nadata->max_read_size;
+    err = gensio_os_recvmfrom(nadata->o, fd, nadata->rpkts, nadata->read_batch,
+			      &nadata->rpkt_count, 0);
     if (err) {
 	if (!nadata->is_dummy)
 	    /* Don't log on dummy accepters. */
@@ -1087,135 +1685,172 @@ udpna_readhandler(int fd, void *cbdata)
 			   gensio_err_to_str(err));
 	goto out_unlock;
     }
-    if (datalen == 0)
-	goto out_unlock;
+    nadata->rpkt_pos = 0;
+    nadata->rpkt_fd = fd;
 
-    udpna_fd_read_disable(nadata);
-
-    nadata->data_pending_len = datalen;
-    nadata->data_pos = 0;
-
-    if (nadata->nocon) {
-	if (gensio_list_empty(&nadata->udpns)) {
-	    ndata = NULL;
-	} else {
-	    ndata = gensio_link_to_ndata(gensio_list_first(&nadata->udpns));
-	    nadata->curr_recvaddr = addr;
-	    addr = NULL;
-	}
-    } else {
-	ndata = udpn_find(&nadata->udpns, addr);
-    }
-    if (ndata)
-	/* Data belongs to an existing connection. */
-	goto got_ndata;
+ handle_pkts:
+    waiters = udpna_handle_rpkts(nadata);
 
-    if (nadata->closed || !nadata->enabled) {
-	nadata->data_pending_len = 0;
-	goto out_unlock_enable;
-    }
+ out_unlock:
+    udpna_deref_and_unlock(nadata);
 
-    /* New connection. */
-    ndata = udp_alloc_gensio(nadata, fd, addr, NULL, NULL, &nadata->udpns);
-    if (!ndata)
-	goto out_nomem;
+    udpna_run_waiters(nadata, waiters);
+}
 
-    addr = NULL;
-    ndata->state = UDPN_OPEN;
-    nadata->read_disable_count++;
+/*
+ * GRO is only an optimization, if the OS can't do it just read the
+ * packets one at a time.
+ */
+static void
+udpna_enable_gro(struct udpna_data *nadata)
+{
+    unsigned int i;
+    int err;
 
-    nadata->pending_data_owner = ndata;
-    nadata->in_new_connection = true;
-    ndata->in_read = true;
-    udpna_unlock(nadata);
+    for (i = 0; i < nadata->nr_fds; i++) {
+	err = gensio_os_set_udp_gro(nadata->o, nadata->fds[i].fd, true);
+	if (err) {
+	    gensio_log(nadata->o, GENSIO_LOG_INFO,
+		       "udp: Unable to enable GRO: %s",
+		       gensio_err_to_str(err));
+	    break;
+	}
+    }
+}
 
-    gensio_acc_cb(nadata->acc, GENSIO_ACC_EVENT_NEW_CONNECTION, ndata->io);
+/*
+ * Open the sockets for all the shards.  They all come back in one
+ * array, shard 0 (nadata) keeps it, the others get a copy of their
+ * part.
+ */
+static int
+udpna_open_shards(struct udpna_data *nadata)
+{
+    struct gensio_os_funcs *o = nadata->o;
+    struct udpna_data *shard;
+    struct opensocks *fds, *sfds[GENSIO_MAX_UDP_SHARDS];
+    void *data[GENSIO_MAX_UDP_SHARDS];
+    unsigned int i, nr_fds;
+    int rv;
 
-    udpna_lock(nadata);
-    ndata->in_read = false;
-    nadata->in_new_connection = false;
-    waiters = nadata->acc_disable_waiters;
-    nadata->acc_disable_waiters = NULL;
+    data[0] = nadata;
+    for (i = 1; i < nadata->nr_shards; i++)
+	data[i] = nadata->shards[i - 1];
 
-    if (ndata->state == UDPN_OPEN) {
-    got_ndata:
-	if (ndata->read_enabled && !ndata->in_read) {
-	    ndata->in_read = true;
-	    udpn_finish_read(ndata);
-	}
-    } else {
-	nadata->data_pending_len = 0;
-    }
+    rv = gensio_os_open_sharded_socket(o, nadata->ai,
+				       udpna_readhandler, udpna_writehandler,
+				       udpna_fd_cleared, data,
+				       nadata->nr_shards, &fds, &nr_fds);
+    if (rv)
+	return rv;
 
-    if (ndata->state == UDPN_IN_CLOSE) {
-	udpn_finish_close(nadata, ndata);
-	goto out_unlock_enable;
+    for (i = 1; i < nadata->nr_shards; i++) {
+	sfds[i] = o->zalloc(o, sizeof(*fds) * nr_fds);
+	if (!sfds[i])
+	    goto out_nomem;
+	memcpy(sfds[i], fds + i * nr_fds, sizeof(*fds) * nr_fds);
     }
 
-    if (nadata->in_shutdown) {
-	struct gensio_accepter *accepter = nadata->acc;
-
-	ndata->in_read = true;
-	udpna_unlock(nadata);
-	if (nadata->shutdown_done)
-	    nadata->shutdown_done(accepter, nadata->shutdown_data);
-	udpna_lock(nadata);
-	ndata->in_read = false;
-	nadata->in_shutdown = false;
+    nadata->fds = fds;
+    nadata->nr_fds = nr_fds;
+    for (i = 1; i < nadata->nr_shards; i++) {
+	shard = nadata->shards[i - 1];
+	udpna_lock(shard);
+	shard->fds = sfds[i];
+	shard->nr_fds = nr_fds;
+	udpna_unlock(shard);
     }
-    udpna_check_finish_free(nadata);
-    goto out_unlock_enable;
+    return 0;
 
  out_nomem:
-    nadata->data_pending_len = 0;
-    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-		   "Out of memory allocating for udp port");
- out_unlock_enable:
-    udpna_fd_read_enable(nadata);
- out_unlock:
-    if (addr)
-	gensio_addr_free(addr);
-    udpna_deref_and_unlock(nadata);
-
-    while (waiters) {
-	next = waiters->next;
-	waiters->done(nadata->acc, waiters->done_data);
-	nadata->o->free(nadata->o, waiters);
-	waiters = next;
+    while (i > 1)
+	o->free(o, sfds[--i]);
+    for (i = 0; i < nr_fds * nadata->nr_shards; i++) {
+	o->clear_fd_handlers_norpt(o, fds[i].fd);
+	gensio_os_close(o, fds[i].fd);
     }
-
-    return;
+    o->free(o, fds);
+    return GE_NOMEM;
 }
 
 static int
 udpna_startup(struct gensio_accepter *accepter)
 {
     struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
+    struct udpna_data *shard;
+    unsigned int i;
     int rv = 0;
 
     udpna_lock(nadata);
     if (!nadata->fds) {
-	rv = gensio_os_open_socket(nadata->o, nadata->ai,
-				   udpna_readhandler, udpna_writehandler,
-				   udpna_fd_cleared, nadata,
-				   &nadata->fds, &nadata->nr_fds);
+	if (nadata->nr_shards > 1)
+	    rv = udpna_open_shards(nadata);
+	else
+	    rv = gensio_os_open_socket(nadata->o, nadata->ai,
+				       udpna_readhandler, udpna_writehandler,
+				       udpna_fd_cleared, nadata,
+				       &nadata->fds, &nadata->nr_fds);
 	if (rv)
 	    goto out_unlock;
+	if (nadata->gro) {
+	    udpna_enable_gro(nadata);
+	    for (i = 1; i < nadata->nr_shards; i++)
+		udpna_enable_gro(nadata->shards[i - 1]);
+	}
     }
 
     nadata->enabled = true;
     udpna_enable_read(nadata);
+    for (i = 1; i < nadata->nr_shards; i++) {
+	shard = nadata->shards[i - 1];
+	udpna_lock(shard);
+	shard->enabled = true;
+	udpna_enable_read(shard);
+	udpna_unlock(shard);
+    }
  out_unlock:
     udpna_unlock(nadata);
 
     return rv;
 }
 
+static void
+udpna_shard_done(struct gensio_accepter *accepter, void *cb_data)
+{
+    struct udpna_shard_done *sd = cb_data;
+    struct udpna_data *nadata = sd->nadata;
+    bool finished;
+
+    udpna_lock(nadata);
+    finished = --sd->pending == 0;
+    udpna_unlock(nadata);
+
+    if (finished) {
+	if (sd->done)
+	    sd->done(accepter, sd->done_data);
+	nadata->o->free(nadata->o, sd);
+    }
+}
+
+static struct udpna_shard_done *
+udpna_shard_done_alloc(struct udpna_data *nadata,
+		       gensio_acc_done done, void *done_data)
+{
+    struct udpna_shard_done *sd = nadata->o->zalloc(nadata->o, sizeof(*sd));
+
+    if (sd) {
+	sd->nadata = nadata;
+	sd->pending = nadata->nr_shards;
+	sd->done = done;
+	sd->done_data = done_data;
+    }
+    return sd;
+}
+
 static int
-udpna_shutdown(struct gensio_accepter *accepter,
-	       gensio_acc_done shutdown_done, void *shutdown_data)
+i_udpna_shutdown(struct udpna_data *nadata,
+		 gensio_acc_done shutdown_done, void *shutdown_data)
 {
-    struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
     int rv = 0;
 
     udpna_lock(nadata);
@@ -1235,6 +1870,35 @@ udpna_shutdown(struct gensio_accepter *accepter,
     return rv;
 }
 
+static int
+udpna_shutdown(struct gensio_accepter *accepter,
+	       gensio_acc_done shutdown_done, void *shutdown_data)
+{
+    struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
+    struct udpna_shard_done *sd;
+    unsigned int i;
+    int rv;
+
+    if (nadata->nr_shards == 1)
+	return i_udpna_shutdown(nadata, shutdown_done, shutdown_data);
+
+    sd = udpna_shard_done_alloc(nadata, shutdown_done, shutdown_data);
+    if (!sd)
+	return GE_NOMEM;
+
+    rv = i_udpna_shutdown(nadata, udpna_shard_done, sd);
+    if (rv) {
+	nadata->o->free(nadata->o, sd);
+	return rv;
+    }
+    for (i = 1; i < nadata->nr_shards; i++) {
+	if (i_udpna_shutdown(nadata->shards[i - 1], udpna_shard_done, sd))
+	    udpna_shard_done(accepter, sd);
+    }
+
+    return 0;
+}
+
 static void
 waiter_runner_cb(struct gensio_runner *runner, void *cb_data)
 {
@@ -1250,10 +1914,9 @@ waiter_runner_cb(struct gensio_runner *runner, void *cb_data)
 }
 
 static int
-udpna_set_accept_callback_enable(struct gensio_accepter *accepter, bool enabled,
-				 gensio_acc_done done, void *done_data)
+i_udpna_set_accept_callback_enable(struct udpna_data *nadata, bool enabled,
+				   gensio_acc_done done, void *done_data)
 {
-    struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
     int rv = 0;
 
     udpna_lock(nadata);
@@ -1289,11 +1952,47 @@ udpna_set_accept_callback_enable(struct gensio_accepter *accepter, bool enabled,
     return rv;
 }
 
-static void
-udpna_free(struct gensio_accepter *accepter)
+static int
+udpna_set_accept_callback_enable(struct gensio_accepter *accepter, bool enabled,
+				 gensio_acc_done done, void *done_data)
 {
     struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
+    struct udpna_shard_done *sd = NULL;
+    unsigned int i;
+    int rv, rv2;
+
+    if (nadata->nr_shards == 1)
+	return i_udpna_set_accept_callback_enable(nadata, enabled,
+						  done, done_data);
+
+    if (done) {
+	sd = udpna_shard_done_alloc(nadata, done, done_data);
+	if (!sd)
+	    return GE_NOMEM;
+    }
+
+    rv = i_udpna_set_accept_callback_enable(nadata, enabled,
+					    sd ? udpna_shard_done : NULL, sd);
+    if (rv && sd)
+	udpna_shard_done(accepter, sd);
+    for (i = 1; i < nadata->nr_shards; i++) {
+	rv2 = i_udpna_set_accept_callback_enable(nadata->shards[i - 1], enabled,
+						 sd ? udpna_shard_done : NULL,
+						 sd);
+	if (rv2) {
+	    if (!rv)
+		rv = rv2;
+	    if (sd)
+		udpna_shard_done(accepter, sd);
+	}
+    }
 
+    return rv;
+}
+
+static void
+i_udpna_free(struct udpna_data *nadata)
+{
     udpna_lock_and_ref(nadata);
 
     assert(!nadata->freed);
@@ -1322,16 +2021,36 @@ udpna_free(struct gensio_accepter *accepter)
 }
 
 static void
-udpna_disable(struct gensio_accepter *accepter)
+udpna_free(struct gensio_accepter *accepter)
 {
     struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
+    unsigned int i;
+
+    for (i = 1; i < nadata->nr_shards; i++)
+	i_udpna_free(nadata->shards[i - 1]);
+    i_udpna_free(nadata);
+}
 
+static void
+i_udpna_disable(struct udpna_data *nadata)
+{
     nadata->enabled = false;
     nadata->in_shutdown = false;
     nadata->shutdown_done = NULL;
     nadata->disabled = true;
 }
 
+static void
+udpna_disable(struct gensio_accepter *accepter)
+{
+    struct udpna_data *nadata = gensio_acc_get_gensio_data(accepter);
+    unsigned int i;
+
+    for (i = 1; i < nadata->nr_shards; i++)
+	i_udpna_disable(nadata->shards[i - 1]);
+    i_udpna_disable(nadata);
+}
+
 int
 udpna_str_to_gensio(struct gensio_accepter *accepter, const char *addrstr,
 		    gensio_event cb, void *user_data, struct gensio **new_net)
@@ -1345,6 +2064,13 @@ udpna_str_to_gensio(struct gensio_accepter *accepter, const char *addrstr,
     bool is_port_set;
     int protocol = 0;
 
+    /*
+     * The kernel picks which shard gets the packets from the remote
+     * end, there's no way to know which shard the gensio belongs in.
+     */
+    if (nadata->nr_shards > 1)
+	return GE_NOTSUP;
+
     err = gensio_scan_network_port(nadata->o, addrstr, false, &addr,
 				   &protocol, &is_port_set, NULL, &iargs);
     if (err)
@@ -1369,9 +2095,9 @@ udpna_str_to_gensio(struct gensio_accepter *accepter, const char *addrstr,
  found:
 
     udpna_lock(nadata);
-    ndata = udpn_find(&nadata->udpns, addr);
+    ndata = udpn_find(nadata, &nadata->udpns, addr);
     if (!ndata)
-	ndata = udpn_find(&nadata->closed_udpns, addr);
+	ndata = udpn_find(nadata, &nadata->closed_udpns, addr);
     if (ndata) {
 	udpna_unlock(nadata);
 	err = GE_EXISTS;
@@ -1457,18 +2183,21 @@ gensio_acc_udp_func(struct gensio_accepter *acc, int func, int val,
     }
 }
 
-static int
-i_udp_gensio_accepter_alloc(struct gensio_addr *iai, gensiods max_read_size,
-			    struct gensio_os_funcs *o,
-			    gensio_accepter_event cb, void *user_data,
-			    struct gensio_accepter **accepter)
+static struct udpna_data *
+udpna_alloc_data(struct gensio_addr *iai, gensiods max_read_size,
+		 unsigned int read_batch, unsigned int write_batch,
+		 bool gso, bool gro, struct gensio_os_funcs *o)
 {
     struct udpna_data *nadata;
+    unsigned int i;
 
     nadata = o->zalloc(o, sizeof(*nadata));
     if (!nadata)
-	return GE_NOMEM;
+	return NULL;
     nadata->o = o;
+    nadata->nr_shards = 1;
+    nadata->gso = gso && write_batch > 1;
+    nadata->gro = gro;
     gensio_list_init(&nadata->udpns);
     gensio_list_init(&nadata->closed_udpns);
     nadata->refcount = 1;
@@ -1478,9 +2207,32 @@ i_udp_gensio_accepter_alloc(struct gensio_addr *iai, gensiods max_read_size,
     if (!nadata->ai && iai) /* Allow a null ai if it was passed in. */
 	goto out_nomem;
 
-    nadata->read_data = o->zalloc(o, max_read_size);
-    if (!nadata->read_data)
+    nadata->read_batch = read_batch;
+    nadata->read_bufs = o->zalloc(o, max_read_size * read_batch);
+    if (!nadata->read_bufs)
 	goto out_nomem;
+    nadata->rpkts = o->zalloc(o, sizeof(*nadata->rpkts) * read_batch);
+    if (!nadata->rpkts)
+	goto out_nomem;
+    for (i = 0; i < read_batch; i++)
+	nadata->rpkts[i].buf = nadata->read_bufs + i * max_read_size;
+
+    nadata->write_batch = write_batch;
+    if (write_batch > 1) {
+	nadata->write_bufs = o->zalloc(o, (GENSIO_DEFAULT_UDP_BUF_SIZE
+					   * write_batch));
+	if (!nadata->write_bufs)
+	    goto out_nomem;
+	nadata->wpkts = o->zalloc(o, sizeof(*nadata->wpkts) * write_batch);
+	if (!nadata->wpkts)
+	    goto out_nomem;
+	nadata->wpkt_fds = o->zalloc(o, sizeof(int) * write_batch);
+	if (!nadata->wpkt_fds)
+	    goto out_nomem;
+	for (i = 0; i < write_batch; i++)
+	    nadata->wpkts[i].buf = (nadata->write_bufs +
+				    i * GENSIO_DEFAULT_UDP_BUF_SIZE);
+    }
 
     nadata->deferred_op_runner = o->alloc_runner(o, udpna_deferred_op, nadata);
     if (!nadata->deferred_op_runner)
@@ -1490,18 +2242,69 @@ i_udp_gensio_accepter_alloc(struct gensio_addr *iai, gensiods max_read_size,
     if (!nadata->lock)
 	goto out_nomem;
 
+    nadata->max_read_size = max_read_size;
+
+    return nadata;
+
+ out_nomem:
+    udpna_do_free(nadata);
+    return NULL;
+}
+
+static int
+i_udp_gensio_accepter_alloc(struct gensio_addr *iai, gensiods max_read_size,
+			    unsigned int read_batch, unsigned int write_batch,
+			    unsigned int nr_shards, bool gso, bool gro,
+			    struct gensio_os_funcs *o,
+			    gensio_accepter_event cb, void *user_data,
+			    struct gensio_accepter **accepter)
+{
+    struct udpna_data *nadata, *shard;
+    unsigned int i;
+
+    nadata = udpna_alloc_data(iai, max_read_size, read_batch, write_batch,
+			      gso, gro, o);
+    if (!nadata)
+	return GE_NOMEM;
+
+    if (nr_shards > 1) {
+	nadata->shards = o->zalloc(o, sizeof(*nadata->shards) * (nr_shards - 1));
+	if (!nadata->shards)
+	    goto out_nomem;
+	for (i = 0; i < nr_shards - 1; i++) {
+	    nadata->shards[i] = udpna_alloc_data(iai, max_read_size,
+						 read_batch, write_batch,
+						 gso, gro, o);
+	    if (!nadata->shards[i])
+		goto out_nomem;
+	}
+    }
+
     nadata->acc = gensio_acc_data_alloc(o, cb, user_data, gensio_acc_udp_func,
 					NULL, "udp", nadata);
     if (!nadata->acc)
 	goto out_nomem;
     gensio_acc_set_is_packet(nadata->acc, true);
 
-    nadata->max_read_size = max_read_size;
+    /* Can't fail from here, so link up the shards. */
+    nadata->nr_shards = nr_shards;
+    for (i = 0; i < nr_shards - 1; i++) {
+	shard = nadata->shards[i];
+	shard->acc = nadata->acc;
+	shard->parent = nadata;
+	udpna_ref(nadata);
+    }
 
     *accepter = nadata->acc;
     return 0;
 
  out_nomem:
+    if (nadata->shards) {
+	for (i = 0; i < nr_shards - 1; i++) {
+	    if (nadata->shards[i])
+		udpna_do_free(nadata->shards[i]);
+	}
+    }
     udpna_do_free(nadata);
     return GE_NOMEM;
 }
@@ -1514,16 +2317,40 @@ udp_gensio_accepter_alloc(struct gensio_addr *iai,
 			  struct gensio_accepter **accepter)
 {
     gensiods max_read_size = GENSIO_DEFAULT_UDP_BUF_SIZE;
+    unsigned int read_batch = GENSIO_DEFAULT_UDP_READ_BATCH;
+    unsigned int write_batch = GENSIO_DEFAULT_UDP_WRITE_BATCH;
+    unsigned int nr_shards = 1;
     unsigned int i;
+    bool gso = false, gro = false;
 
     for (i = 0; args && args[i]; i++) {
 	if (gensio_check_keyds(args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "readbatch", &read_batch) > 0)
+	    continue;
+	if (gensio_check_keyuint(args[i], "writebatch", &write_batch) > 0)
+	    continue;
+	if (gensio_check_keyuint(args[i], "shards", &nr_shards) > 0)
+	    continue;
+	if (gensio_check_keybool(args[i], "gso", &gso) > 0)
+	    continue;
+	if (gensio_check_keybool(args[i], "gro", &gro) > 0)
+	    continue;
 	return GE_INVAL;
     }
 
-    return i_udp_gensio_accepter_alloc(iai, max_read_size, o, cb, user_data,
-				       accepter);
+    if (read_batch == 0 || read_batch > GENSIO_MAX_UDP_BATCH ||
+		write_batch == 0 || write_batch > GENSIO_MAX_UDP_BATCH ||
+		nr_shards == 0 || nr_shards > GENSIO_MAX_UDP_SHARDS)
+	return GE_INVAL;
+
+    /* Coalesced packets could be truncated with a smaller buffer. */
+    if (gro && max_read_size < GENSIO_DEFAULT_UDP_BUF_SIZE)
+	return GE_INVAL;
+
+    return i_udp_gensio_accepter_alloc(iai, max_read_size,
+				       read_batch, write_batch, nr_shards,
+				       gso, gro, o, cb, user_data, accepter);
 }
 
 int
@@ -1558,8 +2385,11 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
     struct gensio_addr *laddr = NULL, *mcast = NULL, *tmpaddr, *tmpaddr2;
     int err, new_fd;
     gensiods max_read_size = GENSIO_DEFAULT_UDP_BUF_SIZE;
+    unsigned int read_batch = GENSIO_DEFAULT_UDP_READ_BATCH;
+    unsigned int write_batch = GENSIO_DEFAULT_UDP_WRITE_BATCH;
     unsigned int i;
     bool nocon = false, mcast_loop_set = false, mcast_loop = true;
+    bool gso = false, gro = false;
 
     err = gensio_get_defaultaddr(o, "udp", "laddr", false,
 				 GENSIO_NET_PROTOCOL_UDP, true, false, &laddr);
@@ -1573,6 +2403,10 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
     for (i = 0; args && args[i]; i++) {
 	if (gensio_check_keyds(args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "readbatch", &read_batch) > 0)
+	    continue;
+	if (gensio_check_keyuint(args[i], "writebatch", &write_batch) > 0)
+	    continue;
 	tmpaddr = NULL;
 	if (gensio_check_keyaddrs(o, args[i], "laddr", GENSIO_NET_PROTOCOL_UDP,
 				  true, false, &tmpaddr) > 0) {
@@ -1604,6 +2438,10 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
 	    mcast_loop_set = true;
 	    continue;
 	}
+	if (gensio_check_keybool(args[i], "gso", &gso) > 0)
+	    continue;
+	if (gensio_check_keybool(args[i], "gro", &gro) > 0)
+	    continue;
     parm_err:
 	if (laddr)
 	    gensio_addr_free(laddr);
@@ -1612,6 +2450,13 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
 	return err;
     }
 
+    if (read_batch == 0 || read_batch > GENSIO_MAX_UDP_BATCH ||
+		write_batch == 0 || write_batch > GENSIO_MAX_UDP_BATCH ||
+		(gro && max_read_size < GENSIO_DEFAULT_UDP_BUF_SIZE)) {
+	err = GE_INVAL;
+	goto parm_err;
+    }
+
     err = gensio_os_socket_open(o, addr, GENSIO_NET_PROTOCOL_UDP, &new_fd);
     if (err) {
 	if (laddr)
@@ -1656,7 +2501,8 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
     }
 
     /* Allocate a dummy network accepter. */
-    err = i_udp_gensio_accepter_alloc(NULL, max_read_size, o,
+    err = i_udp_gensio_accepter_alloc(NULL, max_read_size,
+				      read_batch, write_batch, 1, gso, gro, o,
 				      NULL, NULL, &accepter);
     if (err) {
 	gensio_os_close(o, new_fd);
@@ -1675,6 +2521,8 @@ udp_gensio_alloc(struct gensio_addr *addr, const char * const args[],
     nadata->fds->family = gensio_addr_get_nettype(addr);
     nadata->fds->fd = new_fd;
     nadata->nr_fds = 1;
+    if (gro)
+	udpna_enable_gro(nadata);
     /* fd belongs to udpn now, updn_do_free() will close it. */
 
     nadata->closed = true; /* Free nadata when ndata is freed. */
@@ -106,6 +106,7 @@ do_break(int fd)
 
 #include <gensio/sergensio_class.h>
 #include <gensio/gensio_ll_fd.h>
+#include <gensio/gensio_osops.h>
 
 #include "uucplock.h"
 #include "utils.h"
@@ -429,8 +430,29 @@ struct sterm_data {
     struct gensio_timer *timer;
     bool timer_stopped;
 
+    struct gensio_ll *ll;
+
+    /*
+     * Read aggregation.  If read_gap is set, incoming data is left in
+     * the kernel until read_min bytes are there or no new data has
+     * arrived for read_gap character times.
+     */
+    unsigned int read_gap;
+    gensiods read_min;
+    int read_last_count;
+    bool read_timer_running;
+    bool read_timer_stopped;
+    struct gensio_timer *read_timer;
+
     bool open;
-    unsigned int close_timeouts_left;
+
+    /*
+     * Close drain tracking.  We give up on draining the output if it
+     * makes no progress for close_stall_left nanoseconds.
+     */
+    int close_last_outq;
+    int64_t close_last_wait;
+    int64_t close_stall_left;
 
     char *devname;
     char *parms;
@@ -1140,9 +1162,48 @@ sergensio_sterm_func(struct sergensio *sio, int op, int val, char *buf,
 static void
 sterm_timer_stopped(struct gensio_timer *timer, void *cb_data)
 {
-    struct sterm_data *sdata = cb_data;
+    bool *stopped = cb_data;
+
+    *stopped = true;
+}
+
+/* Time we allow the output to not drain at all before giving up. */
+#define SERIALDEV_CLOSE_STALL_NS	2000000000LL
+/* Minimum time between output queue checks, and slop for the UART. */
+#define SERIALDEV_CLOSE_MIN_WAIT_NS	10000000LL
+/* Maximum time to wait between output queue checks. */
+#define SERIALDEV_CLOSE_MAX_WAIT_NS	1000000000LL
+
+/*
+ * Return the number of nanoseconds it will take to send count
+ * characters with the current port settings, or 0 if that can't be
+ * calculated.
+ */
+static int64_t
+sterm_xmit_time(struct sterm_data *sdata, int count)
+{
+    g_termios t;
+    int baud, bits = 2; /* Start and stop bit. */
+
+    if (get_termios(sdata->fd, &t) == -1)
+	return 0;
+
+    baud = get_baud_rate_val(&t);
+    if (baud <= 0)
+	return 0;
+
+    switch (t.c_cflag & CSIZE) {
+    case CS5: bits += 5; break;
+    case CS6: bits += 6; break;
+    case CS7: bits += 7; break;
+    default: bits += 8; break;
+    }
+    if (t.c_cflag & PARENB)
+	bits++;
+    if (t.c_cflag & CSTOPB)
+	bits++;
 
-    sdata->timer_stopped = true;
+    return (int64_t) count * bits * 1000000000LL / baud;
 }
 
 static int
@@ -1151,14 +1212,23 @@ sterm_check_close_drain(void *handler_data, enum gensio_ll_close_state state,
 {
     struct sterm_data *sdata = handler_data;
     int rv, count = 0, err = 0;
+    int64_t wait;
 
     sterm_lock(sdata);
     if (state == GENSIO_LL_CLOSE_STATE_START) {
 	sdata->open = false;
-	/* FIXME - this should be calculated. */
-	sdata->close_timeouts_left = 200;
+	sdata->read_timer_running = false;
+	rv = sdata->o->stop_timer_with_done(sdata->read_timer,
+					    sterm_timer_stopped,
+					    &sdata->read_timer_stopped);
+	if (rv)
+	    sdata->read_timer_stopped = true;
+	sdata->close_last_outq = INT_MAX;
+	sdata->close_last_wait = 0;
+	sdata->close_stall_left = SERIALDEV_CLOSE_STALL_NS;
 	rv = sdata->o->stop_timer_with_done(sdata->timer,
-					    sterm_timer_stopped, sdata);
+					    sterm_timer_stopped,
+					    &sdata->timer_stopped);
 	if (rv)
 	    sdata->timer_stopped = true;
     }
@@ -1167,24 +1237,40 @@ sterm_check_close_drain(void *handler_data, enum gensio_ll_close_state state,
 	goto out_unlock;
 
     sdata->open = false;
+    wait = SERIALDEV_CLOSE_MIN_WAIT_NS;
     if (sdata->termio_q)
 	goto out_einprogress;
 
-    if (!sdata->timer_stopped)
+    if (!sdata->timer_stopped || !sdata->read_timer_stopped)
 	goto out_einprogress;
 
     rv = ioctl(sdata->fd, TIOCOUTQ, &count);
     if (rv || count == 0)
 	goto out_rm_uucp;
 
-    sdata->close_timeouts_left--;
-    if (sdata->close_timeouts_left == 0)
-	goto out_rm_uucp;
+    if (count < sdata->close_last_outq) {
+	sdata->close_stall_left = SERIALDEV_CLOSE_STALL_NS;
+    } else {
+	/* No progress, probably flow controlled. */
+	sdata->close_stall_left -= sdata->close_last_wait;
+	if (sdata->close_stall_left <= 0)
+	    goto out_rm_uucp;
+    }
+    sdata->close_last_outq = count;
+
+    /*
+     * Wait for about as long as it should take to send what is left,
+     * instead of polling.  Cap it so a stalled port is noticed.
+     */
+    wait += sterm_xmit_time(sdata, count);
+    if (wait > SERIALDEV_CLOSE_MAX_WAIT_NS)
+	wait = SERIALDEV_CLOSE_MAX_WAIT_NS;
+    sdata->close_last_wait = wait;
 
  out_einprogress:
     err = GE_INPROGRESS;
-    next_timeout->secs = 0;
-    next_timeout->nsecs = 10000000;
+    next_timeout->secs = wait / 1000000000;
+    next_timeout->nsecs = wait % 1000000000;
  out_rm_uucp:
     if (!err) {
 	set_termios(sdata->fd, &sdata->orig_termios);
@@ -1196,6 +1282,91 @@ sterm_check_close_drain(void *handler_data, enum gensio_ll_close_state state,
     return err;
 }
 
+static int
+sterm_do_read(int fd, void *data, gensiods count, gensiods *rcount,
+	      const char **auxdata, void *cb_data)
+{
+    struct sterm_data *sdata = cb_data;
+
+    return gensio_os_read(sdata->o, fd, data, count, rcount);
+}
+
+/*
+ * See if we should hold off on reading the data in the kernel.  If
+ * so, start the timer.  Must be called with the lock held.  Returns
+ * true if the read should be deferred.
+ */
+static bool
+sterm_aggregate_read(struct sterm_data *sdata)
+{
+    gensio_time timeout;
+    int64_t wait;
+    int count = 0;
+
+    if (!sdata->open || ioctl(sdata->fd, TIOCINQ, &count) == -1)
+	return false;
+
+    /*
+     * Nothing there (EOF or error) or no new data since the last
+     * check, the line has gone idle.
+     */
+    if (count <= sdata->read_last_count || count >= sdata->read_min)
+	return false;
+
+    wait = sterm_xmit_time(sdata, sdata->read_gap);
+    if (wait == 0)
+	return false;
+    sdata->read_last_count = count;
+
+    timeout.secs = wait / 1000000000;
+    timeout.nsecs = wait % 1000000000;
+    if (sdata->o->start_timer(sdata->read_timer, &timeout))
+	return false;
+    sdata->read_timer_running = true;
+    return true;
+}
+
+static void
+sterm_read_timeout(struct gensio_timer *t, void *cb_data)
+{
+    struct sterm_data *sdata = cb_data;
+
+    sterm_lock(sdata);
+    if (!sdata->read_timer_running) {
+	sterm_unlock(sdata);
+	return;
+    }
+    sdata->read_timer_running = false;
+    if (sterm_aggregate_read(sdata)) {
+	sterm_unlock(sdata);
+	return;
+    }
+    sdata->read_last_count = 0;
+    sterm_unlock(sdata);
+
+    gensio_fd_ll_handle_incoming(sdata->ll, sterm_do_read, NULL, sdata);
+}
+
+static void
+sterm_read_ready(void *handler_data, int fd)
+{
+    struct sterm_data *sdata = handler_data;
+
+    if (sdata->read_gap) {
+	sterm_lock(sdata);
+	if (sdata->read_timer_running || sterm_aggregate_read(sdata)) {
+	    /* The timer will handle the read. */
+	    sdata->o->set_read_handler(sdata->o, fd, false);
+	    sterm_unlock(sdata);
+	    return;
+	}
+	sdata->read_last_count = 0;
+	sterm_unlock(sdata);
+    }
+
+    gensio_fd_ll_handle_incoming(sdata->ll, sterm_do_read, NULL, sdata);
+}
+
 #if defined(__CYGWIN__) || defined(HAVE_TERMIOS2)
 static void cfmakeraw(g_termios *termios_p) {
     termios_p->c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL|IXON);
@@ -1227,6 +1398,8 @@ sterm_sub_open(void *handler_data, int *fd)
     }
 
     sdata->timer_stopped = false;
+    sdata->read_timer_stopped = false;
+    sdata->read_last_count = 0;
 
     options = O_NONBLOCK | O_NOCTTY;
     if (sdata->write_only)
@@ -1409,6 +1582,8 @@ sterm_free(void *handler_data)
 	sdata->o->free_lock(sdata->lock);
     if (sdata->timer)
 	sdata->o->free_timer(sdata->timer);
+    if (sdata->read_timer)
+	sdata->o->free_timer(sdata->read_timer);
     if (sdata->devname)
 	sdata->o->free(sdata->o, sdata->devname);
     if (sdata->deferred_op_runner)
@@ -1422,11 +1597,24 @@ static int
 sterm_control(void *handler_data, int fd, bool get, unsigned int option,
 	      char *data, gensiods *datalen)
 {
-    if (get || option != GENSIO_CONTROL_SEND_BREAK)
-	return GE_NOTSUP;
+    switch (option) {
+    case GENSIO_CONTROL_SEND_BREAK:
+	if (get)
+	    return GE_NOTSUP;
+	do_break(fd);
+	return 0;
 
-    do_break(fd);
-    return 0;
+    case GENSIO_CONTROL_RAW_FD:
+	if (!get)
+	    return GE_NOTSUP;
+	if (fd == -1)
+	    return GE_NOTREADY;
+	*datalen = snprintf(data, *datalen, "%d", fd);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
 }
 
 static const struct gensio_fd_ll_ops sterm_fd_ll_ops = {
@@ -1435,7 +1623,8 @@ static const struct gensio_fd_ll_ops sterm_fd_ll_ops = {
     .remote_id = sterm_remote_id,
     .check_close = sterm_check_close_drain,
     .free = sterm_free,
-    .control = sterm_control
+    .control = sterm_control,
+    .read_ready = sterm_read_ready
 };
 
 static int
@@ -1728,16 +1917,27 @@ serialdev_gensio_alloc(const char *devname, const char * const args[],
 	if (gensio_check_keybool(args[i], "custspeed",
 				 &sdata->allow_custspeed) > 0)
 	    continue;
+	if (gensio_check_keyuint(args[i], "readgap", &sdata->read_gap) > 0)
+	    continue;
+	if (gensio_check_keyds(args[i], "readmin", &sdata->read_min) > 0)
+	    continue;
 	err = GE_INVAL;
 	goto out_err;
     }
 
     sdata->fd = -1;
 
+    if (sdata->read_min == 0 || sdata->read_min > max_read_size)
+	sdata->read_min = max_read_size;
+
     sdata->timer = o->alloc_timer(o, serialdev_timeout, sdata);
     if (!sdata->timer)
 	goto out_nomem;
 
+    sdata->read_timer = o->alloc_timer(o, sterm_read_timeout, sdata);
+    if (!sdata->read_timer)
+	goto out_nomem;
+
     sdata->devname = gensio_strdup(o, devname);
     if (!sdata->devname)
 	goto out_nomem;
@@ -1785,6 +1985,7 @@ serialdev_gensio_alloc(const char *devname, const char * const args[],
 			    sdata->write_only);
     if (!ll)
 	goto out_nomem;
+    sdata->ll = ll;
 
     /*
      * After this point, freeing the ll or io will free sdata through
@@ -247,7 +247,15 @@ process_telnet_data(unsigned char *outdata, unsigned int outlen,
 	    td->telnet_cmd[td->telnet_cmd_pos++] = TN_IAC;
 	    td->suboption_iac = 0;
 	} else {
-	    outdata[j++] = indata[i];
+	    /* Copy everything up to the next IAC in one go. */
+	    unsigned char *p = memchr(indata + i, TN_IAC, *inlen - i);
+	    unsigned int run = p ? p - (indata + i) : *inlen - i;
+
+	    if (run > outlen - j)
+		run = outlen - j;
+	    memcpy(outdata + j, indata + i, run);
+	    j += run;
+	    i += run - 1; /* The loop increments i. */
 	}
     }
 
@@ -261,24 +269,29 @@ unsigned int
 process_telnet_xmit(unsigned char *outdata, unsigned int outlen,
 		    const unsigned char **indata, size_t *r_inlen)
 {
-    unsigned int i, j = 0;
+    unsigned int i = 0, j = 0, run;
     unsigned int inlen = *r_inlen;
-    const unsigned char *ibuf = *indata;
-
-    /* Double the IACs on a telnet transmit stream. */
-    for (i = 0; i < inlen; i++) {
-	if (ibuf[i] == TN_IAC) {
-	    if (outlen < 2)
-		    break;
-	    outdata[j++] = TN_IAC;
-	    outdata[j++] = TN_IAC;
-	    outlen -= 2;
-	} else {
-	    if (outlen < 1)
-		break;
-	    outdata[j++] = ibuf[i];
-	    outlen--;
-	}
+    const unsigned char *ibuf = *indata, *p;
+
+    /*
+     * Double the IACs on a telnet transmit stream.  The data between
+     * IACs is copied in bulk.
+     */
+    while (i < inlen) {
+	p = memchr(ibuf + i, TN_IAC, inlen - i);
+	run = p ? p - (ibuf + i) : inlen - i;
+	if (run > outlen)
+	    run = outlen;
+	memcpy(outdata + j, ibuf + i, run);
+	i += run;
+	j += run;
+	outlen -= run;
+	if (i == inlen || ibuf[i] != TN_IAC || outlen < 2)
+	    break;
+	outdata[j++] = TN_IAC;
+	outdata[j++] = TN_IAC;
+	outlen -= 2;
+	i++;
     }
 
     *indata = ibuf + i;
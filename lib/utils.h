@@ -22,6 +22,19 @@ int strncasecmp(const char *s1, const char *s2, int n);
 
 int gensio_time_cmp(gensio_time *t1, gensio_time *t2);
 
+/* The name passed to gensio_set_progname(), "gensio" by default. */
+const char *gensio_os_get_progname(void);
+
+/*
+ * Return a hash of the current address, for looking addresses up in
+ * hash tables.  Addresses that gensio_addr_equal() says are equal
+ * (with compare_all false and the same compare_ports) have the same
+ * hash.
+ */
+struct gensio_addr;
+unsigned int gensio_addr_hash(const struct gensio_addr *addr,
+			      bool compare_ports);
+
 /*
  * Returns true if the first strlen(prefix) characters of s are the
  * same as prefix.  If true is returned, val is set to the character
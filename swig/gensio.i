@@ -259,6 +259,10 @@ struct waiter { };
 %constant int GENSIO_CONTROL_DEL_MCAST = GENSIO_CONTROL_DEL_MCAST;
 %constant int GENSIO_CONTROL_LADDR = GENSIO_CONTROL_LADDR;
 %constant int GENSIO_CONTROL_LPORT = GENSIO_CONTROL_LPORT;
+%constant int GENSIO_CONTROL_RTT = GENSIO_CONTROL_RTT;
+%constant int GENSIO_CONTROL_CWND = GENSIO_CONTROL_CWND;
+%constant int GENSIO_CONTROL_RETRANSMITS = GENSIO_CONTROL_RETRANSMITS;
+%constant int GENSIO_CONTROL_RAW_FD = GENSIO_CONTROL_RAW_FD;
 
 %extend gensio {
     gensio(struct gensio_os_funcs *o, char *str, swig_cb *handler) {
@@ -0,0 +1,146 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Helpers for tests that drive gensiot as a subprocess.  These don't
+# need the python gensio module, so they run even when the swig
+# bindings are not built.
+#
+
+import os
+import sys
+import socket
+import subprocess
+import tempfile
+import shutil
+import threading
+import time
+
+if len(sys.argv) > 1:
+    gensiot = sys.argv[1]
+else:
+    gensiot = os.environ.get("GENSIOT")
+if not gensiot or not os.path.exists(gensiot):
+    print("gensiot not found, skipping")
+    sys.exit(77)
+
+tooldir = os.path.dirname(gensiot)
+
+procs = []
+
+def free_port(stype = socket.SOCK_STREAM):
+    s = socket.socket(socket.AF_INET, stype)
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+def start(args, **kwargs):
+    p = subprocess.Popen([gensiot] + args, **kwargs)
+    procs.append(p)
+    return p
+
+def make_data(size):
+    return bytes([(i * 7 + i // 251) & 0xff for i in range(0, size)])
+
+def write_file(tmpdir, name, data):
+    fname = os.path.join(tmpdir, name)
+    with open(fname, "wb") as f:
+        f.write(data)
+    return fname
+
+def wait_exit(p, name, timeout = 20):
+    try:
+        rv = p.wait(timeout=timeout)
+    except subprocess.TimeoutExpired:
+        raise Exception("%s did not exit" % name)
+    if rv != 0:
+        raise Exception("%s exited with %d" % (name, rv))
+
+def check_data(got, data, what):
+    if got != data:
+        for i in range(0, min(len(got), len(data))):
+            if got[i] != data[i]:
+                break
+        else:
+            i = min(len(got), len(data))
+        raise Exception("%s %d bytes, expected %d, first difference at %d" %
+                        (what, len(got), len(data), i))
+
+def read_all(p, out):
+    t = threading.Thread(target = lambda: out.append(p.stdout.read()))
+    t.start()
+    return t
+
+def file_transfer(tmpdir, data, acc, con, sendio = None):
+    """Send data from a file gensio on one gensiot through con to a
+    gensiot listening on acc, the receiver writes it to stdout.
+    Return what was received."""
+    infile = write_file(tmpdir, "xfer.in", data)
+    recv = start(["-i", "stdio(self)", "-a", acc],
+                 stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    time.sleep(0.5)
+    if not sendio:
+        sendio = "file(infile=" + infile + ")"
+    send = start(["-i", sendio, con])
+
+    out = []
+    t = read_all(recv, out)
+    wait_exit(send, "sender")
+    t.join(20)
+    recv.stdin.close()
+    wait_exit(recv, "receiver")
+    if not out:
+        return b""
+    return out[0]
+
+def echo_transfer(data, acc, con, accio = "echo", chunk = None, delay = 0):
+    """Start an echo on acc, write data to a gensiot connecting with
+    con and return what comes back.  If chunk is set, the data is
+    read back in pieces of at most that size with delay between them
+    so the stack sees a slow consumer."""
+    echo = start(["-i", accio, "-a", acc])
+    time.sleep(0.5)
+    send = start(["-i", "stdio(self)", con],
+                 stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    out = bytearray()
+    def reader():
+        size = chunk if chunk else 65536
+        while len(out) < len(data):
+            b = send.stdout.read1(size)
+            if not b:
+                break
+            out.extend(b)
+            if delay:
+                time.sleep(delay)
+    t = threading.Thread(target = reader)
+    t.start()
+    send.stdin.write(data)
+    send.stdin.flush()
+    t.join(60)
+    send.stdin.close()
+    wait_exit(send, "sender")
+    echo.terminate()
+    echo.wait()
+    return bytes(out)
+
+def run_tests(tests):
+    """Run a list of (description, function) pairs.  Each function
+    gets a scratch directory, all gensiots are killed at the end."""
+    tmpdir = tempfile.mkdtemp()
+    try:
+        for (desc, func) in tests:
+            print("Test " + desc)
+            func(tmpdir)
+            print("  Success!")
+    finally:
+        for p in procs:
+            if p.poll() is None:
+                p.kill()
+                p.wait()
+        shutil.rmtree(tmpdir)
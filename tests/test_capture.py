@@ -0,0 +1,131 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Test trace capture segments and the replay gensio with gensiot.
+# The segments must rotate with the right headers, a new capture must
+# continue after an old one, and replay must give back what was
+# captured, through a gensio stack and with the recorded timing.
+#
+
+import struct
+from gensiot_utils import *
+
+def read_segment(fname):
+    with open(fname, "rb") as f:
+        buf = f.read()
+    if buf[0:8] != b"GNSCAP1\0":
+        raise Exception("%s: bad magic" % fname)
+    (seq, length) = struct.unpack_from("<QQ", buf, 8)
+    if length == 0 or length > len(buf):
+        raise Exception("%s: bad length %d" % (fname, length))
+    recs = []
+    pos = 24
+    while pos + 24 <= length and buf[pos] != 0:
+        (rtype, dlen) = struct.unpack_from("<B3xI", buf, pos)
+        pos += 24
+        if rtype == 3:
+            raise Exception("%s: records were dropped" % fname)
+        recs.append(buf[pos:pos + dlen])
+        pos += dlen
+    return (seq, recs)
+
+def capture(tmpdir, name, opts, chunks, delay):
+    """Write chunks through a capturing trace with delay between them."""
+    outfile = os.path.join(tmpdir, name + ".out")
+    if os.path.exists(outfile):
+        os.remove(outfile)
+    p = start(["-i", "stdio(self)",
+               "trace(dir=write,capture=%s%s),file(outfile=%s,create)" %
+               (os.path.join(tmpdir, name), opts, outfile)],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    for c in chunks:
+        p.stdin.write(c)
+        p.stdin.flush()
+        time.sleep(delay)
+    p.stdin.close()
+    wait_exit(p, "capture")
+    with open(outfile, "rb") as f:
+        check_data(f.read(), b"".join(chunks), "Wrote")
+
+def replay(stack):
+    p = start(["-i", "stdio(self)", stack],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = []
+    t = read_all(p, out)
+    t.join(20)
+    p.stdin.close()
+    wait_exit(p, "replay")
+    return out[0] if out else b""
+
+def chunks_of(data, size):
+    return [data[i:i + size] for i in range(0, len(data), size)]
+
+def rotate(tmpdir):
+    data = make_data(40000)
+    capture(tmpdir, "rot", ",segsize=4096,segments=4",
+            chunks_of(data, 1000), 0.02)
+    segs = []
+    for i in range(0, 4):
+        segs.append(read_segment(os.path.join(tmpdir, "rot.%d" % i)))
+    if os.path.exists(os.path.join(tmpdir, "rot.4")):
+        raise Exception("More segments than asked for")
+    segs.sort()
+    for i in range(1, 4):
+        if segs[i][0] != segs[0][0] + i:
+            raise Exception("Segment sequence numbers are not in order")
+    kept = b"".join([b"".join(s[1]) for s in segs])
+    if not kept or kept != data[len(data) - len(kept):]:
+        raise Exception("Segments don't hold the end of the data")
+    got = replay("replay(file=%s,dir=write)" % os.path.join(tmpdir, "rot"))
+    check_data(got, kept, "Replayed")
+
+    # A new capture continues after the old one.
+    lastseq = segs[3][0]
+    capture(tmpdir, "rot", ",segsize=4096,segments=4",
+            [b"more data"], 0)
+    newest = max([read_segment(os.path.join(tmpdir, "rot.%d" % i))
+                  for i in range(0, 4)])
+    if newest[0] != lastseq + 1 or newest[1] != [b"more data"]:
+        raise Exception("New capture didn't continue the old one")
+
+def stack(tmpdir):
+    # Capture the msgdelim wire data, then unframe it again on replay.
+    data = make_data(100000)
+    name = os.path.join(tmpdir, "md")
+    infile = write_file(tmpdir, "md.in", data)
+    p = start(["-i", "file(infile=%s)" % infile,
+               "msgdelim(writebuf=65536),"
+               "trace(dir=write,capture=%s,segsize=1048576),"
+               "file(outfile=%s,create)" %
+               (name, os.path.join(tmpdir, "md.out"))])
+    wait_exit(p, "capture")
+    got = replay("msgdelim(readbuf=65536),replay(file=%s,dir=write)" % name)
+    check_data(got, data, "Replayed")
+
+def speed(tmpdir):
+    data = make_data(5000)
+    capture(tmpdir, "spd", "", chunks_of(data, 1000), 0.3)
+    name = os.path.join(tmpdir, "spd")
+    start_time = time.time()
+    got = replay("replay(file=%s,dir=write,speed=recorded)" % name)
+    recorded = time.time() - start_time
+    check_data(got, data, "Replayed")
+    start_time = time.time()
+    got = replay("replay(file=%s,dir=write)" % name)
+    fast = time.time() - start_time
+    check_data(got, data, "Replayed")
+    if recorded < 1.0:
+        raise Exception("Recorded speed replay took %f seconds" % recorded)
+    if fast >= recorded:
+        raise Exception("Max speed replay wasn't faster")
+
+run_tests([
+    ("capture segments rotate and replay", rotate),
+    ("replay a capture through a gensio stack", stack),
+    ("replay at the recorded speed", speed),
+])
@@ -0,0 +1,74 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Read files through the file gensio with mmap using gensiot.  Files
+# that are empty, that end on a 4MB mapping window boundary, and that
+# span several windows must all come out exactly, data added to a file
+# while it is read must be read, and mmap on a FIFO must fall back to
+# normal reads.
+#
+
+from gensiot_utils import *
+
+WINDOW = 4 * 1024 * 1024
+
+def read_file(infile, opts = ",mmap"):
+    p = start(["-i", "stdio(self)", "file(infile=%s%s)" % (infile, opts)],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = []
+    t = read_all(p, out)
+    t.join(30)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    return out[0] if out else b""
+
+def roundtrip(tmpdir, size):
+    data = make_data(size)
+    infile = write_file(tmpdir, "mm.in", data)
+    check_data(read_file(infile), data, "Read")
+
+def append(tmpdir):
+    data = make_data(WINDOW + 100000)
+    infile = write_file(tmpdir, "mm.in", data[:WINDOW + 1000])
+    p = start(["-i", "stdio(self)", "file(infile=%s,mmap)" % infile],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    # Nothing is read from gensiot yet, so it is stuck in the first
+    # window when the data is added.
+    time.sleep(0.5)
+    with open(infile, "ab") as f:
+        f.write(data[WINDOW + 1000:])
+    out = []
+    t = read_all(p, out)
+    t.join(30)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    check_data(out[0] if out else b"", data, "Read")
+
+def fifo(tmpdir):
+    fname = os.path.join(tmpdir, "mm.fifo")
+    os.mkfifo(fname)
+    data = make_data(100000)
+    def writer():
+        with open(fname, "wb") as f:
+            f.write(data)
+    t = threading.Thread(target = writer)
+    t.start()
+    got = read_file(fname)
+    t.join(20)
+    check_data(got, data, "Read")
+
+run_tests([
+    ("mmap of an empty file", lambda tmpdir: roundtrip(tmpdir, 0)),
+    ("mmap of a one byte file", lambda tmpdir: roundtrip(tmpdir, 1)),
+    ("mmap of a file the size of a window",
+     lambda tmpdir: roundtrip(tmpdir, WINDOW)),
+    ("mmap of a file spanning windows",
+     lambda tmpdir: roundtrip(tmpdir, 2 * WINDOW + 12345)),
+    ("mmap of a file that grows while it is read", append),
+    ("mmap of a FIFO", fifo),
+])
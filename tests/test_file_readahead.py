@@ -0,0 +1,67 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Read files through the file gensio with readahead using gensiot.
+# All the data must come out in order with different buffer counts
+# and sizes, and closing while the readahead is waiting on a FIFO
+# that has no data must not hang.
+#
+
+from gensiot_utils import *
+
+def read_file(infile, opts):
+    p = start(["-i", "stdio(self)", "file(infile=%s%s)" % (infile, opts)],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = []
+    t = read_all(p, out)
+    t.join(20)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    return out[0] if out else b""
+
+def roundtrip(tmpdir, size, opts):
+    data = make_data(size)
+    infile = write_file(tmpdir, "ra.in", data)
+    check_data(read_file(infile, opts), data, "Read")
+
+def fifo(tmpdir):
+    fname = os.path.join(tmpdir, "ra.fifo")
+    os.mkfifo(fname)
+    p = start(["-i", "stdio(self)", "file(infile=%s,readahead=4)" % fname],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    # This waits for gensiot to open the FIFO.
+    w = os.open(fname, os.O_WRONLY)
+    data = make_data(10000)
+    os.write(w, data)
+    out = bytearray()
+    while len(out) < len(data):
+        b = p.stdout.read1(65536)
+        if not b:
+            break
+        out.extend(b)
+    check_data(bytes(out), data, "Read")
+    # The writer stays open, so the readahead is waiting for more.
+    time.sleep(0.5)
+    start_time = time.time()
+    p.stdin.close()
+    wait_exit(p, "gensiot", timeout = 5)
+    os.close(w)
+    if time.time() - start_time > 2:
+        raise Exception("Close took %f seconds" % (time.time() - start_time))
+
+run_tests([
+    ("readahead of a large file",
+     lambda tmpdir: roundtrip(tmpdir, 5000000, ",readahead=4")),
+    ("readahead with one buffer and an odd readbuf",
+     lambda tmpdir: roundtrip(tmpdir, 1000000, ",readahead=1,readbuf=1000")),
+    ("readahead with many small buffers",
+     lambda tmpdir: roundtrip(tmpdir, 100000, ",readahead=64,readbuf=7")),
+    ("readahead of an empty file",
+     lambda tmpdir: roundtrip(tmpdir, 0, ",readahead=4")),
+    ("readahead of a FIFO closes while waiting for data", fifo),
+])
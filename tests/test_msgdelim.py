@@ -0,0 +1,140 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Check the msgdelim wire format against an encoder and decoder
+# written here, with data full of 254s.  Messages with bad CRCs, bad
+# escapes, or too much data must be dropped without hurting the ones
+# after them.
+#
+
+from gensiot_utils import *
+
+def crc16(data):
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for i in range(0, 8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+def escape(data):
+    return data.replace(b"\xfe", b"\xfe\x00")
+
+def encode(msgs, crc = True):
+    out = bytearray(b"\xfe\x01")
+    for m in msgs:
+        if crc:
+            c = crc16(m)
+            m = m + bytes([c >> 8, c & 0xff])
+        out.extend(escape(m))
+        out.extend(b"\xfe\x01")
+    return bytes(out)
+
+def decode(wire, crc = True):
+    if wire[0:2] != b"\xfe\x01":
+        raise Exception("Output doesn't start with a separator")
+    msgs = []
+    msg = bytearray()
+    i = 2
+    while i < len(wire):
+        b = wire[i]
+        i += 1
+        if b != 0xfe:
+            msg.append(b)
+            continue
+        if i >= len(wire):
+            raise Exception("Output ends in the middle of an escape")
+        b = wire[i]
+        i += 1
+        if b == 0:
+            msg.append(0xfe)
+        elif b == 1:
+            msgs.append(bytes(msg))
+            msg = bytearray()
+        else:
+            raise Exception("Bad escape 254 %d at %d" % (b, i - 2))
+    if msg:
+        raise Exception("Output doesn't end with a separator")
+    if crc:
+        for m in msgs:
+            if len(m) < 3 or crc16(m) != 0:
+                raise Exception("Bad CRC on a %d byte message" % len(m))
+        msgs = [m[:-2] for m in msgs]
+    return msgs
+
+def test_data():
+    # All byte values, runs of 254s, and things that look like escapes.
+    return (make_data(50000) + bytes([254] * 3000) +
+            bytes([254, 0, 254, 1, 255, 254]) * 1000 + make_data(10000))
+
+def encode_test(tmpdir, opts, crc):
+    data = test_data()
+    infile = write_file(tmpdir, "md.in", data)
+    outfile = os.path.join(tmpdir, "md.out")
+    if os.path.exists(outfile):
+        os.remove(outfile)
+    p = start(["-i", "file(infile=%s)" % infile,
+               "msgdelim(writebuf=65536%s),file(outfile=%s,create)" %
+               (opts, outfile)])
+    wait_exit(p, "gensiot")
+    with open(outfile, "rb") as f:
+        wire = f.read()
+    msgs = decode(wire, crc)
+    if not msgs:
+        raise Exception("No messages written")
+    check_data(b"".join(msgs), data, "Decoded")
+
+def decode_test(tmpdir):
+    data = test_data()
+    msgs = []
+    pos = 0
+    size = 1
+    while pos < len(data):
+        msgs.append(data[pos:pos + size])
+        pos += size
+        size = size * 7 % 1000 + 1
+    wire = bytearray(b"\xfe\x01")
+    for (i, m) in enumerate(msgs):
+        wire.extend(encode([m])[2:])
+        if i % 50 == 10:
+            # A bad CRC, a bad escape, and one that is too big.
+            bad = bytearray(encode([b"bad crc " + m])[2:])
+            bad[0] ^= 1
+            wire.extend(bad)
+            wire.extend(b"bad\xfe\x05escape" + encode([m])[2:])
+            wire.extend(encode([data[0:5000]])[2:])
+    infile = write_file(tmpdir, "md.wire", bytes(wire))
+    p = start(["-i", "stdio(self)",
+               "msgdelim(readbuf=4096),file(infile=%s)" % infile],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = []
+    t = read_all(p, out)
+    t.join(20)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    check_data(out[0] if out else b"", data, "Decoded")
+
+def xfer(tmpdir):
+    data = test_data()
+    port = free_port()
+    got = file_transfer(tmpdir, data,
+                        "msgdelim(readbuf=4096),tcp,127.0.0.1,%d" % port,
+                        "msgdelim(writebuf=4096),tcp,127.0.0.1,%d" % port)
+    check_data(got, data, "Received")
+
+run_tests([
+    ("msgdelim wire format",
+     lambda tmpdir: encode_test(tmpdir, "", True)),
+    ("msgdelim wire format without a CRC",
+     lambda tmpdir: encode_test(tmpdir, ",crc=off", False)),
+    ("msgdelim drops bad messages", decode_test),
+    ("msgdelim transfer over tcp", xfer),
+])
@@ -0,0 +1,105 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Test gensiot relaying data between plain file descriptors, file to
+# tcp, tcp to file, and tcp to tcp.  Files read with mmap or readahead
+# can't be relayed from, so those must fall back to normal reads in
+# that direction.
+#
+
+from gensiot_utils import *
+
+def middle(port):
+    """Start a gensiot relaying tcp to tcp to port, return its port."""
+    mport = free_port()
+    midp = start(["-i", "tcp,127.0.0.1,%d" % port,
+                  "-a", "tcp,127.0.0.1,%d" % mport])
+    time.sleep(0.5)
+    return (midp, mport)
+
+def file_to_tcp(tmpdir, opts = ""):
+    data = make_data(3000000)
+    port = free_port()
+    got = file_transfer(tmpdir, data, "tcp,127.0.0.1,%d" % port,
+                        "tcp,127.0.0.1,%d" % port,
+                        sendio = "file(infile=%s%s)" %
+                        (os.path.join(tmpdir, "xfer.in"), opts))
+    check_data(got, data, "Received")
+
+def file_to_tcp_mid(tmpdir):
+    data = make_data(3000000)
+    infile = write_file(tmpdir, "relay.in", data)
+    port = free_port()
+    recv = start(["-i", "stdio(self)", "-a", "tcp,127.0.0.1,%d" % port],
+                 stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    time.sleep(0.5)
+    (midp, mport) = middle(port)
+    send = start(["-i", "file(infile=%s)" % infile,
+                  "tcp,127.0.0.1,%d" % mport])
+    out = []
+    t = read_all(recv, out)
+    wait_exit(send, "sender")
+    wait_exit(midp, "middle")
+    t.join(20)
+    recv.stdin.close()
+    wait_exit(recv, "receiver")
+    check_data(out[0] if out else b"", data, "Received")
+
+def tcp_to_file(tmpdir):
+    data = make_data(3000000)
+    infile = write_file(tmpdir, "relay.in", data)
+    outfile = os.path.join(tmpdir, "relay.out")
+    port = free_port()
+    recv = start(["-i", "file(outfile=%s,create)" % outfile,
+                  "-a", "tcp,127.0.0.1,%d" % port])
+    time.sleep(0.5)
+    send = start(["-i", "file(infile=%s)" % infile,
+                  "tcp,127.0.0.1,%d" % port])
+    wait_exit(send, "sender")
+    wait_exit(recv, "receiver")
+    with open(outfile, "rb") as f:
+        check_data(f.read(), data, "Wrote")
+
+def tcp_both_ways(tmpdir):
+    data = make_data(1000000)
+    eport = free_port()
+    echo = start(["-i", "echo", "-a", "tcp,127.0.0.1,%d" % eport])
+    time.sleep(0.5)
+    (midp, mport) = middle(eport)
+    send = start(["-i", "stdio(self)", "tcp,127.0.0.1,%d" % mport],
+                 stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    out = bytearray()
+    def reader():
+        while len(out) < len(data):
+            b = send.stdout.read1(65536)
+            if not b:
+                break
+            out.extend(b)
+    t = threading.Thread(target = reader)
+    t.start()
+    send.stdin.write(data)
+    send.stdin.flush()
+    t.join(20)
+    send.stdin.close()
+    wait_exit(send, "sender")
+    wait_exit(midp, "middle")
+    echo.terminate()
+    echo.wait()
+    check_data(bytes(out), data, "Echoed")
+
+run_tests([
+    ("relay file to tcp", file_to_tcp),
+    ("relay file with mmap to tcp",
+     lambda tmpdir: file_to_tcp(tmpdir, ",mmap")),
+    ("relay file with readahead to tcp",
+     lambda tmpdir: file_to_tcp(tmpdir, ",readahead=4")),
+    ("relay file to tcp through tcp to tcp", file_to_tcp_mid),
+    ("relay tcp to file", tcp_to_file),
+    ("relay tcp to tcp both ways", tcp_both_ways),
+])
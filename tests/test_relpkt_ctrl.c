@@ -0,0 +1,265 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Transfer data through relpkt over udp with a proxy in the middle
+ * that drops some of the data packets.  The data must all arrive
+ * intact, and the round trip time, congestion window, and retransmit
+ * count controls must show what happened.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <gensio/gensio.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+
+#define DATA_SIZE	300000
+
+/* Drop every DROP_EVERY'th data packet from the client. */
+#define DROP_EVERY	20
+
+static struct gensio_os_funcs *o;
+static int proxyfd = -1;
+static struct sockaddr_in servaddr;
+static volatile bool proxy_stop;
+static unsigned int proxy_dropped;
+static unsigned char data[DATA_SIZE];
+
+static void
+fail(const char *what, int err)
+{
+    if (err)
+	fprintf(stderr, "%s: %s\n", what, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s\n", what);
+    exit(1);
+}
+
+static void
+handle_sigusr1(int sig)
+{
+}
+
+static void *
+proxy_thread(void *arg)
+{
+    struct sockaddr_in cliaddr, addr;
+    bool have_client = false;
+    unsigned int count = 0;
+    unsigned char buf[65536];
+    struct pollfd pfd;
+    socklen_t addrlen;
+    ssize_t len;
+
+    pfd.fd = proxyfd;
+    pfd.events = POLLIN;
+    while (!proxy_stop) {
+	if (poll(&pfd, 1, 100) <= 0)
+	    continue;
+	addrlen = sizeof(addr);
+	len = recvfrom(proxyfd, buf, sizeof(buf), 0,
+		       (struct sockaddr *) &addr, &addrlen);
+	if (len < 0)
+	    continue;
+	if (addr.sin_port == servaddr.sin_port) {
+	    if (have_client)
+		sendto(proxyfd, buf, len, 0,
+		       (struct sockaddr *) &cliaddr, sizeof(cliaddr));
+	    continue;
+	}
+	cliaddr = addr;
+	have_client = true;
+	/* Only drop packets carrying data, not the handshake or acks. */
+	if (len > 100 && ++count % DROP_EVERY == 0) {
+	    proxy_dropped++;
+	    continue;
+	}
+	sendto(proxyfd, buf, len, 0,
+	       (struct sockaddr *) &servaddr, sizeof(servaddr));
+    }
+    return NULL;
+}
+
+static void *
+recv_thread(void *arg)
+{
+    struct gensio *io = arg;
+    static unsigned char rdata[DATA_SIZE];
+    gensiods pos = 0, count;
+    gensio_time timeout;
+    int rv;
+
+    while (pos < DATA_SIZE) {
+	timeout.secs = 10;
+	timeout.nsecs = 0;
+	rv = gensio_read_s(io, &count, rdata + pos, DATA_SIZE - pos, &timeout);
+	if (rv)
+	    fail("Receive failed", rv);
+	pos += count;
+    }
+    if (memcmp(rdata, data, DATA_SIZE) != 0)
+	fail("Received data mismatch", 0);
+    return NULL;
+}
+
+static long long
+get_ctrl(struct gensio *io, unsigned int option, const char *name)
+{
+    char buf[30];
+    gensiods len = sizeof(buf);
+    int rv;
+
+    rv = gensio_control(io, GENSIO_CONTROL_DEPTH_FIRST, true, option,
+			buf, &len);
+    if (rv)
+	fail(name, rv);
+    printf("  %s is %s\n", name, buf);
+    return strtoll(buf, NULL, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_accepter *acc;
+    struct gensio *cio, *sio;
+    struct sockaddr_in addr;
+    struct sigaction sigdo;
+    socklen_t addrlen;
+    pthread_t proxyth, recvth;
+    gensio_time timeout, zerotime = { 0, 0 };
+    gensiods pos, count;
+    char str[100];
+    unsigned int i;
+    int rv;
+
+    for (i = 0; i < DATA_SIZE; i++)
+	data[i] = i * 7 + i / 251;
+
+    memset(&sigdo, 0, sizeof(sigdo));
+    sigdo.sa_handler = handle_sigusr1;
+    if (sigaction(SIGUSR1, &sigdo, NULL)) {
+	perror("Could not set up siguser1 handler");
+	exit(1);
+    }
+
+    rv = gensio_default_os_hnd(SIGUSR1, &o);
+    if (rv)
+	fail("Could not allocate OS handler", rv);
+
+    rv = str_to_gensio_accepter("relpkt,udp,127.0.0.1,0", o, NULL, NULL,
+				&acc);
+    if (rv)
+	fail("Could not allocate accepter", rv);
+    rv = gensio_acc_set_sync(acc);
+    if (rv)
+	fail("Could not set accepter sync", rv);
+    rv = gensio_acc_startup(acc);
+    if (rv)
+	fail("Could not start accepter", rv);
+    count = sizeof(str);
+    strcpy(str, "0");
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, str, &count);
+    if (rv)
+	fail("Could not get accepter port", rv);
+
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    servaddr.sin_port = htons(atoi(str));
+
+    proxyfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (proxyfd == -1)
+	fail("Could not allocate proxy socket", 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(proxyfd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+	fail("Could not bind proxy socket", 0);
+    addrlen = sizeof(addr);
+    getsockname(proxyfd, (struct sockaddr *) &addr, &addrlen);
+    pthread_create(&proxyth, NULL, proxy_thread, NULL);
+
+    snprintf(str, sizeof(str), "relpkt,udp,127.0.0.1,%d",
+	     ntohs(addr.sin_port));
+    rv = str_to_gensio(str, o, NULL, NULL, &cio);
+    if (rv)
+	fail("Could not allocate connecter", rv);
+    rv = gensio_set_sync(cio);
+    if (rv)
+	fail("Could not set connecter sync", rv);
+    rv = gensio_open_s(cio);
+    if (rv)
+	fail("Could not open connecter", rv);
+
+    timeout.secs = 10;
+    timeout.nsecs = 0;
+    rv = gensio_acc_accept_s(acc, &timeout, &sio);
+    if (rv)
+	fail("Could not accept", rv);
+    rv = gensio_set_sync(sio);
+    if (rv)
+	fail("Could not set accepted gensio sync", rv);
+
+    printf("Test relpkt transfer with dropped packets\n");
+    pthread_create(&recvth, NULL, recv_thread, sio);
+    for (pos = 0; pos < DATA_SIZE; pos += count) {
+	timeout.secs = 10;
+	timeout.nsecs = 0;
+	rv = gensio_write_s(cio, &count, data + pos, DATA_SIZE - pos,
+			    &timeout);
+	if (rv)
+	    fail("Send failed", rv);
+    }
+    pthread_join(recvth, NULL);
+    printf("  proxy dropped %u packets\n", proxy_dropped);
+    if (proxy_dropped == 0)
+	fail("The proxy didn't drop anything", 0);
+
+    if (get_ctrl(cio, GENSIO_CONTROL_RTT, "rtt") <= 0)
+	fail("No round trip time was measured", 0);
+    if (get_ctrl(cio, GENSIO_CONTROL_CWND, "cwnd") < 1)
+	fail("Congestion window is empty", 0);
+    if (get_ctrl(cio, GENSIO_CONTROL_RETRANSMITS, "retransmits") == 0)
+	fail("Dropped packets were not retransmitted", 0);
+    printf("  Success!\n");
+
+    gensio_close_s(cio);
+    gensio_close_s(sio);
+    gensio_free(cio);
+    gensio_free(sio);
+
+    proxy_stop = true;
+    pthread_join(proxyth, NULL);
+    close(proxyfd);
+
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    while (o->service(o, &zerotime) == 0)
+	;
+    o->free_funcs(o);
+    return 0;
+}
+#else
+int
+main(int argc, char *argv[])
+{
+    fprintf(stderr, "No thread support, skipping\n");
+    return 77;
+}
+#endif
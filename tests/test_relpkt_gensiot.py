@@ -0,0 +1,71 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Transfer data through relpkt over udp with gensiot, with a window
+# larger than the version 0 sequence numbers allow and with version 0
+# on either end, with udp batching, and echo data with different ack
+# settings.
+#
+
+from gensiot_utils import *
+
+def xfer(tmpdir, accver, conver, udpopts = ""):
+    data = make_data(1000000)
+    port = free_port(socket.SOCK_DGRAM)
+    got = file_transfer(tmpdir, data,
+                        "relpkt(max_packets=300%s),udp%s,127.0.0.1,%d" %
+                        (accver, udpopts, port),
+                        "relpkt(max_packets=300%s),udp%s,127.0.0.1,%d" %
+                        (conver, udpopts, port))
+    check_data(got, data, "Received")
+
+# Acks are delayed and carried on data going the other way, run data
+# both ways through an echo with different ack settings.
+def echo(tmpdir, accopts, conopts):
+    data = make_data(500000)
+    port = free_port(socket.SOCK_DGRAM)
+    got = echo_transfer(data,
+                        "relpkt(%s),udp,127.0.0.1,%d" % (accopts, port),
+                        "relpkt(%s),udp,127.0.0.1,%d" % (conopts, port))
+    check_data(got, data, "Echoed")
+
+def bad_option(tmpdir):
+    port = free_port(socket.SOCK_DGRAM)
+    p = start(["-i", "stdio(self)",
+               "relpkt(ack_every=0),udp,127.0.0.1,%d" % port],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+              stderr=subprocess.DEVNULL)
+    p.stdin.close()
+    try:
+        rv = p.wait(timeout=10)
+    except subprocess.TimeoutExpired:
+        raise Exception("gensiot did not exit")
+    if rv == 0:
+        raise Exception("ack_every=0 was not rejected")
+
+run_tests([
+    ("relpkt version 1 over udp",
+     lambda tmpdir: xfer(tmpdir, "", "")),
+    ("relpkt version 0 server with version 1 client over udp",
+     lambda tmpdir: xfer(tmpdir, ",version=0", "")),
+    ("relpkt version 1 server with version 0 client over udp",
+     lambda tmpdir: xfer(tmpdir, "", ",version=0")),
+    ("relpkt over udp reading and writing in batches",
+     lambda tmpdir: xfer(tmpdir, "", "", "(readbatch=16,writebatch=16)")),
+    ("relpkt echo with default delayed acks",
+     lambda tmpdir: echo(tmpdir, "", "")),
+    ("relpkt echo acking every packet immediately",
+     lambda tmpdir: echo(tmpdir, "ack_every=1,ack_delay=0",
+                         "ack_every=1,ack_delay=0")),
+    ("relpkt echo with long ack delays",
+     lambda tmpdir: echo(tmpdir, "ack_every=16,ack_delay=50",
+                         "ack_every=8,ack_delay=100")),
+    ("relpkt echo with delayed acks to a version 0 peer",
+     lambda tmpdir: echo(tmpdir, "version=0", "ack_every=8")),
+    ("relpkt rejects ack_every=0", bad_option),
+])
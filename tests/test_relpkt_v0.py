@@ -0,0 +1,21 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2018  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+from utils import *
+import gensio
+
+# A window larger than version 0 sequence numbers allow, it must be
+# limited to 127 when talking to an old implementation.
+print("Test relpkt version 0 server with version 1 client over udp")
+TestAccept(o, "mux,relpkt(max_packets=300),udp,localhost,",
+           "mux,relpkt(version=0,max_packets=300),udp,localhost,0",
+           do_large_test)
+
+print("Test relpkt version 1 server with version 0 client over udp")
+TestAccept(o, "mux,relpkt(version=0,max_packets=300),udp,localhost,",
+           "mux,relpkt(max_packets=300),udp,localhost,0",
+           do_large_test)
@@ -0,0 +1,40 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2018  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+from utils import *
+import gensio
+import tempfile
+import shutil
+
+def capture_and_replay(capstr, name):
+    # Enough data to fill a few minimum-size capture segments.
+    data = bytes([(i * 7 + i // 256) & 0xff for i in range(0, 8000)])
+
+    io = alloc_io(o, "trace(dir=read," + capstr + "),echo")
+    test_dataxfer(io, io, data)
+    io_close(io)
+
+    io = alloc_io(o, "replay(file=" + name + ")")
+    io.handler.set_compare(data)
+    if (io.handler.wait_timeout(1000) == 0):
+        raise Exception("%s: Timed out waiting for replay data at byte %d" %
+                        (io.handler.name, io.handler.compared))
+    io_close(io)
+
+tmpdir = tempfile.mkdtemp()
+try:
+    print("Test trace capture segments and replay")
+    name = os.path.join(tmpdir, "cap")
+    capture_and_replay("capture=" + name + ",segsize=4096,segments=4", name)
+    print("  Success!")
+
+    print("Test trace binary file and replay")
+    name = os.path.join(tmpdir, "trace.bin")
+    capture_and_replay("binary,file=" + name, name)
+    print("  Success!")
+finally:
+    shutil.rmtree(tmpdir)
@@ -0,0 +1,177 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Fill a slow (9600 baud) serialdev opened on a pty until it won't
+ * take any more, then close it.  Everything written before the close
+ * must come out the other side, and the close must finish in bounded
+ * time even if nobody ever reads the other side.
+ */
+
+#define _GNU_SOURCE /* Get posix_openpt() and friends. */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+
+#define MAX_DATA	(1024 * 1024)
+
+static struct gensio_os_funcs *o;
+static unsigned char wrbuf[MAX_DATA], rdbuf[MAX_DATA];
+static bool closed;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static int
+io_cb(struct gensio *io, void *user_data, int event, int err,
+      unsigned char *buf, gensiods *buflen,
+      const char *const *auxdata)
+{
+    return GE_NOTSUP;
+}
+
+static void
+close_done(struct gensio *io, void *close_data)
+{
+    closed = true;
+}
+
+static int64_t
+now_ms(void)
+{
+    gensio_time t;
+
+    o->get_monotonic_time(o, &t);
+    return t.secs * 1000 + t.nsecs / 1000000;
+}
+
+static void
+service(unsigned int msecs)
+{
+    gensio_time timeout;
+
+    timeout.secs = 0;
+    timeout.nsecs = msecs * 1000000;
+    o->service(o, &timeout);
+}
+
+/*
+ * Write to io until it won't take any more, with the pty master not
+ * being read.  Return the number of bytes written.
+ */
+static gensiods
+fill(struct gensio *io)
+{
+    gensiods pos = 0, count;
+    int rv;
+
+    for (pos = 0; pos < MAX_DATA; pos++)
+	wrbuf[pos] = pos * 7 + pos / 251;
+    pos = 0;
+    do {
+	rv = gensio_write(io, &count, wrbuf + pos, 1024, NULL);
+	if (rv)
+	    fail("Write failed at", pos, rv);
+	pos += count;
+    } while (count == 1024 && pos + 1024 <= MAX_DATA);
+    if (pos == 0 || pos + 1024 > MAX_DATA)
+	fail("Couldn't fill the pty, wrote", pos, 0);
+    return pos;
+}
+
+static void
+test_drain(bool read_data)
+{
+    struct gensio *io;
+    char str[200];
+    gensiods len, pos = 0;
+    int64_t start, done = 0;
+    ssize_t rv;
+    int err, mfd;
+
+    mfd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (mfd == -1 || grantpt(mfd) || unlockpt(mfd)) {
+	printf("No ptys, skipping\n");
+	exit(77);
+    }
+
+    snprintf(str, sizeof(str), "serialdev(nouucplock),%s,9600n81",
+	     ptsname(mfd));
+    printf("Test close %s reading the other side on %s\n",
+	   read_data ? "while" : "without", str);
+    err = str_to_gensio(str, o, io_cb, NULL, &io);
+    if (err)
+	fail("Could not allocate serialdev", 0, err);
+    err = gensio_open_s(io);
+    if (err)
+	fail("Could not open serialdev", 0, err);
+
+    len = fill(io);
+    closed = false;
+    start = now_ms();
+    err = gensio_close(io, close_done, NULL);
+    if (err)
+	fail("Could not close serialdev", 0, err);
+
+    /* Give the close a chance to drop data before reading starts. */
+    while (now_ms() - start < 500)
+	service(10);
+
+    while (now_ms() - start < 10000) {
+	if (closed && !done)
+	    done = now_ms();
+	if (read_data) {
+	    rv = read(mfd, rdbuf + pos, sizeof(rdbuf) - pos);
+	    if (rv > 0)
+		pos += rv;
+	    else if (rv == 0 || (errno != EAGAIN && errno != EINTR))
+		break; /* EIO once the slave is closed and empty. */
+	} else if (closed) {
+	    break;
+	}
+	service(10);
+    }
+    if (!closed)
+	fail("Close didn't finish, msecs:", now_ms() - start, 0);
+    if (read_data && (pos != len || memcmp(rdbuf, wrbuf, len) != 0))
+	fail("Close lost data, got", pos, 0);
+    if (done - start > 5000)
+	fail("Close took too long, msecs:", done - start, 0);
+
+    gensio_free(io);
+    close(mfd);
+    printf("  Success!\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    test_drain(true);
+    test_drain(false);
+
+    o->free_funcs(o);
+    return 0;
+}
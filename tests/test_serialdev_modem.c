@@ -0,0 +1,176 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Turn on modem state monitoring on a serialdev opened on a pty and
+ * pass data both ways for a few monitor periods.  A pty has no modem
+ * lines, so the monitor can't report anything, but it must not get
+ * in the way of the data or hold up the close.
+ */
+
+#define _GNU_SOURCE /* Get posix_openpt() and friends. */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <gensio/gensio.h>
+#include <gensio/sergensio.h>
+
+#define NR_ROUNDS	25
+
+static struct gensio_os_funcs *o;
+static char rdbuf[100];
+static gensiods rdlen;
+static const char *err_str;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static int
+io_cb(struct gensio *io, void *user_data, int event, int err,
+      unsigned char *buf, gensiods *buflen,
+      const char *const *auxdata)
+{
+    if (event == GENSIO_EVENT_SER_MODEMSTATE)
+	return 0;
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	err_str = gensio_err_to_str(err);
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+    if (*buflen > sizeof(rdbuf) - rdlen)
+	*buflen = sizeof(rdbuf) - rdlen;
+    memcpy(rdbuf + rdlen, buf, *buflen);
+    rdlen += *buflen;
+    return 0;
+}
+
+static void
+service(unsigned int msecs)
+{
+    gensio_time timeout;
+
+    timeout.secs = msecs / 1000;
+    timeout.nsecs = (msecs % 1000) * 1000000;
+    while (o->service(o, &timeout) != GE_TIMEDOUT && !err_str)
+	;
+    if (err_str) {
+	fprintf(stderr, "Read error: %s\n", err_str);
+	exit(1);
+    }
+}
+
+static int64_t
+now_ms(void)
+{
+    gensio_time t;
+
+    o->get_monotonic_time(o, &t);
+    return t.secs * 1000 + t.nsecs / 1000000;
+}
+
+/* Read exactly len bytes from the pty master. */
+static void
+master_read(int fd, char *buf, unsigned int len, unsigned int round)
+{
+    struct pollfd pfd;
+    unsigned int pos = 0;
+    ssize_t rv;
+
+    while (pos < len) {
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 5000) != 1)
+	    fail("Timed out reading the pty in round", round, 0);
+	rv = read(fd, buf + pos, len - pos);
+	if (rv <= 0)
+	    fail("Error reading the pty in round", round, 0);
+	pos += rv;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio *io;
+    char str[200], msg[20], buf[20];
+    gensiods len, count;
+    unsigned int i, j;
+    int64_t start;
+    int rv, mfd;
+
+    mfd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (mfd == -1 || grantpt(mfd) || unlockpt(mfd)) {
+	printf("No ptys, skipping\n");
+	return 77;
+    }
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    snprintf(str, sizeof(str), "serialdev(nouucplock),%s,9600n81",
+	     ptsname(mfd));
+    printf("Test modem state monitoring on %s\n", str);
+    rv = str_to_gensio(str, o, io_cb, NULL, &io);
+    if (rv)
+	fail("Could not allocate serialdev", 0, rv);
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open serialdev", 0, rv);
+    rv = sergensio_modemstate(gensio_to_sergensio(io), 255);
+    if (rv)
+	fail("Could not enable modem state", 0, rv);
+    gensio_set_read_callback_enable(io, true);
+
+    /* This runs a few seconds, so the monitor runs several times. */
+    for (i = 0; i < NR_ROUNDS; i++) {
+	len = snprintf(msg, sizeof(msg), "ping %u", i);
+	if (write(mfd, msg, len) != len)
+	    fail("Could not write to the pty in round", i, 0);
+	for (j = 0; j < 500 && rdlen < len; j++)
+	    service(10);
+	if (rdlen != len || memcmp(rdbuf, msg, len) != 0)
+	    fail("Wrong data from serialdev in round", i, 0);
+	rdlen = 0;
+
+	len = snprintf(msg, sizeof(msg), "pong %u", i);
+	rv = gensio_write(io, &count, msg, len, NULL);
+	if (rv || count != len)
+	    fail("Could not write to serialdev in round", i, rv);
+	master_read(mfd, buf, len, i);
+	if (memcmp(buf, msg, len) != 0)
+	    fail("Wrong data from the pty in round", i, 0);
+	service(100);
+    }
+
+    start = now_ms();
+    rv = gensio_close_s(io);
+    if (rv)
+	fail("Could not close serialdev", 0, rv);
+    if (now_ms() - start > 1000)
+	fail("Close took too long, msecs:", now_ms() - start, 0);
+    printf("  Success!\n");
+
+    gensio_free(io);
+    close(mfd);
+    o->free_funcs(o);
+    return 0;
+}
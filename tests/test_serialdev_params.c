@@ -0,0 +1,152 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Open a serialdev on a pty over and over with different port
+ * settings and defaults, and check the termios the port ends up with
+ * each time.  Every open must use the settings and defaults in effect
+ * at the time, no matter what was opened before it.
+ */
+
+#define _GNU_SOURCE /* Get posix_openpt() and friends. */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <gensio/gensio.h>
+
+#define NR_PASSES	20
+
+static struct gensio_os_funcs *o;
+
+/*
+ * A pty forces 8 bits and no parity, so only the speed, stop bits,
+ * and flow control can be checked.
+ */
+struct param_test {
+    const char *def_speed;	/* Default speed, NULL to leave it alone. */
+    int def_xonxoff;		/* Default xonxoff, -1 to leave it alone. */
+    const char *parms;		/* Options after the device name. */
+    speed_t speed;
+    bool two_stop;
+    bool xonxoff;
+};
+
+static struct param_test tests[] = {
+    { "9600N81", 0, "",			B9600, false, false },
+    { NULL, -1, ",19200N82",		B19200, true, false },
+    { NULL, -1, "",			B9600, false, false },
+    { "38400N82", -1, "",		B38400, true, false },
+    { NULL, -1, ",115200N81",		B115200, false, false },
+    { NULL, -1, "",			B38400, true, false },
+    { NULL, 1, "",			B38400, true, true },
+    { NULL, -1, ",xonxoff=false",	B38400, true, false },
+    { NULL, -1, ",speed=57600N81",	B57600, false, true },
+    { "9600N81", 0, ",4800",		B4800, false, false },
+    { NULL, -1, "",			B9600, false, false },
+};
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static int
+io_cb(struct gensio *io, void *user_data, int event, int err,
+      unsigned char *buf, gensiods *buflen,
+      const char *const *auxdata)
+{
+    return GE_NOTSUP;
+}
+
+static void
+run_test(const char *dev, int sfd, unsigned int i)
+{
+    struct param_test *t = &tests[i];
+    struct gensio *io;
+    struct termios tio;
+    char str[200];
+    int rv;
+
+    if (t->def_speed) {
+	rv = gensio_set_default(o, "serialdev", "speed", t->def_speed, 0);
+	if (rv)
+	    fail("Could not set default speed in test", i, rv);
+    }
+    if (t->def_xonxoff >= 0) {
+	rv = gensio_set_default(o, "serialdev", "xonxoff", NULL,
+				t->def_xonxoff);
+	if (rv)
+	    fail("Could not set default xonxoff in test", i, rv);
+    }
+
+    snprintf(str, sizeof(str), "serialdev(nouucplock),%s%s", dev, t->parms);
+    rv = str_to_gensio(str, o, io_cb, NULL, &io);
+    if (rv)
+	fail("Could not allocate serialdev in test", i, rv);
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open serialdev in test", i, rv);
+
+    if (tcgetattr(sfd, &tio))
+	fail("Could not get termios in test", i, 0);
+    if (cfgetospeed(&tio) != t->speed || cfgetispeed(&tio) != t->speed)
+	fail("Wrong speed in test", i, 0);
+    if (!!(tio.c_cflag & CSTOPB) != t->two_stop)
+	fail("Wrong stop bits in test", i, 0);
+    if (!!(tio.c_iflag & IXON) != t->xonxoff)
+	fail("Wrong xonxoff in test", i, 0);
+
+    rv = gensio_close_s(io);
+    if (rv)
+	fail("Could not close serialdev in test", i, rv);
+    gensio_free(io);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int i, j;
+    char *dev;
+    int rv, mfd, sfd;
+
+    mfd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (mfd == -1 || grantpt(mfd) || unlockpt(mfd)) {
+	printf("No ptys, skipping\n");
+	return 77;
+    }
+    dev = ptsname(mfd);
+    /* Keep the slave open to look at its termios. */
+    sfd = open(dev, O_RDWR | O_NOCTTY);
+    if (sfd == -1)
+	fail("Could not open the pty slave", 0, 0);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    printf("Test serialdev settings and defaults on %s\n", dev);
+    for (j = 0; j < NR_PASSES; j++) {
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+	    run_test(dev, sfd, i);
+    }
+    printf("  Success!\n");
+
+    close(sfd);
+    close(mfd);
+    o->free_funcs(o);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Dribble data into a serialdev on a pty a few bytes at a time and
+# check readgap and readmin with gensiot.  A binary read trace above
+# the serialdev records each read it delivers, with readgap there
+# must be far fewer of them, with readmin they must be at least that
+# big, and all the data must always get through.
+#
+
+import pty
+import tty
+import struct
+from gensiot_utils import *
+
+def read_sizes(fname):
+    sizes = []
+    with open(fname, "rb") as f:
+        buf = f.read()
+    pos = 0
+    while pos < len(buf):
+        (rtype, length) = struct.unpack_from("<B3xI", buf, pos)
+        pos += 24
+        if rtype in (1, 2):
+            sizes.append(length)
+            pos += length
+    return sizes
+
+def dribble(tmpdir, name, opts):
+    """Write 10 bytes at a time to the pty every couple of
+    milliseconds and return the sizes of the reads serialdev did."""
+    tfile = os.path.join(tmpdir, name + ".bin")
+    (master, slave) = pty.openpty()
+    tty.setraw(master)
+    p = start(["-i", "stdio(self)",
+               "trace(binary,dir=read,file=%s),"
+               "serialdev(nouucplock%s),%s,9600n81" %
+               (tfile, opts, os.ttyname(slave))],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    os.close(slave)
+    time.sleep(0.5)
+    data = make_data(2000)
+    out = bytearray()
+    def reader():
+        while len(out) < len(data):
+            b = p.stdout.read1(65536)
+            if not b:
+                break
+            out.extend(b)
+    t = threading.Thread(target = reader)
+    t.start()
+    for i in range(0, len(data), 10):
+        os.write(master, data[i:i + 10])
+        time.sleep(0.002)
+    t.join(20)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    os.close(master)
+    check_data(bytes(out), data, "Read")
+    return read_sizes(tfile)
+
+def nogap(tmpdir):
+    sizes = dribble(tmpdir, "nogap", "")
+    if len(sizes) < 50:
+        raise Exception("Only %d reads without readgap" % len(sizes))
+
+def gap(tmpdir):
+    sizes = dribble(tmpdir, "gap", ",readgap=50")
+    if len(sizes) > 20:
+        raise Exception("%d reads with readgap" % len(sizes))
+    if max(sizes) > 1024:
+        raise Exception("A %d byte read is bigger than readbuf" % max(sizes))
+
+def gapmin(tmpdir):
+    sizes = dribble(tmpdir, "gapmin", ",readgap=50,readmin=100")
+    if len(sizes) > 20:
+        raise Exception("%d reads with readgap" % len(sizes))
+    if len(sizes) > 1 and min(sizes[:-1]) < 100:
+        raise Exception("A %d byte read is smaller than readmin" %
+                        min(sizes[:-1]))
+
+run_tests([
+    ("serialdev reads without readgap", nogap),
+    ("serialdev reads with readgap", gap),
+    ("serialdev reads with readgap and readmin", gapmin),
+])
@@ -0,0 +1,194 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Check how stdio and pty gensios start their subprograms: only
+ * stdin, stdout, and stderr are passed to them, stderr can go to
+ * stdout, a pty subprogram has the pty as its controlling terminal,
+ * and a program that can't be run gives an error.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gensio/gensio.h>
+
+static struct gensio_os_funcs *o;
+
+static void
+fail(const char *what, const char *str, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %s: %s\n", what, str, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %s\n", what, str);
+    exit(1);
+}
+
+/*
+ * Run str, a stdio or pty gensio, and return everything it writes
+ * with \r removed in out.  Return the exit status.
+ */
+static int
+run(const char *str, char *out, gensiods outlen)
+{
+    struct gensio *io;
+    gensio_time timeout;
+    char buf[20];
+    gensiods i, count, len = 0;
+    int rv;
+
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (rv)
+	fail("Could not allocate", str, rv);
+    rv = gensio_set_sync(io);
+    if (rv)
+	fail("Could not set sync on", str, rv);
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open", str, rv);
+    for (;;) {
+	timeout.secs = 10;
+	timeout.nsecs = 0;
+	rv = gensio_read_s(io, &count, out + len, outlen - len - 1,
+			   &timeout);
+	/* A pty returns an I/O error when the subprogram exits. */
+	if (rv == GE_REMCLOSE || rv == GE_IOERR)
+	    break;
+	if (rv)
+	    fail("Read failed on", str, rv);
+	if (count == 0)
+	    fail("Timed out reading", str, 0);
+	len += count;
+    }
+    out[len] = '\0';
+    for (i = 0, count = 0; i <= len; i++) {
+	if (out[i] != '\r')
+	    out[count++] = out[i];
+    }
+    rv = gensio_close_s(io);
+    if (rv)
+	fail("Could not close", str, rv);
+    count = sizeof(buf);
+    rv = gensio_control(io, 0, true, GENSIO_CONTROL_EXIT_CODE, buf, &count);
+    if (rv)
+	fail("Could not get the exit code for", str, rv);
+    gensio_free(io);
+    return strtol(buf, NULL, 0);
+}
+
+static void
+check_run(const char *str, const char *expect)
+{
+    char out[1000];
+    int status;
+
+    status = run(str, out, sizeof(out));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	fail("Bad exit from", str, 0);
+    if (strcmp(out, expect) != 0) {
+	fprintf(stderr, "Got: %s", out);
+	fail("Wrong output from", str, 0);
+    }
+}
+
+static void
+test_fds(void)
+{
+    int fd;
+
+    printf("Test that only stdin, stdout, and stderr are passed\n");
+    if (access("/proc/self/fd", F_OK) != 0) {
+	printf("  No /proc/self/fd, skipping\n");
+	return;
+    }
+    /* Not close on exec, so only the spawn can keep it from the child. */
+    fd = open("/dev/null", O_RDONLY);
+    if (fd == -1)
+	fail("Could not open", "/dev/null", 0);
+    check_run("stdio,sh -c 'ls -1 /proc/$$/fd'", "0\n1\n2\n");
+    check_run("pty,sh -c 'ls -1 /proc/$$/fd'", "0\n1\n2\n");
+    close(fd);
+    printf("  Success!\n");
+}
+
+static void
+test_stderr(void)
+{
+    printf("Test stderr going to stdout\n");
+    check_run("stdio(stderr-to-stdout),sh -c 'echo out; echo err >&2'",
+	      "out\nerr\n");
+    check_run("stdio,sh -c 'echo out; echo err >&2'", "out\n");
+    printf("  Success!\n");
+}
+
+static void
+test_ctty(void)
+{
+    printf("Test that a pty subprogram has a controlling terminal\n");
+    check_run("pty,sh -c 'exec </dev/tty && test -t 0 && echo ctty'",
+	      "ctty\n");
+    /* A stdio subprogram's stdin is a pipe, not a terminal. */
+    check_run("stdio,sh -c 'test -t 0 || echo notty'", "notty\n");
+    printf("  Success!\n");
+}
+
+static void
+test_bad_prog(void)
+{
+    const char *str = "stdio,/nonexistent/program";
+    struct gensio *io;
+    char buf[20];
+    gensiods len = sizeof(buf);
+    int rv;
+
+    printf("Test a program that can't be run\n");
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (rv)
+	fail("Could not allocate", str, rv);
+    rv = gensio_open_s(io);
+    if (rv == 0) {
+	/*
+	 * Where fork() is used instead of posix_spawn() the open works
+	 * and the child exits with an error.
+	 */
+	rv = gensio_close_s(io);
+	if (rv)
+	    fail("Could not close", str, rv);
+	rv = gensio_control(io, 0, true, GENSIO_CONTROL_EXIT_CODE,
+			    buf, &len);
+	if (rv)
+	    fail("Could not get the exit code for", str, rv);
+	if (strtol(buf, NULL, 0) == 0)
+	    fail("No error from", str, 0);
+    }
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", "", rv);
+
+    test_fds();
+    test_stderr();
+    test_ctty();
+    test_bad_prog();
+
+    o->free_funcs(o);
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Close stdio gensios running subprograms and check that close waits
+ * for the subprogram and gets its exit code, whether it has already
+ * exited or not, when the same gensio is reopened over and over, and
+ * with a lot of them closing at once.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <gensio/gensio.h>
+
+#define NR_REOPENS	20
+#define NR_AT_ONCE	20
+
+static struct gensio_os_funcs *o;
+static struct gensio *ios[NR_AT_ONCE];
+static unsigned int nr_closed;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static int64_t
+now_ms(void)
+{
+    gensio_time t;
+
+    o->get_monotonic_time(o, &t);
+    return t.secs * 1000 + t.nsecs / 1000000;
+}
+
+static struct gensio *
+alloc_stdio(const char *cmd)
+{
+    struct gensio *io;
+    char str[200];
+    int rv;
+
+    snprintf(str, sizeof(str), "stdio,sh -c '%s'", cmd);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (rv)
+	fail("Could not allocate stdio", 0, rv);
+    return io;
+}
+
+/* Return the exit status of the subprogram, it must have exited. */
+static int
+exit_status(struct gensio *io, unsigned int i)
+{
+    char buf[20];
+    gensiods len = sizeof(buf);
+    int rv, status;
+
+    rv = gensio_control(io, 0, true, GENSIO_CONTROL_EXIT_CODE, buf, &len);
+    if (rv)
+	fail("Could not get the exit code for", i, rv);
+    status = strtol(buf, NULL, 0);
+    if (!WIFEXITED(status))
+	fail("Subprogram didn't exit normally:", i, 0);
+    return WEXITSTATUS(status);
+}
+
+static void
+test_exited(void)
+{
+    struct gensio *io;
+    gensio_time timeout;
+    char buf[100];
+    gensiods count, len = 0;
+    int rv;
+
+    printf("Test close after the subprogram has exited\n");
+    io = alloc_stdio("echo hello; exit 3");
+    rv = gensio_set_sync(io);
+    if (rv)
+	fail("Could not set sync", 0, rv);
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open stdio", 0, rv);
+    for (;;) {
+	timeout.secs = 10;
+	timeout.nsecs = 0;
+	rv = gensio_read_s(io, &count, buf + len, sizeof(buf) - len - 1,
+			   &timeout);
+	if (rv == GE_REMCLOSE)
+	    break;
+	if (rv)
+	    fail("Read failed after bytes:", len, rv);
+	len += count;
+    }
+    buf[len] = '\0';
+    if (strcmp(buf, "hello\n") != 0)
+	fail("Wrong output, length", len, 0);
+    rv = gensio_close_s(io);
+    if (rv)
+	fail("Could not close stdio", 0, rv);
+    if (exit_status(io, 0) != 3)
+	fail("Wrong exit code", exit_status(io, 0), 0);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+test_running(void)
+{
+    struct gensio *io;
+    int64_t start, msecs;
+    int rv;
+
+    printf("Test close while the subprogram is running\n");
+    io = alloc_stdio("sleep 0.5; exit 5");
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open stdio", 0, rv);
+    start = now_ms();
+    rv = gensio_close_s(io);
+    if (rv)
+	fail("Could not close stdio", 0, rv);
+    msecs = now_ms() - start;
+    if (msecs < 400 || msecs > 5000)
+	fail("Close didn't wait for the subprogram, msecs:", msecs, 0);
+    if (exit_status(io, 0) != 5)
+	fail("Wrong exit code", exit_status(io, 0), 0);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+test_reopen(void)
+{
+    struct gensio *io;
+    unsigned int i;
+    int rv;
+
+    printf("Test reopening the same stdio %d times\n", NR_REOPENS);
+    io = alloc_stdio("sleep 0.01; exit 7");
+    for (i = 0; i < NR_REOPENS; i++) {
+	rv = gensio_open_s(io);
+	if (rv)
+	    fail("Could not open stdio on pass", i, rv);
+	rv = gensio_close_s(io);
+	if (rv)
+	    fail("Could not close stdio on pass", i, rv);
+	if (exit_status(io, i) != 7)
+	    fail("Wrong exit code on pass", i, 0);
+    }
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+close_done(struct gensio *io, void *close_data)
+{
+    nr_closed++;
+}
+
+static void
+test_at_once(void)
+{
+    gensio_time timeout;
+    char cmd[50];
+    unsigned int i;
+    int rv;
+
+    printf("Test closing %d stdios at once\n", NR_AT_ONCE);
+    for (i = 0; i < NR_AT_ONCE; i++) {
+	snprintf(cmd, sizeof(cmd), "sleep 0.2; exit %u", i + 10);
+	ios[i] = alloc_stdio(cmd);
+	rv = gensio_open_s(ios[i]);
+	if (rv)
+	    fail("Could not open stdio", i, rv);
+    }
+    for (i = 0; i < NR_AT_ONCE; i++) {
+	rv = gensio_close(ios[i], close_done, NULL);
+	if (rv)
+	    fail("Could not close stdio", i, rv);
+    }
+    for (i = 0; i < 1000 && nr_closed < NR_AT_ONCE; i++) {
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	o->service(o, &timeout);
+    }
+    if (nr_closed != NR_AT_ONCE)
+	fail("Closes finished:", nr_closed, 0);
+    for (i = 0; i < NR_AT_ONCE; i++) {
+	if (exit_status(ios[i], i) != i + 10)
+	    fail("Wrong exit code for", i, 0);
+	gensio_free(ios[i]);
+    }
+    printf("  Success!\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    test_exited();
+    test_running();
+    test_reopen();
+    test_at_once();
+
+    o->free_funcs(o);
+    return 0;
+}
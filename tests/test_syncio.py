@@ -55,6 +55,53 @@ def test_sync_gensio(o):
     g.close_s()
     return
 
+class SyncToAsyncEvent:
+    def __init__(self, o):
+        self.waiter = gensio.waiter(o)
+        self.data = ""
+        return
+
+    def read_callback(self, io, err, data, auxdata):
+        if err:
+            raise Exception("sync to async read error: " + err)
+        self.data += data.decode(encoding='utf8')
+        io.read_cb_enable(False)
+        self.waiter.wake()
+        return len(data)
+
+    def write_callback(self, io):
+        io.write_cb_enable(False)
+        return
+
+def test_sync_to_async_gensio(o):
+    print("Testing sync I/O data left for async I/O")
+
+    gensios_enabled.check_iostr_gensios("echo")
+    h = SyncToAsyncEvent(o)
+    g = gensio.gensio(o, "echo", h)
+    g.set_sync()
+    g.open_s()
+
+    (count, time) = g.write_s("HelloThere", 1000)
+    if count != 10:
+        raise Exception("Invalid write return: %d %d\n" % (count, time))
+
+    # Only take part of it, the rest must go to the async callback.
+    (buf, time) = g.read_s(5, 1000)
+    buf = buf.decode(encoding='utf8')
+    if buf != "Hello":
+        raise Exception("Invalid read return: '%s' %d\n" % (buf, time))
+
+    g.clear_sync()
+    g.read_cb_enable(True)
+    if h.waiter.wait_timeout(1, 1000) == 0:
+        raise Exception("Timed out waiting for async data")
+    if h.data != "There":
+        raise Exception("Invalid async data: '%s'\n" % h.data)
+
+    g.close_s()
+    return
+
 class SyncEvent:
     def __init__(self):
         self.opened = False
@@ -102,4 +149,5 @@ def test_sync_gensio_accepter(o):
 o = gensio.alloc_gensio_selector(Logger())
 
 test_sync_gensio(o)
+test_sync_to_async_gensio(o)
 test_sync_gensio_accepter(o)
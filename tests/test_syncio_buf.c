@@ -0,0 +1,360 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Test sync I/O on an echo gensio: reading a byte at a time out of
+ * what the gensio delivered, readers waiting in two threads getting
+ * each byte written from a third exactly once, timed out reads not
+ * breaking later ones, and data left after gensio_clear_sync() going
+ * to the async callback in order, or back to gensio_read_s() if sync
+ * is set again.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+
+#define DATA_SIZE	4000
+
+static struct gensio_os_funcs *o;
+static unsigned char data[DATA_SIZE];
+static unsigned char cbdata[DATA_SIZE];
+static gensiods cblen, cbstop;
+static const char *cb_err;
+
+static void
+handle_sigusr1(int sig)
+{
+}
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+/*
+ * The async callback takes one byte per call, so the rest has to be
+ * delivered again, and disables read when it has cbstop bytes.
+ */
+static int
+io_cb(struct gensio *io, void *user_data, int event, int err,
+      unsigned char *buf, gensiods *buflen,
+      const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	cb_err = gensio_err_to_str(err);
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+    if (*buflen == 0)
+	return 0;
+    if (cblen >= cbstop) {
+	cb_err = "Data delivered with read disabled";
+	*buflen = 0;
+	return 0;
+    }
+    cbdata[cblen++] = buf[0];
+    *buflen = 1;
+    if (cblen == cbstop)
+	gensio_set_read_callback_enable(io, false);
+    return 0;
+}
+
+static struct gensio *
+alloc_echo(void)
+{
+    struct gensio *io;
+    int rv;
+
+    rv = str_to_gensio("echo", o, io_cb, NULL, &io);
+    if (rv)
+	fail("Could not allocate echo", 0, rv);
+    rv = gensio_set_sync(io);
+    if (rv)
+	fail("Could not set sync", 0, rv);
+    rv = gensio_open_s(io);
+    if (rv)
+	fail("Could not open echo", 0, rv);
+    return io;
+}
+
+static void
+write_data(struct gensio *io, const unsigned char *buf, gensiods len)
+{
+    gensio_time timeout = { 10, 0 };
+    gensiods count;
+    int rv;
+
+    rv = gensio_write_s(io, &count, buf, len, &timeout);
+    if (rv || count != len)
+	fail("Write failed, wrote", count, rv);
+}
+
+static void
+read_data(struct gensio *io, unsigned char *buf, gensiods len,
+	  gensiods chunk)
+{
+    gensio_time timeout;
+    gensiods pos, count;
+    int rv;
+
+    for (pos = 0; pos < len; pos += count) {
+	timeout.secs = 10;
+	timeout.nsecs = 0;
+	rv = gensio_read_s(io, &count, buf + pos,
+			   chunk < len - pos ? chunk : len - pos, &timeout);
+	if (rv)
+	    fail("Read failed at", pos, rv);
+	if (count == 0)
+	    fail("Read timed out at", pos, 0);
+    }
+}
+
+static void
+test_bytes(void)
+{
+    struct gensio *io;
+    unsigned char buf[DATA_SIZE];
+    gensiods pos;
+
+    printf("Test sync reads a byte at a time\n");
+    io = alloc_echo();
+    /* Echo holds 1024 bytes, so write less than that at a time. */
+    for (pos = 0; pos < DATA_SIZE; pos += 1000) {
+	write_data(io, data + pos, 1000);
+	read_data(io, buf + pos, 1000, 1);
+    }
+    if (memcmp(buf, data, DATA_SIZE) != 0)
+	fail("Wrong data read", 0, 0);
+    gensio_close_s(io);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static unsigned int seen[256];
+
+static void *
+reader(void *cb_data)
+{
+    struct gensio *io = cb_data;
+    unsigned char buf[128];
+    unsigned int i;
+
+    read_data(io, buf, sizeof(buf), 1);
+    /* Both threads count into seen[]. */
+    for (i = 0; i < sizeof(buf); i++)
+	__atomic_add_fetch(&seen[buf[i]], 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static void
+test_threads(void)
+{
+    struct gensio *io;
+    unsigned char buf[256];
+    pthread_t th1, th2;
+    unsigned int i;
+
+    printf("Test sync reads from two threads\n");
+    io = alloc_echo();
+    for (i = 0; i < sizeof(buf); i++)
+	buf[i] = i;
+    pthread_create(&th1, NULL, reader, io);
+    pthread_create(&th2, NULL, reader, io);
+    /* Let the readers get to waiting before the data is written. */
+    usleep(100000);
+    write_data(io, buf, sizeof(buf));
+    pthread_join(th1, NULL);
+    pthread_join(th2, NULL);
+    for (i = 0; i < 256; i++) {
+	if (seen[i] != 1)
+	    fail("Wrong number of reads of byte", i, 0);
+    }
+    gensio_close_s(io);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+test_timeout(void)
+{
+    struct gensio *io;
+    gensio_time timeout;
+    unsigned char buf[100];
+    gensiods count;
+    unsigned int i;
+    int rv;
+
+    printf("Test sync reads after timeouts\n");
+    io = alloc_echo();
+    for (i = 0; i < 20; i++) {
+	timeout.secs = 0;
+	timeout.nsecs = 1000000;
+	rv = gensio_read_s(io, &count, buf, sizeof(buf), &timeout);
+	if (rv || count != 0)
+	    fail("Read without data didn't time out on pass", i, rv);
+	write_data(io, data + i, 10);
+	read_data(io, buf, 10, sizeof(buf));
+	if (memcmp(buf, data + i, 10) != 0)
+	    fail("Wrong data read on pass", i, 0);
+    }
+    gensio_close_s(io);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+wait_cb(gensiods len)
+{
+    gensio_time timeout;
+    unsigned int i;
+
+    for (i = 0; i < 1000 && cblen < len && !cb_err; i++) {
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	o->service(o, &timeout);
+    }
+    if (cb_err)
+	fail(cb_err, cblen, 0);
+    if (cblen != len)
+	fail("Async bytes read:", cblen, 0);
+}
+
+static void
+test_to_async(void)
+{
+    struct gensio *io;
+    unsigned char buf[100];
+    gensio_time timeout;
+    gensiods count;
+    int rv;
+
+    printf("Test data left by sync reads going to async reads\n");
+    io = alloc_echo();
+    write_data(io, data, 100);
+    read_data(io, buf, 10, 10);
+    if (memcmp(buf, data, 10) != 0)
+	fail("Wrong sync data", 0, 0);
+    rv = gensio_clear_sync(io);
+    if (rv)
+	fail("Could not clear sync", 0, rv);
+
+    /* Take part of it, then stop, then take the rest. */
+    cbstop = 30;
+    gensio_set_read_callback_enable(io, true);
+    wait_cb(30);
+    cbstop = 90;
+    gensio_set_read_callback_enable(io, true);
+    wait_cb(90);
+    if (memcmp(cbdata, data + 10, 90) != 0)
+	fail("Wrong async data", 0, 0);
+
+    /* New data comes after what was buffered. */
+    rv = gensio_write(io, &count, data + 100, 50, NULL);
+    if (rv || count != 50)
+	fail("Async write failed", count, rv);
+    cbstop = 140;
+    gensio_set_read_callback_enable(io, true);
+    wait_cb(140);
+    if (memcmp(cbdata, data + 10, 140) != 0)
+	fail("Wrong async data after the buffered data", 0, 0);
+
+    /* Sync again with nothing buffered, it must still work. */
+    rv = gensio_set_sync(io);
+    if (rv)
+	fail("Could not set sync again", 0, rv);
+    write_data(io, data, 10);
+    read_data(io, buf, 10, 1);
+    if (memcmp(buf, data, 10) != 0)
+	fail("Wrong sync data after async", 0, 0);
+    timeout.secs = 0;
+    timeout.nsecs = 1000000;
+    rv = gensio_read_s(io, &count, buf, sizeof(buf), &timeout);
+    if (rv || count != 0)
+	fail("Extra data after async", count, rv);
+
+    gensio_close_s(io);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+static void
+test_back_to_sync(void)
+{
+    struct gensio *io;
+    unsigned char buf[100];
+    int rv;
+
+    printf("Test data left by sync reads going back to sync reads\n");
+    io = alloc_echo();
+    write_data(io, data, 100);
+    read_data(io, buf, 10, 10);
+    rv = gensio_clear_sync(io);
+    if (rv)
+	fail("Could not clear sync", 0, rv);
+    rv = gensio_set_sync(io);
+    if (rv)
+	fail("Could not set sync again", 0, rv);
+    read_data(io, buf, 90, 7);
+    if (memcmp(buf, data + 10, 90) != 0)
+	fail("Wrong data after setting sync again", 0, 0);
+
+    /* Close with data still buffered. */
+    write_data(io, data, 100);
+    read_data(io, buf, 1, 1);
+    rv = gensio_clear_sync(io);
+    if (rv)
+	fail("Could not clear sync", 0, rv);
+    gensio_close_s(io);
+    gensio_free(io);
+    printf("  Success!\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sigaction sigdo;
+    unsigned int i;
+    int rv;
+
+    /* The os handler wakes threads with this signal. */
+    memset(&sigdo, 0, sizeof(sigdo));
+    sigdo.sa_handler = handle_sigusr1;
+    if (sigaction(SIGUSR1, &sigdo, NULL)) {
+	perror("Could not set up siguser1 handler");
+	exit(1);
+    }
+
+    rv = gensio_default_os_hnd(SIGUSR1, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    for (i = 0; i < DATA_SIZE; i++)
+	data[i] = i * 7 + i / 251;
+
+    test_bytes();
+    test_threads();
+    test_timeout();
+    test_to_async();
+    test_back_to_sync();
+
+    o->free_funcs(o);
+    return 0;
+}
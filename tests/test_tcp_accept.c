@@ -0,0 +1,240 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Start a burst of tcp connections to one accepter all at once, every
+ * one must be accepted exactly once and carry data both ways.
+ *
+ * Extra options for the accepter's tcp can be given on the command
+ * line, like "acceptbatch=1" or "reuseport=4", to run the same test
+ * with them.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gensio/gensio.h>
+
+#define NR_CONNS	200
+
+static struct gensio_os_funcs *o;
+static struct gensio *cios[NR_CONNS], *sios[NR_CONNS];
+static unsigned int conn_idx[NR_CONNS];
+static unsigned int nr_accepted, nr_opened, nr_echoed, nr_srv_closed;
+static const char *err_str;
+static unsigned int err_idx;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static void
+cb_fail(const char *what, unsigned int i)
+{
+    if (!err_str) {
+	err_str = what;
+	err_idx = i;
+    }
+}
+
+/* Get the connection number from "conn N", or NR_CONNS if bad. */
+static unsigned int
+msg_idx(const unsigned char *buf, gensiods len)
+{
+    char msg[20];
+
+    if (len < 6 || len >= sizeof(msg) || strncmp((char *) buf, "conn ", 5))
+	return NR_CONNS;
+    memcpy(msg, buf, len);
+    msg[len] = '\0';
+    return strtoul(msg + 5, NULL, 10);
+}
+
+/*
+ * The accepter side echoes the client's message back.  The message
+ * is short enough to always come in one read on loopback.
+ */
+static int
+server_cb(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    gensiods count;
+    unsigned int i;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    gensio_set_read_callback_enable(io, false);
+    if (err) {
+	cb_fail("Read error on accepted connection", nr_accepted);
+	return 0;
+    }
+
+    i = msg_idx(buf, *buflen);
+    if (i >= NR_CONNS) {
+	cb_fail("Bad message on accepted connection", i);
+	return 0;
+    }
+    if (sios[i])
+	cb_fail("Connection accepted twice", i);
+    sios[i] = io;
+    if (gensio_write(io, &count, buf, *buflen, NULL) || count != *buflen)
+	cb_fail("Echo write failed", i);
+    return 0;
+}
+
+static int
+acc_cb(struct gensio_accepter *accepter, void *user_data, int event,
+       void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+    nr_accepted++;
+    gensio_set_callback(io, server_cb, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static int
+client_cb(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    unsigned int *idx = user_data;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    gensio_set_read_callback_enable(io, false);
+    if (err) {
+	cb_fail("Read error on connection", *idx);
+	return 0;
+    }
+    if (msg_idx(buf, *buflen) != *idx)
+	cb_fail("Wrong echo on connection", *idx);
+    nr_echoed++;
+    return 0;
+}
+
+static void
+open_done(struct gensio *io, int err, void *open_data)
+{
+    unsigned int *idx = open_data;
+    char msg[20];
+    gensiods len, count;
+
+    if (err) {
+	cb_fail("Open failed on connection", *idx);
+	return;
+    }
+    nr_opened++;
+    len = snprintf(msg, sizeof(msg), "conn %u", *idx);
+    if (gensio_write(io, &count, msg, len, NULL) || count != len)
+	cb_fail("Write failed on connection", *idx);
+    gensio_set_read_callback_enable(io, true);
+}
+
+static void
+close_done(struct gensio *io, void *close_data)
+{
+    nr_srv_closed++;
+}
+
+static void
+wait_for(unsigned int *val, unsigned int expect, const char *what)
+{
+    gensio_time timeout;
+    unsigned int i;
+
+    for (i = 0; i < 2000 && *val < expect && !err_str; i++) {
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	o->service(o, &timeout);
+    }
+    if (err_str)
+	fail(err_str, err_idx, 0);
+    if (*val != expect)
+	fail(what, *val, 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_accepter *acc;
+    char str[200], port[20];
+    gensiods len;
+    unsigned int i;
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    snprintf(str, sizeof(str), "tcp%s%s%s,127.0.0.1,0",
+	     argc > 1 ? "(" : "", argc > 1 ? argv[1] : "",
+	     argc > 1 ? ")" : "");
+    printf("Test %d connections at once to %s\n", NR_CONNS, str);
+    rv = str_to_gensio_accepter(str, o, acc_cb, NULL, &acc);
+    if (rv == GE_NOTSUP) {
+	printf("  Options not supported, skipping\n");
+	return 77;
+    }
+    if (rv)
+	fail("Could not allocate accepter", 0, rv);
+    rv = gensio_acc_startup(acc);
+    if (rv)
+	fail("Could not start accepter", 0, rv);
+    len = sizeof(port);
+    strcpy(port, "0");
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv)
+	fail("Could not get accepter port", 0, rv);
+
+    /* Start them all before letting the accepter run. */
+    snprintf(str, sizeof(str), "tcp,127.0.0.1,%s", port);
+    for (i = 0; i < NR_CONNS; i++) {
+	conn_idx[i] = i;
+	rv = str_to_gensio(str, o, client_cb, &conn_idx[i], &cios[i]);
+	if (rv)
+	    fail("Could not allocate connection", i, rv);
+	rv = gensio_open(cios[i], open_done, &conn_idx[i]);
+	if (rv)
+	    fail("Could not open connection", i, rv);
+    }
+
+    wait_for(&nr_opened, NR_CONNS, "Connections opened:");
+    wait_for(&nr_echoed, NR_CONNS, "Connections echoed:");
+    if (nr_accepted != NR_CONNS)
+	fail("Connections accepted:", nr_accepted, 0);
+    printf("  Success!\n");
+
+    for (i = 0; i < NR_CONNS; i++) {
+	gensio_close_s(cios[i]);
+	gensio_free(cios[i]);
+	rv = gensio_close(sios[i], close_done, NULL);
+	if (rv)
+	    close_done(sios[i], NULL);
+    }
+    wait_for(&nr_srv_closed, NR_CONNS, "Accepted connections closed:");
+    for (i = 0; i < NR_CONNS; i++)
+	gensio_free(sios[i]);
+
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    o->free_funcs(o);
+    return 0;
+}
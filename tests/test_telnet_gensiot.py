@@ -0,0 +1,116 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Run data full of 0xff (IAC) bytes through telnet with gensiot.
+# Check the escaping telnet writes, that commands mixed in with the
+# data are removed on the way in, and that data gets through a
+# telnet connection both ways, including when the lower layer hands
+# telnet small pieces and when the reader is slow.
+#
+
+from gensiot_utils import *
+
+IAC = 255
+SE = 240
+SB = 250
+
+def test_data():
+    # All byte values, runs of IACs, and things that look like commands.
+    return (make_data(50000) + bytes([IAC] * 3000) +
+            bytes([IAC, SB, 24, 1, IAC, SE, IAC, IAC, 251, 1]) * 1000 +
+            make_data(10000))
+
+def strip_telnet(wire):
+    """Remove telnet commands from wire and return the data."""
+    out = bytearray()
+    i = 0
+    while i < len(wire):
+        p = wire.find(bytes([IAC]), i)
+        if p < 0:
+            out.extend(wire[i:])
+            break
+        out.extend(wire[i:p])
+        cmd = wire[p + 1]
+        if cmd == IAC:
+            out.append(IAC)
+            i = p + 2
+        elif cmd == SB:
+            i = wire.index(bytes([IAC, SE]), p) + 2
+        elif cmd >= 251:
+            i = p + 3
+        else:
+            i = p + 2
+    return bytes(out)
+
+def escape_test(tmpdir):
+    data = test_data()
+    infile = write_file(tmpdir, "tn.in", data)
+    outfile = os.path.join(tmpdir, "tn.out")
+    p = start(["-i", "file(infile=%s)" % infile,
+               "telnet,file(outfile=%s,create)" % outfile])
+    wait_exit(p, "gensiot")
+    with open(outfile, "rb") as f:
+        wire = f.read()
+    expect = data.replace(bytes([IAC]), bytes([IAC, IAC]))
+    check_data(wire, expect, "Wrote")
+
+def strip_test(tmpdir, fileopts = "", telopts = ""):
+    data = test_data()
+    wire = bytearray()
+    cmds = [bytes([IAC, 241]), bytes([IAC, 251, 1]),
+            bytes([IAC, SB, 24, 1, 2, 3, IAC, SE])]
+    for i in range(0, len(data), 997):
+        wire.extend(data[i:i + 997].replace(bytes([IAC]), bytes([IAC, IAC])))
+        wire.extend(cmds[i % len(cmds)])
+    if strip_telnet(bytes(wire)) != data:
+        raise Exception("Test wire data is wrong")
+    infile = write_file(tmpdir, "tn.wire", bytes(wire))
+    p = start(["-i", "stdio(self)",
+               "telnet%s,file(infile=%s%s)" % (telopts, infile, fileopts)],
+              stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    out = []
+    t = read_all(p, out)
+    t.join(20)
+    p.stdin.close()
+    wait_exit(p, "gensiot")
+    check_data(out[0] if out else b"", data, "Read")
+
+def xfer(tmpdir):
+    data = test_data()
+    port = free_port()
+    got = file_transfer(tmpdir, data,
+                        "telnet,tcp,127.0.0.1,%d" % port,
+                        "telnet,tcp,127.0.0.1,%d" % port)
+    check_data(got, data, "Received")
+
+def echo(tmpdir, opts, chunk = None, delay = 0):
+    data = test_data()
+    port = free_port()
+    got = echo_transfer(data,
+                        "telnet%s,tcp,127.0.0.1,%d" % (opts, port),
+                        "telnet%s,tcp,127.0.0.1,%d" % (opts, port),
+                        chunk = chunk, delay = delay)
+    check_data(got, data, "Echoed")
+
+run_tests([
+    ("telnet escapes IACs it writes", escape_test),
+    ("telnet removes commands from read data", strip_test),
+    ("telnet removes commands split across reads",
+     lambda tmpdir: strip_test(tmpdir, ",readbuf=7")),
+    ("telnet removes commands with a small read buffer",
+     lambda tmpdir: strip_test(tmpdir, ",readbuf=100", "(readbuf=16)")),
+    ("telnet transfer over tcp", xfer),
+    ("telnet echo over tcp", lambda tmpdir: echo(tmpdir, "")),
+    ("telnet echo over tcp with rfc2217",
+     lambda tmpdir: echo(tmpdir, "(rfc2217)")),
+    ("telnet echo to a slow reader",
+     lambda tmpdir: echo(tmpdir, "", chunk = 4096, delay = 0.005)),
+    ("telnet echo to a slow reader with a small read buffer",
+     lambda tmpdir: echo(tmpdir, "(readbuf=64)", chunk = 4096,
+                         delay = 0.005)),
+])
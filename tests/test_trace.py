@@ -0,0 +1,122 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+#
+# Test binary tracing with gensiot.  The records must hold all the
+# data, gtracedump must print the same thing a text trace of the same
+# data does, and records too big for the buffer must be reported as
+# dropped.  Trace files are appended to, so each test uses its own.
+#
+
+import struct
+from gensiot_utils import *
+
+gtracedump = os.path.join(tooldir, "gtracedump")
+
+def read_records(fname):
+    recs = []
+    with open(fname, "rb") as f:
+        buf = f.read()
+    pos = 0
+    while pos < len(buf):
+        if pos + 24 > len(buf):
+            raise Exception("Partial record header at %d" % pos)
+        (rtype, length, secs, nsecs, err) = struct.unpack_from("<B3xIqIi",
+                                                               buf, pos)
+        pos += 24
+        if rtype in (1, 2):
+            data = buf[pos:pos + length]
+            if len(data) != length:
+                raise Exception("Partial record data at %d" % pos)
+            pos += length
+        elif rtype == 3:
+            data = None
+        else:
+            raise Exception("Bad record type %d at %d" % (rtype, pos - 24))
+        recs.append((rtype, secs, nsecs, err, data))
+    return recs
+
+def check_times(recs):
+    last = (0, 0)
+    for r in recs:
+        if r[2] >= 1000000000:
+            raise Exception("Bad nanoseconds in record")
+        if (r[1], r[2]) < last:
+            raise Exception("Record timestamps go backwards")
+        last = (r[1], r[2])
+
+def xfer(tmpdir):
+    data = make_data(200000)
+    tfile = os.path.join(tmpdir, "trace.bin")
+    port = free_port()
+    got = file_transfer(tmpdir, data,
+                        "trace(binary,dir=read,file=%s),tcp,127.0.0.1,%d" %
+                        (tfile, port),
+                        "tcp,127.0.0.1,%d" % port)
+    check_data(got, data, "Received")
+    recs = read_records(tfile)
+    check_times(recs)
+    for r in recs:
+        if r[0] != 1:
+            raise Exception("Record of type %d in a read trace" % r[0])
+    traced = b"".join([r[4] for r in recs if r[3] == 0])
+    check_data(traced, data, "Traced")
+
+def strip_time(text):
+    # Lines starting a record begin with "secs:usecs ".
+    lines = []
+    for l in text.splitlines():
+        if not l.startswith(" "):
+            l = l.split(" ", 1)[1]
+        lines.append(l)
+    return lines
+
+def dump(tmpdir):
+    data = make_data(30000)
+    infile = write_file(tmpdir, "tr.in", data)
+    bfile = os.path.join(tmpdir, "dump.bin")
+    tfile = os.path.join(tmpdir, "dump.txt")
+    outfile = os.path.join(tmpdir, "tr.out")
+    p = start(["-i", "file(infile=%s)" % infile,
+               "trace(binary,dir=write,file=%s),trace(dir=write,file=%s),"
+               "file(outfile=%s,create)" % (bfile, tfile, outfile)])
+    wait_exit(p, "gensiot")
+    d = subprocess.run([gtracedump, bfile], stdout=subprocess.PIPE,
+                       timeout=20)
+    if d.returncode != 0:
+        raise Exception("gtracedump exited with %d" % d.returncode)
+    with open(tfile, "r") as f:
+        text = f.read()
+    got = strip_time(d.stdout.decode())
+    expect = strip_time(text)
+    if got != expect:
+        raise Exception("gtracedump output doesn't match the text trace")
+
+def dropped(tmpdir):
+    data = make_data(100000)
+    infile = write_file(tmpdir, "tr.in", data)
+    bfile = os.path.join(tmpdir, "dropped.bin")
+    outfile = os.path.join(tmpdir, "dropped.out")
+    p = start(["-i", "file(infile=%s,readbuf=8192)" % infile,
+               "trace(binary,bufsize=4096,dir=write,file=%s),"
+               "file(outfile=%s,create)" % (bfile, outfile)])
+    wait_exit(p, "gensiot")
+    with open(outfile, "rb") as f:
+        check_data(f.read(), data, "Wrote")
+    recs = read_records(bfile)
+    ndropped = sum([r[3] for r in recs if r[0] == 3])
+    if ndropped == 0:
+        raise Exception("No records were reported as dropped")
+    for r in recs:
+        if r[0] == 2 and len(r[4]) + 24 > 4096:
+            raise Exception("Record bigger than the buffer was written")
+
+run_tests([
+    ("binary trace of a transfer", xfer),
+    ("gtracedump matches the text trace", dump),
+    ("binary trace drops records bigger than the buffer", dropped),
+])
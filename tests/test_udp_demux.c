@@ -0,0 +1,238 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Open a lot of udp connections to one udp accepter and make sure
+ * each packet goes to the right connection, both as the connections
+ * are created and after, in an order different from the one they
+ * were created in.  Then close half of them and make sure the rest
+ * still work.  The clients use sync I/O, the accepter side runs from
+ * callbacks while the clients wait.
+ *
+ * Extra options for the accepter's udp can be given on the command
+ * line, like "shards=4", to run the same test with them.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gensio/gensio.h>
+
+#define NR_CONNS	200
+
+static struct gensio_os_funcs *o;
+static struct gensio *cios[NR_CONNS], *sios[NR_CONNS];
+static unsigned int conn_idx[NR_CONNS];
+static const char *server_err;
+static unsigned int server_err_idx;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static void
+server_fail(const char *what, unsigned int i)
+{
+    if (!server_err) {
+	server_err = what;
+	server_err_idx = i;
+    }
+}
+
+/*
+ * The accepter side echoes every packet back on the connection it
+ * came in on.  The packets say which client sent them, check that a
+ * "hello" is the first packet on a new connection and everything
+ * else arrives on the connection the client's hello did.
+ */
+static int
+server_cb(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    unsigned int *idx = user_data;
+    char msg[50], *end;
+    gensiods len = *buflen, count;
+    unsigned long i;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	server_fail("Read error on accepted connection", idx ? *idx : 0);
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+
+    if (len >= sizeof(msg))
+	len = sizeof(msg) - 1;
+    memcpy(msg, buf, len);
+    msg[len] = '\0';
+    end = strchr(msg, ' ');
+    if (!end) {
+	server_fail("Bad message on accepted connection", 0);
+	return 0;
+    }
+    i = strtoul(end + 1, NULL, 10);
+    if (i >= NR_CONNS) {
+	server_fail("Bad connection number", i);
+	return 0;
+    }
+    if (strncmp(msg, "hello ", 6) == 0) {
+	if (idx || sios[i])
+	    server_fail("Hello not on a new connection", i);
+	conn_idx[i] = i;
+	sios[i] = io;
+	gensio_set_user_data(io, &conn_idx[i]);
+    } else if (!idx || *idx != i) {
+	server_fail("Data went to the wrong connection", i);
+    }
+
+    gensio_write(io, &count, buf, *buflen, NULL);
+    return 0;
+}
+
+static int
+acc_cb(struct gensio_accepter *accepter, void *user_data, int event,
+       void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+    gensio_set_callback(io, server_cb, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static void
+check_server(void)
+{
+    if (server_err)
+	fail(server_err, server_err_idx, 0);
+}
+
+/* Send a message from a client and wait for the echo. */
+static void
+send_msg(const char *prefix, unsigned int i)
+{
+    gensio_time timeout = { 5, 0 };
+    char buf[50];
+    gensiods len, count;
+    int rv;
+
+    len = snprintf(buf, sizeof(buf), "%s %u", prefix, i);
+    rv = gensio_write_s(cios[i], &count, buf, len, &timeout);
+    if (rv)
+	fail("Write failed on connection", i, rv);
+    if (count != len)
+	fail("Short write on connection", i, 0);
+}
+
+static void
+recv_msg(const char *prefix, unsigned int i)
+{
+    gensio_time timeout = { 5, 0 };
+    char buf[50], expect[50];
+    gensiods count;
+    int rv;
+
+    rv = gensio_read_s(cios[i], &count, buf, sizeof(buf) - 1, &timeout);
+    if (rv)
+	fail("Read failed on connection", i, rv);
+    check_server();
+    buf[count] = '\0';
+    snprintf(expect, sizeof(expect), "%s %u", prefix, i);
+    if (strcmp(buf, expect) != 0)
+	fail("Wrong echo on connection", i, 0);
+}
+
+static void
+close_conn(unsigned int i)
+{
+    gensio_close_s(cios[i]);
+    gensio_free(cios[i]);
+    if (sios[i]) {
+	gensio_close_s(sios[i]);
+	gensio_free(sios[i]);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_accepter *acc;
+    char str[200], port[20];
+    gensiods len;
+    unsigned int i;
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    snprintf(str, sizeof(str), "udp%s%s%s,127.0.0.1,0",
+	     argc > 1 ? "(" : "", argc > 1 ? argv[1] : "",
+	     argc > 1 ? ")" : "");
+    printf("Test %d connections to %s\n", NR_CONNS, str);
+    rv = str_to_gensio_accepter(str, o, acc_cb, NULL, &acc);
+    if (rv)
+	fail("Could not allocate accepter", 0, rv);
+    rv = gensio_acc_startup(acc);
+    if (rv)
+	fail("Could not start accepter", 0, rv);
+    len = sizeof(port);
+    strcpy(port, "0");
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv)
+	fail("Could not get accepter port", 0, rv);
+
+    /* Each new connection must show up with its first packet. */
+    snprintf(str, sizeof(str), "udp,127.0.0.1,%s", port);
+    for (i = 0; i < NR_CONNS; i++) {
+	rv = str_to_gensio(str, o, NULL, NULL, &cios[i]);
+	if (rv)
+	    fail("Could not allocate connection", i, rv);
+	rv = gensio_set_sync(cios[i]);
+	if (rv)
+	    fail("Could not set sync on connection", i, rv);
+	rv = gensio_open_s(cios[i]);
+	if (rv)
+	    fail("Could not open connection", i, rv);
+	send_msg("hello", i);
+	recv_msg("hello", i);
+    }
+
+    /* Now send on all of them in reverse order, then read them all. */
+    for (i = NR_CONNS; i > 0; i--)
+	send_msg("data", i - 1);
+    for (i = 0; i < NR_CONNS; i++)
+	recv_msg("data", i);
+
+    /* Close the even ones, the odd ones must still work. */
+    for (i = 0; i < NR_CONNS; i += 2)
+	close_conn(i);
+    for (i = 1; i < NR_CONNS; i += 2)
+	send_msg("more", i);
+    for (i = 1; i < NR_CONNS; i += 2)
+	recv_msg("more", i);
+    for (i = 1; i < NR_CONNS; i += 2)
+	close_conn(i);
+    printf("  Success!\n");
+
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    o->free_funcs(o);
+    return 0;
+}
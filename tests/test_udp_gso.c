@@ -0,0 +1,228 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Send runs of same sized packets with GSO to a udp accepter using
+ * GRO, and have the accepter echo them back the same way.  Every
+ * packet must come out the other end as its own read, whole and in
+ * order, whether the kernel coalesced them or not.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gensio/gensio.h>
+
+#define NR_PKTS		100
+#define PKT_SIZE	1000
+
+static struct gensio_os_funcs *o;
+static unsigned int srv_pkts, cli_pkts;
+static const char *err_str;
+static unsigned int err_pkt;
+
+static void
+fail(const char *what, unsigned int i, int err)
+{
+    if (err)
+	fprintf(stderr, "%s %u: %s\n", what, i, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s %u\n", what, i);
+    exit(1);
+}
+
+static void
+cb_fail(const char *what, unsigned int i)
+{
+    if (!err_str) {
+	err_str = what;
+	err_pkt = i;
+    }
+}
+
+/*
+ * Packets are PKT_SIZE long in runs of 16, with every 16th one
+ * shorter, so a GSO run ends with a short packet and the next run
+ * starts over at the full size.
+ */
+static unsigned int
+pkt_len(unsigned int i)
+{
+    return (i % 16) == 15 ? PKT_SIZE / 3 : PKT_SIZE;
+}
+
+static void
+fill_pkt(unsigned char *buf, unsigned int i)
+{
+    unsigned int j;
+
+    for (j = 0; j < pkt_len(i); j++)
+	buf[j] = i * 13 + j;
+}
+
+static void
+check_pkt(const unsigned char *buf, gensiods len, unsigned int i)
+{
+    unsigned char cmp[PKT_SIZE];
+
+    if (i >= NR_PKTS) {
+	cb_fail("Too many packets", i);
+	return;
+    }
+    if (len != pkt_len(i)) {
+	cb_fail("Wrong packet length on packet", i);
+	return;
+    }
+    fill_pkt(cmp, i);
+    if (memcmp(buf, cmp, len) != 0)
+	cb_fail("Data mismatch on packet", i);
+}
+
+static int
+server_cb(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    gensiods count;
+    int rv;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	cb_fail("Server read error after packet", srv_pkts);
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+
+    check_pkt(buf, *buflen, srv_pkts);
+    rv = gensio_write(io, &count, buf, *buflen, NULL);
+    if (rv || count != *buflen)
+	cb_fail("Echo write failed on packet", srv_pkts);
+    srv_pkts++;
+    return 0;
+}
+
+static int
+client_cb(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	cb_fail("Client read error after packet", cli_pkts);
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+
+    check_pkt(buf, *buflen, cli_pkts);
+    cli_pkts++;
+    return 0;
+}
+
+static int
+acc_cb(struct gensio_accepter *accepter, void *user_data, int event,
+       void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+    *((struct gensio **) user_data) = io;
+    gensio_set_callback(io, server_cb, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_accepter *acc;
+    struct gensio *cio, *sio = NULL;
+    unsigned char buf[PKT_SIZE];
+    gensio_time timeout;
+    char str[200], port[20];
+    gensiods len, count;
+    unsigned int i;
+    int rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", 0, rv);
+
+    rv = str_to_gensio_accepter("udp(gso,gro,writebatch=16,readbatch=4),"
+				"127.0.0.1,0", o, acc_cb, &sio, &acc);
+    if (rv)
+	fail("Could not allocate accepter", 0, rv);
+    rv = gensio_acc_startup(acc);
+    if (rv)
+	fail("Could not start accepter", 0, rv);
+    len = sizeof(port);
+    strcpy(port, "0");
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv)
+	fail("Could not get accepter port", 0, rv);
+
+    snprintf(str, sizeof(str), "udp(gso,gro,writebatch=16,readbatch=4),"
+	     "127.0.0.1,%s", port);
+    rv = str_to_gensio(str, o, client_cb, NULL, &cio);
+    if (rv)
+	fail("Could not allocate connection", 0, rv);
+    rv = gensio_open_s(cio);
+    if (rv)
+	fail("Could not open connection", 0, rv);
+    gensio_set_read_callback_enable(cio, true);
+
+    printf("Test %d packets through udp with GSO and GRO\n", NR_PKTS);
+    for (i = 0; i < NR_PKTS; ) {
+	fill_pkt(buf, i);
+	rv = gensio_write(cio, &count, buf, pkt_len(i), NULL);
+	if (rv)
+	    fail("Write failed on packet", i, rv);
+	if (count == 0) {
+	    /* The batch is full and waiting on the socket. */
+	    timeout.secs = 0;
+	    timeout.nsecs = 10000000;
+	    o->service(o, &timeout);
+	    continue;
+	}
+	if (i % 16 == 15) {
+	    /* Let the receiver keep up so the socket buffers don't fill. */
+	    timeout.secs = 0;
+	    timeout.nsecs = 1000000;
+	    o->service(o, &timeout);
+	}
+	i++;
+    }
+
+    for (i = 0; i < 1000 && cli_pkts < NR_PKTS && !err_str; i++) {
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	o->service(o, &timeout);
+    }
+    if (err_str)
+	fail(err_str, err_pkt, 0);
+    if (srv_pkts != NR_PKTS)
+	fail("Server only got packets:", srv_pkts, 0);
+    if (cli_pkts != NR_PKTS)
+	fail("Client only got packets:", cli_pkts, 0);
+    printf("  Success!\n");
+
+    gensio_close_s(cio);
+    gensio_free(cio);
+    if (sio) {
+	gensio_close_s(sio);
+	gensio_free(sio);
+    }
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    o->free_funcs(o);
+    return 0;
+}
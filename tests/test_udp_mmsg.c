@@ -0,0 +1,204 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Test sending and receiving UDP packets in batches with
+ * gensio_os_sendmto() and gensio_os_recvmfrom().  A zero length
+ * datagram must come through as a message, an empty socket must
+ * return no messages, and batches bigger than the OS handles at once
+ * must still all get through, in order.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_osops.h>
+
+#define NR_PKTS		100
+#define PKT_SIZE	200
+
+static struct gensio_os_funcs *o;
+
+static void
+fail(const char *what, int err)
+{
+    if (err)
+	fprintf(stderr, "%s: %s\n", what, gensio_err_to_str(err));
+    else
+	fprintf(stderr, "%s\n", what);
+    exit(1);
+}
+
+/* Packet i is i % PKT_SIZE bytes long, so packet 0 is empty. */
+static unsigned int
+pkt_len(unsigned int i)
+{
+    return i % PKT_SIZE;
+}
+
+static void
+fill_pkt(unsigned char *buf, unsigned int i)
+{
+    unsigned int j;
+
+    for (j = 0; j < pkt_len(i); j++)
+	buf[j] = i + j;
+}
+
+static int
+open_udp(struct gensio_addr **raddr)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    char str[50];
+    int fd, rv;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+	fail("Could not open socket", 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) == -1)
+	fail("Could not bind socket", 0);
+    getsockname(fd, (struct sockaddr *) &sin, &len);
+    rv = gensio_os_set_non_blocking(o, fd);
+    if (rv)
+	fail("Could not set non-blocking", rv);
+
+    snprintf(str, sizeof(str), "ipv4,127.0.0.1,%d", ntohs(sin.sin_port));
+    rv = gensio_os_scan_netaddr(o, str, false, GENSIO_NET_PROTOCOL_UDP,
+				raddr);
+    if (rv)
+	fail("Could not scan address", rv);
+    return fd;
+}
+
+static void
+test_empty(int fd)
+{
+    struct gensio_os_mmsg msgs[4];
+    unsigned char buf[4][PKT_SIZE];
+    unsigned int i, nr_done = 1000;
+    int rv;
+
+    printf("Test receive from an empty socket\n");
+    for (i = 0; i < 4; i++) {
+	msgs[i].buf = buf[i];
+	msgs[i].len = sizeof(buf[i]);
+	msgs[i].addr = NULL;
+    }
+    rv = gensio_os_recvmfrom(o, fd, msgs, 4, &nr_done, 0);
+    if (rv)
+	fail("Receive from empty socket failed", rv);
+    if (nr_done != 0)
+	fail("Got messages from an empty socket", 0);
+    printf("  Success!\n");
+}
+
+static void
+test_batch(int sfd, int rfd, struct gensio_addr *raddr, unsigned int batch)
+{
+    static unsigned char sbuf[NR_PKTS][PKT_SIZE], rbuf[NR_PKTS][PKT_SIZE];
+    struct gensio_os_mmsg msgs[NR_PKTS];
+    unsigned int i, sent, recvd, nr_done;
+    unsigned char cmp[PKT_SIZE];
+    struct pollfd pfd;
+    int rv;
+
+    printf("Test sending and receiving %d packets %d at a time\n",
+	   NR_PKTS, batch);
+
+    /* Send in batches, all must go out to a local socket. */
+    for (i = 0; i < NR_PKTS; i++) {
+	fill_pkt(sbuf[i], i);
+	msgs[i].buf = sbuf[i];
+	msgs[i].len = pkt_len(i);
+	msgs[i].addr = raddr;
+    }
+    for (sent = 0; sent < NR_PKTS; sent += nr_done) {
+	i = NR_PKTS - sent;
+	if (i > batch)
+	    i = batch;
+	rv = gensio_os_sendmto(o, sfd, msgs + sent, i, &nr_done, 0);
+	if (rv)
+	    fail("Send failed", rv);
+	if (nr_done == 0)
+	    fail("Nothing sent", 0);
+    }
+
+    for (i = 0; i < NR_PKTS; i++) {
+	msgs[i].buf = rbuf[i];
+	msgs[i].len = PKT_SIZE;
+	msgs[i].addr = NULL;
+    }
+    pfd.fd = rfd;
+    pfd.events = POLLIN;
+    for (recvd = 0; recvd < NR_PKTS; recvd += nr_done) {
+	if (poll(&pfd, 1, 5000) != 1)
+	    fail("Timed out waiting for packets", 0);
+	i = NR_PKTS - recvd;
+	if (i > batch)
+	    i = batch;
+	rv = gensio_os_recvmfrom(o, rfd, msgs + recvd, i, &nr_done, 0);
+	if (rv)
+	    fail("Receive failed", rv);
+    }
+
+    for (i = 0; i < NR_PKTS; i++) {
+	if (!msgs[i].addr)
+	    fail("No address on received packet", 0);
+	if (gensio_addr_get_nettype(msgs[i].addr) != AF_INET)
+	    fail("Wrong address type on received packet", 0);
+	gensio_addr_free(msgs[i].addr);
+	if (msgs[i].len != pkt_len(i)) {
+	    fprintf(stderr, "Packet %u was %lu bytes, expected %u\n",
+		    i, (unsigned long) msgs[i].len, pkt_len(i));
+	    exit(1);
+	}
+	fill_pkt(cmp, i);
+	if (memcmp(rbuf[i], cmp, pkt_len(i)) != 0) {
+	    fprintf(stderr, "Packet %u data mismatch\n", i);
+	    exit(1);
+	}
+    }
+    printf("  Success!\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_addr *saddr, *raddr;
+    int sfd, rfd, rv;
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv)
+	fail("Could not allocate OS handler", rv);
+
+    sfd = open_udp(&saddr);
+    rfd = open_udp(&raddr);
+
+    test_empty(rfd);
+    test_batch(sfd, rfd, raddr, 1);
+    test_batch(sfd, rfd, raddr, 16);
+    test_batch(sfd, rfd, raddr, NR_PKTS);
+    test_empty(rfd);
+
+    gensio_addr_free(saddr);
+    gensio_addr_free(raddr);
+    gensio_os_close(o, sfd);
+    gensio_os_close(o, rfd);
+    o->free_funcs(o);
+    return 0;
+}
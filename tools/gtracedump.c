@@ -0,0 +1,124 @@
+/*
+ *  gtracedump - Convert binary gensio trace files to text
+ *  Copyright (C) 2026  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Reads the records written by the trace gensio with binary set, or
+ * its capture segments, and prints them in the same format the trace
+ * gensio uses for text output.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <gensio/gensio.h>
+
+#include "gensio_filter_trace.h"
+
+static int
+dump_file(FILE *in, const char *name, FILE *out)
+{
+    unsigned char hdr[TRACE_REC_HDR_SIZE], buf[4096];
+    struct gensio_trace_dump_history h;
+    const char *op;
+    size_t len, count;
+    int64_t secs;
+    int32_t nsecs, val;
+    bool capture = false;
+
+    count = fread(hdr, 1, TRACE_CAP_HDR_SIZE, in);
+    if (count == TRACE_CAP_HDR_SIZE &&
+		memcmp(hdr, TRACE_CAP_MAGIC, TRACE_CAP_MAGIC_SIZE) == 0) {
+	/* A capture segment, skip the header. */
+	capture = true;
+	count = 0;
+    }
+    count += fread(hdr + count, 1, sizeof(hdr) - count, in);
+
+    for (; count == sizeof(hdr);
+	 count = fread(hdr, 1, sizeof(hdr), in)) {
+	if (hdr[0] == 0 && capture)
+	    return 0; /* End of the data in a capture segment. */
+	len = gensio_trace_get_le(hdr + 4, 4);
+	secs = gensio_trace_get_le(hdr + 8, 8);
+	nsecs = gensio_trace_get_le(hdr + 16, 4);
+	val = gensio_trace_get_le(hdr + 20, 4);
+
+	switch (hdr[0]) {
+	case TRACE_REC_READ: op = "Read"; break;
+	case TRACE_REC_WRITE: op = "Write"; break;
+	case TRACE_REC_DROPPED:
+	    fprintf(out, "%ld:%6.6d %d records dropped\n",
+		    (long) secs, (nsecs + 500) / 1000, val);
+	    continue;
+	default:
+	    fprintf(stderr, "%s: Invalid record type %d\n", name, hdr[0]);
+	    return 1;
+	}
+
+	gensio_trace_print_rec(out, secs, nsecs, op, val, len);
+	if (val)
+	    continue;
+
+	memset(&h, 0, sizeof(h));
+	while (len > 0) {
+	    count = len > sizeof(buf) ? sizeof(buf) : len;
+	    if (fread(buf, 1, count, in) != count) {
+		fprintf(stderr, "%s: Truncated record\n", name);
+		return 1;
+	    }
+	    gensio_trace_dump_buf(out, buf, count, &h);
+	    len -= count;
+	}
+	gensio_trace_dump_buf_finish(out, &h);
+    }
+    if (count != 0) {
+	fprintf(stderr, "%s: Truncated record header\n", name);
+	return 1;
+    }
+
+    return 0;
+}
+
+static void
+help(const char *progname)
+{
+    printf("Convert binary trace output from the trace gensio to text.\n");
+    printf("%s [file [file ...]]\n", progname);
+    printf("If no file is given, read from standard input.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE *in;
+    int i, rv = 0;
+
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 ||
+		     strcmp(argv[1], "--help") == 0)) {
+	help(argv[0]);
+	return 0;
+    }
+
+    if (argc < 2)
+	return dump_file(stdin, "<stdin>", stdout);
+
+    for (i = 1; i < argc; i++) {
+	in = fopen(argv[i], "rb");
+	if (!in) {
+	    fprintf(stderr, "Unable to open %s\n", argv[i]);
+	    rv = 1;
+	    continue;
+	}
+	if (dump_file(in, argv[i], stdout))
+	    rv = 1;
+	fclose(in);
+    }
+
+    return rv;
+}
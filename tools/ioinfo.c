@@ -5,7 +5,8 @@
  *  SPDX-License-Identifier: GPL-2.0-only
  */
 
-
+#include "config.h"
+#define _GNU_SOURCE /* Get splice(). */
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
@@ -13,6 +14,45 @@
 
 #include "ioinfo.h"
 
+/*
+ * If the read side of one gensio and the write side of the other are
+ * plain file descriptors and nothing has to look at the data, that
+ * direction is relayed in the kernel.  A worker thread moves the data
+ * with splice() through a pipe, or with sendfile() from a regular
+ * file, and falls back to the normal read callbacks if the file
+ * descriptor can't be spliced.  Each direction is checked on its own,
+ * one that can't be relayed uses the callbacks.
+ */
+#if defined(HAVE_SPLICE) && defined(USE_PTHREADS)
+#define IOINFO_RELAY 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+#include <gensio/gensio_osops.h>
+
+#define IOINFO_RELAY_CHUNK 65536
+
+/* Relays the data read from ioinfo to the other ioinfo. */
+struct ioinfo_relay {
+    struct ioinfo *ioinfo;
+    int infd;
+    int outfd;
+    int pipe[2];
+    unsigned char *copybuf; /* Used if outfd can't be spliced to. */
+    struct gensio_os_worker *worker;
+
+    /* Set by the thread before it exits. */
+    bool stopped;
+    bool unsupported;
+    int oserr; /* Zero means end of file. */
+};
+#else
+#define IOINFO_RELAY 0
+#endif
+
 struct ioinfo {
     struct gensio *io;
     struct ioinfo *otherio;
@@ -32,6 +72,10 @@ struct ioinfo {
 
     struct ioinfo_oob *oob_head;
     struct ioinfo_oob *oob_tail;
+
+#if IOINFO_RELAY
+    struct ioinfo_relay *relay;
+#endif
 };
 
 void
@@ -84,6 +128,30 @@ ioinfo_otherioinfo(struct ioinfo *ioinfo)
     return ioinfo->otherio;
 }
 
+#if IOINFO_RELAY
+/*
+ * The thread only blocks waiting on the fds, so this doesn't take
+ * long.
+ */
+static void
+ioinfo_relay_stop(struct ioinfo_relay *relay)
+{
+    if (relay)
+	gensio_os_worker_stop_wait(relay->worker);
+}
+#endif
+
+/* The relays must be stopped before the user closes the gensios. */
+static void
+ioinfo_shutdown(struct ioinfo *ioinfo, bool user_req)
+{
+#if IOINFO_RELAY
+    ioinfo_relay_stop(ioinfo->relay);
+    ioinfo_relay_stop(ioinfo->otherio->relay);
+#endif
+    ioinfo->uh->shutdown(ioinfo, user_req);
+}
+
 void
 ioinfo_sendoob(struct ioinfo *ioinfo, struct ioinfo_oob *oobinfo)
 {
@@ -129,7 +197,7 @@ handle_escapechar(struct ioinfo *ioinfo, char c)
     c = tolower(c);
 
     if (c == 'q') {
-	ioinfo->uh->shutdown(ioinfo, true);
+	ioinfo_shutdown(ioinfo, true);
 	return false;
     }
 
@@ -167,9 +235,9 @@ io_event(struct gensio *io, void *user_data, int event, int err,
     if (err) {
 	if (err != GE_REMCLOSE) {
 	    ioinfo_err(ioinfo, "read error: %s", gensio_err_to_str(err));
-	    ioinfo->uh->shutdown(ioinfo, false);
+	    ioinfo_shutdown(ioinfo, false);
 	} else {
-	    ioinfo->uh->shutdown(ioinfo, true);
+	    ioinfo_shutdown(ioinfo, true);
 	}
 	return 0;
     }
@@ -213,7 +281,7 @@ io_event(struct gensio *io, void *user_data, int event, int err,
 		if (rv != GE_REMCLOSE)
 		    ioinfo_err(rioinfo, "write error: %s",
 			       gensio_err_to_str(rv));
-		ioinfo->uh->shutdown(ioinfo, rv == GE_REMCLOSE);
+		ioinfo_shutdown(ioinfo, rv == GE_REMCLOSE);
 		return 0;
 	    }
 	} else {
@@ -248,7 +316,7 @@ io_event(struct gensio *io, void *user_data, int event, int err,
 	    rv = gensio_write(ioinfo->io, &count, oob->buf, oob->len, oobaux);
 	    if (rv) {
 		ioinfo_err(rioinfo, "write error: %s", gensio_err_to_str(rv));
-		ioinfo->uh->shutdown(ioinfo, false);
+		ioinfo_shutdown(ioinfo, false);
 		return 0;
 	    }
 	    if (count >= oob->len) {
@@ -286,6 +354,226 @@ io_event(struct gensio *io, void *user_data, int event, int err,
     return rv;
 }
 
+#if IOINFO_RELAY
+/* Write the n bytes in the pipe to outfd, returns a gensio error. */
+static int
+relay_write(struct gensio_os_worker *w, struct ioinfo_relay *relay,
+	    ssize_t n)
+{
+    struct gensio_os_funcs *o = relay->ioinfo->o;
+    ssize_t m, pos;
+    int err;
+
+    while (!relay->copybuf && n > 0) {
+	err = gensio_os_worker_wait_fd(w, relay->outfd, true);
+	if (err)
+	    return err;
+	m = splice(relay->pipe[0], NULL, relay->outfd, NULL, n,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (m == -1) {
+	    if (errno == EAGAIN || errno == EINTR)
+		continue;
+	    if (errno != EINVAL)
+		return gensio_os_err_to_err(o, errno);
+	    /* Can't splice to this fd, copy through user space. */
+	    relay->copybuf = malloc(IOINFO_RELAY_CHUNK);
+	    if (!relay->copybuf)
+		return GE_NOMEM;
+	    break;
+	}
+	n -= m;
+    }
+
+    if (n == 0)
+	return 0;
+    if (read(relay->pipe[0], relay->copybuf, n) != n)
+	return GE_IOERR;
+    for (pos = 0; pos < n; ) {
+	err = gensio_os_worker_wait_fd(w, relay->outfd, true);
+	if (err)
+	    return err;
+	m = write(relay->outfd, relay->copybuf + pos, n - pos);
+	if (m == -1) {
+	    if (errno == EAGAIN || errno == EINTR)
+		continue;
+	    return gensio_os_err_to_err(o, errno);
+	}
+	pos += m;
+    }
+    return 0;
+}
+
+static void
+relay_thread(struct gensio_os_worker *w, void *cb_data)
+{
+    struct ioinfo_relay *relay = cb_data;
+    struct gensio_os_funcs *o = relay->ioinfo->o;
+    bool moved = false;
+    ssize_t n;
+    int err;
+#ifdef HAVE_SENDFILE
+    struct stat st;
+    bool use_sendfile;
+
+    use_sendfile = fstat(relay->infd, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+
+    relay->unsupported = false;
+    relay->oserr = 0;
+    while (!(err = gensio_os_worker_wait_fd(w, relay->infd, false))) {
+#ifdef HAVE_SENDFILE
+	if (use_sendfile) {
+	    err = gensio_os_worker_wait_fd(w, relay->outfd, true);
+	    if (err)
+		break;
+	    n = sendfile(relay->outfd, relay->infd, NULL, IOINFO_RELAY_CHUNK);
+	    if (n > 0) {
+		moved = true;
+		continue;
+	    }
+	    if (n == 0)
+		break; /* End of file. */
+	    if (errno == EAGAIN || errno == EINTR)
+		continue;
+	    if (errno == EINVAL && !moved) {
+		use_sendfile = false;
+		continue;
+	    }
+	    err = gensio_os_err_to_err(o, errno);
+	    break;
+	}
+#endif
+	n = splice(relay->infd, NULL, relay->pipe[1], NULL,
+		   IOINFO_RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n == 0)
+	    break; /* End of file. */
+	if (n == -1) {
+	    if (errno == EAGAIN || errno == EINTR)
+		continue;
+	    if (errno == EINVAL && !moved)
+		/* Nothing has been read, the callbacks can take over. */
+		relay->unsupported = true;
+	    else
+		err = gensio_os_err_to_err(o, errno);
+	    break;
+	}
+	moved = true;
+	err = relay_write(w, relay, n);
+	if (err)
+	    break;
+    }
+
+    relay->stopped = err == GE_LOCALCLOSED;
+    if (!relay->stopped)
+	relay->oserr = err;
+}
+
+/* The thread exited on its own, handle the reason from the selector. */
+static void
+relay_done(struct gensio_os_worker *w, void *cb_data)
+{
+    struct ioinfo_relay *relay = cb_data;
+    struct ioinfo *ioinfo = relay->ioinfo;
+
+    if (relay->stopped)
+	return;
+    if (relay->unsupported) {
+	/* Nothing was moved, read this direction with callbacks. */
+	gensio_set_read_callback_enable(ioinfo->io, true);
+    } else if (relay->oserr) {
+	ioinfo_err(ioinfo, "relay error: %s",
+		   gensio_err_to_str(relay->oserr));
+	ioinfo_shutdown(ioinfo, false);
+    } else {
+	ioinfo_shutdown(ioinfo, true);
+    }
+}
+
+/* Get the raw file descriptor for one side of the gensio, or -1. */
+static int
+relay_get_fd(struct gensio *io, const char *side)
+{
+    char buf[20];
+    gensiods len = sizeof(buf);
+
+    strcpy(buf, side);
+    if (gensio_control(io, 0, true, GENSIO_CONTROL_RAW_FD, buf, &len))
+	return -1;
+    return strtol(buf, NULL, 0);
+}
+
+/* Can the data read from this ioinfo be relayed if the other end can? */
+static bool
+relay_possible(struct ioinfo *ioinfo)
+{
+    return ioinfo->escape_char < 0 && !ioinfo->uh->oobdata &&
+	relay_get_fd(ioinfo->io, "0") != -1;
+}
+
+static void
+relay_free(struct ioinfo_relay *relay)
+{
+    if (relay->worker)
+	gensio_os_worker_free(relay->worker);
+    if (relay->pipe[0] != -1) {
+	close(relay->pipe[0]);
+	close(relay->pipe[1]);
+    }
+    if (relay->copybuf)
+	free(relay->copybuf);
+    free(relay);
+}
+
+/*
+ * Start relaying the data read from ioinfo in the kernel, returns
+ * false if that can't be done.
+ */
+static bool
+ioinfo_start_relay(struct ioinfo *ioinfo)
+{
+    struct ioinfo *rioinfo = ioinfo->otherio;
+    struct ioinfo_relay *relay;
+    int infd, outfd;
+
+    if (ioinfo->relay) {
+	/* From an earlier connection, the pipe may hold stale data. */
+	relay_free(ioinfo->relay);
+	ioinfo->relay = NULL;
+    }
+
+    if (!relay_possible(ioinfo))
+	return false;
+    infd = relay_get_fd(ioinfo->io, "0");
+    outfd = relay_get_fd(rioinfo->io, "1");
+    if (outfd == -1)
+	return false;
+
+    relay = malloc(sizeof(*relay));
+    if (!relay)
+	return false;
+    memset(relay, 0, sizeof(*relay));
+    relay->ioinfo = ioinfo;
+    relay->infd = infd;
+    relay->outfd = outfd;
+    if (pipe(relay->pipe)) {
+	relay->pipe[0] = -1;
+	goto out_err;
+    }
+    if (gensio_os_worker_alloc(ioinfo->o, relay_thread, NULL, relay_done,
+			       relay, &relay->worker))
+	goto out_err;
+    if (gensio_os_worker_start(relay->worker))
+	goto out_err;
+
+    ioinfo->relay = relay;
+    return true;
+
+ out_err:
+    relay_free(relay);
+    return false;
+}
+#endif
+
 void
 ioinfo_set_ready(struct ioinfo *ioinfo, struct gensio *io)
 {
@@ -293,10 +581,27 @@ ioinfo_set_ready(struct ioinfo *ioinfo, struct gensio *io)
 
     ioinfo->io = io;
     gensio_set_callback(io, io_event, ioinfo);
-    gensio_set_read_callback_enable(ioinfo->io, true);
     ioinfo->ready = true;
+#if IOINFO_RELAY
+    /*
+     * Don't read anything if the data may be relayed in the kernel,
+     * the relay would not see data buffered in the gensio.  Once
+     * both ends are ready, each direction is relayed if it can be.
+     */
+    if (!rioinfo->ready) {
+	if (!relay_possible(ioinfo))
+	    gensio_set_read_callback_enable(ioinfo->io, true);
+	return;
+    }
+    if (!ioinfo_start_relay(ioinfo))
+	gensio_set_read_callback_enable(ioinfo->io, true);
+    if (!ioinfo_start_relay(rioinfo))
+	gensio_set_read_callback_enable(rioinfo->io, true);
+#else
+    gensio_set_read_callback_enable(ioinfo->io, true);
     if (rioinfo->ready)
 	gensio_set_read_callback_enable(rioinfo->io, true);
+#endif
 }
 
 void
@@ -330,5 +635,9 @@ alloc_ioinfo(struct gensio_os_funcs *o,
 void
 free_ioinfo(struct ioinfo *ioinfo)
 {
+#if IOINFO_RELAY
+    if (ioinfo->relay)
+	relay_free(ioinfo->relay);
+#endif
     free(ioinfo);
 }